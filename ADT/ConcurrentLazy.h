@@ -0,0 +1,182 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "llvm/Support/Compiler.h"
+
+#include "ADT/UniqueFunc.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace details {
+
+/// Threads waiting on a ConcurrentLazy that another thread is computing block
+/// here instead of in the ConcurrentLazy itself. This keeps a ConcurrentLazy
+/// as small as a Lazy; waiters are rare so sharing buckets is fine.
+class LazyParkingLot {
+public:
+  struct Bucket {
+    std::mutex M;
+    std::condition_variable CV;
+  };
+
+  static Bucket &bucketFor(const void *Addr) {
+    static LazyParkingLot Lot;
+    auto Hash = reinterpret_cast<uintptr_t>(Addr);
+    Hash ^= Hash >> 7;
+    return Lot.Buckets_[Hash % NumBuckets];
+  }
+
+private:
+  static constexpr size_t NumBuckets = 64;
+  Bucket Buckets_[NumBuckets];
+};
+
+} // namespace details
+
+/// A Lazy value which may be forced from many threads at once. Exactly one
+/// thread runs the generator; any other thread calling \c get() while the
+/// value is being computed blocks until it is available. Once computed,
+/// \c get() is a single acquire load.
+///
+/// Unlike \c Lazy, moving or assigning a ConcurrentLazy is only allowed while
+/// no other thread can observe it.
+template <typename Value> class ConcurrentLazy {
+public:
+  using GenType = UniqueFunc<Value()>;
+
+  ConcurrentLazy(const Value &V) : State_(Computed), Holder_(V) {}
+  ConcurrentLazy(Value &&V) : State_(Computed), Holder_(std::move(V)) {}
+
+  ConcurrentLazy(ConcurrentLazy &&Other) : State_(Other.loadState_()) {
+    assert(State_ == Pending || State_ == Computed);
+    if (State_ == Computed) {
+      new (&Holder_.V) Value(std::move(Other.Holder_.V));
+    } else {
+      new (&Holder_.G) GenType(std::move(Other.Holder_.G));
+    }
+  }
+
+  template <typename Functor>
+  ConcurrentLazy(Functor F) : State_(Pending), Holder_(std::move(F)) {}
+
+  ConcurrentLazy &operator=(ConcurrentLazy &&Other) {
+    DestructHolder_();
+    new (this) ConcurrentLazy(std::move(Other));
+    return *this;
+  }
+
+  ~ConcurrentLazy() { DestructHolder_(); }
+
+  template <typename F>
+  using LazyMapped = ConcurrentLazy<std::result_of_t<F(Value)>>;
+
+  // Lazily map a ConcurrentLazy value. The map function runs at most once, on
+  // whichever thread first forces the result. Note: the return value's
+  // lifetime is contrained by this' lifetime.
+  template <typename Functor> LazyMapped<Functor> map(Functor F) & {
+    return LazyMapped<Functor>(
+        [FF = std::move(F), &L = *this]() mutable { return FF(L.get()); });
+  }
+
+  // Force the computation to occur and get the underlying value. Safe to call
+  // concurrently.
+  const Value &get() {
+    if (loadState_() != Computed) {
+      EnsureComputed_();
+    }
+    return Holder_.V;
+  }
+
+  // Force the computation and move the value out. The caller must guarantee no
+  // other thread is accessing this ConcurrentLazy.
+  Value take() { return std::move(const_cast<Value &>(get())); }
+
+  bool isComputed() const { return loadState_() == Computed; }
+
+private:
+  enum State : uint8_t {
+    Pending,
+    Computing,
+    ComputingWithWaiters,
+    Computed,
+  };
+
+  uint8_t loadState_() const { return State_.load(std::memory_order_acquire); }
+
+  LLVM_ATTRIBUTE_NOINLINE void EnsureComputed_() {
+    uint8_t S = Pending;
+    if (State_.compare_exchange_strong(S, Computing,
+                                       std::memory_order_acquire)) {
+      auto V = Holder_.G();
+      Holder_.G.~GenType();
+      new (&Holder_.V) Value(std::move(V));
+      if (State_.exchange(Computed, std::memory_order_acq_rel) ==
+          ComputingWithWaiters) {
+        auto &B = details::LazyParkingLot::bucketFor(this);
+        std::lock_guard<std::mutex> Lock(B.M);
+        B.CV.notify_all();
+      }
+      return;
+    }
+    Wait_();
+  }
+
+  void Wait_() {
+    // Most generators are short, so give the computing thread a moment before
+    // going to sleep.
+    for (unsigned I = 0; I < 64; ++I) {
+      if (loadState_() == Computed) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+
+    auto &B = details::LazyParkingLot::bucketFor(this);
+    std::unique_lock<std::mutex> Lock(B.M);
+    uint8_t S = Computing;
+    if (!State_.compare_exchange_strong(S, ComputingWithWaiters,
+                                        std::memory_order_acquire) &&
+        S == Computed) {
+      return;
+    }
+    B.CV.wait(Lock, [this]() { return loadState_() == Computed; });
+  }
+
+  void DestructHolder_() {
+    if (loadState_() == Computed) {
+      Holder_.V.~Value();
+    } else {
+      Holder_.G.~GenType();
+    }
+  }
+
+  std::atomic<uint8_t> State_;
+  union Holder {
+    Value V;
+    GenType G;
+
+    Holder() {}
+
+    Holder(const Value &VV) : V(VV) {}
+    Holder(Value &&VV) : V(std::move(VV)) {}
+
+    template <typename F> Holder(F &&FF) : G(std::move(FF)) {}
+
+    ~Holder() {}
+  };
+  Holder Holder_;
+};
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -2,7 +2,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <future>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/ThreadPool.h"
 
 #include "ADT/UniqueFunc.h"
 
@@ -10,6 +17,13 @@ namespace llvm {
 
 namespace ald {
 
+template <typename Value> class Lazy;
+
+namespace details {
+template <typename L> struct LazyValue;
+template <typename Value> struct LazyValue<Lazy<Value>> { using type = Value; };
+} // namespace details
+
 template <typename Value> class Lazy {
 public:
   using GenType = UniqueFunc<Value()>;
@@ -59,6 +73,8 @@ public:
     return *this;
   }
 
+  ~Lazy() { DestructHolder_(); }
+
   template <typename F> using LazyMapped = Lazy<std::result_of_t<F(Value)>>;
 
   // Lazily map a Lazy value. This delays computation of the map function until
@@ -76,6 +92,29 @@ public:
         });
   }
 
+  template <typename F>
+  using LazyFlatMapped =
+      Lazy<typename details::LazyValue<std::result_of_t<F(Value)>>::type>;
+
+  // Lazily map a Lazy value with a function that itself returns a Lazy value.
+  // Both the function and the returned Lazy are forced only once Lazy::get() is
+  // called on the return value. Note: the return value's lifetime is
+  // contrained by this' lifetime.
+  template <typename Functor> LazyFlatMapped<Functor> flatMap(Functor F) & {
+    return LazyFlatMapped<Functor>([FF = std::move(F), &L = *this]() mutable {
+      return FF(L.get()).take();
+    });
+  }
+
+  template <typename Functor> LazyFlatMapped<Functor> flatMap(Functor F) && {
+    return LazyFlatMapped<Functor>(
+        [FF = std::move(F), L = std::move(*this)]() mutable {
+          return FF(L.take()).take();
+        });
+  }
+
+  bool isComputed() const { return Computed_; }
+
   // Force the Lazy computation to occur and get the underlying value.
   const Value &get() {
     EnsureComputed_();
@@ -90,9 +129,9 @@ public:
 private:
   void EnsureComputed_() {
     if (!Computed_) {
-      auto V = std::move(Holder_.G());
+      auto V = Holder_.G();
       Holder_.G.~GenType();
-      Holder_.V = std::move(V);
+      new (&Holder_.V) Value(std::move(V));
       Computed_ = true;
     }
   }
@@ -122,6 +161,55 @@ private:
   Holder Holder_;
 };
 
+// Combine two Lazy values into a Lazy pair. Neither input is forced until
+// Lazy::get() is called on the return value. Note: the return value's lifetime
+// is contrained by the inputs' lifetimes.
+template <typename A, typename B>
+Lazy<std::pair<A, B>> zip(Lazy<A> &LA, Lazy<B> &LB) {
+  return Lazy<std::pair<A, B>>([&LA, &LB]() {
+    return std::pair<A, B>(LA.get(), LB.get());
+  });
+}
+
+template <typename A, typename B>
+Lazy<std::pair<A, B>> zip(Lazy<A> &&LA, Lazy<B> &&LB) {
+  return Lazy<std::pair<A, B>>(
+      [LA = std::move(LA), LB = std::move(LB)]() mutable {
+        return std::pair<A, B>(LA.take(), LB.take());
+      });
+}
+
+// Force every Lazy value in \p Lazies using the threads of \p TP, returning
+// once all of them have been computed. The values are split into contiguous
+// batches so that many cheap computations don't each pay for a task. Each
+// element must be independent of the others (i.e. no element may force another
+// element of the range). Must not be called from one of \p TP's threads.
+template <typename Range> void forceAll(Range &Lazies, ThreadPool &TP) {
+  auto Begin = std::begin(Lazies);
+  size_t Count = std::distance(Begin, std::end(Lazies));
+  if (Count == 0) {
+    return;
+  }
+
+  size_t NumBatches = std::min<size_t>(Count, TP.getThreadCount() * 4);
+  size_t BatchSize = (Count + NumBatches - 1) / NumBatches;
+
+  std::vector<std::shared_future<void>> Batches;
+  Batches.reserve(NumBatches);
+  for (size_t Start = 0; Start < Count; Start += BatchSize) {
+    size_t End = std::min(Start + BatchSize, Count);
+    Batches.push_back(TP.async([Begin, Start, End]() {
+      auto Iter = std::next(Begin, Start);
+      for (size_t I = Start; I < End; ++I, ++Iter) {
+        (*Iter).get();
+      }
+    }));
+  }
+  for (auto &Batch : Batches) {
+    Batch.wait();
+  }
+}
+
 } // end namespace ald
 
 } // end namespace llvm
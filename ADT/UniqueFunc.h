@@ -2,7 +2,9 @@
 
 #pragma once
 
+#include <cassert>
 #include <memory>
+#include <new>
 #include <type_traits>
 
 namespace llvm {
@@ -16,28 +18,78 @@ public:
       std::is_convertible<std::result_of_t<F(Args...)>, R>::value;
 };
 
-template <typename R, typename... Args> struct UFImpl {
-  virtual R Invoke(Args &&... args) = 0;
-  virtual ~UFImpl() {}
+/// The number of bytes a functor may occupy and still be stored inline in a
+/// UniqueFunc. Three pointers is enough for the vast majority of lambdas we
+/// create (e.g. a moved functor plus a reference or two).
+constexpr size_t UFInlineSize = 3 * sizeof(void *);
+constexpr size_t UFInlineAlign = alignof(void *);
+
+union UFStorage {
+  void *Heap;
+  std::aligned_storage_t<UFInlineSize, UFInlineAlign> Inline;
 };
 
-template <typename F, typename R, typename... Args>
-struct UFImplImpl : public UFImpl<R, Args...> {
-  template <typename FF> UFImplImpl(FF &&FF_) : F_(std::forward<FF>(FF_)) {}
+/// Functors are stored inline only if they fit and can be relocated without
+/// throwing (moving a UniqueFunc is noexcept).
+template <typename F>
+struct UFIsInline
+    : std::integral_constant<bool,
+                             sizeof(F) <= UFInlineSize &&
+                                 alignof(F) <= UFInlineAlign &&
+                                 std::is_nothrow_move_constructible<F>::value> {
+};
+
+/// A hand rolled vtable. Every UniqueFunc holding a functor of type F points
+/// at the single static instance of this table for F.
+template <typename R, typename... Args> struct UFVTable {
+  R (*Invoke)(UFStorage &, Args &&...);
+  /// Move construct the functor held in the first argument from the functor
+  /// held in the second argument, leaving the second argument destroyed.
+  void (*Relocate)(UFStorage &, UFStorage &);
+  void (*Destroy)(UFStorage &);
+};
+
+template <typename F, typename R, typename... Args> struct UFInlineOps {
+  static F &get(UFStorage &S) { return *reinterpret_cast<F *>(&S.Inline); }
 
-  R Invoke(Args &&... args) override { return F_(std::forward<Args>(args)...); }
+  static R invoke(UFStorage &S, Args &&... args) {
+    return static_cast<R>(get(S)(std::forward<Args>(args)...));
+  }
 
-  F F_;
+  static void relocate(UFStorage &Dst, UFStorage &Src) {
+    new (&Dst.Inline) F(std::move(get(Src)));
+    get(Src).~F();
+  }
+
+  static void destroy(UFStorage &S) { get(S).~F(); }
+
+  static constexpr UFVTable<R, Args...> VTable = {&invoke, &relocate,
+                                                  &destroy};
 };
 
-template <typename F, typename... Args>
-struct UFImplImpl<F, void, Args...> : public UFImpl<void, Args...> {
-  template <typename FF> UFImplImpl(FF &&FF_) : F_(std::forward<FF>(FF_)) {}
+template <typename F, typename R, typename... Args>
+constexpr UFVTable<R, Args...> UFInlineOps<F, R, Args...>::VTable;
+
+template <typename F, typename R, typename... Args> struct UFHeapOps {
+  static F &get(UFStorage &S) { return *static_cast<F *>(S.Heap); }
+
+  static R invoke(UFStorage &S, Args &&... args) {
+    return static_cast<R>(get(S)(std::forward<Args>(args)...));
+  }
+
+  static void relocate(UFStorage &Dst, UFStorage &Src) {
+    Dst.Heap = Src.Heap;
+    Src.Heap = nullptr;
+  }
 
-  void Invoke(Args &&... args) override { F_(std::forward<Args>(args)...); }
+  static void destroy(UFStorage &S) { delete static_cast<F *>(S.Heap); }
 
-  F F_;
+  static constexpr UFVTable<R, Args...> VTable = {&invoke, &relocate,
+                                                  &destroy};
 };
+
+template <typename F, typename R, typename... Args>
+constexpr UFVTable<R, Args...> UFHeapOps<F, R, Args...>::VTable;
 } // namespace details
 
 template <typename Sig> class UniqueFunc;
@@ -52,11 +104,32 @@ template <typename Sig> class UniqueFunc;
 //
 // However we are allowed to write the same statement, but with UniqueFunc in
 // place of std::function.
+//
+// Small functors (see details::UFInlineSize) are stored inline, so creating a
+// UniqueFunc from e.g. a lambda capturing a couple of references doesn't
+// allocate. Larger functors fall back to the heap.
 template <typename R, typename... Args> class UniqueFunc<R(Args...)> {
 public:
   UniqueFunc() = default;
-  UniqueFunc(UniqueFunc &&) = default;
-  UniqueFunc &operator=(UniqueFunc &&) = default;
+
+  UniqueFunc(UniqueFunc &&Other) noexcept : VT_(Other.VT_) {
+    if (VT_ != nullptr) {
+      VT_->Relocate(Storage_, Other.Storage_);
+      Other.VT_ = nullptr;
+    }
+  }
+
+  UniqueFunc &operator=(UniqueFunc &&Other) noexcept {
+    if (this != &Other) {
+      reset_();
+      VT_ = Other.VT_;
+      if (VT_ != nullptr) {
+        VT_->Relocate(Storage_, Other.Storage_);
+        Other.VT_ = nullptr;
+      }
+    }
+    return *this;
+  }
 
   UniqueFunc(const UniqueFunc &) = delete;
   UniqueFunc &operator=(const UniqueFunc &) = delete;
@@ -73,20 +146,42 @@ public:
   template <typename F, typename = std::enable_if_t<
                             details::RVConv<F, R, Args...>::value &&
                             !std::is_same<std::decay_t<F>, UniqueFunc>::value>>
-  UniqueFunc(F &&Func) : Impl_(make_impl<F>(std::forward<F>(Func))) {}
+  UniqueFunc(F &&Func) {
+    using FT = std::decay_t<F>;
+    construct_<FT>(std::forward<F>(Func), details::UFIsInline<FT>());
+  }
+
+  ~UniqueFunc() { reset_(); }
 
   R operator()(Args... args) const {
-    return Impl_->Invoke(std::forward<Args>(args)...);
+    assert(VT_ != nullptr && "Invoking an empty UniqueFunc");
+    return VT_->Invoke(Storage_, std::forward<Args>(args)...);
   }
 
+  explicit operator bool() const { return VT_ != nullptr; }
+
 private:
-  template <typename F>
-  std::unique_ptr<details::UFImpl<R, Args...>> make_impl(F &&Func) {
-    return std::make_unique<details::UFImplImpl<std::decay_t<F>, R, Args...>>(
-        std::forward<F>(Func));
+  template <typename FT, typename F>
+  void construct_(F &&Func, std::true_type /* Inline */) {
+    new (&Storage_.Inline) FT(std::forward<F>(Func));
+    VT_ = &details::UFInlineOps<FT, R, Args...>::VTable;
+  }
+
+  template <typename FT, typename F>
+  void construct_(F &&Func, std::false_type /* Inline */) {
+    Storage_.Heap = new FT(std::forward<F>(Func));
+    VT_ = &details::UFHeapOps<FT, R, Args...>::VTable;
+  }
+
+  void reset_() {
+    if (VT_ != nullptr) {
+      VT_->Destroy(Storage_);
+      VT_ = nullptr;
+    }
   }
 
-  std::unique_ptr<details::UFImpl<R, Args...>> Impl_;
+  const details::UFVTable<R, Args...> *VT_ = nullptr;
+  mutable details::UFStorage Storage_;
 };
 
 } // end namespace ald
@@ -2,8 +2,12 @@
 
 #include "MachO/Builder.h"
 
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
-#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/xxhash.h"
+
+#include <thread>
 
 using namespace llvm::MachO;
 
@@ -27,20 +31,261 @@ namespace Builder {
   }                                                                            \
   auto &x = *x##OrErr
 
+Section &SegmentCommand::addSection(std::unique_ptr<Section> S) {
+  Sections_.push_back(std::move(S));
+  return *Sections_.back();
+}
+
+uint32_t SegmentCommand::size() const {
+  return sizeof(segment_command_64) + Sections_.size() * sizeof(section_64);
+}
+
+void SegmentCommand::layout(uint64_t &Offset) {
+  uint64_t Addr = VMAddr_;
+  uint64_t MaxAlign = 1;
+  for (auto &S : Sections_) {
+    Addr = alignTo(Addr, 1ull << S->Align_);
+    S->Addr_ = Addr;
+    Addr += S->Size_;
+    MaxAlign = std::max<uint64_t>(MaxAlign, 1ull << S->Align_);
+  }
+  VMSize_ = Addr - VMAddr_;
+
+  // Section contents are placed at the same offset from the start of the
+  // segment in the file as they are in memory.
+  FileOff_ = alignTo(Offset, PageSize_ != 0 ? PageSize_ : MaxAlign);
+  FileSize_ = 0;
+  for (auto &S : Sections_) {
+    if (S->Contents_ == nullptr) {
+      continue;
+    }
+    uint64_t SectOffset = FileOff_ + (S->Addr_ - VMAddr_);
+    S->Contents_->place(SectOffset);
+    FileSize_ = SectOffset - FileOff_;
+  }
+  if (PageSize_ != 0) {
+    VMSize_ = alignTo(VMSize_, PageSize_);
+    FileSize_ = alignTo(FileSize_, PageSize_);
+  }
+  Offset = FileOff_ + FileSize_;
+
+  for (auto &S : Sections_) {
+    if (S->Relocations_.empty()) {
+      continue;
+    }
+    auto Begin = (const uint8_t *)S->Relocations_.data();
+    S->RelocationsChunk_ = std::make_unique<DataChunk>(
+        ArrayRef<uint8_t>(Begin, Begin + S->Relocations_.size() *
+                                             sizeof(any_relocation_info)),
+        alignof(any_relocation_info));
+    S->RelocationsChunk_->place(Offset);
+  }
+}
+
+void SegmentCommand::build(uint8_t *Buf) const {
+  segment_command_64 Cmd;
+  memset(&Cmd, 0, sizeof(Cmd));
+  Cmd.cmd = LC_SEGMENT_64;
+  Cmd.cmdsize = size();
+  strncpy(Cmd.segname, Name_.c_str(), sizeof(Cmd.segname));
+  Cmd.vmaddr = VMAddr_;
+  Cmd.vmsize = VMSize_;
+  Cmd.fileoff = FileOff_;
+  Cmd.filesize = FileSize_;
+  Cmd.maxprot = MaxProt_;
+  Cmd.initprot = InitProt_;
+  Cmd.nsects = Sections_.size();
+  Cmd.flags = 0;
+  memcpy(Buf, &Cmd, sizeof(Cmd));
+  Buf += sizeof(Cmd);
+
+  for (auto &S : Sections_) {
+    section_64 Sect;
+    memset(&Sect, 0, sizeof(Sect));
+    strncpy(Sect.sectname, S->SectName_.c_str(), sizeof(Sect.sectname));
+    strncpy(Sect.segname, S->SegName_.c_str(), sizeof(Sect.segname));
+    Sect.addr = S->Addr_;
+    Sect.size = S->Size_;
+    Sect.offset = S->Contents_ ? S->Contents_->getFileOffset() : 0;
+    Sect.align = S->Align_;
+    Sect.reloff =
+        S->RelocationsChunk_ ? S->RelocationsChunk_->getFileOffset() : 0;
+    Sect.nreloc = S->Relocations_.size();
+    Sect.flags = S->Flags_;
+    Sect.reserved1 = S->Reserved1_;
+    Sect.reserved2 = S->Reserved2_;
+    memcpy(Buf, &Sect, sizeof(Sect));
+    Buf += sizeof(Sect);
+  }
+}
+
+void SegmentCommand::getChunks(std::vector<const Chunk *> &Chunks) const {
+  for (auto &S : Sections_) {
+    if (S->Contents_ != nullptr) {
+      Chunks.push_back(S->Contents_.get());
+    }
+  }
+  for (auto &S : Sections_) {
+    if (S->RelocationsChunk_ != nullptr) {
+      Chunks.push_back(S->RelocationsChunk_.get());
+    }
+  }
+}
+
+uint32_t SymtabCommand::addSymbol(StringRef Name, uint8_t Type, uint8_t Sect,
+                                  uint16_t Desc, uint64_t Value) {
+  // Every symbol has a string, so the string's handle is the symbol's index.
+  Strtab_.add(Name);
+  nlist_64 NL;
+  NL.n_strx = 0;
+  NL.n_type = Type;
+  NL.n_sect = Sect;
+  NL.n_desc = Desc;
+  NL.n_value = Value;
+  Symbols_.push_back(NL);
+  return Symbols_.size() - 1;
+}
+
+void SymtabCommand::layout(uint64_t &Offset) {
+  Strtab_.finalize();
+  for (size_t I = 0; I < Symbols_.size(); ++I) {
+    Symbols_[I].n_strx = Strtab_.getOffset(I);
+  }
+
+  auto Begin = (const uint8_t *)Symbols_.data();
+  SymbolsChunk_ = std::make_unique<DataChunk>(
+      ArrayRef<uint8_t>(Begin, Begin + Symbols_.size() * sizeof(nlist_64)), 8);
+  SymbolsChunk_->place(Offset);
+
+  // The string table's size is conventionally a multiple of the pointer size.
+  Strtab_.pad(8);
+  StringsChunk_ = std::make_unique<DataChunk>(Strtab_.data(), 8);
+  StringsChunk_->place(Offset);
+}
+
+void SymtabCommand::build(uint8_t *Buf) const {
+  symtab_command Cmd;
+  Cmd.cmd = LC_SYMTAB;
+  Cmd.cmdsize = size();
+  Cmd.symoff = SymbolsChunk_->getFileOffset();
+  Cmd.nsyms = Symbols_.size();
+  Cmd.stroff = StringsChunk_->getFileOffset();
+  Cmd.strsize = StringsChunk_->size();
+  memcpy(Buf, &Cmd, sizeof(Cmd));
+}
+
+void SymtabCommand::getChunks(std::vector<const Chunk *> &Chunks) const {
+  Chunks.push_back(SymbolsChunk_.get());
+  Chunks.push_back(StringsChunk_.get());
+}
+
+void DysymtabCommand::layout(uint64_t &Offset) {
+  if (IndirectSymbols_.empty()) {
+    return;
+  }
+  auto Begin = (const uint8_t *)IndirectSymbols_.data();
+  IndirectSymbolsChunk_ = std::make_unique<DataChunk>(
+      ArrayRef<uint8_t>(Begin,
+                        Begin + IndirectSymbols_.size() * sizeof(uint32_t)),
+      sizeof(uint32_t));
+  IndirectSymbolsChunk_->place(Offset);
+}
+
+void DysymtabCommand::build(uint8_t *Buf) const {
+  dysymtab_command Cmd;
+  memset(&Cmd, 0, sizeof(Cmd));
+  Cmd.cmd = LC_DYSYMTAB;
+  Cmd.cmdsize = size();
+  Cmd.ilocalsym = 0;
+  Cmd.nlocalsym = NumLocals_;
+  Cmd.iextdefsym = NumLocals_;
+  Cmd.nextdefsym = NumExternals_;
+  Cmd.iundefsym = NumLocals_ + NumExternals_;
+  Cmd.nundefsym = NumUndefined_;
+  if (IndirectSymbolsChunk_ != nullptr) {
+    Cmd.indirectsymoff = IndirectSymbolsChunk_->getFileOffset();
+    Cmd.nindirectsyms = IndirectSymbols_.size();
+  }
+  memcpy(Buf, &Cmd, sizeof(Cmd));
+}
+
+void DysymtabCommand::getChunks(std::vector<const Chunk *> &Chunks) const {
+  if (IndirectSymbolsChunk_ != nullptr) {
+    Chunks.push_back(IndirectSymbolsChunk_.get());
+  }
+}
+
+void DyldInfoCommand::layout(uint64_t &Offset) {
+  for (unsigned I = 0; I < NumStreams; ++I) {
+    if (Streams_[I].empty()) {
+      continue;
+    }
+    // Streams are conventionally padded to the pointer size.
+    Streams_[I].resize(alignTo(Streams_[I].size(), 8), 0);
+    Chunks_[I] = std::make_unique<DataChunk>(ArrayRef<uint8_t>(Streams_[I]), 8);
+    Chunks_[I]->place(Offset);
+  }
+}
+
+void DyldInfoCommand::build(uint8_t *Buf) const {
+  dyld_info_command Cmd;
+  memset(&Cmd, 0, sizeof(Cmd));
+  Cmd.cmd = LC_DYLD_INFO_ONLY;
+  Cmd.cmdsize = size();
+  auto Get = [this](Stream S, uint32_t &Off, uint32_t &Size) {
+    if (Chunks_[S] != nullptr) {
+      Off = Chunks_[S]->getFileOffset();
+      Size = Chunks_[S]->size();
+    }
+  };
+  Get(Rebase, Cmd.rebase_off, Cmd.rebase_size);
+  Get(Bind, Cmd.bind_off, Cmd.bind_size);
+  Get(WeakBind, Cmd.weak_bind_off, Cmd.weak_bind_size);
+  Get(LazyBind, Cmd.lazy_bind_off, Cmd.lazy_bind_size);
+  memcpy(Buf, &Cmd, sizeof(Cmd));
+}
+
+void DyldInfoCommand::getChunks(std::vector<const Chunk *> &Chunks) const {
+  for (unsigned I = 0; I < NumStreams; ++I) {
+    if (Chunks_[I] != nullptr) {
+      Chunks.push_back(Chunks_[I].get());
+    }
+  }
+}
+
+UUIDCommand::UUIDCommand(ArrayRef<uint8_t> UUID) {
+  assert(UUID.size() == sizeof(UUID_) && "UUIDs are 16 bytes");
+  memcpy(UUID_, UUID.data(), sizeof(UUID_));
+}
+
+void UUIDCommand::build(uint8_t *Buf) const {
+  uuid_command Cmd;
+  memset(&Cmd, 0, sizeof(Cmd));
+  Cmd.cmd = LC_UUID;
+  Cmd.cmdsize = size();
+  memcpy(Cmd.uuid, UUID_, sizeof(UUID_));
+  memcpy(Buf, &Cmd, sizeof(Cmd));
+}
+
 uint32_t File::buildHeaderFlags() const {
+  if (FileType_ == MH_OBJECT) {
+    return MH_SUBSECTIONS_VIA_SYMBOLS;
+  }
+  if (FileType_ == MH_DSYM) {
+    return 0;
+  }
+
   uint32_t result = MH_NOUNDEFS | MH_DYLDLINK | MH_TWOLEVEL | MH_PIE;
 
-#if 0
-  if (HasWeakExports()) {
+  if (HasWeakDefinitions_) {
     result |= MH_WEAK_DEFINES;
   }
-  if (HasWeakImports()) {
+  if (BindsToWeak_) {
     result |= MH_BINDS_TO_WEAK;
   }
-  if (HasTLVDescriptors()) {
+  if (HasTLVDescriptors_) {
     result |= MH_HAS_TLV_DESCRIPTORS;
   }
-#endif
 
   return result;
 }
@@ -57,7 +302,7 @@ Expected<mach_header_64> File::buildHeader(uint32_t LoadCommandsSize) const {
   CheckErrMove(CPUSubType);
   hdr.cpusubtype = CPUSubType;
 
-  hdr.filetype = MH_EXECUTE;
+  hdr.filetype = FileType_;
   hdr.ncmds = LoadCommands_.size();
   hdr.sizeofcmds = LoadCommandsSize;
 
@@ -69,40 +314,130 @@ Expected<mach_header_64> File::buildHeader(uint32_t LoadCommandsSize) const {
 
 namespace {
 
-Error createFile(const std::string &Filename, size_t Size) {
-  using namespace sys::fs;
-  Expected<file_t> FOrErr =
-      openNativeFileForWrite(Filename, CD_CreateAlways, OF_None, 0755);
-  CheckErr(F);
-  if (auto Err = errorCodeToError(resize_file(F, Size))) {
-    return Err;
+/// Create a file of \c Size bytes next to \c Filename which can later be
+/// renamed over it.
+Expected<sys::fs::TempFile> createFile(const std::string &Filename,
+                                       uint64_t Size) {
+  auto TempOrErr = sys::fs::TempFile::create(Filename + ".tmp%%%%%%", 0755);
+  CheckErrMove(Temp);
+  if (auto EC = sys::fs::resize_file(Temp.FD, Size)) {
+    return joinErrors(errorCodeToError(EC), Temp.discard());
   }
-  if (auto Err = errorCodeToError(closeFile(F))) {
-    return Err;
+  return std::move(Temp);
+}
+
+/// Atomically replace \c Filename with \c Temp, so that a partially written
+/// output is never visible under \c Filename.
+///
+/// Releasing the last reference to a large file can block for a long time on
+/// some filesystems. To keep that off the critical path we hold the old output
+/// open across the rename, so the rename only drops a link, and close it on a
+/// background thread.
+Error replaceFile(sys::fs::TempFile &Temp, const std::string &Filename) {
+  int OldFD = -1;
+  bool HoldsOld = sys::fs::is_regular_file(Filename) &&
+                  !sys::fs::openFileForRead(Filename, OldFD);
+
+  Error Err = Temp.keep(Filename);
+  if (HoldsOld) {
+    std::thread([OldFD]() {
+      sys::Process::SafelyCloseFileDescriptor(OldFD);
+    }).detach();
   }
-  return Error::success();
+  return Err;
+}
+
+/// The size of the pieces of the output which are hashed in parallel to compute
+/// its UUID. Changing this changes every UUID.
+constexpr uint64_t UUIDPieceSize = 1 << 20;
+
+/// Combine the digests of the output's pieces into its UUID.
+std::vector<uint8_t> computeUUID(ArrayRef<uint64_t> PieceDigests) {
+  // Digests are stored little endian so that the UUID doesn't depend on the
+  // host.
+  std::vector<uint8_t> Digests((PieceDigests.size() + 1) * sizeof(uint64_t));
+  for (size_t I = 0; I < PieceDigests.size(); ++I) {
+    support::endian::write64le(Digests.data() + I * sizeof(uint64_t),
+                               PieceDigests[I]);
+  }
+
+  // A UUID is 128 bits, so hash the digests twice, the second time including
+  // the result of the first.
+  ArrayRef<uint8_t> AllDigests(Digests);
+  uint64_t Hi = xxHash64(AllDigests.drop_back(sizeof(uint64_t)));
+  support::endian::write64le(
+      Digests.data() + PieceDigests.size() * sizeof(uint64_t), Hi);
+  uint64_t Lo = xxHash64(AllDigests);
+
+  std::vector<uint8_t> UUID(16);
+  support::endian::write64be(UUID.data(), Hi);
+  support::endian::write64be(UUID.data() + 8, Lo);
+  // Mark it as a name based (version 3) UUID like ld64 does.
+  UUID[6] = (UUID[6] & 0x0f) | 0x30;
+  UUID[8] = (UUID[8] & 0x3f) | 0x80;
+  return UUID;
 }
 
 } // namespace
 
-Error File::buildAndWrite(std::string Filename) const {
+Error File::buildAndWrite(std::string Filename) {
   uint32_t LoadCommandsSize = 0;
+  for (auto &LC : LoadCommands_) {
+    LoadCommandsSize += LC->size();
+  }
 
   auto HeaderOrErr = buildHeader(LoadCommandsSize);
   CheckErr(Header);
 
-  size_t TotalSize = sizeof(mach_header_64);
+  uint64_t TotalSize = sizeof(mach_header_64) + LoadCommandsSize;
+  std::vector<const Chunk *> Chunks;
+  for (auto &LC : LoadCommands_) {
+    LC->layout(TotalSize);
+    LC->getChunks(Chunks);
+  }
 
-  if (auto Err = createFile(Filename, TotalSize)) {
-    return Err;
+  // The header and load commands are just another chunk at the start of the
+  // file as far as the writer is concerned.
+  std::vector<uint8_t> HeaderBuf(sizeof(mach_header_64) + LoadCommandsSize);
+  memcpy(HeaderBuf.data(), &Header, sizeof(mach_header_64));
+  uint8_t *LCBuf = HeaderBuf.data() + sizeof(mach_header_64);
+  uint64_t UUIDOffset = 0;
+  for (size_t I = 0; I < LoadCommands_.size(); ++I) {
+    if (UUIDIndex_ && *UUIDIndex_ == I) {
+      UUIDOffset = (LCBuf - HeaderBuf.data()) + offsetof(uuid_command, uuid);
+    }
+    LoadCommands_[I]->build(LCBuf);
+    LCBuf += LoadCommands_[I]->size();
   }
+  DataChunk HeaderChunk{ArrayRef<uint8_t>(HeaderBuf)};
+  uint64_t HeaderOffset = 0;
+  HeaderChunk.place(HeaderOffset);
+  Chunks.insert(Chunks.begin(), &HeaderChunk);
 
-  auto BufferOrErr =
-      errorOrToExpected(WriteThroughMemoryBuffer::getFile(Filename, TotalSize));
-  CheckErr(Buffer);
-  memcpy((void *)Buffer->getBufferStart(), &Header, sizeof(mach_header_64));
+  auto TempOrErr = createFile(Filename, TotalSize);
+  CheckErr(Temp);
 
-  return Error::success();
+  MappedWriter DefaultWriter;
+  Writer &W = Writer_ ? *Writer_ : DefaultWriter;
+  sys::fs::file_t F = sys::fs::convertFDToNativeFile(Temp.FD);
+  // The UUID is hashed while the output is written, with its own bytes still
+  // zero, and patched in afterwards.
+  Optional<PieceHasher> Hasher;
+  if (UUIDIndex_) {
+    Hasher.emplace(TotalSize, UUIDPieceSize);
+  }
+  if (auto Err =
+          W.write(F, TotalSize, Chunks, Hasher ? &*Hasher : nullptr)) {
+    return joinErrors(std::move(Err), Temp.discard());
+  }
+  UUID_.clear();
+  if (Hasher) {
+    UUID_ = computeUUID(Hasher->getDigests());
+    if (auto Err = writeAt(F, UUIDOffset, UUID_)) {
+      return joinErrors(std::move(Err), Temp.discard());
+    }
+  }
+  return replaceFile(Temp, Filename);
 }
 
 } // end namespace Builder
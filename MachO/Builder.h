@@ -2,8 +2,20 @@
 
 #pragma once
 
+#include "MachO/Writer.h"
+#include "Util/StrtabBuilder.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/BinaryFormat/MachO.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <memory>
+#include <vector>
 
 namespace llvm {
 
@@ -13,11 +25,291 @@ namespace MachO {
 
 namespace Builder {
 
+/// A contiguous piece of the output file which lives after the header and
+/// load commands, e.g. the contents of a section or the string table.
+class Chunk {
+public:
+  virtual ~Chunk() {}
+
+  /// The number of bytes this chunk occupies in the file.
+  virtual uint64_t size() const = 0;
+
+  /// The required alignment (in bytes, a power of two) of this chunk's offset.
+  virtual uint32_t getAlignment() const { return 1; }
+
+  /// Write bytes [Begin, End) of this chunk to \c Buf. Writers may ask for a
+  /// chunk in pieces, so this must not assume \c Begin is 0.
+  virtual void write(uint8_t *Buf, uint64_t Begin, uint64_t End) const = 0;
+
+  /// Align \c Offset, assign it as this chunk's file offset and advance it past
+  /// this chunk.
+  void place(uint64_t &Offset) {
+    Offset = alignTo(Offset, getAlignment());
+    FileOffset_ = Offset;
+    Offset += size();
+  }
+
+  uint64_t getFileOffset() const { return FileOffset_; }
+
+private:
+  uint64_t FileOffset_ = 0;
+};
+
+/// A chunk whose contents are a plain buffer, either owned by the chunk or
+/// borrowed from memory that outlives the build (e.g. a mapped input).
+class DataChunk : public Chunk {
+public:
+  explicit DataChunk(std::vector<uint8_t> Data, uint32_t Alignment = 1)
+      : Owned_(std::move(Data)), Data_(Owned_), Alignment_(Alignment) {}
+  explicit DataChunk(ArrayRef<uint8_t> Data, uint32_t Alignment = 1)
+      : Data_(Data), Alignment_(Alignment) {}
+
+  DataChunk(const DataChunk &) = delete;
+  DataChunk &operator=(const DataChunk &) = delete;
+
+  uint64_t size() const override { return Data_.size(); }
+  uint32_t getAlignment() const override { return Alignment_; }
+  void write(uint8_t *Buf, uint64_t Begin, uint64_t End) const override {
+    memcpy(Buf, Data_.data() + Begin, End - Begin);
+  }
+
+private:
+  std::vector<uint8_t> Owned_;
+  ArrayRef<uint8_t> Data_;
+  uint32_t Alignment_;
+};
+
 class LoadCommand {
 public:
   virtual ~LoadCommand() {}
-  virtual ::llvm::MachO::load_command *build() = 0;
-  virtual uint32_t size() = 0;
+
+  /// The size of this load command, i.e. its \c cmdsize.
+  virtual uint32_t size() const = 0;
+
+  /// Called once every load command has been sized. Assign file offsets to the
+  /// chunks owned by this command starting at \c Offset, advancing \c Offset
+  /// past them. Commands are laid out in the order they were added.
+  virtual void layout(uint64_t &) {}
+
+  /// Write this load command to \c Buf, which is \c size() bytes long.
+  virtual void build(uint8_t *Buf) const = 0;
+
+  /// Append the chunks owned by this command to \c Chunks.
+  virtual void getChunks(std::vector<const Chunk *> &) const {}
+};
+
+class Section {
+public:
+  /// Construct a section backed by \c Contents.
+  /// \param Align The log2 of the section's alignment.
+  Section(StringRef SegName, StringRef SectName, uint32_t Flags, uint32_t Align,
+          std::unique_ptr<Chunk> Contents)
+      : SegName_(SegName), SectName_(SectName), Flags_(Flags), Align_(Align),
+        Size_(Contents->size()), Contents_(std::move(Contents)) {}
+
+  /// Construct a zerofill section which takes no space in the file.
+  Section(StringRef SegName, StringRef SectName, uint32_t Flags, uint32_t Align,
+          uint64_t Size)
+      : SegName_(SegName), SectName_(SectName), Flags_(Flags), Align_(Align),
+        Size_(Size) {}
+
+  Section &addRelocation(::llvm::MachO::any_relocation_info RI) {
+    Relocations_.push_back(RI);
+    return *this;
+  }
+
+  /// Set the section's \c reserved1, e.g. the index of the first entry of an
+  /// S_SYMBOL_STUBS section in the indirect symbol table.
+  Section &setReserved1(uint32_t Reserved1) {
+    Reserved1_ = Reserved1;
+    return *this;
+  }
+
+  /// Set the section's \c reserved2, e.g. the size of each stub in an
+  /// S_SYMBOL_STUBS section.
+  Section &setReserved2(uint32_t Reserved2) {
+    Reserved2_ = Reserved2;
+    return *this;
+  }
+
+  StringRef getSegName() const { return SegName_; }
+  StringRef getSectName() const { return SectName_; }
+  uint32_t getFlags() const { return Flags_; }
+  uint32_t getAlign() const { return Align_; }
+  uint64_t size() const { return Size_; }
+  uint64_t getAddr() const { return Addr_; }
+
+private:
+  friend class SegmentCommand;
+
+  std::string SegName_;
+  std::string SectName_;
+  uint32_t Flags_;
+  uint32_t Align_;
+  uint64_t Size_;
+  uint64_t Addr_ = 0;
+  uint32_t Reserved1_ = 0;
+  uint32_t Reserved2_ = 0;
+  std::unique_ptr<Chunk> Contents_;
+  std::vector<::llvm::MachO::any_relocation_info> Relocations_;
+  std::unique_ptr<DataChunk> RelocationsChunk_;
+};
+
+/// An LC_SEGMENT_64 command. Section addresses are assigned consecutively from
+/// the segment's address in the order the sections were added.
+class SegmentCommand : public LoadCommand {
+public:
+  SegmentCommand(StringRef Name, uint64_t VMAddr = 0,
+                 uint32_t MaxProt = ::llvm::MachO::VM_PROT_READ |
+                                    ::llvm::MachO::VM_PROT_WRITE |
+                                    ::llvm::MachO::VM_PROT_EXECUTE,
+                 uint32_t InitProt = ::llvm::MachO::VM_PROT_READ |
+                                     ::llvm::MachO::VM_PROT_WRITE |
+                                     ::llvm::MachO::VM_PROT_EXECUTE)
+      : Name_(Name), VMAddr_(VMAddr), MaxProt_(MaxProt), InitProt_(InitProt) {}
+
+  Section &addSection(std::unique_ptr<Section> S);
+
+  /// Align the segment's vmsize and filesize to \c PageSize (0 to not align).
+  SegmentCommand &setPageSize(uint64_t PageSize) {
+    PageSize_ = PageSize;
+    return *this;
+  }
+
+  uint32_t size() const override;
+  void layout(uint64_t &Offset) override;
+  void build(uint8_t *Buf) const override;
+  void getChunks(std::vector<const Chunk *> &Chunks) const override;
+
+  ArrayRef<std::unique_ptr<Section>> sections() const { return Sections_; }
+
+private:
+  std::string Name_;
+  uint64_t VMAddr_;
+  uint64_t VMSize_ = 0;
+  uint64_t FileOff_ = 0;
+  uint64_t FileSize_ = 0;
+  uint64_t PageSize_ = 0;
+  uint32_t MaxProt_;
+  uint32_t InitProt_;
+  std::vector<std::unique_ptr<Section>> Sections_;
+};
+
+/// An LC_SYMTAB command along with its symbol and string tables. Names share
+/// storage in the string table when one ends with another, see
+/// \c StrtabBuilder.
+class SymtabCommand : public LoadCommand {
+public:
+  SymtabCommand() : Saver_(Alloc_) {}
+
+  /// Add a symbol to the table, returning its index. \c Name isn't copied, so
+  /// it must outlive the command like the names of mapped inputs do. Names
+  /// built on the fly can be copied with \c saveName.
+  uint32_t addSymbol(StringRef Name, uint8_t Type, uint8_t Sect, uint16_t Desc,
+                     uint64_t Value);
+
+  /// Copy \c Name into storage which lives as long as the command.
+  StringRef saveName(StringRef Name) { return Saver_.save(Name); }
+
+  uint32_t size() const override {
+    return sizeof(::llvm::MachO::symtab_command);
+  }
+  void layout(uint64_t &Offset) override;
+  void build(uint8_t *Buf) const override;
+  void getChunks(std::vector<const Chunk *> &Chunks) const override;
+
+private:
+  std::vector<::llvm::MachO::nlist_64> Symbols_;
+  BumpPtrAllocator Alloc_;
+  StringSaver Saver_;
+  StrtabBuilder Strtab_;
+  std::unique_ptr<DataChunk> SymbolsChunk_;
+  std::unique_ptr<DataChunk> StringsChunk_;
+};
+
+/// An LC_DYSYMTAB command, which tells dyld where the local, external and
+/// undefined symbols of the LC_SYMTAB start, along with the indirect symbol
+/// table mapping the entries of stub and pointer sections to symbols.
+class DysymtabCommand : public LoadCommand {
+public:
+  /// \param IndirectSymbols The symbol table index of each entry, or
+  /// INDIRECT_SYMBOL_LOCAL.
+  DysymtabCommand(uint32_t NumLocals, uint32_t NumExternals,
+                  uint32_t NumUndefined, std::vector<uint32_t> IndirectSymbols)
+      : NumLocals_(NumLocals), NumExternals_(NumExternals),
+        NumUndefined_(NumUndefined),
+        IndirectSymbols_(std::move(IndirectSymbols)) {}
+
+  uint32_t size() const override {
+    return sizeof(::llvm::MachO::dysymtab_command);
+  }
+  void layout(uint64_t &Offset) override;
+  void build(uint8_t *Buf) const override;
+  void getChunks(std::vector<const Chunk *> &Chunks) const override;
+
+private:
+  uint32_t NumLocals_;
+  uint32_t NumExternals_;
+  uint32_t NumUndefined_;
+  std::vector<uint32_t> IndirectSymbols_;
+  std::unique_ptr<DataChunk> IndirectSymbolsChunk_;
+};
+
+/// An LC_DYLD_INFO_ONLY command along with the opcode streams dyld follows to
+/// rebase and bind the output. Streams left empty take no space.
+class DyldInfoCommand : public LoadCommand {
+public:
+  DyldInfoCommand &setRebaseInfo(std::vector<uint8_t> Info) {
+    Streams_[Rebase] = std::move(Info);
+    return *this;
+  }
+
+  DyldInfoCommand &setBindInfo(std::vector<uint8_t> Info) {
+    Streams_[Bind] = std::move(Info);
+    return *this;
+  }
+
+  DyldInfoCommand &setWeakBindInfo(std::vector<uint8_t> Info) {
+    Streams_[WeakBind] = std::move(Info);
+    return *this;
+  }
+
+  DyldInfoCommand &setLazyBindInfo(std::vector<uint8_t> Info) {
+    Streams_[LazyBind] = std::move(Info);
+    return *this;
+  }
+
+  uint32_t size() const override {
+    return sizeof(::llvm::MachO::dyld_info_command);
+  }
+  void layout(uint64_t &Offset) override;
+  void build(uint8_t *Buf) const override;
+  void getChunks(std::vector<const Chunk *> &Chunks) const override;
+
+private:
+  enum Stream { Rebase, Bind, WeakBind, LazyBind, NumStreams };
+
+  std::vector<uint8_t> Streams_[NumStreams];
+  std::unique_ptr<DataChunk> Chunks_[NumStreams];
+};
+
+/// An LC_UUID command. The UUID is usually a hash of the rest of the output,
+/// so it's left zeroed here and filled in by \c File once the output is
+/// written.
+class UUIDCommand : public LoadCommand {
+public:
+  UUIDCommand() = default;
+
+  /// An LC_UUID command with a given \c UUID, which must be 16 bytes.
+  explicit UUIDCommand(ArrayRef<uint8_t> UUID);
+
+  uint32_t size() const override {
+    return sizeof(::llvm::MachO::uuid_command);
+  }
+  void build(uint8_t *Buf) const override;
+
+private:
+  uint8_t UUID_[16] = {};
 };
 
 class File {
@@ -27,12 +319,60 @@ public:
     return *this;
   }
 
+  File &setFileType(::llvm::MachO::HeaderFileType Type) {
+    FileType_ = Type;
+    return *this;
+  }
+
   File &addLoadCommand(std::unique_ptr<LoadCommand> LC) {
     LoadCommands_.push_back(std::move(LC));
     return *this;
   }
 
-  Error buildAndWrite(std::string Filename) const;
+  /// Add an LC_UUID command whose UUID is a hash of the output, so that
+  /// identical outputs get identical UUIDs.
+  File &addUUIDCommand() {
+    UUIDIndex_ = LoadCommands_.size();
+    return addLoadCommand(std::make_unique<UUIDCommand>());
+  }
+
+  /// Add an LC_UUID command with a given \c UUID, e.g. the UUID of the binary
+  /// whose debug info this file holds.
+  File &addUUIDCommand(ArrayRef<uint8_t> UUID) {
+    return addLoadCommand(std::make_unique<UUIDCommand>(UUID));
+  }
+
+  /// The UUID computed by the last \c buildAndWrite, empty if there was none.
+  ArrayRef<uint8_t> getUUID() const { return UUID_; }
+
+  /// Whether the output has thread-local variable descriptors, which dyld has
+  /// to set up, i.e. MH_HAS_TLV_DESCRIPTORS.
+  File &setHasTLVDescriptors(bool Has) {
+    HasTLVDescriptors_ = Has;
+    return *this;
+  }
+
+  /// Whether the output exports weak definitions, which dyld may coalesce
+  /// with other images' definitions, i.e. MH_WEAK_DEFINES.
+  File &setHasWeakDefinitions(bool Has) {
+    HasWeakDefinitions_ = Has;
+    return *this;
+  }
+
+  /// Whether the output uses weak definitions, so that dyld has to look for
+  /// the one to bind them to, i.e. MH_BINDS_TO_WEAK.
+  File &setBindsToWeak(bool Binds) {
+    BindsToWeak_ = Binds;
+    return *this;
+  }
+
+  /// Use \c W to write the output. Defaults to a \c MappedWriter.
+  File &setWriter(std::unique_ptr<Writer> W) {
+    Writer_ = std::move(W);
+    return *this;
+  }
+
+  Error buildAndWrite(std::string Filename);
 
 private:
   uint32_t buildHeaderFlags() const;
@@ -40,7 +380,14 @@ private:
   buildHeader(uint32_t LoadCommandsSize) const;
 
   Triple Triple_;
+  ::llvm::MachO::HeaderFileType FileType_ = ::llvm::MachO::MH_EXECUTE;
   std::vector<std::unique_ptr<LoadCommand>> LoadCommands_;
+  std::unique_ptr<Writer> Writer_;
+  Optional<size_t> UUIDIndex_;
+  std::vector<uint8_t> UUID_;
+  bool HasTLVDescriptors_ = false;
+  bool HasWeakDefinitions_ = false;
+  bool BindsToWeak_ = false;
 };
 
 } // end namespace Builder
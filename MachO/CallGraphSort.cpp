@@ -0,0 +1,237 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/CallGraphSort.h"
+
+#include "MachO/InputFile.h"
+#include "MachO/Layout.h"
+#include "MachO/SymbolTable.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+
+#include <numeric>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+Expected<CallGraphProfile> CallGraphProfile::read(StringRef Path) {
+  auto MBOrErr = errorOrToExpected(MemoryBuffer::getFile(Path));
+  if (auto Err = MBOrErr.takeError()) {
+    return std::move(Err);
+  }
+  return parse(std::move(*MBOrErr));
+}
+
+Expected<CallGraphProfile>
+CallGraphProfile::parse(std::unique_ptr<MemoryBuffer> MB) {
+  CallGraphProfile Profile;
+  StringRef Rest = MB->getBuffer();
+  for (unsigned LineNo = 1; !Rest.empty(); ++LineNo) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#")) {
+      continue;
+    }
+
+    SmallVector<StringRef, 3> Fields;
+    Line.split(Fields, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    Edge E;
+    if (Fields.size() != 3 || Fields[2].getAsInteger(10, E.Weight)) {
+      return make_error<StringError>(
+          "line " + Twine(LineNo) + ": expected '<caller> <callee> <weight>'",
+          inconvertibleErrorCode());
+    }
+    E.From = Fields[0];
+    E.To = Fields[1];
+    Profile.Edges_.push_back(E);
+  }
+  Profile.MB_ = std::move(MB);
+  return std::move(Profile);
+}
+
+namespace {
+
+/// Clusters larger than this aren't grown any further, there's little
+/// locality left to gain inside them.
+constexpr uint64_t MaxClusterSize = 1024 * 1024;
+
+/// Merging a cluster into its caller's must not dilute the caller's density
+/// by more than this factor.
+constexpr uint64_t MaxDensityDegradation = 8;
+
+struct Cluster {
+  Cluster(int Node, uint64_t Size) : Next(Node), Prev(Node), Size(Size) {}
+
+  double getDensity() const {
+    return Size == 0 ? 0 : double(Weight) / double(Size);
+  }
+
+  /// The members of a cluster form a circular list through Next and Prev.
+  int Next;
+  int Prev;
+  uint64_t Size;
+  uint64_t Weight = 0;
+  uint64_t InitialWeight = 0;
+  int BestPred = -1;
+  uint64_t BestPredWeight = 0;
+};
+
+class CallGraphSorter {
+public:
+  CallGraphSorter(const CallGraphProfile &Profile, const SymbolTable &Symtab,
+                  const Layout &L);
+
+  std::vector<const Atom *> run();
+
+private:
+  int getOrCreateNode_(const Atom &A);
+  bool isNewDensityBad_(const Cluster &Into, const Cluster &From) const;
+  void merge_(int IntoIdx, int FromIdx);
+  int getLeader_(int Idx);
+
+  std::vector<const Atom *> Atoms_;
+  std::vector<Cluster> Clusters_;
+  std::vector<int> Leaders_;
+  DenseMap<const Atom *, int> Nodes_;
+};
+
+CallGraphSorter::CallGraphSorter(const CallGraphProfile &Profile,
+                                 const SymbolTable &Symtab, const Layout &L) {
+  for (const CallGraphProfile::Edge &E : Profile.edges()) {
+    const Symbol *From = Symtab.find(E.From);
+    const Symbol *To = Symtab.find(E.To);
+    if (From == nullptr || To == nullptr || !From->isDefined() ||
+        !To->isDefined()) {
+      continue;
+    }
+    const Atom &FromAtom = L.getLeader(*From->Definition);
+    const Atom &ToAtom = L.getLeader(*To->Definition);
+    if (!FromAtom.getSection().isCode() ||
+        L.getOutputSection(FromAtom) != L.getOutputSection(ToAtom)) {
+      continue;
+    }
+
+    int FromNode = getOrCreateNode_(FromAtom);
+    int ToNode = getOrCreateNode_(ToAtom);
+    Cluster &ToCluster = Clusters_[ToNode];
+    ToCluster.Weight += E.Weight;
+    if (FromNode == ToNode) {
+      continue;
+    }
+    if (ToCluster.BestPred == -1 || ToCluster.BestPredWeight < E.Weight) {
+      ToCluster.BestPred = FromNode;
+      ToCluster.BestPredWeight = E.Weight;
+    }
+  }
+  for (Cluster &C : Clusters_) {
+    C.InitialWeight = C.Weight;
+  }
+}
+
+int CallGraphSorter::getOrCreateNode_(const Atom &A) {
+  auto Inserted = Nodes_.try_emplace(&A, Clusters_.size());
+  if (Inserted.second) {
+    Atoms_.push_back(&A);
+    Clusters_.emplace_back(Clusters_.size(), A.size());
+  }
+  return Inserted.first->second;
+}
+
+bool CallGraphSorter::isNewDensityBad_(const Cluster &Into,
+                                       const Cluster &From) const {
+  double NewDensity =
+      double(Into.Weight + From.Weight) / double(Into.Size + From.Size);
+  return NewDensity < Into.getDensity() / MaxDensityDegradation;
+}
+
+void CallGraphSorter::merge_(int IntoIdx, int FromIdx) {
+  Cluster &Into = Clusters_[IntoIdx];
+  Cluster &From = Clusters_[FromIdx];
+  int IntoTail = Into.Prev;
+  int FromTail = From.Prev;
+  Into.Prev = FromTail;
+  Clusters_[FromTail].Next = IntoIdx;
+  From.Prev = IntoTail;
+  Clusters_[IntoTail].Next = FromIdx;
+
+  Into.Size += From.Size;
+  Into.Weight += From.Weight;
+  From.Size = 0;
+  From.Weight = 0;
+}
+
+int CallGraphSorter::getLeader_(int Idx) {
+  while (Leaders_[Idx] != Idx) {
+    Leaders_[Idx] = Leaders_[Leaders_[Idx]];
+    Idx = Leaders_[Idx];
+  }
+  return Idx;
+}
+
+std::vector<const Atom *> CallGraphSorter::run() {
+  auto ByDensity = [this](int LHS, int RHS) {
+    return Clusters_[LHS].getDensity() > Clusters_[RHS].getDensity();
+  };
+
+  std::vector<int> Sorted(Clusters_.size());
+  std::iota(Sorted.begin(), Sorted.end(), 0);
+  Leaders_ = Sorted;
+  llvm::stable_sort(Sorted, ByDensity);
+
+  for (int Idx : Sorted) {
+    // Denser clusters visited earlier may have merged into this one, but a
+    // cluster only stops leading itself when it's visited, so it still does.
+    Cluster &C = Clusters_[Idx];
+    // Don't follow edges which account for few of this cluster's calls.
+    if (C.BestPred == -1 || C.BestPredWeight * 10 <= C.InitialWeight) {
+      continue;
+    }
+    int PredIdx = getLeader_(C.BestPred);
+    if (PredIdx == Idx) {
+      continue;
+    }
+    Cluster &Pred = Clusters_[PredIdx];
+    if (C.Size + Pred.Size > MaxClusterSize || isNewDensityBad_(Pred, C)) {
+      continue;
+    }
+    Leaders_[Idx] = PredIdx;
+    merge_(PredIdx, Idx);
+  }
+
+  Sorted.clear();
+  for (int Idx = 0, End = Clusters_.size(); Idx != End; ++Idx) {
+    if (Clusters_[Idx].Size > 0) {
+      Sorted.push_back(Idx);
+    }
+  }
+  llvm::stable_sort(Sorted, ByDensity);
+
+  std::vector<const Atom *> Order;
+  Order.reserve(Atoms_.size());
+  for (int Leader : Sorted) {
+    int Idx = Leader;
+    do {
+      Order.push_back(Atoms_[Idx]);
+      Idx = Clusters_[Idx].Next;
+    } while (Idx != Leader);
+  }
+  return Order;
+}
+
+} // namespace
+
+std::vector<const Atom *> sortByCallGraph(const CallGraphProfile &Profile,
+                                          const SymbolTable &Symtab,
+                                          const Layout &L) {
+  return CallGraphSorter(Profile, Symtab, L).run();
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,68 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Atom;
+class Layout;
+class SymbolTable;
+
+/// Weighted call edges between functions, e.g. sampled with perf or derived
+/// from instrumentation. Each line of the text format is
+/// \c "<caller> <callee> <weight>". Lines starting with '#' are comments.
+class CallGraphProfile {
+public:
+  struct Edge {
+    StringRef From;
+    StringRef To;
+    uint64_t Weight;
+  };
+
+  CallGraphProfile() {}
+
+  static Expected<CallGraphProfile> read(StringRef Path);
+
+  static Expected<CallGraphProfile> parse(std::unique_ptr<MemoryBuffer> MB);
+
+  /// The edges, whose names point into the profile's buffer.
+  ArrayRef<Edge> edges() const { return Edges_; }
+
+  bool empty() const { return Edges_.empty(); }
+
+private:
+  std::unique_ptr<MemoryBuffer> MB_;
+  std::vector<Edge> Edges_;
+};
+
+/// Order the code atoms mentioned by \c Profile so that callers and their hot
+/// callees end up next to each other, using the C3 heuristic from
+/// "Optimizing Function Placement for Large-Scale Data-Center Applications".
+///
+/// Every atom starts in its own cluster. Visiting clusters from the densest
+/// (most samples per byte) down, each is appended to the cluster of its most
+/// frequent caller unless that makes the result too large or too sparse. The
+/// resulting clusters are returned densest first.
+///
+/// Atoms must have been placed in output sections by \c L, edges between
+/// different output sections are ignored.
+std::vector<const Atom *> sortByCallGraph(const CallGraphProfile &Profile,
+                                          const SymbolTable &Symtab,
+                                          const Layout &L);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
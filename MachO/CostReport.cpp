@@ -0,0 +1,121 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/CostReport.h"
+
+#include "MachO/File.h"
+#include "MachO/Linker.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/Support/JSON.h"
+
+#include <chrono>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+struct InputCost {
+  uint64_t BytesMapped = 0;
+  uint64_t BytesLaidOut = 0;
+  uint64_t Atoms = 0;
+  uint64_t AtomsFolded = 0;
+  uint64_t Symbols = 0;
+  uint64_t Relocations = 0;
+  std::chrono::nanoseconds ParseTime{0};
+  std::chrono::nanoseconds RelocationTime{0};
+
+  InputCost &operator+=(const InputCost &Other) {
+    BytesMapped += Other.BytesMapped;
+    BytesLaidOut += Other.BytesLaidOut;
+    Atoms += Other.Atoms;
+    AtomsFolded += Other.AtomsFolded;
+    Symbols += Other.Symbols;
+    Relocations += Other.Relocations;
+    ParseTime += Other.ParseTime;
+    RelocationTime += Other.RelocationTime;
+    return *this;
+  }
+};
+
+InputCost measure(const InputFile &IF, const Layout &L) {
+  InputCost C;
+  C.BytesMapped = IF.getFile().getBuffer().getBufferSize();
+  for (const auto &IS : IF.sections()) {
+    C.Relocations += IS->getRelocations().size();
+    for (const Atom &A : IS->atoms()) {
+      ++C.Atoms;
+      if (L.isFolded(A)) {
+        ++C.AtomsFolded;
+      } else if (L.getOutputSection(A) != nullptr) {
+        C.BytesLaidOut += A.size();
+      }
+    }
+  }
+  // Undefined references are counted too, they cost a symbol table lookup
+  // all the same.
+  C.Symbols = IF.symbols().size();
+  C.ParseTime = IF.getParseTime();
+  C.RelocationTime = IF.getRelocationTime();
+  return C;
+}
+
+double toMilliseconds(std::chrono::nanoseconds Time) {
+  return std::chrono::duration<double, std::milli>(Time).count();
+}
+
+void writeCost(json::OStream &J, const InputCost &C) {
+  J.attribute("bytes_mapped", C.BytesMapped);
+  J.attribute("bytes_laid_out", C.BytesLaidOut);
+  J.attribute("atoms", C.Atoms);
+  J.attribute("atoms_folded", C.AtomsFolded);
+  J.attribute("symbols", C.Symbols);
+  J.attribute("relocations", C.Relocations);
+  J.attribute("parse_ms", toMilliseconds(C.ParseTime));
+  J.attribute("relocations_ms", toMilliseconds(C.RelocationTime));
+}
+
+} // namespace
+
+void writeCostReport(const Linker &L, raw_ostream &OS) {
+  ArrayRef<const InputFile *> Inputs = L.inputs();
+  std::vector<InputCost> Costs(Inputs.size());
+  Scheduler::get().forEach(Inputs.size(), [&](size_t I) {
+    Costs[I] = measure(*Inputs[I], L.getLayout());
+  });
+
+  InputCost Total;
+  for (const InputCost &C : Costs) {
+    Total += C;
+  }
+
+  json::OStream J(OS, 2);
+  J.object([&]() {
+    J.attributeObject("total", [&]() {
+      J.attribute("inputs", static_cast<uint64_t>(Inputs.size()));
+      writeCost(J, Total);
+      J.attribute("atoms_coalesced",
+                  static_cast<uint64_t>(L.getNumCoalesced()));
+      J.attribute("atoms_icf_folded", static_cast<uint64_t>(L.getNumFolded()));
+    });
+    J.attributeArray("inputs", [&]() {
+      for (size_t I = 0; I < Inputs.size(); ++I) {
+        J.object([&]() {
+          J.attribute("path", Inputs[I]->getFile().getPath());
+          writeCost(J, Costs[I]);
+        });
+      }
+    });
+  });
+  OS << '\n';
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
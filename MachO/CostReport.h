@@ -0,0 +1,25 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Linker;
+
+/// Write what each input of \c L costs the link to \c OS as JSON: the bytes
+/// mapped and laid out, its atoms and how many were folded away, its symbols
+/// and relocations and the time spent parsing it. Each input is measured in
+/// parallel into its own entry, and the totals are summed once they're done.
+void writeCostReport(const Linker &L, raw_ostream &OS);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,724 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/DebugCompanion.h"
+
+#include "MachO/Builder.h"
+#include "MachO/DebugMap.h"
+#include "MachO/File.h"
+#include "MachO/Linker.h"
+#include "Util/Compression.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/DebugInfo/DWARF/DWARFAbbreviationDeclaration.h"
+#include "llvm/DebugInfo/DWARF/DWARFDataExtractor.h"
+#include "llvm/DebugInfo/DWARF/DWARFDebugAbbrev.h"
+#include "llvm/DebugInfo/DWARF/DWARFFormValue.h"
+#include "llvm/Support/Endian.h"
+
+#include <vector>
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// The debug sections the companion keeps, in the order it lists them.
+enum DebugSection : unsigned {
+  DS_Info,
+  DS_Abbrev,
+  DS_Line,
+  DS_Str,
+  DS_LineStr,
+  DS_StrOffsets,
+  DS_Addr,
+  DS_Ranges,
+  DS_RngLists,
+  DS_Loc,
+  DS_LocLists,
+  DS_MacInfo,
+  DS_ARanges,
+  DS_PubNames,
+  DS_PubTypes,
+  DS_GnuPubNames,
+  DS_GnuPubTypes,
+  DS_Frame,
+  DS_Count
+};
+
+/// The names of the sections, which Mach-O cuts off at 16 characters.
+const char *const DebugSectionNames[DS_Count] = {
+    "__debug_info",     "__debug_abbrev",   "__debug_line",
+    "__debug_str",      "__debug_line_str", "__debug_str_offs",
+    "__debug_addr",     "__debug_ranges",   "__debug_rnglists",
+    "__debug_loc",      "__debug_loclists", "__debug_macinfo",
+    "__debug_aranges",  "__debug_pubnames", "__debug_pubtypes",
+    "__debug_gnu_pubn", "__debug_gnu_pubt", "__debug_frame"};
+
+/// The debug sections of an input and where each of them starts in the
+/// companion's section of the same name.
+struct InputDebugInfo {
+  const InputSection *Sections[DS_Count] = {};
+  uint64_t Bases[DS_Count] = {};
+};
+
+/// Where walking a section for the offsets it holds can start: the unit
+/// holding the offset, whose header the walk needs, and the offset itself.
+struct ResumePoint {
+  uint64_t Unit;
+  uint64_t Offset;
+};
+
+/// Called with every offset into another debug section a walk finds: where
+/// it is, how big it is and which section it's an offset into.
+using FixupFn =
+    function_ref<void(uint64_t Offset, unsigned Size, DebugSection Target)>;
+
+/// Called with every point a walk could later resume from, in order.
+using ResumeFn = function_ref<void(ResumePoint)>;
+
+/// Finds the offsets one input's debug section holds into the input's other
+/// debug sections, which are rebased when the sections are merged. Each
+/// section is walked unit by unit, skipping what holds no offsets, e.g. line
+/// programs. Walking stops at anything malformed, whose offsets are left as
+/// they are.
+class OffsetWalker {
+public:
+  OffsetWalker(const InputDebugInfo &In, DebugSection Kind)
+      : In_(In), Kind_(Kind), D_(contents_(Kind), true, 8) {}
+
+  /// Walk the section from \c From until the first unit or DIE starting at or
+  /// after \c End.
+  void walk(ResumePoint From, uint64_t End, FixupFn OnFixup,
+            ResumeFn OnResume) const;
+
+private:
+  ArrayRef<uint8_t> contents_(DebugSection Kind) const {
+    return In_.Sections[Kind] ? In_.Sections[Kind]->getContents()
+                              : ArrayRef<uint8_t>();
+  }
+
+  /// Walk the unit at \c Unit. Returns the offset of the next unit, or 0 if
+  /// the walk can't go on.
+  uint64_t walkInfo_(uint64_t Unit, uint64_t From, uint64_t End,
+                     FixupFn OnFixup, ResumeFn OnResume) const;
+  uint64_t walkLine_(uint64_t Unit, FixupFn OnFixup) const;
+  uint64_t walkStrOffsets_(uint64_t Unit, uint64_t From, uint64_t End,
+                           FixupFn OnFixup, ResumeFn OnResume) const;
+  uint64_t walkFrame_(uint64_t Unit, FixupFn OnFixup) const;
+  /// Walk a unit which starts with a version and an offset into __debug_info,
+  /// e.g. an address range table.
+  uint64_t walkInfoHeader_(uint64_t Unit, FixupFn OnFixup) const;
+
+  /// Skip \c Form's value at \c C, without reading it.
+  bool skip_(DataExtractor::Cursor &C, dwarf::Form Form,
+             const dwarf::FormParams &P) const {
+    uint64_t Offset = C.tell();
+    if (!DWARFFormValue::skipValue(Form, D_, &Offset, P)) {
+      return false;
+    }
+    D_.skip(C, Offset - C.tell());
+    return bool(C);
+  }
+
+  const InputDebugInfo &In_;
+  DebugSection Kind_;
+  DWARFDataExtractor D_;
+};
+
+/// Which section the value of \c Attr, in \c Form, is an offset into. Returns
+/// false if it isn't an offset into another debug section.
+bool getTarget(dwarf::Attribute Attr, dwarf::Form Form,
+               const dwarf::FormParams &P, unsigned &Size,
+               DebugSection &Target) {
+  switch (Form) {
+  case dwarf::DW_FORM_strp:
+    Size = P.getDwarfOffsetByteSize();
+    Target = DS_Str;
+    return true;
+  case dwarf::DW_FORM_line_strp:
+    Size = P.getDwarfOffsetByteSize();
+    Target = DS_LineStr;
+    return true;
+  case dwarf::DW_FORM_ref_addr:
+    Size = P.getRefAddrByteSize();
+    Target = DS_Info;
+    return true;
+  case dwarf::DW_FORM_sec_offset:
+    Size = P.getDwarfOffsetByteSize();
+    break;
+  case dwarf::DW_FORM_data4:
+  case dwarf::DW_FORM_data8:
+    // Before DW_FORM_sec_offset, offsets were data. Member offsets are
+    // constants though.
+    if (P.Version >= 4 || Attr == dwarf::DW_AT_data_member_location) {
+      return false;
+    }
+    Size = Form == dwarf::DW_FORM_data4 ? 4 : 8;
+    break;
+  default:
+    return false;
+  }
+
+  bool IsV5 = P.Version >= 5;
+  switch (Attr) {
+  case dwarf::DW_AT_stmt_list:
+    Target = DS_Line;
+    return true;
+  case dwarf::DW_AT_ranges:
+  case dwarf::DW_AT_start_scope:
+    Target = IsV5 ? DS_RngLists : DS_Ranges;
+    return true;
+  case dwarf::DW_AT_location:
+  case dwarf::DW_AT_data_member_location:
+  case dwarf::DW_AT_frame_base:
+  case dwarf::DW_AT_return_addr:
+  case dwarf::DW_AT_segment:
+  case dwarf::DW_AT_static_link:
+  case dwarf::DW_AT_string_length:
+  case dwarf::DW_AT_use_location:
+  case dwarf::DW_AT_vtable_elem_location:
+    Target = IsV5 ? DS_LocLists : DS_Loc;
+    return true;
+  case dwarf::DW_AT_macro_info:
+    Target = DS_MacInfo;
+    return true;
+  case dwarf::DW_AT_str_offsets_base:
+    Target = DS_StrOffsets;
+    return true;
+  case dwarf::DW_AT_addr_base:
+  case dwarf::DW_AT_GNU_addr_base:
+    Target = DS_Addr;
+    return true;
+  case dwarf::DW_AT_rnglists_base:
+    Target = DS_RngLists;
+    return true;
+  case dwarf::DW_AT_GNU_ranges_base:
+    Target = DS_Ranges;
+    return true;
+  case dwarf::DW_AT_loclists_base:
+    Target = DS_LocLists;
+    return true;
+  default:
+    return false;
+  }
+}
+
+void OffsetWalker::walk(ResumePoint From, uint64_t End, FixupFn OnFixup,
+                        ResumeFn OnResume) const {
+  for (uint64_t Unit = From.Unit; Unit < End && D_.isValidOffset(Unit);) {
+    OnResume({Unit, Unit});
+    uint64_t Offset = Unit == From.Unit ? From.Offset : Unit;
+    uint64_t Next;
+    switch (Kind_) {
+    case DS_Info:
+      Next = walkInfo_(Unit, Offset, End, OnFixup, OnResume);
+      break;
+    case DS_Line:
+      Next = walkLine_(Unit, OnFixup);
+      break;
+    case DS_StrOffsets:
+      Next = walkStrOffsets_(Unit, Offset, End, OnFixup, OnResume);
+      break;
+    case DS_Frame:
+      Next = walkFrame_(Unit, OnFixup);
+      break;
+    case DS_ARanges:
+    case DS_PubNames:
+    case DS_PubTypes:
+    case DS_GnuPubNames:
+    case DS_GnuPubTypes:
+      Next = walkInfoHeader_(Unit, OnFixup);
+      break;
+    default:
+      // Nothing else holds offsets into other sections.
+      return;
+    }
+    if (Next <= Unit) {
+      return;
+    }
+    Unit = Next;
+  }
+}
+
+uint64_t OffsetWalker::walkInfo_(uint64_t Unit, uint64_t From, uint64_t End,
+                                 FixupFn OnFixup, ResumeFn OnResume) const {
+  DataExtractor::Cursor C(Unit);
+  dwarf::FormParams P;
+  uint64_t Length;
+  std::tie(Length, P.Format) = D_.getInitialLength(C);
+  uint64_t UnitEnd = C.tell() + Length;
+  unsigned OffsetSize = P.getDwarfOffsetByteSize();
+  P.Version = D_.getU16(C);
+  uint8_t UnitType = dwarf::DW_UT_compile;
+  if (P.Version >= 5) {
+    UnitType = D_.getU8(C);
+    P.AddrSize = D_.getU8(C);
+  }
+  OnFixup(C.tell(), OffsetSize, DS_Abbrev);
+  uint64_t AbbrevOffset = OffsetSize == 8 ? D_.getU64(C) : D_.getU32(C);
+  if (P.Version < 5) {
+    P.AddrSize = D_.getU8(C);
+  }
+  switch (UnitType) {
+  case dwarf::DW_UT_skeleton:
+  case dwarf::DW_UT_split_compile:
+    D_.skip(C, 8);
+    break;
+  case dwarf::DW_UT_type:
+  case dwarf::DW_UT_split_type:
+    D_.skip(C, 8 + OffsetSize);
+    break;
+  }
+  DWARFAbbreviationDeclarationSet Abbrevs;
+  uint64_t AbbrevCursor = AbbrevOffset;
+  if (!C || P.Version < 2 || P.Version > 5 ||
+      !Abbrevs.extract(DataExtractor(contents_(DS_Abbrev), true, 8),
+                       &AbbrevCursor)) {
+    consumeError(C.takeError());
+    return 0;
+  }
+
+  // DIEs are walked in a flat sequence, their nesting doesn't matter here.
+  uint64_t DIE = std::max(From, C.tell());
+  DataExtractor::Cursor DC(DIE);
+  while (DIE < UnitEnd && DIE < End) {
+    OnResume({Unit, DIE});
+    uint64_t Code = D_.getULEB128(DC);
+    if (!DC) {
+      break;
+    }
+    if (Code == 0) {
+      DIE = DC.tell();
+      continue;
+    }
+    const DWARFAbbreviationDeclaration *Decl =
+        Abbrevs.getAbbreviationDeclaration(Code);
+    if (!Decl) {
+      return 0;
+    }
+    for (const DWARFAbbreviationDeclaration::AttributeSpec &Spec :
+         Decl->attributes()) {
+      if (Spec.isImplicitConst()) {
+        continue;
+      }
+      dwarf::Form Form = Spec.Form;
+      if (Form == dwarf::DW_FORM_indirect) {
+        Form = dwarf::Form(D_.getULEB128(DC));
+      }
+      unsigned Size;
+      DebugSection Target;
+      if (getTarget(Spec.Attr, Form, P, Size, Target)) {
+        OnFixup(DC.tell(), Size, Target);
+      }
+      if (!skip_(DC, Form, P)) {
+        consumeError(DC.takeError());
+        return 0;
+      }
+    }
+    DIE = DC.tell();
+  }
+  if (!DC) {
+    consumeError(DC.takeError());
+    return 0;
+  }
+  return UnitEnd;
+}
+
+uint64_t OffsetWalker::walkLine_(uint64_t Unit, FixupFn OnFixup) const {
+  DataExtractor::Cursor C(Unit);
+  dwarf::FormParams P;
+  uint64_t Length;
+  std::tie(Length, P.Format) = D_.getInitialLength(C);
+  uint64_t UnitEnd = C.tell() + Length;
+  P.Version = D_.getU16(C);
+  // Only DWARF 5 headers refer to strings, in their directory and file
+  // tables.
+  if (P.Version >= 5) {
+    P.AddrSize = D_.getU8(C);
+    D_.skip(C, 1 + P.getDwarfOffsetByteSize() + 5);
+    uint8_t OpcodeBase = D_.getU8(C);
+    D_.skip(C, OpcodeBase > 0 ? OpcodeBase - 1 : 0);
+    for (unsigned Table = 0; Table < 2 && C; ++Table) {
+      std::vector<dwarf::Form> Forms(D_.getU8(C));
+      for (dwarf::Form &Form : Forms) {
+        D_.getULEB128(C);
+        Form = dwarf::Form(D_.getULEB128(C));
+      }
+      for (uint64_t N = D_.getULEB128(C); N > 0 && C; --N) {
+        for (dwarf::Form Form : Forms) {
+          if (Form == dwarf::DW_FORM_strp || Form == dwarf::DW_FORM_line_strp) {
+            OnFixup(C.tell(), P.getDwarfOffsetByteSize(),
+                    Form == dwarf::DW_FORM_strp ? DS_Str : DS_LineStr);
+          }
+          if (!skip_(C, Form, P)) {
+            consumeError(C.takeError());
+            return 0;
+          }
+        }
+      }
+    }
+  }
+  if (!C) {
+    consumeError(C.takeError());
+    return 0;
+  }
+  return UnitEnd;
+}
+
+uint64_t OffsetWalker::walkStrOffsets_(uint64_t Unit, uint64_t From,
+                                       uint64_t End, FixupFn OnFixup,
+                                       ResumeFn OnResume) const {
+  DataExtractor::Cursor C(Unit);
+  uint64_t Length;
+  dwarf::DwarfFormat Format;
+  std::tie(Length, Format) = D_.getInitialLength(C);
+  uint64_t UnitEnd = C.tell() + Length;
+  // The version and padding.
+  D_.skip(C, 4);
+  if (!C) {
+    consumeError(C.takeError());
+    return 0;
+  }
+  unsigned Size = dwarf::getDwarfOffsetByteSize(Format);
+  for (uint64_t Entry = std::max(From, C.tell());
+       Entry + Size <= UnitEnd && Entry < End; Entry += Size) {
+    OnResume({Unit, Entry});
+    OnFixup(Entry, Size, DS_Str);
+  }
+  return UnitEnd;
+}
+
+uint64_t OffsetWalker::walkFrame_(uint64_t Unit, FixupFn OnFixup) const {
+  DataExtractor::Cursor C(Unit);
+  uint64_t Length;
+  dwarf::DwarfFormat Format;
+  std::tie(Length, Format) = D_.getInitialLength(C);
+  uint64_t UnitEnd = C.tell() + Length;
+  if (Length == 0) {
+    return UnitEnd;
+  }
+  unsigned Size = dwarf::getDwarfOffsetByteSize(Format);
+  // FDEs point to their CIE, CIEs have an id of all ones instead.
+  uint64_t Id = C.tell();
+  uint64_t CIEPointer = Size == 8 ? D_.getU64(C) : D_.getU32(C);
+  if (!C) {
+    consumeError(C.takeError());
+    return 0;
+  }
+  if (CIEPointer != (Size == 8 ? UINT64_MAX : UINT32_MAX)) {
+    OnFixup(Id, Size, DS_Frame);
+  }
+  return UnitEnd;
+}
+
+uint64_t OffsetWalker::walkInfoHeader_(uint64_t Unit, FixupFn OnFixup) const {
+  DataExtractor::Cursor C(Unit);
+  uint64_t Length;
+  dwarf::DwarfFormat Format;
+  std::tie(Length, Format) = D_.getInitialLength(C);
+  uint64_t UnitEnd = C.tell() + Length;
+  D_.skip(C, 2);
+  if (!C) {
+    consumeError(C.takeError());
+    return 0;
+  }
+  OnFixup(C.tell(), dwarf::getDwarfOffsetByteSize(Format), DS_Info);
+  return UnitEnd;
+}
+
+/// Write the \c Size byte little endian \c Value at \c Offset of a section,
+/// of which \c Buf holds bytes [Begin, End). Bytes outside of it are dropped,
+/// they're written along with the block they're in.
+void writeClipped(uint8_t *Buf, uint64_t Begin, uint64_t End, uint64_t Offset,
+                  unsigned Size, uint64_t Value) {
+  uint8_t Bytes[8];
+  support::endian::write64le(Bytes, Value);
+  for (uint64_t I = std::max(Offset, Begin); I < std::min(Offset + Size, End);
+       ++I) {
+    Buf[I - Begin] = Bytes[I - Offset];
+  }
+}
+
+/// A piece of an input's debug section which is rewritten and compressed as
+/// a whole.
+struct Block {
+  const InputDebugInfo *In;
+  DebugSection Kind;
+  uint64_t Begin;
+  uint64_t End;
+  /// Where to start walking the section for the offsets in this block.
+  ResumePoint Resume;
+};
+
+/// Rewrites blocks of the inputs' debug sections for the companion.
+class BlockWriter {
+public:
+  explicit BlockWriter(const Linker &L) : L_(L) {}
+
+  /// Fill \c Buf with \c B, rebased and relocated.
+  void fill(const Block &B, std::vector<uint8_t> &Buf) const;
+
+private:
+  /// Find the output address of what the pointer relocation \c R of \c IS
+  /// refers to. Returns false if it's not in the output.
+  bool getTarget_(const InputSection &IS, const Relocation &R,
+                  uint64_t &Addr) const;
+  bool getAddr_(const Atom &A, uint64_t &Addr) const;
+
+  const Linker &L_;
+};
+
+bool BlockWriter::getAddr_(const Atom &A, uint64_t &Addr) const {
+  if (L_.getLayout().getOutputSection(A) == nullptr) {
+    return false;
+  }
+  Addr = L_.getLayout().getAddr(A);
+  return true;
+}
+
+bool BlockWriter::getTarget_(const InputSection &IS, const Relocation &R,
+                             uint64_t &Addr) const {
+  if (R.Sym) {
+    const Symbol &S = L_.getSymbolTable().resolve(IS.getInputFile(), *R.Sym);
+    if (!S.isDefined() || !getAddr_(*S.Definition, Addr)) {
+      return false;
+    }
+    Addr += S.Offset;
+    return true;
+  }
+  if (isDebugSection(*R.Sect)) {
+    return false;
+  }
+  const Atom *Target;
+  uint64_t Offset;
+  if (!IS.decodeTarget(R, Target, Offset)) {
+    // The ends of ranges point just past their section's last atom.
+    const uint8_t *Loc = IS.getContents().data() + R.Offset;
+    uint64_t Stored = R.Length == 3 ? support::endian::read64le(Loc)
+                                    : support::endian::read32le(Loc);
+    if (R.Sect->atoms().empty() ||
+        Stored != R.Sect->getAddr() + R.Sect->size()) {
+      return false;
+    }
+    Target = &R.Sect->atoms().back();
+    Offset = Target->size();
+  }
+  if (!getAddr_(*Target, Addr)) {
+    return false;
+  }
+  Addr += Offset;
+  return true;
+}
+
+void BlockWriter::fill(const Block &B, std::vector<uint8_t> &Buf) const {
+  const InputSection &IS = *B.In->Sections[B.Kind];
+  ArrayRef<uint8_t> Contents = IS.getContents();
+  Buf.assign(Contents.begin() + B.Begin, Contents.begin() + B.End);
+  auto Read = [&](uint64_t Offset, unsigned Size) {
+    return Size == 8 ? support::endian::read64le(&Contents[Offset])
+                     : support::endian::read32le(&Contents[Offset]);
+  };
+
+  OffsetWalker(*B.In, B.Kind)
+      .walk(
+          B.Resume, B.End,
+          [&](uint64_t Offset, unsigned Size, DebugSection Target) {
+            if ((Size == 4 || Size == 8) && Offset + Size > B.Begin &&
+                Offset < B.End && Offset + Size <= Contents.size()) {
+              writeClipped(Buf.data(), B.Begin, B.End, Offset, Size,
+                           Read(Offset, Size) + B.In->Bases[Target]);
+            }
+          },
+          [](ResumePoint) {});
+
+  // Pointers are UNSIGNED relocations, and differences between two of them a
+  // SUBTRACTOR relocation of the one subtracted followed by an UNSIGNED one.
+  uint8_t Subtractor = IS.getFile().getTriple().getArch() == Triple::x86_64
+                           ? X86_64_RELOC_SUBTRACTOR
+                           : ARM64_RELOC_SUBTRACTOR;
+  ArrayRef<Relocation> Relocs = IS.getRelocations();
+  size_t I = llvm::partition_point(Relocs, [&](const Relocation &R) {
+               return R.Offset + 8 <= B.Begin;
+             }) -
+             Relocs.begin();
+  for (; I < Relocs.size() && Relocs[I].Offset < B.End; ++I) {
+    const Relocation &R = Relocs[I];
+    unsigned Size = 1u << R.Length;
+    if (R.PCRel || (Size != 4 && Size != 8) ||
+        R.Offset + Size > Contents.size()) {
+      continue;
+    }
+    uint64_t Value;
+    if (R.Type == Subtractor) {
+      if (I + 1 == Relocs.size() || Relocs[I + 1].Offset != R.Offset) {
+        continue;
+      }
+      const Relocation &Minuend = Relocs[++I];
+      uint64_t From, To;
+      // Only differences of symbols, i.e. whose addend is all the fixup
+      // holds, are understood.
+      if (!R.Sym || !Minuend.Sym || !getTarget_(IS, R, From) ||
+          !getTarget_(IS, Minuend, To)) {
+        continue;
+      }
+      Value = To - From + Read(R.Offset, Size);
+    } else if (R.Type == 0) {
+      if (!getTarget_(IS, R, Value)) {
+        continue;
+      }
+      if (R.Sym) {
+        Value += Read(R.Offset, Size);
+      }
+    } else {
+      continue;
+    }
+    writeClipped(Buf.data(), B.Begin, B.End, R.Offset, Size, Value);
+  }
+}
+
+/// A section of the companion: its GNU compression header and then the
+/// stream of its blocks, read back from where it was spilled.
+class CompressedSectionChunk : public Builder::Chunk {
+public:
+  explicit CompressedSectionChunk(std::unique_ptr<ZlibStream> Stream)
+      : Stream_(std::move(Stream)) {
+    memcpy(Header_, "ZLIB", 4);
+    support::endian::write64be(Header_ + 4, Stream_->getUncompressedSize());
+  }
+
+  uint64_t size() const override { return sizeof(Header_) + Stream_->size(); }
+
+  void write(uint8_t *Buf, uint64_t Begin, uint64_t End) const override {
+    uint64_t HeaderEnd = std::min<uint64_t>(End, sizeof(Header_));
+    if (Begin < HeaderEnd) {
+      memcpy(Buf, Header_ + Begin, HeaderEnd - Begin);
+    }
+    uint64_t StreamBegin = std::max<uint64_t>(Begin, sizeof(Header_));
+    if (StreamBegin < End) {
+      Stream_->read(Buf + (StreamBegin - Begin),
+                    StreamBegin - sizeof(Header_), End - sizeof(Header_));
+    }
+  }
+
+private:
+  std::unique_ptr<ZlibStream> Stream_;
+  uint8_t Header_[12];
+};
+
+} // namespace
+
+Error writeDebugCompanion(const Linker &L, ArrayRef<uint8_t> UUID,
+                          StringRef Path) {
+  std::vector<InputDebugInfo> Inputs;
+  for (const InputFile *IF : L.inputs()) {
+    InputDebugInfo In;
+    bool Any = false;
+    for (auto &IS : IF->sections()) {
+      if (!isDebugSection(*IS) || IS->getContents().empty()) {
+        continue;
+      }
+      auto *It = llvm::find(DebugSectionNames, IS->getSectName());
+      if (It != std::end(DebugSectionNames)) {
+        In.Sections[It - std::begin(DebugSectionNames)] = IS.get();
+        Any = true;
+      }
+    }
+    if (Any) {
+      Inputs.push_back(In);
+    }
+  }
+
+  // Each input's sections are appended, in input order, and split into
+  // blocks.
+  std::vector<std::vector<Block>> Blocks(DS_Count);
+  for (unsigned Kind = 0; Kind < DS_Count; ++Kind) {
+    uint64_t Base = 0;
+    for (InputDebugInfo &In : Inputs) {
+      In.Bases[Kind] = Base;
+      if (const InputSection *IS = In.Sections[Kind]) {
+        for (uint64_t B = 0; B < IS->size();
+             B += DefaultCompressionBlockSize) {
+          Blocks[Kind].push_back(
+              {&In, DebugSection(Kind), B,
+               std::min(IS->size(), B + DefaultCompressionBlockSize),
+               {0, 0}});
+        }
+        Base += IS->size();
+      }
+    }
+  }
+
+  // Walk every input's sections once to find where each of their blocks can
+  // start to be walked, so that blocks are rewritten independently.
+  std::vector<std::pair<unsigned, size_t>> Pieces;
+  for (unsigned Kind = 0; Kind < DS_Count; ++Kind) {
+    for (size_t I = 0; I < Blocks[Kind].size(); ++I) {
+      if (Blocks[Kind][I].Begin == 0) {
+        Pieces.push_back({Kind, I});
+      }
+    }
+  }
+  Scheduler::get().forEach(Pieces.size(), [&](size_t P) {
+    std::vector<Block> &KindBlocks = Blocks[Pieces[P].first];
+    Block *First = &KindBlocks[Pieces[P].second];
+    Block *End = KindBlocks.data() + KindBlocks.size();
+    Block *Next = First + 1;
+    ResumePoint Last = {0, 0};
+    auto Record = [&](ResumePoint R) {
+      for (; Next != End && Next->In == First->In && Next->Begin < R.Offset;
+           ++Next) {
+        Next->Resume = Last;
+      }
+      Last = R;
+    };
+    OffsetWalker(*First->In, First->Kind)
+        .walk({0, 0}, UINT64_MAX,
+              [](uint64_t, unsigned, DebugSection) {}, Record);
+    for (; Next != End && Next->In == First->In; ++Next) {
+      Next->Resume = Last;
+    }
+  });
+
+  Builder::File F;
+  F.setTriple(L.getTriple()).setFileType(MH_DSYM);
+  if (!UUID.empty()) {
+    F.addUUIDCommand(UUID);
+  }
+  BlockWriter W(L);
+  auto Seg = std::make_unique<Builder::SegmentCommand>("__DWARF");
+  for (unsigned Kind = 0; Kind < DS_Count; ++Kind) {
+    if (Blocks[Kind].empty()) {
+      continue;
+    }
+    const std::vector<Block> &KindBlocks = Blocks[Kind];
+    auto StreamOrErr = ZlibStream::create(
+        KindBlocks.size(), [&W, &KindBlocks](size_t I,
+                                             std::vector<uint8_t> &Buf) {
+          W.fill(KindBlocks[I], Buf);
+        });
+    if (auto Err = StreamOrErr.takeError()) {
+      return Err;
+    }
+    // __debug_info becomes .zdebug_info.
+    std::string Name =
+        (".zdebug_" + StringRef(DebugSectionNames[Kind]).drop_front(8)).str();
+    Seg->addSection(std::make_unique<Builder::Section>(
+        "__DWARF", Name, S_ATTR_DEBUG, 0,
+        std::make_unique<CompressedSectionChunk>(std::move(*StreamOrErr))));
+  }
+  F.addLoadCommand(std::move(Seg));
+  F.setWriter(std::make_unique<Builder::StreamingWriter>());
+  return F.buildAndWrite(Path.str());
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,40 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Linker;
+
+/// Write the debug info of the inputs of \c L to an MH_DSYM companion file at
+/// \c Path instead of the output. Each input's __DWARF sections are appended
+/// to the companion's section of the same name, with the offsets they hold
+/// into the input's other debug sections rebased to where those landed, and
+/// the addresses they hold relocated to where \c L put their targets.
+/// Accelerator tables, and the other sections which can't be merged by
+/// appending them, are left out: debuggers fall back to reading the DWARF.
+///
+/// Sections are compressed like GNU .zdebug sections, whose names they take
+/// so that LLVM's DWARF tools read them: "ZLIB", the uncompressed size as a
+/// big endian 64 bit number and then a zlib stream. Each section is a
+/// \c ZlibStream of blocks rewritten straight out of the mapped inputs and
+/// compressed once, so none of it is ever held in memory as a whole.
+///
+/// \param UUID The output's UUID, if it has one, so that debuggers can pair
+/// the two.
+Error writeDebugCompanion(const Linker &L, ArrayRef<uint8_t> UUID,
+                          StringRef Path);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
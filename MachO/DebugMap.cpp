@@ -0,0 +1,143 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/DebugMap.h"
+
+#include "MachO/File.h"
+#include "MachO/Layout.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/MachO.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// The directory and name of the first compile unit in \c F, which is what
+/// the N_SO stabs describe. Both are empty if \c F has no usable DWARF.
+std::pair<std::string, std::string> getSourceName(const File &F) {
+  auto ObjOrErr = object::ObjectFile::createMachOObjectFile(
+      F.getBuffer().getMemBufferRef());
+  if (!ObjOrErr) {
+    consumeError(ObjOrErr.takeError());
+    return {};
+  }
+  // Only the compile unit's name is needed, which is never relocated.
+  auto Ignore = [](Error Err) { consumeError(std::move(Err)); };
+  std::unique_ptr<DWARFContext> Ctx = DWARFContext::create(
+      **ObjOrErr, DWARFContext::ProcessDebugRelocations::Ignore, nullptr, "",
+      Ignore, Ignore);
+  if (Ctx->getNumCompileUnits() == 0) {
+    return {};
+  }
+  DWARFDie CU = Ctx->getUnitAtIndex(0)->getUnitDIE();
+  StringRef Name = dwarf::toStringRef(CU.find(dwarf::DW_AT_name));
+  StringRef Dir = dwarf::toStringRef(CU.find(dwarf::DW_AT_comp_dir));
+  if (Name.empty()) {
+    return {};
+  }
+  if (sys::path::is_absolute(Name)) {
+    Dir = sys::path::parent_path(Name);
+    Name = sys::path::filename(Name);
+  }
+  // The directory stab is told apart from the name by its trailing slash.
+  std::string DirName = Dir.str();
+  if (!DirName.empty() && DirName.back() != '/') {
+    DirName += '/';
+  }
+  return {DirName, Name.str()};
+}
+
+void buildUnit(const InputFile &IF, const SymbolTable &Symtab, const Layout &L,
+               DebugMapUnit &Unit) {
+  if (llvm::none_of(IF.sections(),
+                    [](const std::unique_ptr<InputSection> &IS) {
+                      return isDebugSection(*IS);
+                    })) {
+    return;
+  }
+  const File &F = IF.getFile();
+  std::string Dir, Name;
+  std::tie(Dir, Name) = getSourceName(F);
+  if (Name.empty()) {
+    return;
+  }
+
+  // The debugger finds the object by its absolute path and checks that it's
+  // the one that was linked by its modification time.
+  SmallString<256> Path(F.getPath());
+  sys::fs::make_absolute(Path);
+  sys::fs::file_status Status;
+  uint64_t MTime = 0;
+  if (!sys::fs::status(Path, Status)) {
+    MTime = sys::toTimeT(Status.getLastModificationTime());
+  }
+
+  auto Save = [&Unit](std::string S) -> StringRef {
+    Unit.Strings.push_back(std::move(S));
+    return Unit.Strings.back();
+  };
+  std::vector<Stab> &Stabs = Unit.Stabs;
+  Stabs.push_back({Save(std::move(Dir)), N_SO, NO_SECT, 0, 0});
+  Stabs.push_back({Save(std::move(Name)), N_SO, NO_SECT, 0, 0});
+  Stabs.push_back({Save(Path.str().str()), N_OSO, NO_SECT, 1, MTime});
+
+  for (const Symbol &FS : IF.symbols()) {
+    // External symbols are only described by the input defining them, and
+    // symbols folded into another input's atom by that input.
+    const Symbol *S = &Symtab.resolve(IF, FS);
+    if (!S->isDefined() || S->isTemporary()) {
+      continue;
+    }
+    const Atom &Leader = L.getLeader(*S->Definition);
+    if (&Leader.getSection().getFile() != &F ||
+        isDebugSection(Leader.getSection())) {
+      continue;
+    }
+    uint8_t Sect = L.getOutputSection(Leader)->getIndex();
+    uint64_t Addr = L.getAddr(*S);
+    if (Leader.getSection().isCode()) {
+      uint64_t Size = S->Definition->size() - S->Offset;
+      Stabs.push_back({"", N_BNSYM, Sect, 0, Addr});
+      Stabs.push_back({S->Name, N_FUN, Sect, 0, Addr});
+      Stabs.push_back({"", N_FUN, NO_SECT, 0, Size});
+      Stabs.push_back({"", N_ENSYM, Sect, 0, Size});
+    } else if (S->isExternal()) {
+      Stabs.push_back({S->Name, N_GSYM, NO_SECT, 0, 0});
+    } else {
+      Stabs.push_back({S->Name, N_STSYM, Sect, 0, Addr});
+    }
+  }
+  Stabs.push_back({"", N_SO, 1, 0, 0});
+}
+
+} // namespace
+
+bool isDebugSection(const InputSection &IS) {
+  return (IS.getFlags() & S_ATTR_DEBUG) || IS.getSegName() == "__DWARF";
+}
+
+std::vector<DebugMapUnit> buildDebugMap(ArrayRef<const InputFile *> Inputs,
+                                        const SymbolTable &Symtab,
+                                        const Layout &L) {
+  std::vector<DebugMapUnit> Units(Inputs.size());
+  Scheduler::get().forEach(Inputs.size(), [&](size_t I) {
+    buildUnit(*Inputs[I], Symtab, L, Units[I]);
+  });
+  return Units;
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,56 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/InputFile.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Layout;
+class SymbolTable;
+
+/// Whether \c IS holds debug info. Debug info is never copied to the output,
+/// the debug map tells the debugger where to find it instead.
+bool isDebugSection(const InputSection &IS);
+
+/// A stab, i.e. a debugging symbol table entry.
+struct Stab {
+  StringRef Name;
+  uint8_t Type;
+  uint8_t Sect;
+  uint16_t Desc;
+  uint64_t Value;
+};
+
+/// The stabs describing one input with debug info.
+struct DebugMapUnit {
+  std::vector<Stab> Stabs;
+  /// Names which aren't in any input, e.g. the input's absolute path.
+  std::deque<std::string> Strings;
+};
+
+/// Build the debug map like ld64 does: for every input with DWARF, an N_SO
+/// naming its source, an N_OSO pointing the debugger at the input itself and
+/// then an N_FUN or N_STSYM/N_GSYM for each of its symbols, giving their
+/// addresses in the output. Inputs are handled in parallel, but the result is
+/// in input order. \c Inputs must have been laid out by \c L, with their
+/// symbols resolved by \c Symtab.
+std::vector<DebugMapUnit> buildDebugMap(ArrayRef<const InputFile *> Inputs,
+                                        const SymbolTable &Symtab,
+                                        const Layout &L);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
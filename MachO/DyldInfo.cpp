@@ -0,0 +1,139 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/DyldInfo.h"
+
+#include "MachO/Layout.h"
+
+#include "llvm/BinaryFormat/MachO.h"
+#include "llvm/Support/LEB128.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+void appendULEB128(std::vector<uint8_t> &Out, uint64_t Value) {
+  uint8_t Buf[10];
+  unsigned Size = encodeULEB128(Value, Buf);
+  Out.insert(Out.end(), Buf, Buf + Size);
+}
+
+void appendSLEB128(std::vector<uint8_t> &Out, int64_t Value) {
+  uint8_t Buf[10];
+  unsigned Size = encodeSLEB128(Value, Buf);
+  Out.insert(Out.end(), Buf, Buf + Size);
+}
+
+void appendName(std::vector<uint8_t> &Out, StringRef Name) {
+  Out.insert(Out.end(), Name.begin(), Name.end());
+  Out.push_back(0);
+}
+
+/// Append the opcodes which set the symbol and dylib dyld binds \c B to, and
+/// the location it binds.
+void appendBinding(std::vector<uint8_t> &Out, const Binding &B) {
+  Out.push_back(BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | B.Loc.Segment);
+  appendULEB128(Out, B.Loc.Offset);
+  Out.push_back(BIND_OPCODE_SET_DYLIB_SPECIAL_IMM |
+                (uint8_t(BIND_SPECIAL_DYLIB_FLAT_LOOKUP) &
+                 BIND_IMMEDIATE_MASK));
+  Out.push_back(BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | B.Flags);
+  appendName(Out, B.Name);
+}
+
+} // namespace
+
+DyldLocation locate(const Layout &L, uint64_t Addr) {
+  ArrayRef<std::unique_ptr<OutputSegment>> Segments = L.segments();
+  for (uint32_t I = 0; I < Segments.size(); ++I) {
+    const OutputSegment &Seg = *Segments[I];
+    if (Addr >= Seg.getVMAddr() && Addr < Seg.getVMAddr() + Seg.getVMSize()) {
+      return {I, Addr - Seg.getVMAddr()};
+    }
+  }
+  llvm_unreachable("Address outside of every segment");
+}
+
+std::vector<uint8_t> encodeRebases(ArrayRef<DyldLocation> Locs) {
+  std::vector<uint8_t> Out;
+  if (Locs.empty()) {
+    return Out;
+  }
+  Out.push_back(REBASE_OPCODE_SET_TYPE_IMM | REBASE_TYPE_POINTER);
+  // Runs of consecutive pointers, e.g. a section of them, take one opcode.
+  for (size_t I = 0, End; I < Locs.size(); I = End) {
+    for (End = I + 1; End < Locs.size() &&
+                      Locs[End].Segment == Locs[I].Segment &&
+                      Locs[End].Offset == Locs[End - 1].Offset + 8;
+         ++End) {
+    }
+    Out.push_back(REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | Locs[I].Segment);
+    appendULEB128(Out, Locs[I].Offset);
+    Out.push_back(REBASE_OPCODE_DO_REBASE_ULEB_TIMES);
+    appendULEB128(Out, End - I);
+  }
+  Out.push_back(REBASE_OPCODE_DONE);
+  return Out;
+}
+
+std::vector<uint8_t> encodeBinds(ArrayRef<Binding> Bindings) {
+  std::vector<uint8_t> Out;
+  if (Bindings.empty()) {
+    return Out;
+  }
+  Out.push_back(BIND_OPCODE_SET_TYPE_IMM | BIND_TYPE_POINTER);
+  // The addend carries over from one bind to the next.
+  int64_t Addend = 0;
+  for (const Binding &B : Bindings) {
+    if (B.Addend != Addend) {
+      Out.push_back(BIND_OPCODE_SET_ADDEND_SLEB);
+      appendSLEB128(Out, B.Addend);
+      Addend = B.Addend;
+    }
+    appendBinding(Out, B);
+    Out.push_back(BIND_OPCODE_DO_BIND);
+  }
+  Out.push_back(BIND_OPCODE_DONE);
+  return Out;
+}
+
+std::vector<uint8_t> encodeWeakBinds(ArrayRef<Binding> Bindings) {
+  std::vector<uint8_t> Out;
+  if (Bindings.empty()) {
+    return Out;
+  }
+  // Weak binds don't name a dylib, every image is searched.
+  Out.push_back(BIND_OPCODE_SET_TYPE_IMM | BIND_TYPE_POINTER);
+  for (const Binding &B : Bindings) {
+    Out.push_back(BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | B.Flags);
+    appendName(Out, B.Name);
+    Out.push_back(BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | B.Loc.Segment);
+    appendULEB128(Out, B.Loc.Offset);
+    Out.push_back(BIND_OPCODE_DO_BIND);
+  }
+  Out.push_back(BIND_OPCODE_DONE);
+  return Out;
+}
+
+std::vector<uint8_t> encodeLazyBinds(ArrayRef<Binding> Bindings,
+                                     std::vector<uint32_t> &Offsets) {
+  std::vector<uint8_t> Out;
+  for (const Binding &B : Bindings) {
+    Offsets.push_back(Out.size());
+    appendBinding(Out, B);
+    Out.push_back(BIND_OPCODE_DO_BIND);
+    Out.push_back(BIND_OPCODE_DONE);
+  }
+  return Out;
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
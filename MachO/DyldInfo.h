@@ -0,0 +1,64 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Layout;
+
+/// A pointer in the output which dyld fixes up, given by the index of its
+/// segment among the output's LC_SEGMENT_64 commands and its offset in it.
+struct DyldLocation {
+  uint32_t Segment;
+  uint64_t Offset;
+};
+
+/// The location of the pointer at \c Addr in \c L, which must be finalized.
+DyldLocation locate(const Layout &L, uint64_t Addr);
+
+/// A pointer dyld sets to the address of a symbol in another image.
+struct Binding {
+  DyldLocation Loc;
+  StringRef Name;
+  /// The symbol's BIND_SYMBOL_FLAGS_*.
+  uint8_t Flags = 0;
+  /// What dyld adds to the symbol's address.
+  int64_t Addend = 0;
+};
+
+/// Encode the rebase opcodes sliding the pointers at \c Locs. Runs of
+/// consecutive pointers share opcodes, so \c Locs should be in address
+/// order. Returns an empty stream if there are none.
+std::vector<uint8_t> encodeRebases(ArrayRef<DyldLocation> Locs);
+
+/// Encode the bind opcodes for \c Bindings, which dyld binds at load time.
+/// The output doesn't record which dylib each import comes from, so symbols
+/// are looked up in every image. Returns an empty stream if there are none.
+std::vector<uint8_t> encodeBinds(ArrayRef<Binding> Bindings);
+
+/// Encode the weak bind opcodes for \c Bindings, which dyld binds to the
+/// first definition of their symbol in any image. Returns an empty stream if
+/// there are none.
+std::vector<uint8_t> encodeWeakBinds(ArrayRef<Binding> Bindings);
+
+/// Encode the lazy bind opcodes for \c Bindings, a record of its own for
+/// each, which dyld runs when the stub helper asks it to. The offset of each
+/// record in the stream is appended to \c Offsets.
+std::vector<uint8_t> encodeLazyBinds(ArrayRef<Binding> Bindings,
+                                     std::vector<uint32_t> &Offsets);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
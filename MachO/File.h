@@ -1,5 +1,7 @@
 // Copyright (c) 2020 Daniel Zimmerman
 
+#pragma once
+
 #include "llvm/ADT/Triple.h"
 #include "llvm/BinaryFormat/MachO.h"
 #include "llvm/Object/MachO.h"
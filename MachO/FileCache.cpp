@@ -0,0 +1,63 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/FileCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+Expected<FileCache::Cached> FileCache::get(StringRef Path, bool Parse) {
+  SmallString<256> AbsPath(Path);
+  if (auto EC = sys::fs::make_absolute(AbsPath)) {
+    return errorCodeToError(EC);
+  }
+  sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/true);
+
+  sys::fs::file_status Status;
+  if (auto EC = sys::fs::status(AbsPath, Status)) {
+    return errorCodeToError(EC);
+  }
+
+  Entry &E = Entries_[AbsPath];
+  if (E.F == nullptr || E.MTime != Status.getLastModificationTime() ||
+      E.Size != Status.getSize()) {
+    // The parse refers into the file it's replacing.
+    E.Input.reset();
+    E.Parsed = false;
+    // Load with the path as given so that diagnostics match the command line.
+    auto FOrErr = File::read(Path);
+    if (auto Err = FOrErr.takeError()) {
+      Entries_.erase(AbsPath);
+      return std::move(Err);
+    }
+    E.MTime = Status.getLastModificationTime();
+    E.Size = Status.getSize();
+    E.F = std::move(*FOrErr);
+    if (Journal_ != nullptr) {
+      *Journal_ << AbsPath << '\n';
+    }
+  }
+
+  if (Parse && !E.Parsed) {
+    E.Parsed = true;
+    auto IFOrErr = InputFile::create(*E.F);
+    if (IFOrErr) {
+      E.Input = std::move(*IFOrErr);
+    } else {
+      consumeError(IFOrErr.takeError());
+    }
+  }
+  return Cached{E.F.get(), E.Input.get()};
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/File.h"
+#include "MachO/InputFile.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+/// Loaded inputs which are kept around between links, e.g. by ald -daemon,
+/// along with their parses. Files are keyed by their absolute path and
+/// revalidated against their modification time and size whenever they're
+/// looked up, so an input which was rebuilt is loaded, and parsed, again.
+class FileCache {
+public:
+  /// A cached file, and its parse if it has one.
+  struct Cached {
+    const File *F;
+    const InputFile *Input;
+  };
+
+  /// Return the file at \c Path, loading it if it isn't cached or changed
+  /// since it was cached. With \c Parse the file is parsed too, unless it
+  /// already was. A file which doesn't parse is still returned, without a
+  /// parse, so that the link using it parses it and reports why. Both live
+  /// as long as this cache, or until the file is loaded again.
+  Expected<Cached> get(StringRef Path, bool Parse = false);
+
+  /// Write the absolute path of every file \c get loads from now on to \c OS,
+  /// one per line. Pass nullptr to stop.
+  void setJournal(raw_ostream *OS) { Journal_ = OS; }
+
+  size_t size() const { return Entries_.size(); }
+
+private:
+  struct Entry {
+    sys::TimePoint<> MTime;
+    uint64_t Size = 0;
+    std::unique_ptr<File> F;
+    /// Declared after \c F, which it refers to, so it's destroyed first.
+    std::unique_ptr<InputFile> Input;
+    /// Whether parsing \c F was tried, so a file which doesn't parse isn't
+    /// parsed over and over.
+    bool Parsed = false;
+  };
+
+  StringMap<Entry> Entries_;
+  raw_ostream *Journal_ = nullptr;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
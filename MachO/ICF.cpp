@@ -0,0 +1,322 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/ICF.h"
+
+#include "MachO/File.h"
+#include "MachO/Layout.h"
+#include "MachO/SymbolTable.h"
+
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/xxhash.h"
+
+#include <atomic>
+#include <numeric>
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// Branches only ever call their target, so they don't make its address
+/// significant.
+bool isBranch(const InputSection &IS, const Relocation &R) {
+  if (IS.getFile().getTriple().getArch() == Triple::aarch64) {
+    return R.Type == ARM64_RELOC_BRANCH26;
+  }
+  return R.Type == X86_64_RELOC_BRANCH;
+}
+
+class ICF {
+public:
+  ICF(ArrayRef<const InputFile *> Inputs, const SymbolTable &Symtab,
+      Layout &L, ICFLevel Level);
+
+  size_t run();
+
+private:
+  /// What the extern relocation \c R of \c A refers to.
+  const Symbol &getTarget_(const Atom &A, const Relocation &R) const {
+    return Symtab_.resolve(A.getSection().getInputFile(), *R.Sym);
+  }
+
+  bool equalsConstant_(const Atom &A, const Atom &B) const;
+  bool equalsVariable_(const Atom &A, const Atom &B) const;
+
+  /// Split the class occupying Order_[Begin, End) into runs of atoms which
+  /// are \c Equal to the first of the run, and record each run's new class in
+  /// the next generation of Classes_.
+  template <typename Pred>
+  bool segregate_(size_t Begin, size_t End, Pred Equal);
+
+  const SymbolTable &Symtab_;
+  Layout &Layout_;
+  /// The atoms which may be folded, in input order.
+  std::vector<const Atom *> Atoms_;
+  DenseMap<const Atom *, uint32_t> Index_;
+  /// Indices into Atoms_ with the members of each class next to each other.
+  std::vector<uint32_t> Order_;
+  /// The class of each atom, which is the position in Order_ of its class'
+  /// first member. Classes are double buffered so that every class can be
+  /// split in parallel while reading the previous generation.
+  std::vector<uint32_t> Classes_[2];
+  unsigned Current_ = 0;
+};
+
+ICF::ICF(ArrayRef<const InputFile *> Inputs, const SymbolTable &Symtab,
+         Layout &L, ICFLevel Level)
+    : Symtab_(Symtab), Layout_(L) {
+  // Atoms referenced other than by a branch might have their addresses
+  // compared, so safe folding leaves them alone. When a non-extern
+  // relocation's fixup can't be decoded every atom of its section is assumed
+  // to be referenced.
+  DenseSet<const Atom *> AddressTaken;
+  if (Level == ICFLevel::Safe) {
+    for (const InputFile *IF : Inputs) {
+      for (auto &IS : IF->sections()) {
+        for (const Relocation &R : IS->getRelocations()) {
+          if (isBranch(*IS, R)) {
+            continue;
+          }
+          if (R.Sym != nullptr) {
+            const Symbol &Target = Symtab.resolve(*IF, *R.Sym);
+            if (Target.isDefined()) {
+              AddressTaken.insert(&L.getLeader(*Target.Definition));
+            }
+          } else if (R.Sect != nullptr) {
+            const Atom *Target;
+            uint64_t Offset;
+            if (IS->decodeTarget(R, Target, Offset)) {
+              AddressTaken.insert(&L.getLeader(*Target));
+              continue;
+            }
+            for (const Atom &A : R.Sect->atoms()) {
+              AddressTaken.insert(&A);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for (const InputFile *IF : Inputs) {
+    for (auto &IS : IF->sections()) {
+      if (IS->isZeroFill() || IS->getSegName() != "__TEXT" ||
+          IS->getSectName() == "__eh_frame") {
+        continue;
+      }
+      // Read-only data is only ever accessed through its address.
+      if (!IS->isCode() && Level != ICFLevel::All) {
+        continue;
+      }
+      for (const Atom &A : IS->atoms()) {
+        if (A.size() != 0 && !L.isFolded(A) && !AddressTaken.count(&A)) {
+          Index_[&A] = Atoms_.size();
+          Atoms_.push_back(&A);
+        }
+      }
+    }
+  }
+}
+
+bool ICF::equalsConstant_(const Atom &A, const Atom &B) const {
+  const InputSection &SA = A.getSection();
+  const InputSection &SB = B.getSection();
+  if (A.size() != B.size() || A.getAlign() != B.getAlign() ||
+      SA.getFlags() != SB.getFlags() || SA.getSegName() != SB.getSegName() ||
+      SA.getSectName() != SB.getSectName() ||
+      A.getContents() != B.getContents()) {
+    return false;
+  }
+
+  ArrayRef<Relocation> RA = A.relocations();
+  ArrayRef<Relocation> RB = B.relocations();
+  if (RA.size() != RB.size()) {
+    return false;
+  }
+  for (size_t I = 0; I < RA.size(); ++I) {
+    const Relocation &X = RA[I];
+    const Relocation &Y = RB[I];
+    if (X.Offset - A.getOffset() != Y.Offset - B.getOffset() ||
+        X.Type != Y.Type || X.PCRel != Y.PCRel || X.Length != Y.Length ||
+        X.Addend != Y.Addend || (X.Sym == nullptr) != (Y.Sym == nullptr)) {
+      return false;
+    }
+    if (X.Sym == nullptr) {
+      // The bytes of a pc-relative fixup depend on where its atom is, so the
+      // same bytes can refer to different places. Compare where they point
+      // instead, and give up on fixups which can't be decoded.
+      const Atom *TX, *TY;
+      uint64_t OX, OY;
+      if (!A.getSection().decodeTarget(X, TX, OX) ||
+          !B.getSection().decodeTarget(Y, TY, OY) || OX != OY) {
+        return false;
+      }
+      continue;
+    }
+    // Distinct symbols are only equivalent if they're defined at the same
+    // offset of atoms which equalsVariable_ finds equivalent.
+    const Symbol &TX = getTarget_(A, X);
+    const Symbol &TY = getTarget_(B, Y);
+    if (&TX != &TY && (!TX.isDefined() || !TY.isDefined() ||
+                       TX.Offset != TY.Offset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ICF::equalsVariable_(const Atom &A, const Atom &B) const {
+  ArrayRef<Relocation> RA = A.relocations();
+  ArrayRef<Relocation> RB = B.relocations();
+  const std::vector<uint32_t> &Classes = Classes_[Current_];
+  for (size_t I = 0; I < RA.size(); ++I) {
+    const Atom *TA, *TB;
+    if (RA[I].Sym != nullptr) {
+      const Symbol &SA = getTarget_(A, RA[I]);
+      const Symbol &SB = getTarget_(B, RB[I]);
+      if (&SA == &SB) {
+        continue;
+      }
+      TA = SA.Definition;
+      TB = SB.Definition;
+    } else {
+      // equalsConstant_ made sure both decode, to the same offset.
+      uint64_t Offset;
+      A.getSection().decodeTarget(RA[I], TA, Offset);
+      B.getSection().decodeTarget(RB[I], TB, Offset);
+    }
+    TA = &Layout_.getLeader(*TA);
+    TB = &Layout_.getLeader(*TB);
+    if (TA == TB) {
+      continue;
+    }
+    auto IA = Index_.find(TA);
+    auto IB = Index_.find(TB);
+    if (IA == Index_.end() || IB == Index_.end() ||
+        Classes[IA->second] != Classes[IB->second]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Pred>
+bool ICF::segregate_(size_t Begin, size_t End, Pred Equal) {
+  std::vector<uint32_t> &Next = Classes_[Current_ ^ 1];
+  bool Split = false;
+  while (Begin < End) {
+    const Atom &Leader = *Atoms_[Order_[Begin]];
+    auto Mid = std::stable_partition(
+        Order_.begin() + Begin + 1, Order_.begin() + End,
+        [&](uint32_t I) { return Equal(Leader, *Atoms_[I]); });
+    size_t MidIdx = Mid - Order_.begin();
+    for (size_t I = Begin; I < MidIdx; ++I) {
+      Next[Order_[I]] = Begin;
+    }
+    Split |= MidIdx != End;
+    Begin = MidIdx;
+  }
+  return Split;
+}
+
+size_t ICF::run() {
+  if (Atoms_.size() < 2) {
+    return 0;
+  }
+
+  std::vector<uint64_t> Hashes(Atoms_.size());
+  Scheduler::get().forEach(Atoms_.size(), [&](size_t I) {
+    const Atom &A = *Atoms_[I];
+    Hashes[I] = hash_combine(xxHash64(A.getContents()), A.size(),
+                             A.getSection().getFlags(), A.relocations().size());
+  });
+
+  // Stable on the index so that the first member of every class is the first
+  // in input order, no matter how classes are split later on.
+  Order_.resize(Atoms_.size());
+  std::iota(Order_.begin(), Order_.end(), 0);
+  llvm::sort(Order_, [&](uint32_t LHS, uint32_t RHS) {
+    return std::make_pair(Hashes[LHS], LHS) < std::make_pair(Hashes[RHS], RHS);
+  });
+
+  auto ForEachClass = [&](auto Fn) {
+    const std::vector<uint32_t> &Classes = Classes_[Current_];
+    std::vector<std::pair<size_t, size_t>> Ranges;
+    for (size_t Begin = 0, End; Begin < Order_.size(); Begin = End) {
+      End = Begin + 1;
+      while (End < Order_.size() &&
+             Classes[Order_[End]] == Classes[Order_[Begin]]) {
+        ++End;
+      }
+      Ranges.emplace_back(Begin, End);
+    }
+    std::atomic<bool> Changed(false);
+    Scheduler::get().forEach(Ranges.size(), [&](size_t I) {
+      if (Fn(Ranges[I].first, Ranges[I].second)) {
+        Changed = true;
+      }
+    });
+    Current_ ^= 1;
+    return Changed.load();
+  };
+
+  // Start from atoms with the same hash and split off those whose contents
+  // differ, then keep splitting classes until every member's relocations
+  // refer to the same classes.
+  Classes_[0].resize(Atoms_.size());
+  Classes_[1].resize(Atoms_.size());
+  for (size_t I = 0; I < Order_.size(); ++I) {
+    Classes_[Current_][Order_[I]] = Hashes[Order_[I]] & 0xffffffff;
+  }
+  ForEachClass([&](size_t Begin, size_t End) {
+    return segregate_(Begin, End, [&](const Atom &A, const Atom &B) {
+      return equalsConstant_(A, B);
+    });
+  });
+  while (ForEachClass([&](size_t Begin, size_t End) {
+    return segregate_(Begin, End, [&](const Atom &A, const Atom &B) {
+      return equalsVariable_(A, B);
+    });
+  })) {
+  }
+
+  size_t Folded = 0;
+  const std::vector<uint32_t> &Classes = Classes_[Current_];
+  for (size_t Begin = 0, End; Begin < Order_.size(); Begin = End) {
+    const Atom &Leader = *Atoms_[Order_[Begin]];
+    for (End = Begin + 1; End < Order_.size() &&
+                          Classes[Order_[End]] == Classes[Order_[Begin]];
+         ++End) {
+      Layout_.fold(*Atoms_[Order_[End]], Leader);
+      ++Folded;
+    }
+  }
+  return Folded;
+}
+
+} // namespace
+
+size_t foldIdenticalAtoms(ArrayRef<const InputFile *> Inputs,
+                          const SymbolTable &Symtab, Layout &L,
+                          ICFLevel Level) {
+  if (Level == ICFLevel::None) {
+    return 0;
+  }
+  return ICF(Inputs, Symtab, L, Level).run();
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
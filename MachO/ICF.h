@@ -0,0 +1,43 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/InputFile.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Layout;
+class SymbolTable;
+
+enum class ICFLevel {
+  /// Don't fold anything.
+  None,
+  /// Only fold functions whose address is never taken, so that pointer
+  /// comparisons still tell them apart.
+  Safe,
+  /// Fold every identical function and piece of read-only data.
+  All,
+};
+
+/// Identical code folding: atoms of \c Inputs with the same contents whose
+/// relocations refer to equivalent targets are folded in \c L into the first
+/// of them in input order, so symbols they define end up at their leader.
+/// Atoms are first grouped by their contents, hashed in parallel, and those
+/// groups are then split until the targets of each member's relocations,
+/// resolved with \c Symtab, are in the same groups too. Returns the number of
+/// atoms folded away.
+size_t foldIdenticalAtoms(ArrayRef<const InputFile *> Inputs,
+                          const SymbolTable &Symtab, Layout &L,
+                          ICFLevel Level);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,449 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Imports.h"
+
+#include "MachO/DebugMap.h"
+#include "MachO/DyldInfo.h"
+#include "MachO/Layout.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Endian.h"
+
+#include <cstring>
+
+using namespace llvm::MachO;
+using namespace llvm::support::endian;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+enum class ImportKind { None, Stub, GOT, Pointer };
+
+/// What \c R, whose target resolved to \c S, needs to reach it. Only symbols
+/// which dyld could bind get stubs or GOT slots, i.e. undefined ones and
+/// external definitions.
+ImportKind classify(Triple::ArchType Arch, const Relocation &R,
+                    const Symbol *S) {
+  if (S == nullptr || (S->isDefined() && !S->isExternal())) {
+    return ImportKind::None;
+  }
+  // Pointers to imports, e.g. the thunks of thread-local variable
+  // descriptors, are bound where they are. Both architectures use type 0,
+  // *_RELOC_UNSIGNED, for them.
+  if (R.Type == 0 && !R.PCRel && R.Length == 3) {
+    return S->isDefined() ? ImportKind::None : ImportKind::Pointer;
+  }
+  if (Arch == Triple::x86_64) {
+    switch (R.Type) {
+    case X86_64_RELOC_BRANCH:
+      return S->isDefined() ? ImportKind::None : ImportKind::Stub;
+    case X86_64_RELOC_GOT_LOAD:
+    case X86_64_RELOC_GOT:
+      return ImportKind::GOT;
+    default:
+      return ImportKind::None;
+    }
+  }
+  switch (R.Type) {
+  case ARM64_RELOC_BRANCH26:
+    return S->isDefined() ? ImportKind::None : ImportKind::Stub;
+  case ARM64_RELOC_GOT_LOAD_PAGE21:
+  case ARM64_RELOC_GOT_LOAD_PAGEOFF12:
+  case ARM64_RELOC_POINTER_TO_GOT:
+    return ImportKind::GOT;
+  default:
+    return ImportKind::None;
+  }
+}
+
+/// The imports one input needs.
+struct ImportSets {
+  DenseSet<const Symbol *> Stubs;
+  DenseSet<const Symbol *> GOT;
+};
+
+/// Merge the \c Member sets of \c Sets into a list sorted by name. Names are
+/// unique since every symbol which can be imported is interned.
+std::vector<const Symbol *>
+merge(ArrayRef<ImportSets> Sets,
+      DenseSet<const Symbol *> ImportSets::*Member) {
+  std::vector<const Symbol *> Merged;
+  for (const ImportSets &IS : Sets) {
+    Merged.insert(Merged.end(), (IS.*Member).begin(), (IS.*Member).end());
+  }
+  llvm::sort(Merged, [](const Symbol *A, const Symbol *B) {
+    return A->Name < B->Name;
+  });
+  Merged.erase(std::unique(Merged.begin(), Merged.end()), Merged.end());
+  return Merged;
+}
+
+section_64 makeHeader(StringRef SegName, StringRef SectName, uint32_t Flags,
+                      uint32_t Align, uint64_t Size, uint32_t Reserved1 = 0,
+                      uint32_t Reserved2 = 0) {
+  section_64 Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.segname, SegName.data(),
+          std::min(SegName.size(), sizeof(Header.segname)));
+  strncpy(Header.sectname, SectName.data(),
+          std::min(SectName.size(), sizeof(Header.sectname)));
+  Header.flags = Flags;
+  Header.align = Align;
+  Header.size = Size;
+  Header.reserved1 = Reserved1;
+  Header.reserved2 = Reserved2;
+  return Header;
+}
+
+/// Set the immediate of the adrp \c Insn at \c PC to the page of \c Target.
+uint32_t encodeADRP(uint32_t Insn, uint64_t PC, uint64_t Target) {
+  int64_t Pages = int64_t(Target >> 12) - int64_t(PC >> 12);
+  return Insn | (uint32_t(Pages) & 0x3) << 29 |
+         (uint32_t(Pages >> 2) & 0x7ffff) << 5;
+}
+
+} // namespace
+
+void ImportSections::scan(ArrayRef<const InputFile *> Inputs,
+                          SymbolTable &Symtab, const Layout &L) {
+  std::vector<ImportSets> Sets(Inputs.size());
+  Fixups_.assign(Inputs.size(), {});
+  Pointers_.assign(Inputs.size(), {});
+  Scheduler::get().forEach(Inputs.size(), [&](size_t I) {
+    ImportSets &Set = Sets[I];
+    for (auto &IS : Inputs[I]->sections()) {
+      if (isDebugSection(*IS)) {
+        continue;
+      }
+      for (const Atom &A : IS->atoms()) {
+        // Folded atoms aren't in the output, their leaders speak for them.
+        if (L.isFolded(A)) {
+          continue;
+        }
+        for (const Relocation &R : A.relocations()) {
+          const Symbol *S =
+              R.Sym != nullptr ? &Symtab.resolve(*Inputs[I], *R.Sym) : nullptr;
+          switch (classify(Arch_, R, S)) {
+          case ImportKind::Stub:
+            Set.Stubs.insert(S);
+            Fixups_[I].push_back({&A, &R, S, /*IsStub=*/true});
+            break;
+          case ImportKind::GOT:
+            Set.GOT.insert(S);
+            Fixups_[I].push_back({&A, &R, S, /*IsStub=*/false});
+            break;
+          case ImportKind::Pointer:
+            Pointers_[I].push_back({&A, &R, S, /*IsStub=*/false});
+            break;
+          case ImportKind::None:
+            break;
+          }
+        }
+      }
+    }
+  });
+  Stubs_ = merge(Sets, &ImportSets::Stubs);
+  // Stub helpers call into dyld through its binder's GOT slot.
+  if (!Stubs_.empty()) {
+    Binder_ = &Symtab.intern("dyld_stub_binder");
+    Sets.emplace_back();
+    Sets.back().GOT.insert(Binder_);
+  }
+  GOT_ = merge(Sets, &ImportSets::GOT);
+
+  for (size_t I = 0; I < Stubs_.size(); ++I) {
+    StubSlots_[Stubs_[I]] = I;
+  }
+  for (size_t I = 0; I < GOT_.size(); ++I) {
+    GOTSlots_[GOT_[I]] = I;
+  }
+}
+
+uint32_t ImportSections::getStubSize() const {
+  // jmp *ptr(%rip) or adrp, ldr, br.
+  return Arch_ == Triple::x86_64 ? 6 : 12;
+}
+
+uint32_t ImportSections::getStubHelperHeaderSize_() const {
+  return Arch_ == Triple::x86_64 ? 16 : 24;
+}
+
+uint32_t ImportSections::getStubHelperEntrySize_() const {
+  return Arch_ == Triple::x86_64 ? 10 : 12;
+}
+
+void ImportSections::addTo(Layout &L) {
+  // Stubs and pointers are entries of the indirect symbol table, in the order
+  // stubs, lazy pointers and GOT slots.
+  if (!Stubs_.empty()) {
+    StubsData_.assign(Stubs_.size() * getStubSize(), 0);
+    StubsHeader_ = makeHeader(
+        "__TEXT", "__stubs",
+        S_SYMBOL_STUBS | S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS,
+        Arch_ == Triple::x86_64 ? 1 : 2, StubsData_.size(), 0,
+        getStubSize());
+    StubsSection_ = std::make_unique<InputSection>(StubsHeader_, StubsData_);
+    L.addInputSection(*StubsSection_);
+
+    StubHelperData_.assign(getStubHelperHeaderSize_() +
+                               Stubs_.size() * getStubHelperEntrySize_(),
+                           0);
+    StubHelperHeader_ = makeHeader(
+        "__TEXT", "__stub_helper",
+        S_REGULAR | S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS,
+        2, StubHelperData_.size());
+    StubHelperSection_ =
+        std::make_unique<InputSection>(StubHelperHeader_, StubHelperData_);
+    L.addInputSection(*StubHelperSection_);
+
+    LazyPtrsData_.assign(Stubs_.size() * sizeof(uint64_t), 0);
+    LazyPtrsHeader_ = makeHeader("__DATA", "__la_symbol_ptr",
+                                 S_LAZY_SYMBOL_POINTERS, 3,
+                                 LazyPtrsData_.size(), Stubs_.size());
+    LazyPtrsSection_ =
+        std::make_unique<InputSection>(LazyPtrsHeader_, LazyPtrsData_);
+    L.addInputSection(*LazyPtrsSection_);
+
+    // The stub helper hands dyld this word to identify the image.
+    DyldPrivateData_.assign(sizeof(uint64_t), 0);
+    DyldPrivateHeader_ = makeHeader("__DATA", "__data", S_REGULAR, 3,
+                                    DyldPrivateData_.size());
+    DyldPrivateSection_ =
+        std::make_unique<InputSection>(DyldPrivateHeader_, DyldPrivateData_);
+    L.addInputSection(*DyldPrivateSection_);
+  }
+  if (!GOT_.empty()) {
+    GOTData_.assign(GOT_.size() * sizeof(uint64_t), 0);
+    GOTHeader_ = makeHeader("__DATA_CONST", "__got",
+                            S_NON_LAZY_SYMBOL_POINTERS, 3, GOTData_.size(),
+                            2 * Stubs_.size());
+    GOTSection_ = std::make_unique<InputSection>(GOTHeader_, GOTData_);
+    L.addInputSection(*GOTSection_);
+  }
+}
+
+uint64_t ImportSections::getStubAddr(size_t Slot) const {
+  return StubsAddr_ + Slot * getStubSize();
+}
+
+uint64_t ImportSections::getGOTAddr(size_t Slot) const {
+  return GOTAddr_ + Slot * sizeof(uint64_t);
+}
+
+void ImportSections::writeStub_(uint8_t *Buf, uint64_t StubAddr,
+                                uint64_t PtrAddr) const {
+  if (Arch_ == Triple::x86_64) {
+    Buf[0] = 0xff;
+    Buf[1] = 0x25;
+    write32le(Buf + 2, uint32_t(PtrAddr - (StubAddr + 6)));
+    return;
+  }
+  // adrp x16, ptr@page; ldr x16, [x16, ptr@pageoff]; br x16
+  write32le(Buf, encodeADRP(0x90000010, StubAddr, PtrAddr));
+  write32le(Buf + 4, 0xf9400210 | uint32_t((PtrAddr & 0xfff) / 8) << 10);
+  write32le(Buf + 8, 0xd61f0200);
+}
+
+void ImportSections::writeStubHelper_(const Layout &L,
+                                      ArrayRef<uint32_t> LazyBindOffsets) {
+  uint8_t *Buf = StubHelperData_.data();
+  uint64_t BinderAddr = getGOTAddr(GOTSlots_.lookup(Binder_));
+  if (Arch_ == Triple::x86_64) {
+    // leaq __dyld_private(%rip), %r11; pushq %r11;
+    // jmpq *dyld_stub_binder@GOTPCREL(%rip); nop
+    const uint8_t Header[] = {0x4c, 0x8d, 0x1d, 0, 0, 0, 0, 0x41,
+                              0x53, 0xff, 0x25, 0, 0, 0, 0, 0x90};
+    memcpy(Buf, Header, sizeof(Header));
+    write32le(Buf + 3, uint32_t(DyldPrivateAddr_ - (StubHelperAddr_ + 7)));
+    write32le(Buf + 11, uint32_t(BinderAddr - (StubHelperAddr_ + 15)));
+  } else {
+    // adrp x17, __dyld_private@page; add x17, x17, __dyld_private@pageoff;
+    // stp x16, x17, [sp, #-16]!; adrp x16, binder@gotpage;
+    // ldr x16, [x16, binder@gotpageoff]; br x16
+    write32le(Buf, encodeADRP(0x90000011, StubHelperAddr_, DyldPrivateAddr_));
+    write32le(Buf + 4,
+              0x91000231 | uint32_t(DyldPrivateAddr_ & 0xfff) << 10);
+    write32le(Buf + 8, 0xa9bf47f0);
+    write32le(Buf + 12,
+              encodeADRP(0x90000010, StubHelperAddr_ + 12, BinderAddr));
+    write32le(Buf + 16, 0xf9400210 | uint32_t((BinderAddr & 0xfff) / 8) << 10);
+    write32le(Buf + 20, 0xd61f0200);
+  }
+
+  // Every entry pushes the offset of its import's lazy bind opcodes and
+  // jumps to the header.
+  for (size_t I = 0; I < Stubs_.size(); ++I) {
+    uint64_t Offset =
+        getStubHelperHeaderSize_() + I * getStubHelperEntrySize_();
+    uint8_t *Entry = Buf + Offset;
+    uint64_t EntryAddr = StubHelperAddr_ + Offset;
+    if (Arch_ == Triple::x86_64) {
+      // pushq $offset; jmp header
+      Entry[0] = 0x68;
+      write32le(Entry + 1, LazyBindOffsets[I]);
+      Entry[5] = 0xe9;
+      write32le(Entry + 6, uint32_t(StubHelperAddr_ - (EntryAddr + 10)));
+    } else {
+      // ldr w16, 1f; b header; 1: .long offset
+      write32le(Entry, 0x18000050);
+      write32le(Entry + 4,
+                0x14000000 | (uint32_t((StubHelperAddr_ - (EntryAddr + 4)) >>
+                                       2) &
+                              0x3ffffff));
+      write32le(Entry + 8, LazyBindOffsets[I]);
+    }
+    write64le(LazyPtrsData_.data() + I * sizeof(uint64_t), EntryAddr);
+  }
+}
+
+bool ImportSections::redirect_(const Fixup &F, uint64_t FixupAddr,
+                               uint64_t Target, Patch &P) const {
+  const Relocation &R = *F.R;
+  if (Arch_ == Triple::x86_64) {
+    // Calls, GOT loads and GOT references in data are all 32 bit
+    // displacements from the end of the fixup, plus what the fixup holds.
+    if (!R.PCRel || R.Length != 2) {
+      return false;
+    }
+    int32_t Addend = read32le(P.Bytes);
+    write32le(P.Bytes, uint32_t(Target + Addend - (FixupAddr + 4)));
+    return true;
+  }
+
+  uint32_t Insn = read32le(P.Bytes);
+  switch (R.Type) {
+  case ARM64_RELOC_BRANCH26:
+    write32le(P.Bytes, (Insn & 0xfc000000) |
+                           (uint32_t((Target - FixupAddr) >> 2) & 0x3ffffff));
+    return true;
+  case ARM64_RELOC_GOT_LOAD_PAGE21:
+    write32le(P.Bytes, encodeADRP(Insn & 0x9f00001f, FixupAddr, Target));
+    return true;
+  case ARM64_RELOC_GOT_LOAD_PAGEOFF12:
+    // ldr xd, [xn, slot@pageoff], with the offset scaled by the slot size.
+    write32le(P.Bytes,
+              (Insn & 0xffc003ff) | uint32_t((Target & 0xfff) / 8) << 10);
+    return true;
+  case ARM64_RELOC_POINTER_TO_GOT:
+    if (!R.PCRel || R.Length != 2) {
+      return false;
+    }
+    write32le(P.Bytes, uint32_t(Target - FixupAddr));
+    return true;
+  default:
+    return false;
+  }
+}
+
+void ImportSections::finalize(Layout &L) {
+  if (StubsSection_) {
+    StubsAddr_ = L.getAddr(StubsSection_->atoms().front());
+    StubHelperAddr_ = L.getAddr(StubHelperSection_->atoms().front());
+    LazyPtrsAddr_ = L.getAddr(LazyPtrsSection_->atoms().front());
+    DyldPrivateAddr_ = L.getAddr(DyldPrivateSection_->atoms().front());
+  }
+  if (GOTSection_) {
+    GOTAddr_ = L.getAddr(GOTSection_->atoms().front());
+  }
+
+  // Lazy pointers start out at their stub helper entries, so they're slid
+  // like GOT slots of definitions, which hold their addresses.
+  std::vector<DyldLocation> Rebases;
+  std::vector<Binding> Binds;
+  std::vector<Binding> WeakBinds;
+  std::vector<Binding> LazyBinds;
+  for (size_t I = 0; I < Stubs_.size(); ++I) {
+    DyldLocation Loc = locate(L, LazyPtrsAddr_ + I * sizeof(uint64_t));
+    writeStub_(StubsData_.data() + I * getStubSize(), getStubAddr(I),
+               LazyPtrsAddr_ + I * sizeof(uint64_t));
+    Rebases.push_back(Loc);
+    LazyBinds.push_back({Loc, Stubs_[I]->Name});
+  }
+  for (size_t I = 0; I < GOT_.size(); ++I) {
+    DyldLocation Loc = locate(L, getGOTAddr(I));
+    if (GOT_[I]->isDefined()) {
+      write64le(GOTData_.data() + I * sizeof(uint64_t), L.getAddr(*GOT_[I]));
+      Rebases.push_back(Loc);
+      // Another image's definition may win over an exported weak one.
+      if (GOT_[I]->isWeakDefinition()) {
+        WeakBinds.push_back({Loc, GOT_[I]->Name});
+      }
+    } else {
+      Binds.push_back({Loc, GOT_[I]->Name});
+    }
+  }
+  // The pointer's contents are the addend.
+  for (const std::vector<Fixup> &Pointers : Pointers_) {
+    for (const Fixup &F : Pointers) {
+      uint64_t Offset = F.R->Offset - F.A->getOffset();
+      ArrayRef<uint8_t> Contents = F.A->getContents();
+      if (Offset + sizeof(uint64_t) > Contents.size()) {
+        continue;
+      }
+      Binds.push_back({locate(L, L.getAddr(*F.A) + Offset), F.S->Name,
+                       /*Flags=*/0,
+                       int64_t(read64le(Contents.data() + Offset))});
+    }
+  }
+  llvm::sort(Rebases, [](const DyldLocation &LHS, const DyldLocation &RHS) {
+    return std::make_pair(LHS.Segment, LHS.Offset) <
+           std::make_pair(RHS.Segment, RHS.Offset);
+  });
+  RebaseInfo_ = encodeRebases(Rebases);
+  BindInfo_ = encodeBinds(Binds);
+  WeakBindInfo_ = encodeWeakBinds(WeakBinds);
+  std::vector<uint32_t> LazyBindOffsets;
+  LazyBindInfo_ = encodeLazyBinds(LazyBinds, LazyBindOffsets);
+  if (StubHelperSection_) {
+    writeStubHelper_(L, LazyBindOffsets);
+  }
+
+  std::vector<std::pair<const Atom *, Patch>> Patches;
+  for (const std::vector<Fixup> &Fixups : Fixups_) {
+    for (const Fixup &F : Fixups) {
+      uint64_t Offset = F.R->Offset - F.A->getOffset();
+      ArrayRef<uint8_t> Contents = F.A->getContents();
+      if (Offset + 4 > Contents.size()) {
+        continue;
+      }
+      uint64_t Target = F.IsStub ? getStubAddr(StubSlots_.lookup(F.S))
+                                 : getGOTAddr(GOTSlots_.lookup(F.S));
+      Patch P;
+      P.Offset = Offset;
+      P.Size = 4;
+      memcpy(P.Bytes, Contents.data() + Offset, P.Size);
+      if (redirect_(F, L.getAddr(*F.A) + Offset, Target, P)) {
+        Patches.emplace_back(F.A, P);
+      }
+    }
+  }
+  L.addPatches(Patches);
+}
+
+std::vector<uint32_t> ImportSections::getIndirectSymbols(
+    const DenseMap<const Symbol *, uint32_t> &Indices) const {
+  std::vector<uint32_t> Indirect;
+  Indirect.reserve(2 * Stubs_.size() + GOT_.size());
+  for (unsigned Pass = 0; Pass < 2; ++Pass) {
+    for (const Symbol *S : Stubs_) {
+      Indirect.push_back(Indices.lookup(S));
+    }
+  }
+  for (const Symbol *S : GOT_) {
+    Indirect.push_back(Indices.lookup(S));
+  }
+  return Indirect;
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,146 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/InputFile.h"
+#include "MachO/Layout.h"
+#include "MachO/SymbolTable.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/BinaryFormat/MachO.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+/// The sections through which the output reaches symbols that dyld binds at
+/// load time: a stub in __TEXT,__stubs for every import that's called, which
+/// jumps through the import's pointer in __DATA,__la_symbol_ptr, and a slot in
+/// __DATA_CONST,__got for every symbol that's loaded through the GOT. Lazy
+/// pointers start out pointing into __TEXT,__stub_helper, which has dyld bind
+/// the import on its first call, through the GOT slot of dyld_stub_binder.
+class ImportSections {
+public:
+  explicit ImportSections(const Triple &T) : Arch_(T.getArch()) {}
+
+  /// Find the stubs and GOT slots the relocations of \c Inputs need, with
+  /// symbols resolved by \c Symtab, and remember those relocations so that
+  /// they can be redirected to them, along with pointers to imports in data
+  /// for dyld to bind. Atoms folded in \c L are skipped. Inputs
+  /// are scanned in parallel, each into sets of its own so that no lock is
+  /// taken per relocation. The sets are merged and sorted by name once, so
+  /// slots don't depend on how the work was scheduled. dyld_stub_binder is
+  /// added to \c Symtab when there are stubs.
+  void scan(ArrayRef<const InputFile *> Inputs, SymbolTable &Symtab,
+            const Layout &L);
+
+  /// Add the sections which have any entries to \c L, before it's finalized.
+  void addTo(Layout &L);
+
+  /// Fill in the sections' contents and the opcodes dyld binds them with
+  /// once \c L has given them addresses, and patch the relocations found by
+  /// \c scan to go through them.
+  void finalize(Layout &L);
+
+  /// The symbols with a stub, in slot order.
+  ArrayRef<const Symbol *> stubs() const { return Stubs_; }
+
+  /// The symbols with a GOT slot, in slot order.
+  ArrayRef<const Symbol *> got() const { return GOT_; }
+
+  /// The address of the stub in \c Slot. Only valid after layout.
+  uint64_t getStubAddr(size_t Slot) const;
+
+  /// The address of the GOT slot \c Slot. Only valid after layout.
+  uint64_t getGOTAddr(size_t Slot) const;
+
+  /// The size in bytes of each stub.
+  uint32_t getStubSize() const;
+
+  /// The opcodes sliding the pointers to the output's own addresses, i.e.
+  /// lazy pointers and GOT slots of definitions. Only valid after
+  /// \c finalize.
+  ArrayRef<uint8_t> getRebaseInfo() const { return RebaseInfo_; }
+
+  /// The opcodes binding the GOT slots of imports and the inputs' pointers
+  /// to them.
+  ArrayRef<uint8_t> getBindInfo() const { return BindInfo_; }
+
+  /// The opcodes binding the GOT slots of exported weak definitions to the
+  /// definition dyld picks among every image's.
+  ArrayRef<uint8_t> getWeakBindInfo() const { return WeakBindInfo_; }
+
+  /// The opcodes binding lazy pointers, which stub helpers refer to.
+  ArrayRef<uint8_t> getLazyBindInfo() const { return LazyBindInfo_; }
+
+  /// The symbol table index of the symbol of each stub, lazy pointer and GOT
+  /// slot, in that order, given the index of every symbol with one.
+  std::vector<uint32_t>
+  getIndirectSymbols(const DenseMap<const Symbol *, uint32_t> &Indices) const;
+
+private:
+  /// A relocation which is redirected to a stub or GOT slot, or a pointer
+  /// which is bound.
+  struct Fixup {
+    const Atom *A;
+    const Relocation *R;
+    const Symbol *S;
+    bool IsStub;
+  };
+
+  void writeStub_(uint8_t *Buf, uint64_t StubAddr, uint64_t PtrAddr) const;
+  void writeStubHelper_(const Layout &L, ArrayRef<uint32_t> LazyBindOffsets);
+  uint32_t getStubHelperHeaderSize_() const;
+  uint32_t getStubHelperEntrySize_() const;
+  /// Fill in \c P, which holds the original bytes of \c F's fixup, to reach
+  /// \c Target from \c FixupAddr. Returns false if it isn't understood.
+  bool redirect_(const Fixup &F, uint64_t FixupAddr, uint64_t Target,
+                 Patch &P) const;
+
+  Triple::ArchType Arch_;
+  uint64_t StubsAddr_ = 0;
+  uint64_t StubHelperAddr_ = 0;
+  uint64_t LazyPtrsAddr_ = 0;
+  uint64_t GOTAddr_ = 0;
+  uint64_t DyldPrivateAddr_ = 0;
+  std::vector<const Symbol *> Stubs_;
+  std::vector<const Symbol *> GOT_;
+  DenseMap<const Symbol *, uint32_t> StubSlots_;
+  DenseMap<const Symbol *, uint32_t> GOTSlots_;
+  const Symbol *Binder_ = nullptr;
+  std::vector<std::vector<Fixup>> Fixups_;
+  /// Pointers in the inputs' data to imports, which dyld binds in place.
+  std::vector<std::vector<Fixup>> Pointers_;
+  ::llvm::MachO::section_64 StubsHeader_;
+  ::llvm::MachO::section_64 StubHelperHeader_;
+  ::llvm::MachO::section_64 LazyPtrsHeader_;
+  ::llvm::MachO::section_64 DyldPrivateHeader_;
+  ::llvm::MachO::section_64 GOTHeader_;
+  std::vector<uint8_t> StubsData_;
+  std::vector<uint8_t> StubHelperData_;
+  std::vector<uint8_t> LazyPtrsData_;
+  std::vector<uint8_t> DyldPrivateData_;
+  std::vector<uint8_t> GOTData_;
+  std::unique_ptr<InputSection> StubsSection_;
+  std::unique_ptr<InputSection> StubHelperSection_;
+  std::unique_ptr<InputSection> LazyPtrsSection_;
+  std::unique_ptr<InputSection> DyldPrivateSection_;
+  std::unique_ptr<InputSection> GOTSection_;
+  std::vector<uint8_t> RebaseInfo_;
+  std::vector<uint8_t> BindInfo_;
+  std::vector<uint8_t> WeakBindInfo_;
+  std::vector<uint8_t> LazyBindInfo_;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
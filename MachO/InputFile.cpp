@@ -0,0 +1,420 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/InputFile.h"
+
+#include "MachO/File.h"
+#include "MachO/Visitor.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+ArrayRef<uint8_t> Atom::getContents() const {
+  if (Section_->isZeroFill()) {
+    return ArrayRef<uint8_t>();
+  }
+  return Section_->getContents().slice(Offset_, Size_);
+}
+
+ArrayRef<Relocation> Atom::relocations() const {
+  return Section_->getRelocations().slice(RelocBegin_,
+                                          RelocEnd_ - RelocBegin_);
+}
+
+InputSection::InputSection(const section_64 &Header,
+                           ArrayRef<uint8_t> Contents)
+    : Input_(nullptr), Header_(&Header), Contents_(Contents) {
+  split_({});
+}
+
+const File &InputSection::getFile() const { return getInputFile().getFile(); }
+
+StringRef InputSection::getSegName() const {
+  return StringRef(Header_->segname,
+                   strnlen(Header_->segname, sizeof(Header_->segname)));
+}
+
+StringRef InputSection::getSectName() const {
+  return StringRef(Header_->sectname,
+                   strnlen(Header_->sectname, sizeof(Header_->sectname)));
+}
+
+bool InputSection::isZeroFill() const {
+  switch (getType()) {
+  case S_ZEROFILL:
+  case S_GB_ZEROFILL:
+  case S_THREAD_LOCAL_ZEROFILL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const Atom &InputSection::getAtomAt(uint64_t Offset) const {
+  assert(!Atoms_.empty() && "Section hasn't been split");
+  auto Iter = llvm::partition_point(
+      Atoms_, [Offset](const Atom &A) { return A.getOffset() <= Offset; });
+  return *std::prev(Iter);
+}
+
+bool InputSection::decodeTarget(const Relocation &R, const Atom *&Target,
+                                uint64_t &Offset) const {
+  assert(R.Sym == nullptr && R.Sect != nullptr && "Not a section relocation");
+  if (isZeroFill() || R.Offset + (1u << R.Length) > size()) {
+    return false;
+  }
+  const uint8_t *Loc = Contents_.data() + R.Offset;
+  // The address of the fixup's end, which pc-relative fixups are relative
+  // to. x86_64's SIGNED_n fixups are followed by an n byte immediate.
+  uint64_t PC = getAddr() + R.Offset + 4;
+  uint64_t Addr;
+  bool IsX86 = getFile().getTriple().getArch() == Triple::x86_64;
+  if (R.Type == 0 && !R.PCRel && R.Length == 3) {
+    // Both architectures use type 0, *_RELOC_UNSIGNED, for pointers.
+    Addr = support::endian::read64le(Loc);
+  } else if (IsX86 && R.Type == X86_64_RELOC_UNSIGNED && !R.PCRel &&
+             R.Length == 2) {
+    Addr = support::endian::read32le(Loc);
+  } else if (IsX86 && R.PCRel && R.Length == 2) {
+    int32_t Disp = support::endian::read32le(Loc);
+    switch (R.Type) {
+    case X86_64_RELOC_SIGNED:
+    case X86_64_RELOC_BRANCH:
+      Addr = PC + Disp;
+      break;
+    case X86_64_RELOC_SIGNED_1:
+      Addr = PC + 1 + Disp;
+      break;
+    case X86_64_RELOC_SIGNED_2:
+      Addr = PC + 2 + Disp;
+      break;
+    case X86_64_RELOC_SIGNED_4:
+      Addr = PC + 4 + Disp;
+      break;
+    default:
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  if (Addr < R.Sect->getAddr() ||
+      Addr >= R.Sect->getAddr() + R.Sect->size()) {
+    return false;
+  }
+  Target = &R.Sect->getAtomAt(Addr - R.Sect->getAddr());
+  Offset = Addr - R.Sect->getAddr() - Target->getOffset();
+  return true;
+}
+
+void InputSection::split_(ArrayRef<uint64_t> Offsets) {
+  assert(Offsets.empty() || Offsets.front() == 0);
+  // An empty section still gets an atom so symbols in it have a definition.
+  if (Offsets.empty()) {
+    Atoms_.emplace_back(*this, 0, size(), getAlign());
+    return;
+  }
+
+  Atoms_.reserve(Offsets.size());
+  for (size_t I = 0; I < Offsets.size(); ++I) {
+    uint64_t Begin = Offsets[I];
+    uint64_t End = I + 1 < Offsets.size() ? Offsets[I + 1] : size();
+    // An atom can be no more aligned than its address in the input.
+    uint64_t Addr = getAddr() + Begin;
+    uint32_t Align =
+        Addr == 0 ? getAlign()
+                  : std::min<uint32_t>(getAlign(), countTrailingZeros(Addr));
+    Atoms_.emplace_back(*this, Begin, End - Begin, Align);
+  }
+}
+
+namespace {
+
+Error createParseError(const Twine &Message) {
+  return make_error<StringError>(Message, inconvertibleErrorCode());
+}
+
+bool inBounds(ArrayRef<uint8_t> Buffer, uint64_t Offset, uint64_t Size) {
+  return Offset <= Buffer.size() && Size <= Buffer.size() - Offset;
+}
+
+/// Collects the sections and symbol table of an input.
+class InputCollector : public LCSegVisitor {
+public:
+  std::vector<const section_64 *> Sections;
+  const symtab_command *Symtab = nullptr;
+
+protected:
+  void visitSection(const File &, const segment_command_64 *,
+                    const section_64 *Sect) override {
+    Sections.push_back(Sect);
+  }
+
+  void visit_LC_SYMTAB(const File &, const symtab_command *Cmd) override {
+    Symtab = Cmd;
+  }
+};
+
+/// Whether resolving thread-local variables rewrites \c R of \c IS.
+bool isTLVRelocation(const InputSection &IS, const Relocation &R, bool IsARM) {
+  if (IS.getType() == S_THREAD_LOCAL_VARIABLES) {
+    return true;
+  }
+  if (IsARM) {
+    return R.Type == ARM64_RELOC_TLVP_LOAD_PAGE21 ||
+           R.Type == ARM64_RELOC_TLVP_LOAD_PAGEOFF12;
+  }
+  return R.Type == X86_64_RELOC_TLV;
+}
+
+} // namespace
+
+Expected<std::unique_ptr<InputFile>> InputFile::create(const File &F) {
+  if (F.getType() != MH_OBJECT) {
+    return createParseError("unsupported file type, expected an object file");
+  }
+  auto Start = std::chrono::steady_clock::now();
+  std::unique_ptr<InputFile> IF(new InputFile(F));
+  if (auto Err = IF->parse_()) {
+    return std::move(Err);
+  }
+  IF->ParseTime_ = std::chrono::steady_clock::now() - Start;
+  return std::move(IF);
+}
+
+Error InputFile::parse_() {
+  InputCollector C;
+  C.visit(File_);
+
+  ArrayRef<uint8_t> Buffer((const uint8_t *)File_.getFileStart(),
+                           (const uint8_t *)File_.getFileEnd());
+
+  std::vector<ArrayRef<any_relocation_info>> RawRelocations;
+  for (const section_64 *Sect : C.Sections) {
+    auto IS = std::make_unique<InputSection>(*this, *Sect);
+    if (!IS->isZeroFill()) {
+      if (!inBounds(Buffer, Sect->offset, Sect->size)) {
+        return createParseError("section '" + IS->getSegName() + "," +
+                                IS->getSectName() +
+                                "' extends past the end of the file");
+      }
+      IS->Contents_ = Buffer.slice(Sect->offset, Sect->size);
+    }
+    if (Sect->nreloc != 0) {
+      uint64_t Size = uint64_t(Sect->nreloc) * sizeof(any_relocation_info);
+      if (!inBounds(Buffer, Sect->reloff, Size)) {
+        return createParseError("relocations of section '" +
+                                IS->getSegName() + "," + IS->getSectName() +
+                                "' extend past the end of the file");
+      }
+    }
+    RawRelocations.push_back(makeArrayRef(
+        (const any_relocation_info *)(Buffer.data() + Sect->reloff),
+        Sect->nreloc));
+    Sections_.push_back(std::move(IS));
+  }
+
+  std::vector<std::vector<uint64_t>> Offsets(Sections_.size());
+  for (size_t I = 0; I < Sections_.size(); ++I) {
+    if (Sections_[I]->size() != 0) {
+      Offsets[I].push_back(0);
+    }
+  }
+  auto Split = [&]() {
+    for (size_t I = 0; I < Sections_.size(); ++I) {
+      llvm::sort(Offsets[I]);
+      Offsets[I].erase(std::unique(Offsets[I].begin(), Offsets[I].end()),
+                       Offsets[I].end());
+      Sections_[I]->split_(Offsets[I]);
+    }
+  };
+  // Relocations refer to symbols by their index in the input's symbol table.
+  std::vector<const Symbol *> ByIndex;
+  auto ParseRelocations = [&]() -> Error {
+    auto Start = std::chrono::steady_clock::now();
+    for (size_t I = 0; I < Sections_.size(); ++I) {
+      if (auto Err =
+              parseRelocations_(*Sections_[I], RawRelocations[I], ByIndex)) {
+        return Err;
+      }
+    }
+    RelocationTime_ = std::chrono::steady_clock::now() - Start;
+    return Error::success();
+  };
+
+  if (C.Symtab == nullptr) {
+    Split();
+    return ParseRelocations();
+  }
+
+  const symtab_command &ST = *C.Symtab;
+  if (!inBounds(Buffer, ST.symoff, uint64_t(ST.nsyms) * sizeof(nlist_64)) ||
+      !inBounds(Buffer, ST.stroff, ST.strsize)) {
+    return createParseError("symbol table extends past the end of the file");
+  }
+  ArrayRef<nlist_64> NList((const nlist_64 *)(Buffer.data() + ST.symoff),
+                           ST.nsyms);
+  StringRef Strings((const char *)Buffer.data() + ST.stroff, ST.strsize);
+
+  auto IsDefinition = [](const nlist_64 &NL) {
+    return (NL.n_type & N_STAB) == 0 && (NL.n_type & N_TYPE) == N_SECT;
+  };
+  for (const nlist_64 &NL : NList) {
+    if (!IsDefinition(NL)) {
+      continue;
+    }
+    if (NL.n_sect == NO_SECT || NL.n_sect > Sections_.size() ||
+        NL.n_value < Sections_[NL.n_sect - 1]->getAddr()) {
+      return createParseError("symbol at index " +
+                              Twine(&NL - NList.begin()) +
+                              " is outside of its section");
+    }
+  }
+
+  // Every symbol starts a new atom when the compiler has promised that's safe,
+  // except alternate entry points which are part of the preceding atom.
+  if (File_.getFlags() & MH_SUBSECTIONS_VIA_SYMBOLS) {
+    for (const nlist_64 &NL : NList) {
+      if (!IsDefinition(NL) || (NL.n_desc & N_ALT_ENTRY)) {
+        continue;
+      }
+      const InputSection &IS = *Sections_[NL.n_sect - 1];
+      uint64_t Offset = NL.n_value - IS.getAddr();
+      if (Offset < IS.size()) {
+        Offsets[NL.n_sect - 1].push_back(Offset);
+      }
+    }
+  }
+  Split();
+
+  // Relocations point at symbols, so they must never move.
+  Symbols_.reserve(NList.size());
+  ByIndex.assign(NList.size(), nullptr);
+  for (size_t I = 0; I < NList.size(); ++I) {
+    const nlist_64 &NL = NList[I];
+    if (NL.n_strx >= Strings.size()) {
+      return createParseError("name of symbol at index " + Twine(I) +
+                              " is outside of the string table");
+    }
+    StringRef Name = Strings.drop_front(NL.n_strx);
+    Name = Name.take_until([](char C) { return C == '\0'; });
+
+    if (NL.n_type & N_STAB) {
+      continue;
+    }
+
+    Symbol S;
+    S.Name = Name;
+    S.Type = NL.n_type;
+    S.Desc = NL.n_desc;
+    switch (NL.n_type & N_TYPE) {
+    case N_SECT: {
+      const InputSection &IS = *Sections_[NL.n_sect - 1];
+      uint64_t Offset = NL.n_value - IS.getAddr();
+      const Atom &A = IS.getAtomAt(Offset);
+      S.Definition = &A;
+      S.Offset = Offset - A.getOffset();
+      break;
+    }
+    case N_UNDF:
+      if ((NL.n_type & N_EXT) == 0) {
+        continue;
+      }
+      break;
+    default:
+      // Absolute and indirect symbols aren't supported yet.
+      continue;
+    }
+    Symbols_.push_back(S);
+    ByIndex[I] = &Symbols_.back();
+  }
+
+  return ParseRelocations();
+}
+
+Error InputFile::parseRelocations_(InputSection &IS,
+                                   ArrayRef<any_relocation_info> Raw,
+                                   ArrayRef<const Symbol *> ByIndex) {
+  bool IsARM = File_.getTriple().getArch() == Triple::aarch64;
+  int64_t PendingAddend = 0;
+  for (const any_relocation_info &RI : Raw) {
+    uint32_t Address = RI.r_word0;
+    if (Address & R_SCATTERED) {
+      return createParseError("scattered relocations are unsupported");
+    }
+    uint32_t SymbolNum = RI.r_word1 & 0xffffff;
+    bool Extern = (RI.r_word1 >> 27) & 1;
+    uint8_t Type = RI.r_word1 >> 28;
+
+    // ARM64_RELOC_ADDEND only carries the addend of the next relocation.
+    if (IsARM && Type == ARM64_RELOC_ADDEND) {
+      PendingAddend = SignExtend64<24>(SymbolNum);
+      continue;
+    }
+
+    if (Address >= IS.size()) {
+      return createParseError("relocation at offset " + Twine(Address) +
+                              " is outside of section '" + IS.getSegName() +
+                              "," + IS.getSectName() + "'");
+    }
+
+    Relocation R;
+    R.Offset = Address;
+    R.Type = Type;
+    R.PCRel = (RI.r_word1 >> 24) & 1;
+    R.Length = (RI.r_word1 >> 25) & 3;
+    R.Sym = nullptr;
+    R.Sect = nullptr;
+    R.Addend = PendingAddend;
+    PendingAddend = 0;
+    if (Extern) {
+      if (SymbolNum >= ByIndex.size() || ByIndex[SymbolNum] == nullptr) {
+        return createParseError("relocation at offset " + Twine(Address) +
+                                " refers to an unsupported symbol");
+      }
+      R.Sym = ByIndex[SymbolNum];
+    } else {
+      if (SymbolNum == NO_SECT || SymbolNum > Sections_.size()) {
+        return createParseError("relocation at offset " + Twine(Address) +
+                                " refers to an invalid section");
+      }
+      R.Sect = Sections_[SymbolNum - 1].get();
+    }
+    IS.Relocations_.push_back(R);
+  }
+
+  llvm::stable_sort(IS.Relocations_,
+                    [](const Relocation &LHS, const Relocation &RHS) {
+                      return LHS.Offset < RHS.Offset;
+                    });
+
+  uint32_t Begin = 0;
+  for (Atom &A : IS.Atoms_) {
+    uint32_t End = Begin;
+    while (End < IS.Relocations_.size() &&
+           IS.Relocations_[End].Offset < A.getOffset() + A.size()) {
+      if (isTLVRelocation(IS, IS.Relocations_[End], IsARM)) {
+        TLVRelocations_.emplace_back(&A, &IS.Relocations_[End]);
+      }
+      ++End;
+    }
+    A.RelocBegin_ = Begin;
+    A.RelocEnd_ = End;
+    Begin = End;
+  }
+  return Error::success();
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
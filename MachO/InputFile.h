@@ -0,0 +1,218 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/SymbolTable.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/BinaryFormat/MachO.h"
+#include "llvm/Support/Error.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class File;
+class InputFile;
+class InputSection;
+
+/// A relocation of an input section, resolved to what it refers to.
+struct Relocation {
+  /// The offset of the fixup within its section.
+  uint64_t Offset;
+  uint8_t Type;
+  bool PCRel;
+  /// The log2 of the fixup's size in bytes.
+  uint8_t Length;
+  /// The target of an extern relocation, otherwise nullptr. This is the
+  /// input's own symbol, see \c SymbolTable::resolve for what it resolves to.
+  const Symbol *Sym;
+  /// The target section of a non-extern relocation, otherwise nullptr.
+  const InputSection *Sect;
+  /// The addend given by a preceding ARM64_RELOC_ADDEND, otherwise 0.
+  int64_t Addend;
+};
+
+/// The unit of layout: a piece of an input section which is placed in the
+/// output as a whole. Sections of inputs built with MH_SUBSECTIONS_VIA_SYMBOLS
+/// are split into an atom per symbol, other sections are a single atom. Atoms
+/// never change once their input is parsed, where each link puts them is kept
+/// by its \c Layout.
+class Atom {
+public:
+  Atom(const InputSection &Section, uint64_t Offset, uint64_t Size,
+       uint32_t Align)
+      : Section_(&Section), Offset_(Offset), Size_(Size), Align_(Align) {}
+
+  const InputSection &getSection() const { return *Section_; }
+
+  /// The offset of this atom within its input section.
+  uint64_t getOffset() const { return Offset_; }
+
+  uint64_t size() const { return Size_; }
+
+  /// The log2 of this atom's alignment.
+  uint32_t getAlign() const { return Align_; }
+
+  /// This atom's contents, empty if it's zerofill.
+  ArrayRef<uint8_t> getContents() const;
+
+  /// The relocations within this atom, sorted by offset.
+  ArrayRef<Relocation> relocations() const;
+
+private:
+  friend class InputFile;
+
+  const InputSection *Section_;
+  uint64_t Offset_;
+  uint64_t Size_;
+  uint32_t Align_;
+  uint32_t RelocBegin_ = 0;
+  uint32_t RelocEnd_ = 0;
+};
+
+class InputSection {
+public:
+  InputSection(const InputFile &IF, const ::llvm::MachO::section_64 &Header)
+      : Input_(&IF), Header_(&Header) {}
+
+  /// A section the linker synthesizes, e.g. __stubs, which is a single atom.
+  /// \c Header and \c Contents must outlive the section, but \c Contents only
+  /// has to be filled in by the time the output is written.
+  InputSection(const ::llvm::MachO::section_64 &Header,
+               ArrayRef<uint8_t> Contents);
+
+  InputSection(const InputSection &) = delete;
+  InputSection &operator=(const InputSection &) = delete;
+
+  /// Whether this section was synthesized rather than read from an input.
+  bool isSynthetic() const { return Input_ == nullptr; }
+
+  const InputFile &getInputFile() const {
+    assert(Input_ != nullptr && "Synthetic sections have no file");
+    return *Input_;
+  }
+
+  const File &getFile() const;
+
+  StringRef getSegName() const;
+  StringRef getSectName() const;
+  uint32_t getFlags() const { return Header_->flags; }
+  uint32_t getType() const {
+    return Header_->flags & ::llvm::MachO::SECTION_TYPE;
+  }
+  /// The log2 of this section's alignment.
+  uint32_t getAlign() const { return Header_->align; }
+  uint64_t getAddr() const { return Header_->addr; }
+  uint64_t size() const { return Header_->size; }
+  /// The index of the first entry of a stub or pointer section in the
+  /// indirect symbol table.
+  uint32_t getReserved1() const { return Header_->reserved1; }
+  /// The size of each stub in an S_SYMBOL_STUBS section.
+  uint32_t getReserved2() const { return Header_->reserved2; }
+
+  bool isZeroFill() const;
+
+  /// Whether this section holds instructions.
+  bool isCode() const {
+    return getFlags() & (::llvm::MachO::S_ATTR_PURE_INSTRUCTIONS |
+                         ::llvm::MachO::S_ATTR_SOME_INSTRUCTIONS);
+  }
+
+  /// This section's contents, empty if it's zerofill.
+  ArrayRef<uint8_t> getContents() const { return Contents_; }
+
+  /// This section's relocations, sorted by offset.
+  ArrayRef<Relocation> getRelocations() const { return Relocations_; }
+
+  ArrayRef<Atom> atoms() const { return Atoms_; }
+
+  /// The atom containing \c Offset. Offsets at or past the end of the section
+  /// belong to the last atom.
+  const Atom &getAtomAt(uint64_t Offset) const;
+
+  /// Find what the non-extern relocation \c R of this section refers to by
+  /// decoding the address its fixup was assembled with: the atom of
+  /// \c R.Sect holding it in \c Target and the offset within that atom in
+  /// \c Offset. Returns false if the fixup's encoding isn't understood or
+  /// the address is outside \c R.Sect.
+  bool decodeTarget(const Relocation &R, const Atom *&Target,
+                    uint64_t &Offset) const;
+
+private:
+  friend class InputFile;
+
+  /// Split this section into atoms starting at each of \c Offsets, which must
+  /// be sorted and within the section.
+  void split_(ArrayRef<uint64_t> Offsets);
+
+  const InputFile *Input_;
+  const ::llvm::MachO::section_64 *Header_;
+  ArrayRef<uint8_t> Contents_;
+  std::vector<Relocation> Relocations_;
+  std::vector<Atom> Atoms_;
+};
+
+/// The sections of an MH_OBJECT input split into atoms, along with its
+/// symbols. An input file never changes once it's parsed, so it can be shared
+/// by every link it's an input of: resolving symbols, folding and layout are
+/// kept in each link's \c SymbolTable and \c Layout.
+class InputFile {
+public:
+  /// Parse \c F, which must outlive the returned file.
+  static Expected<std::unique_ptr<InputFile>> create(const File &F);
+
+  const File &getFile() const { return File_; }
+
+  ArrayRef<std::unique_ptr<InputSection>> sections() const {
+    return Sections_;
+  }
+
+  /// The symbols the linker uses, in the order of the input's symbol table:
+  /// local and external definitions and undefined references. Stabs and
+  /// other symbols the linker ignores are left out.
+  ArrayRef<Symbol> symbols() const { return Symbols_; }
+
+  /// The relocations resolving thread-local variables rewrites, with the
+  /// atoms they're in: the template offsets of __thread_vars descriptors and
+  /// the code loading descriptors.
+  ArrayRef<std::pair<const Atom *, const Relocation *>>
+  tlvRelocations() const {
+    return TLVRelocations_;
+  }
+
+  /// How long \c create took to parse this file.
+  std::chrono::nanoseconds getParseTime() const { return ParseTime_; }
+
+  /// How much of the parse time went to reading relocations.
+  std::chrono::nanoseconds getRelocationTime() const {
+    return RelocationTime_;
+  }
+
+private:
+  explicit InputFile(const File &F) : File_(F) {}
+
+  Error parse_();
+  Error parseRelocations_(InputSection &IS,
+                          ArrayRef<::llvm::MachO::any_relocation_info> Raw,
+                          ArrayRef<const Symbol *> ByIndex);
+
+  const File &File_;
+  std::vector<std::unique_ptr<InputSection>> Sections_;
+  std::vector<Symbol> Symbols_;
+  std::vector<std::pair<const Atom *, const Relocation *>> TLVRelocations_;
+  std::chrono::nanoseconds ParseTime_{0};
+  std::chrono::nanoseconds RelocationTime_{0};
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,355 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Layout.h"
+
+#include "MachO/Builder.h"
+#include "MachO/TLV.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+bool OutputSection::isZeroFill() const {
+  switch (Flags_ & SECTION_TYPE) {
+  case S_ZEROFILL:
+  case S_GB_ZEROFILL:
+  case S_THREAD_LOCAL_ZEROFILL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void OutputSection::assignOffsets_() {
+  uint64_t Offset = 0;
+  Offsets_.clear();
+  Offsets_.reserve(Atoms_.size());
+  for (const Atom *A : Atoms_) {
+    Offset = alignTo(Offset, 1ull << A->getAlign());
+    Offsets_.push_back(Offset);
+    Offset += A->size();
+  }
+  Size_ = Offset;
+}
+
+const Layout::AtomState *Layout::findState_(const Atom &A) const {
+  const InputSection &IS = A.getSection();
+  auto Iter = SectionStates_.find(&IS);
+  if (Iter == SectionStates_.end()) {
+    return nullptr;
+  }
+  return &States_[Iter->second + (&A - IS.atoms().data())];
+}
+
+Layout::AtomState &Layout::getState_(const Atom &A) {
+  const InputSection &IS = A.getSection();
+  auto Inserted = SectionStates_.try_emplace(&IS, States_.size());
+  if (Inserted.second) {
+    States_.resize(States_.size() + IS.atoms().size());
+  }
+  return States_[Inserted.first->second + (&A - IS.atoms().data())];
+}
+
+void Layout::fold(const Atom &A, const Atom &Leader) {
+  getState_(A).Leader = &Leader;
+}
+
+bool Layout::isFolded(const Atom &A) const {
+  const AtomState *State = findState_(A);
+  return State != nullptr && State->Leader != nullptr;
+}
+
+const Atom &Layout::getLeader(const Atom &A) const {
+  // Weak definitions coalesced while loading may be folded again by ICF.
+  const Atom *Leader = &A;
+  while (const AtomState *State = findState_(*Leader)) {
+    if (State->Leader == nullptr) {
+      break;
+    }
+    Leader = State->Leader;
+  }
+  return *Leader;
+}
+
+const OutputSection *Layout::getOutputSection(const Atom &A) const {
+  const AtomState *State = findState_(getLeader(A));
+  return State != nullptr ? State->Output : nullptr;
+}
+
+uint64_t Layout::getAddr(const Atom &A) const {
+  const AtomState *State = findState_(getLeader(A));
+  assert(State != nullptr && State->Output != nullptr &&
+         "Atom hasn't been laid out");
+  return State->Output->getAddr() + State->Offset;
+}
+
+void Layout::addInputSection(const InputSection &S) {
+  SmallString<34> Key(S.getSegName());
+  Key += ',';
+  Key += S.getSectName();
+  OutputSection *&OS = SectionMap_[Key];
+  if (OS == nullptr) {
+    Sections_.push_back(std::make_unique<OutputSection>(
+        S.getSegName(), S.getSectName(), S.getFlags(), S.getReserved1(),
+        S.getReserved2()));
+    OS = Sections_.back().get();
+    // dyld reads descriptors as pointers, whatever the inputs asked for.
+    if (S.getType() == S_THREAD_LOCAL_VARIABLES) {
+      OS->Align_ = 3;
+    }
+  }
+  for (const Atom &A : S.atoms()) {
+    AtomState &State = getState_(A);
+    if (State.Leader == nullptr) {
+      State.Output = OS;
+      OS->Atoms_.push_back(&A);
+      OS->Align_ = std::max(OS->Align_, A.getAlign());
+    }
+  }
+}
+
+void Layout::orderAtoms(ArrayRef<const Atom *> Atoms) {
+  // Gather the ordered atoms of each section first, then append the rest of
+  // each section's atoms in their original order.
+  DenseMap<OutputSection *, std::vector<const Atom *>> Ordered;
+  DenseSet<const Atom *> Seen;
+  for (const Atom *A : Atoms) {
+    const Atom &Leader = getLeader(*A);
+    const AtomState *State = findState_(Leader);
+    if (State == nullptr || State->Output == nullptr ||
+        !Seen.insert(&Leader).second) {
+      continue;
+    }
+    Ordered[State->Output].push_back(&Leader);
+  }
+
+  for (auto &Entry : Ordered) {
+    OutputSection &OS = *Entry.first;
+    std::vector<const Atom *> &SectionAtoms = Entry.second;
+    SectionAtoms.reserve(OS.Atoms_.size());
+    for (const Atom *A : OS.Atoms_) {
+      if (!Seen.count(A)) {
+        SectionAtoms.push_back(A);
+      }
+    }
+    OS.Atoms_ = std::move(SectionAtoms);
+  }
+}
+
+void Layout::orderSymbols(ArrayRef<const Symbol *> Symbols) {
+  std::vector<const Atom *> Atoms;
+  Atoms.reserve(Symbols.size());
+  for (const Symbol *S : Symbols) {
+    if (S->isDefined()) {
+      Atoms.push_back(S->Definition);
+    }
+  }
+  orderAtoms(Atoms);
+}
+
+namespace {
+
+/// Segments are laid out in the order ld64 uses, with any others after them.
+unsigned getSegmentRank(StringRef Name) {
+  return StringSwitch<unsigned>(Name)
+      .Case("__TEXT", 0)
+      .Case("__DATA_CONST", 1)
+      .Case("__DATA", 2)
+      .Default(3);
+}
+
+/// Sections of a segment are ordered by rank. Zerofill sections take no space
+/// in the file, so they have to come last, and the thread-local template has
+/// to be contiguous, so __thread_data is the last section in the file and
+/// __thread_bss the first zerofill one.
+unsigned getSectionRank(const OutputSection &OS) {
+  uint32_t Type = OS.getFlags() & SECTION_TYPE;
+  if (isThreadLocalTemplate(Type)) {
+    return OS.isZeroFill() ? 2 : 1;
+  }
+  return OS.isZeroFill() ? 3 : 0;
+}
+
+uint32_t getSegmentProt(StringRef Name) {
+  if (Name == "__TEXT") {
+    return VM_PROT_READ | VM_PROT_EXECUTE;
+  }
+  return VM_PROT_READ | VM_PROT_WRITE;
+}
+
+} // namespace
+
+void Layout::finalize() {
+  StringMap<OutputSegment *> SegmentMap;
+  for (auto &OS : Sections_) {
+    OutputSegment *&Seg = SegmentMap[OS->getSegName()];
+    if (Seg == nullptr) {
+      Segments_.push_back(std::make_unique<OutputSegment>(
+          OS->getSegName(), getSegmentProt(OS->getSegName())));
+      Seg = Segments_.back().get();
+    }
+    Seg->Sections_.push_back(OS.get());
+  }
+  llvm::stable_sort(Segments_, [](const std::unique_ptr<OutputSegment> &LHS,
+                                  const std::unique_ptr<OutputSegment> &RHS) {
+    return getSegmentRank(LHS->getName()) < getSegmentRank(RHS->getName());
+  });
+
+  uint32_t Index = 1;
+  uint64_t Addr = BaseAddr_;
+  for (auto &Seg : Segments_) {
+    llvm::stable_sort(Seg->Sections_,
+                      [](const OutputSection *LHS, const OutputSection *RHS) {
+                        return getSectionRank(*LHS) < getSectionRank(*RHS);
+                      });
+
+    Seg->VMAddr_ = Addr;
+    for (OutputSection *OS : Seg->Sections_) {
+      OS->assignOffsets_();
+      for (size_t I = 0; I < OS->Atoms_.size(); ++I) {
+        getState_(*OS->Atoms_[I]).Offset = OS->Offsets_[I];
+      }
+      Addr = alignTo(Addr, 1ull << OS->getAlign());
+      OS->Addr_ = Addr;
+      OS->Index_ = Index++;
+      bool IsTemplate = isThreadLocalTemplate(OS->getFlags() & SECTION_TYPE);
+      if (IsTemplate && TLVAddr_ == 0) {
+        TLVAddr_ = Addr;
+      }
+      Addr += OS->size();
+    }
+    Seg->VMSize_ = alignTo(Addr - Seg->VMAddr_, PageSize_);
+    Addr = Seg->VMAddr_ + Seg->VMSize_;
+  }
+}
+
+void Layout::addPatches(ArrayRef<std::pair<const Atom *, Patch>> Patches) {
+  DenseSet<OutputSection *> Patched;
+  for (const auto &Entry : Patches) {
+    const AtomState *State = findState_(*Entry.first);
+    if (State == nullptr || State->Leader != nullptr ||
+        State->Output == nullptr) {
+      continue;
+    }
+    Patch P = Entry.second;
+    P.Offset += State->Offset;
+    State->Output->Patches_.push_back(P);
+    Patched.insert(State->Output);
+  }
+  for (OutputSection *OS : Patched) {
+    llvm::stable_sort(OS->Patches_, [](const Patch &LHS, const Patch &RHS) {
+      return LHS.Offset < RHS.Offset;
+    });
+  }
+}
+
+namespace {
+
+/// Writes the atoms of an output section, zeroing the padding between them,
+/// and then applies the section's patches.
+class AtomsChunk : public Builder::Chunk {
+public:
+  explicit AtomsChunk(const OutputSection &Section) : Section_(Section) {}
+
+  uint64_t size() const override { return Section_.size(); }
+
+  uint32_t getAlignment() const override { return 1u << Section_.getAlign(); }
+
+  void write(uint8_t *Buf, uint64_t Begin, uint64_t End) const override {
+    ArrayRef<const Atom *> Atoms = Section_.atoms();
+    ArrayRef<uint64_t> Offsets = Section_.offsets();
+    // Atoms don't overlap, so at most the atom before the first one starting
+    // at or after Begin reaches into the piece.
+    size_t I = llvm::lower_bound(Offsets, Begin) - Offsets.begin();
+    if (I > 0 && Offsets[I - 1] + Atoms[I - 1]->size() > Begin) {
+      --I;
+    }
+
+    uint64_t Cursor = Begin;
+    for (; I < Atoms.size() && Offsets[I] < End; ++I) {
+      const Atom &A = *Atoms[I];
+      uint64_t AtomOffset = Offsets[I];
+      uint64_t PieceBegin = std::max(Begin, AtomOffset);
+      uint64_t PieceEnd = std::min(End, AtomOffset + A.size());
+      if (PieceBegin >= PieceEnd) {
+        continue;
+      }
+      memset(Buf + (Cursor - Begin), 0, PieceBegin - Cursor);
+      ArrayRef<uint8_t> Contents = A.getContents();
+      if (Contents.empty()) {
+        memset(Buf + (PieceBegin - Begin), 0, PieceEnd - PieceBegin);
+      } else {
+        memcpy(Buf + (PieceBegin - Begin),
+               Contents.data() + (PieceBegin - AtomOffset),
+               PieceEnd - PieceBegin);
+      }
+      Cursor = PieceEnd;
+    }
+    memset(Buf + (Cursor - Begin), 0, End - Cursor);
+
+    // Patches are at most a few bytes long, so only those starting just
+    // before the piece can reach into it.
+    ArrayRef<Patch> Patches = Section_.patches();
+    auto Iter = llvm::partition_point(Patches, [Begin](const Patch &P) {
+      return P.Offset + sizeof(P.Bytes) <= Begin;
+    });
+    for (; Iter != Patches.end() && Iter->Offset < End; ++Iter) {
+      uint64_t From = std::max(Begin, Iter->Offset);
+      uint64_t To = std::min(End, Iter->Offset + Iter->Size);
+      if (From < To) {
+        memcpy(Buf + (From - Begin), Iter->Bytes + (From - Iter->Offset),
+               To - From);
+      }
+    }
+  }
+
+private:
+  const OutputSection &Section_;
+};
+
+} // namespace
+
+bool Layout::hasTLVDescriptors() const {
+  return llvm::any_of(Sections_, [](const std::unique_ptr<OutputSection> &OS) {
+    return (OS->getFlags() & SECTION_TYPE) == S_THREAD_LOCAL_VARIABLES;
+  });
+}
+
+void Layout::build(Builder::File &F) const {
+  F.setHasTLVDescriptors(hasTLVDescriptors());
+  for (auto &Seg : Segments_) {
+    auto Cmd = std::make_unique<Builder::SegmentCommand>(
+        Seg->getName(), Seg->getVMAddr(), Seg->getProt(), Seg->getProt());
+    Cmd->setPageSize(PageSize_);
+    for (const OutputSection *OS : Seg->sections()) {
+      std::unique_ptr<Builder::Section> Sect;
+      if (OS->isZeroFill()) {
+        Sect = std::make_unique<Builder::Section>(
+            OS->getSegName(), OS->getSectName(), OS->getFlags(),
+            OS->getAlign(), OS->size());
+      } else {
+        Sect = std::make_unique<Builder::Section>(
+            OS->getSegName(), OS->getSectName(), OS->getFlags(),
+            OS->getAlign(), std::make_unique<AtomsChunk>(*OS));
+      }
+      Sect->setReserved1(OS->getReserved1());
+      Sect->setReserved2(OS->getReserved2());
+      Cmd->addSection(std::move(Sect));
+    }
+    F.addLoadCommand(std::move(Cmd));
+  }
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,219 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/InputFile.h"
+#include "MachO/SymbolTable.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace Builder {
+class File;
+} // end namespace Builder
+
+/// Bytes a resolved relocation writes over an atom's contents. They may start
+/// before the fixup when the instruction around it is rewritten too.
+struct Patch {
+  /// The offset of the first byte within the atom or, once added to a
+  /// \c Layout, within the atom's output section.
+  uint64_t Offset;
+  uint32_t Size;
+  uint8_t Bytes[10];
+};
+
+/// The atoms of every input section with the same segment and section name,
+/// laid out one after another.
+class OutputSection {
+public:
+  OutputSection(StringRef SegName, StringRef SectName, uint32_t Flags,
+                uint32_t Reserved1 = 0, uint32_t Reserved2 = 0)
+      : SegName_(SegName), SectName_(SectName), Flags_(Flags),
+        Reserved1_(Reserved1), Reserved2_(Reserved2) {}
+
+  StringRef getSegName() const { return SegName_; }
+  StringRef getSectName() const { return SectName_; }
+  uint32_t getFlags() const { return Flags_; }
+  uint32_t getReserved1() const { return Reserved1_; }
+  uint32_t getReserved2() const { return Reserved2_; }
+
+  /// The log2 of the largest alignment of any atom in this section.
+  uint32_t getAlign() const { return Align_; }
+
+  bool isZeroFill() const;
+
+  /// The atoms of this section, in layout order.
+  ArrayRef<const Atom *> atoms() const { return Atoms_; }
+
+  /// The offset of each atom within this section, like \c atoms. Only valid
+  /// after layout.
+  ArrayRef<uint64_t> offsets() const { return Offsets_; }
+
+  /// The patches to apply to this section's atoms, sorted by offset.
+  ArrayRef<Patch> patches() const { return Patches_; }
+
+  /// The 1 based index of this section in the output, i.e. its \c n_sect.
+  uint32_t getIndex() const { return Index_; }
+
+  uint64_t getAddr() const { return Addr_; }
+  uint64_t size() const { return Size_; }
+
+private:
+  friend class Layout;
+
+  /// Assign every atom its offset in this section, in order.
+  void assignOffsets_();
+
+  std::string SegName_;
+  std::string SectName_;
+  uint32_t Flags_;
+  uint32_t Reserved1_;
+  uint32_t Reserved2_;
+  uint32_t Align_ = 0;
+  std::vector<const Atom *> Atoms_;
+  std::vector<uint64_t> Offsets_;
+  std::vector<Patch> Patches_;
+  uint32_t Index_ = 0;
+  uint64_t Addr_ = 0;
+  uint64_t Size_ = 0;
+};
+
+class OutputSegment {
+public:
+  OutputSegment(StringRef Name, uint32_t Prot) : Name_(Name), Prot_(Prot) {}
+
+  StringRef getName() const { return Name_; }
+  uint32_t getProt() const { return Prot_; }
+  ArrayRef<OutputSection *> sections() const { return Sections_; }
+  uint64_t getVMAddr() const { return VMAddr_; }
+  uint64_t getVMSize() const { return VMSize_; }
+
+private:
+  friend class Layout;
+
+  std::string Name_;
+  uint32_t Prot_;
+  std::vector<OutputSection *> Sections_;
+  uint64_t VMAddr_ = 0;
+  uint64_t VMSize_ = 0;
+};
+
+/// Decides where every atom goes in the output. Input sections are added in
+/// command line order, optionally reordered, and then assigned addresses by
+/// \c finalize. Atoms are shared by every link of an input, so which ones
+/// were folded and where each was placed is kept here, in a table with an
+/// entry per atom of every section the layout has seen.
+class Layout {
+public:
+  Layout(uint64_t BaseAddr, uint64_t PageSize)
+      : BaseAddr_(BaseAddr), PageSize_(PageSize) {}
+
+  /// Replace \c A with the identical \c Leader, which is laid out in its
+  /// place. Folded atoms aren't laid out themselves.
+  void fold(const Atom &A, const Atom &Leader);
+
+  bool isFolded(const Atom &A) const;
+
+  /// The atom laid out in place of \c A, which is \c A unless it was folded.
+  const Atom &getLeader(const Atom &A) const;
+
+  /// The output section the leader of \c A was placed in, nullptr if it
+  /// wasn't.
+  const OutputSection *getOutputSection(const Atom &A) const;
+
+  /// The address of \c A, i.e. of its leader, in the output. Only valid after
+  /// \c finalize.
+  uint64_t getAddr(const Atom &A) const;
+
+  /// The address of the defined symbol \c S in the output.
+  uint64_t getAddr(const Symbol &S) const {
+    assert(S.isDefined() && "Undefined symbols have no address");
+    return getAddr(*S.Definition) + S.Offset;
+  }
+
+  /// Append the atoms of \c S to the output section they belong in. Folded
+  /// atoms are skipped, their leaders are laid out in their place.
+  void addInputSection(const InputSection &S);
+
+  /// Move the leaders of \c Atoms to the front of their output sections, in
+  /// the given order. An atom listed more than once keeps its first position.
+  /// This is linear in the number of atoms.
+  void orderAtoms(ArrayRef<const Atom *> Atoms);
+
+  /// Like \c orderAtoms for the atoms defining \c Symbols. Undefined symbols
+  /// are ignored.
+  void orderSymbols(ArrayRef<const Symbol *> Symbols);
+
+  /// Group output sections into segments and assign every atom an address.
+  void finalize();
+
+  /// Apply each patch to its atom when the output is written. Patches of
+  /// atoms which weren't laid out are dropped. Only valid after \c finalize.
+  void addPatches(ArrayRef<std::pair<const Atom *, Patch>> Patches);
+
+  /// The output sections, in the order they were created.
+  ArrayRef<std::unique_ptr<OutputSection>> sections() const {
+    return Sections_;
+  }
+
+  /// The output segments, in address order. Empty until \c finalize.
+  ArrayRef<std::unique_ptr<OutputSegment>> segments() const {
+    return Segments_;
+  }
+
+  uint64_t getPageSize() const { return PageSize_; }
+
+  /// The address of the thread-local variable template, i.e. of __thread_data
+  /// followed by __thread_bss, which descriptors' offsets are relative to.
+  /// Only valid after \c finalize.
+  uint64_t getTLVAddr() const { return TLVAddr_; }
+
+  /// Whether the output has thread-local variable descriptors.
+  bool hasTLVDescriptors() const;
+
+  /// Add an LC_SEGMENT_64 for every output segment to \c F.
+  void build(Builder::File &F) const;
+
+private:
+  /// What the layout knows about an atom.
+  struct AtomState {
+    /// The atom this one was folded into, nullptr if it wasn't.
+    const Atom *Leader = nullptr;
+    OutputSection *Output = nullptr;
+    uint64_t Offset = 0;
+  };
+
+  /// The state of \c A, nullptr if the layout hasn't seen its section.
+  const AtomState *findState_(const Atom &A) const;
+
+  /// The state of \c A, adding an entry for every atom of its section if
+  /// it's the first of them the layout sees.
+  AtomState &getState_(const Atom &A);
+
+  uint64_t BaseAddr_;
+  uint64_t PageSize_;
+  uint64_t TLVAddr_ = 0;
+  /// The index of the state of each input section's first atom.
+  DenseMap<const InputSection *, size_t> SectionStates_;
+  std::vector<AtomState> States_;
+  StringMap<OutputSection *> SectionMap_;
+  std::vector<std::unique_ptr<OutputSection>> Sections_;
+  std::vector<std::unique_ptr<OutputSegment>> Segments_;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
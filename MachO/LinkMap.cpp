@@ -0,0 +1,185 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/LinkMap.h"
+
+#include "MachO/File.h"
+#include "MachO/Linker.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// A line of the symbols table. Sizes are only known once the entries are
+/// sorted, as a symbol ends where the next one in its atom starts.
+struct MapEntry {
+  uint64_t Addr;
+  uint64_t End;
+  uint32_t File;
+  StringRef Name;
+  /// What the linker synthesized for \c Name, if it did.
+  StringRef Synthesized = "";
+};
+
+/// The number of symbols formatted by each parallel task.
+constexpr size_t EntriesPerChunk = 4096;
+
+void printFile(raw_ostream &OS, uint32_t File) {
+  OS << '[' << format_decimal(File, 3) << ']';
+}
+
+void printEntry(raw_ostream &OS, const MapEntry &E) {
+  OS << format_hex(E.Addr, 11, /*Upper=*/true) << '\t'
+     << format_hex(E.End - E.Addr, 10, /*Upper=*/true) << '\t';
+  printFile(OS, E.File);
+  OS << ' ' << E.Synthesized << E.Name << '\n';
+}
+
+/// Collect the laid out symbols of \c Inputs, in parallel. File 0 is the
+/// linker itself, input \c I is file \c I + 1.
+std::vector<MapEntry> collectEntries(const Linker &L) {
+  ArrayRef<const InputFile *> Inputs = L.inputs();
+  const Layout &Lay = L.getLayout();
+  DenseMap<const File *, uint32_t> FileIndices;
+  for (size_t I = 0; I < Inputs.size(); ++I) {
+    FileIndices[&Inputs[I]->getFile()] = I + 1;
+  }
+
+  auto IsLaidOut = [&](const Symbol &S) {
+    return S.isDefined() && !S.isTemporary() &&
+           !Lay.isFolded(*S.Definition) &&
+           Lay.getOutputSection(*S.Definition) != nullptr;
+  };
+  auto MakeEntry = [&](const Symbol &S, uint32_t File) {
+    const Atom &A = *S.Definition;
+    return MapEntry{Lay.getAddr(S), Lay.getAddr(A) + A.size(), File, S.Name};
+  };
+
+  std::vector<std::vector<MapEntry>> PerInput(Inputs.size() + 1);
+  Scheduler::get().forEach(Inputs.size(), [&](size_t I) {
+    for (const Symbol &S : Inputs[I]->symbols()) {
+      if (!S.isExternal() && IsLaidOut(S)) {
+        PerInput[I + 1].push_back(MakeEntry(S, I + 1));
+      }
+    }
+  });
+  for (const Symbol *S : L.getSymbolTable().symbols()) {
+    if (IsLaidOut(*S)) {
+      const InputSection &IS = S->Definition->getSection();
+      uint32_t File = IS.isSynthetic() ? 0 : FileIndices.lookup(&IS.getFile());
+      PerInput[File].push_back(MakeEntry(*S, File));
+    }
+  }
+
+  const ImportSections &Imports = L.getImports();
+  uint64_t StubSize = Imports.getStubSize();
+  for (size_t I = 0; I < Imports.stubs().size(); ++I) {
+    uint64_t Addr = Imports.getStubAddr(I);
+    PerInput[0].push_back(
+        {Addr, Addr + StubSize, 0, Imports.stubs()[I]->Name, "stub for "});
+  }
+  for (size_t I = 0; I < Imports.got().size(); ++I) {
+    uint64_t Addr = Imports.getGOTAddr(I);
+    PerInput[0].push_back(
+        {Addr, Addr + 8, 0, Imports.got()[I]->Name, "GOT slot for "});
+  }
+
+  std::vector<MapEntry> Entries;
+  size_t Size = 0;
+  for (const auto &Part : PerInput) {
+    Size += Part.size();
+  }
+  Entries.reserve(Size);
+  for (auto &Part : PerInput) {
+    Entries.insert(Entries.end(), Part.begin(), Part.end());
+  }
+
+  // Symbols at the same address keep their input order, so that the map is
+  // the same from run to run.
+  std::stable_sort(Entries.begin(), Entries.end(),
+                   [](const MapEntry &A, const MapEntry &B) {
+                     return A.Addr < B.Addr;
+                   });
+  for (size_t I = 0; I + 1 < Entries.size(); ++I) {
+    if (Entries[I + 1].Addr > Entries[I].Addr) {
+      Entries[I].End = std::min(Entries[I].End, Entries[I + 1].Addr);
+    }
+  }
+  return Entries;
+}
+
+} // namespace
+
+Error writeLinkMap(const Linker &L, StringRef OutputPath, StringRef Path) {
+  std::vector<MapEntry> Entries = collectEntries(L);
+  std::vector<std::string> Chunks(
+      (Entries.size() + EntriesPerChunk - 1) / EntriesPerChunk);
+  Scheduler::get().forEach(Chunks.size(), [&](size_t I) {
+    raw_string_ostream OS(Chunks[I]);
+    size_t End = std::min(Entries.size(), (I + 1) * EntriesPerChunk);
+    for (size_t J = I * EntriesPerChunk; J < End; ++J) {
+      printEntry(OS, Entries[J]);
+    }
+  });
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    return errorCodeToError(EC);
+  }
+
+  OS << "# Path: " << OutputPath << '\n';
+  OS << "# Arch: "
+     << (L.getTriple().getArch() == Triple::aarch64 ? "arm64" : "x86_64")
+     << '\n';
+  OS << "# Object files:\n";
+  printFile(OS, 0);
+  OS << " linker synthesized\n";
+  for (size_t I = 0; I < L.inputs().size(); ++I) {
+    printFile(OS, I + 1);
+    OS << ' ' << L.inputs()[I]->getFile().getPath() << '\n';
+  }
+
+  OS << "# Sections:\n";
+  OS << "# Address\tSize    \tSegment\tSection\n";
+  for (const auto &Seg : L.getLayout().segments()) {
+    for (const OutputSection *Sect : Seg->sections()) {
+      OS << format_hex(Sect->getAddr(), 11, /*Upper=*/true) << '\t'
+         << format_hex(Sect->size(), 10, /*Upper=*/true) << '\t'
+         << Sect->getSegName() << '\t' << Sect->getSectName() << '\n';
+    }
+  }
+
+  OS << "# Symbols:\n";
+  OS << "# Address\tSize    \tFile  Name\n";
+  for (const std::string &Chunk : Chunks) {
+    OS << Chunk;
+  }
+
+  OS.close();
+  if (OS.has_error()) {
+    EC = OS.error();
+    OS.clear_error();
+    return errorCodeToError(EC);
+  }
+  return Error::success();
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,28 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Linker;
+
+/// Write a link map of the output \c L laid out, named \c OutputPath, to
+/// \c Path in ld64's format: the inputs, the output's sections and every
+/// symbol with its address, size and the input defining it. Only the finished
+/// layout is read, so the map can be written on another thread while the
+/// output itself is written. Symbols are formatted in parallel chunks, which
+/// are then written in address order.
+Error writeLinkMap(const Linker &L, StringRef OutputPath, StringRef Path);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
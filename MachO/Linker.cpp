@@ -0,0 +1,167 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Linker.h"
+
+#include "MachO/Builder.h"
+#include "MachO/DebugMap.h"
+#include "MachO/File.h"
+#include "MachO/TLV.h"
+
+#include "llvm/ADT/STLExtras.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+uint64_t getPageSize(const Triple &T) {
+  return T.getArch() == Triple::aarch64 ? 0x4000 : 0x1000;
+}
+
+/// Executables are mapped above the 4GB __PAGEZERO.
+constexpr uint64_t ExecutableBaseAddr = 0x100000000;
+
+} // namespace
+
+Linker::Linker(const Triple &T)
+    : Triple_(T), Layout_(ExecutableBaseAddr, getPageSize(T)), Imports_(T) {}
+
+Error Linker::addFile(const InputFile &IF) {
+  if (auto Err = Symtab_.addFile(IF, Layout_)) {
+    return Err;
+  }
+  Inputs_.push_back(&IF);
+  return Error::success();
+}
+
+Error Linker::addFile(const File &F) {
+  auto IFOrErr = InputFile::create(F);
+  if (auto Err = IFOrErr.takeError()) {
+    return Err;
+  }
+  Owned_.push_back(std::move(*IFOrErr));
+  return addFile(*Owned_.back());
+}
+
+Error Linker::link(Builder::File &Out) {
+  NumFolded_ = foldIdenticalAtoms(Inputs_, Symtab_, Layout_, ICFLevel_);
+  Imports_.scan(Inputs_, Symtab_, Layout_);
+  for (const InputFile *IF : Inputs_) {
+    for (auto &IS : IF->sections()) {
+      // Debug info stays in the inputs, the debug map points the debugger at
+      // it.
+      if (!isDebugSection(*IS)) {
+        Layout_.addInputSection(*IS);
+      }
+    }
+  }
+  Imports_.addTo(Layout_);
+
+  // Names are looked up in the symbol table's hash map, so matching the order
+  // file is linear in its length.
+  std::vector<const Atom *> Ordered;
+  if (Order_ != nullptr) {
+    for (StringRef Name : Order_->symbols()) {
+      const Symbol *S = Symtab_.find(Name);
+      if (S != nullptr && S->isDefined()) {
+        Ordered.push_back(S->Definition);
+      }
+    }
+  }
+  if (Profile_ != nullptr && !Profile_->empty()) {
+    std::vector<const Atom *> Clustered =
+        sortByCallGraph(*Profile_, Symtab_, Layout_);
+    Ordered.insert(Ordered.end(), Clustered.begin(), Clustered.end());
+  }
+  if (!Ordered.empty()) {
+    Layout_.orderAtoms(Ordered);
+  }
+
+  Layout_.finalize();
+  Imports_.finalize(Layout_);
+  resolveTLVRelocations(Inputs_, Symtab_, Layout_);
+  Layout_.build(Out);
+  setWeakFlags_(Out);
+  if (!Imports_.getRebaseInfo().empty() || !Imports_.getBindInfo().empty()) {
+    auto DyldInfo = std::make_unique<Builder::DyldInfoCommand>();
+    DyldInfo->setRebaseInfo(Imports_.getRebaseInfo().vec())
+        .setBindInfo(Imports_.getBindInfo().vec())
+        .setWeakBindInfo(Imports_.getWeakBindInfo().vec())
+        .setLazyBindInfo(Imports_.getLazyBindInfo().vec());
+    Out.addLoadCommand(std::move(DyldInfo));
+  }
+  buildSymtab_(Out);
+  return Error::success();
+}
+
+void Linker::setWeakFlags_(Builder::File &Out) const {
+  Out.setHasWeakDefinitions(any_of(Symtab_.symbols(), [](const Symbol *S) {
+    return S->isWeakDefinition();
+  }));
+  // dyld only looks for the definitions to bind uses of weak ones to where
+  // the weak bind opcodes tell it to.
+  Out.setBindsToWeak(!Imports_.getWeakBindInfo().empty());
+}
+
+void Linker::buildSymtab_(Builder::File &Out) {
+  auto Cmd = std::make_unique<Builder::SymtabCommand>();
+
+  // The symbol table must be ordered locals, external definitions and then
+  // undefined symbols. Stabs count as locals. The indirect symbol table refers
+  // to external symbols by their index.
+  DenseMap<const Symbol *, uint32_t> Indices;
+  uint32_t NumLocals = 0;
+  uint32_t NumExternals = 0;
+  uint32_t NumUndefined = 0;
+  if (EmitDebugMap_) {
+    DebugMap_ = buildDebugMap(Inputs_, Symtab_, Layout_);
+    for (const DebugMapUnit &Unit : DebugMap_) {
+      for (const Stab &S : Unit.Stabs) {
+        Cmd->addSymbol(S.Name, S.Type, S.Sect, S.Desc, S.Value);
+        ++NumLocals;
+      }
+    }
+  }
+  for (const InputFile *IF : Inputs_) {
+    for (const Symbol &S : IF->symbols()) {
+      if (S.isExternal() || !S.isDefined() || S.isTemporary()) {
+        continue;
+      }
+      Cmd->addSymbol(S.Name, S.Type,
+                     Layout_.getOutputSection(*S.Definition)->getIndex(),
+                     S.Desc, Layout_.getAddr(S));
+      ++NumLocals;
+    }
+  }
+  for (const Symbol *S : Symtab_.symbols()) {
+    if (S->isDefined()) {
+      Indices[S] = Cmd->addSymbol(
+          S->Name, S->Type,
+          Layout_.getOutputSection(*S->Definition)->getIndex(), S->Desc,
+          Layout_.getAddr(*S));
+      ++NumExternals;
+    }
+  }
+  for (const Symbol *S : Symtab_.symbols()) {
+    if (!S->isDefined()) {
+      Indices[S] = Cmd->addSymbol(S->Name, N_UNDF | N_EXT, NO_SECT, 0, 0);
+      ++NumUndefined;
+    }
+  }
+
+  Out.addLoadCommand(std::move(Cmd));
+  Out.addLoadCommand(std::make_unique<Builder::DysymtabCommand>(
+      NumLocals, NumExternals, NumUndefined,
+      Imports_.getIndirectSymbols(Indices)));
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
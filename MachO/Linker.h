@@ -0,0 +1,111 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/CallGraphSort.h"
+#include "MachO/DebugMap.h"
+#include "MachO/ICF.h"
+#include "MachO/Imports.h"
+#include "MachO/InputFile.h"
+#include "MachO/Layout.h"
+#include "MachO/OrderFile.h"
+#include "MachO/SymbolTable.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class File;
+
+namespace Builder {
+class File;
+} // end namespace Builder
+
+/// Links parsed inputs into a \c Builder::File: their symbols are resolved
+/// against each other and every atom laid out. Inputs are only read, so one
+/// parse of an input can be shared by every link it's in.
+class Linker {
+public:
+  explicit Linker(const Triple &T);
+
+  /// Add an input to the link. \c IF must outlive the linker.
+  Error addFile(const InputFile &IF);
+
+  /// Parse \c F and add it to the link. \c F must outlive the linker.
+  Error addFile(const File &F);
+
+  /// Lay out the atoms defining the symbols in \c OF first, in order. \c OF
+  /// must outlive the linker, so that it can be shared by several links.
+  void setOrderFile(const OrderFile &OF) { Order_ = &OF; }
+
+  /// Cluster the code atoms in \c Profile so that hot callers and callees are
+  /// close together. Symbols in the order file still come first. \c Profile
+  /// must outlive the linker.
+  void setCallGraphProfile(const CallGraphProfile &Profile) {
+    Profile_ = &Profile;
+  }
+
+  /// Fold identical atoms before laying them out.
+  void setICFLevel(ICFLevel Level) { ICFLevel_ = Level; }
+
+  /// Describe where the inputs' debug info is with stabs, see
+  /// \c buildDebugMap. On by default.
+  void setEmitDebugMap(bool Emit) { EmitDebugMap_ = Emit; }
+
+  /// The number of atoms folded away by identical code folding.
+  size_t getNumFolded() const { return NumFolded_; }
+
+  /// The number of atoms of duplicate weak definitions folded into the
+  /// winner's while loading.
+  size_t getNumCoalesced() const { return Symtab_.getNumCoalesced(); }
+
+  /// Lay out every input and add the resulting segments and symbol table to
+  /// \c Out, which refers to the linker's state and so has to be written
+  /// before the linker goes away.
+  Error link(Builder::File &Out);
+
+  const Triple &getTriple() const { return Triple_; }
+
+  const SymbolTable &getSymbolTable() const { return Symtab_; }
+
+  const Layout &getLayout() const { return Layout_; }
+
+  /// The stubs and GOT slots synthesized for the link.
+  const ImportSections &getImports() const { return Imports_; }
+
+  ArrayRef<const InputFile *> inputs() const { return Inputs_; }
+
+private:
+  void setWeakFlags_(Builder::File &Out) const;
+  void buildSymtab_(Builder::File &Out);
+
+  Triple Triple_;
+  SymbolTable Symtab_;
+  std::vector<const InputFile *> Inputs_;
+  /// The inputs parsed by \c addFile rather than given to it.
+  std::vector<std::unique_ptr<InputFile>> Owned_;
+  const OrderFile *Order_ = nullptr;
+  const CallGraphProfile *Profile_ = nullptr;
+  ICFLevel ICFLevel_ = ICFLevel::None;
+  size_t NumFolded_ = 0;
+  bool EmitDebugMap_ = true;
+  /// The symbol table refers to the names of the debug map's stabs, some of
+  /// which are built on the fly, until the output is written.
+  std::vector<DebugMapUnit> DebugMap_;
+  Layout Layout_;
+  ImportSections Imports_;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
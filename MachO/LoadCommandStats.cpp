@@ -0,0 +1,111 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/LoadCommandStats.h"
+
+#include "MachO/File.h"
+#include "MachO/Visitor.h"
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Format.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// Collects the statistics of a single file.
+class StatsVisitor : public LCSegVisitor {
+public:
+  std::map<uint32_t, LoadCommandStats::CommandStats> Commands;
+  StringMap<uint64_t> Sections;
+
+protected:
+  void visitCmd(const File &, const load_command *LC) override {
+    add(LC->cmd, LC->cmdsize);
+  }
+
+  void visitSegment(const File &, const segment_command_64 *Cmd) override {
+    add(Cmd->cmd, Cmd->cmdsize);
+  }
+
+  void visitSection(const File &, const segment_command_64 *,
+                    const section_64 *Sect) override {
+    std::string Name;
+    Name += StringRef(Sect->segname, strnlen(Sect->segname, 16));
+    Name += ',';
+    Name += StringRef(Sect->sectname, strnlen(Sect->sectname, 16));
+    Sections[Name] += Sect->size;
+  }
+
+private:
+  void add(uint32_t Cmd, uint32_t Size) {
+    LoadCommandStats::CommandStats &S = Commands[Cmd];
+    ++S.Count;
+    S.Bytes += Size;
+  }
+};
+
+} // namespace
+
+LoadCommandStats LoadCommandStats::collect(ArrayRef<const File *> Files) {
+  std::vector<StatsVisitor> Visitors(Files.size());
+  Scheduler::get().forEach(Files.size(),
+                           [&](size_t I) { Visitors[I].visit(*Files[I]); });
+
+  LoadCommandStats Stats;
+  for (size_t I = 0; I < Files.size(); ++I) {
+    for (const auto &Cmd : Visitors[I].Commands) {
+      CommandStats &S = Stats.Commands_[Cmd.first];
+      S.Count += Cmd.second.Count;
+      S.Bytes += Cmd.second.Bytes;
+    }
+    for (const auto &Sect : Visitors[I].Sections) {
+      Stats.Sections_[Sect.first().str()] += Sect.second;
+    }
+    Stats.Inputs_.push_back(
+        {Files[I]->getPath(), Files[I]->getBuffer().getBufferSize()});
+  }
+  std::stable_sort(Stats.Inputs_.begin(), Stats.Inputs_.end(),
+                   [](const InputSize &A, const InputSize &B) {
+                     return A.Size > B.Size;
+                   });
+  return Stats;
+}
+
+void LoadCommandStats::print(raw_ostream &OS, size_t TopN) const {
+  OS << "Load commands:\n";
+  OS << "  " << left_justify("Command", 28) << right_justify("Count", 11)
+     << right_justify("Bytes", 15) << '\n';
+  for (const auto &Cmd : Commands_) {
+    OS << "  " << left_justify(getLoadCommandName(Cmd.first), 28)
+       << format_decimal(Cmd.second.Count, 11)
+       << format_decimal(Cmd.second.Bytes, 15) << '\n';
+  }
+
+  OS << "Sections:\n";
+  OS << "  " << left_justify("Section", 39) << right_justify("Bytes", 15)
+     << '\n';
+  for (const auto &Sect : Sections_) {
+    OS << "  " << left_justify(Sect.first, 39)
+       << format_decimal(Sect.second, 15) << '\n';
+  }
+
+  size_t N = std::min(TopN, Inputs_.size());
+  OS << "Largest inputs (" << N << " of " << Inputs_.size() << "):\n";
+  for (const InputSize &Input : makeArrayRef(Inputs_).take_front(N)) {
+    OS << "  " << format_decimal(Input.Size, 15) << ' ' << Input.Path << '\n';
+  }
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
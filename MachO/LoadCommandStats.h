@@ -0,0 +1,67 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class File;
+
+/// Statistics about the load commands of a link's inputs, which tell which
+/// inputs dominate its cost: how many of each load command there are and how
+/// many bytes they take, how large every section is summed over the inputs
+/// and which inputs are the largest.
+class LoadCommandStats {
+public:
+  struct CommandStats {
+    uint64_t Count = 0;
+    uint64_t Bytes = 0;
+  };
+
+  struct InputSize {
+    StringRef Path;
+    uint64_t Size;
+  };
+
+  /// Collect the statistics of \c Files. Every file is visited in parallel
+  /// into statistics of its own, which are merged once at the end.
+  static LoadCommandStats collect(ArrayRef<const File *> Files);
+
+  /// Load commands by \c cmd.
+  const std::map<uint32_t, CommandStats> &commands() const {
+    return Commands_;
+  }
+
+  /// The sum of the sizes of the sections named "segname,sectname".
+  const std::map<std::string, uint64_t> &sections() const {
+    return Sections_;
+  }
+
+  /// Every input, largest first.
+  ArrayRef<InputSize> inputs() const { return Inputs_; }
+
+  /// Print the statistics with the \c TopN largest inputs.
+  void print(raw_ostream &OS, size_t TopN) const;
+
+private:
+  std::map<uint32_t, CommandStats> Commands_;
+  std::map<std::string, uint64_t> Sections_;
+  std::vector<InputSize> Inputs_;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,84 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/OrderFile.h"
+
+#include "llvm/ADT/StringSwitch.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// Whether \c Name is an architecture ld64 accepts as an order file prefix.
+bool isArchName(StringRef Name) {
+  return StringSwitch<bool>(Name)
+      .Cases("ppc", "ppc64", "i386", "x86_64", "x86_64h", true)
+      .Cases("armv6", "armv7", "armv7s", "armv7k", "arm64", "arm64e", true)
+      .Case("arm64_32", true)
+      .Default(false);
+}
+
+bool matchesArch(StringRef Name, const Triple &T) {
+  switch (T.getArch()) {
+  case Triple::aarch64:
+    return Name == "arm64" || Name == "arm64e";
+  case Triple::x86_64:
+    return Name == "x86_64" || Name == "x86_64h";
+  default:
+    return Name == T.getArchName();
+  }
+}
+
+} // namespace
+
+Expected<OrderFile> OrderFile::read(StringRef Path, const Triple &T) {
+  auto MBOrErr = errorOrToExpected(MemoryBuffer::getFile(Path));
+  if (auto Err = MBOrErr.takeError()) {
+    return std::move(Err);
+  }
+  return parse(std::move(*MBOrErr), T);
+}
+
+OrderFile OrderFile::parse(std::unique_ptr<MemoryBuffer> MB, const Triple &T) {
+  OrderFile OF;
+  StringRef Rest = MB->getBuffer();
+  while (!Rest.empty()) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#")) {
+      continue;
+    }
+
+    // Symbol names may themselves contain ':' (e.g. "-[Foo bar:]"), so only
+    // strip prefixes which really are an architecture or an object file.
+    StringRef Prefix, Name;
+    std::tie(Prefix, Name) = Line.split(':');
+    if (!Name.empty() && isArchName(Prefix)) {
+      if (!matchesArch(Prefix, T)) {
+        continue;
+      }
+      Line = Name;
+    }
+    size_t ObjectEnd = Line.find(".o:");
+    if (ObjectEnd != StringRef::npos) {
+      Line = Line.drop_front(ObjectEnd + 3);
+    }
+
+    Line = Line.trim();
+    if (!Line.empty()) {
+      OF.Symbols_.push_back(Line);
+    }
+  }
+  OF.MB_ = std::move(MB);
+  return OF;
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,46 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+/// The symbols named by an -order_file, in order. Like ld64, each line is a
+/// symbol name optionally prefixed by an architecture and/or an object file,
+/// e.g. \c "arm64:main.o:_main". Lines starting with '#' are comments.
+class OrderFile {
+public:
+  OrderFile() {}
+
+  /// Read the order file at \c Path, keeping the entries which apply to \c T.
+  static Expected<OrderFile> read(StringRef Path, const Triple &T);
+
+  /// Parse the order file in \c MB, keeping the entries which apply to \c T.
+  static OrderFile parse(std::unique_ptr<MemoryBuffer> MB, const Triple &T);
+
+  /// The symbol names, pointing into the order file's buffer.
+  ArrayRef<StringRef> symbols() const { return Symbols_; }
+
+  bool empty() const { return Symbols_.empty(); }
+
+private:
+  std::unique_ptr<MemoryBuffer> MB_;
+  std::vector<StringRef> Symbols_;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,109 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/SymbolTable.h"
+
+#include "MachO/File.h"
+#include "MachO/InputFile.h"
+#include "MachO/Layout.h"
+
+using namespace llvm::MachO;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// Drop the weak definition \c Loser in favour of \c Winner. When both are
+/// atoms of their own the loser's bytes are never laid out, and anything else
+/// referring to it ends up at the winner instead. Otherwise folding would
+/// move whatever is at the start of the loser's atom to the start of the
+/// winner's, so the loser's bytes stay. Returns whether the loser's atom was
+/// folded.
+bool dropDefinition(Layout &L, const Symbol &Loser, const Symbol &Winner) {
+  const Atom &LoserAtom = *Loser.Definition;
+  if (Loser.Offset == 0 && Winner.Offset == 0 && !L.isFolded(LoserAtom) &&
+      (LoserAtom.getSection().getFile().getFlags() &
+       MH_SUBSECTIONS_VIA_SYMBOLS)) {
+    L.fold(LoserAtom, *Winner.Definition);
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+Error SymbolTable::addFile(const InputFile &IF, Layout &L) {
+  ArrayRef<Symbol> Symbols = IF.symbols();
+  FileBase_[&IF] = Resolved_.size();
+  for (const Symbol &FS : Symbols) {
+    if (!FS.isExternal()) {
+      Resolved_.push_back(&FS);
+      continue;
+    }
+    Symbol &S = intern(FS.Name);
+    Resolved_.push_back(&S);
+    if (!FS.isDefined()) {
+      continue;
+    }
+
+    if (S.isDefined()) {
+      bool OldWeak = S.Desc & N_WEAK_DEF;
+      bool NewWeak = FS.Desc & N_WEAK_DEF;
+      if (!OldWeak && !NewWeak) {
+        return make_error<StringError>(
+            "duplicate symbol '" + FS.Name + "', also defined in '" +
+                S.Definition->getSection().getFile().getPath() + "'",
+            inconvertibleErrorCode());
+      }
+      if (NewWeak) {
+        NumCoalesced_ += dropDefinition(L, FS, S);
+        continue;
+      }
+      NumCoalesced_ += dropDefinition(L, S, FS);
+    }
+    S.Definition = FS.Definition;
+    S.Offset = FS.Offset;
+    S.Type = FS.Type;
+    S.Desc = FS.Desc;
+  }
+  return Error::success();
+}
+
+const Symbol &SymbolTable::resolve(const InputFile &IF,
+                                   const Symbol &S) const {
+  if (!S.isExternal()) {
+    return S;
+  }
+  auto Iter = FileBase_.find(&IF);
+  assert(Iter != FileBase_.end() && "Input wasn't added");
+  return *Resolved_[Iter->second + (&S - IF.symbols().data())];
+}
+
+Symbol &SymbolTable::intern(StringRef Name) {
+  auto Inserted = Map_.try_emplace(Name);
+  Symbol &S = Inserted.first->second;
+  if (Inserted.second) {
+    S.Name = Inserted.first->first();
+    Symbols_.push_back(&S);
+  }
+  return S;
+}
+
+Symbol *SymbolTable::find(StringRef Name) {
+  auto Iter = Map_.find(Name);
+  return Iter != Map_.end() ? &Iter->second : nullptr;
+}
+
+const Symbol *SymbolTable::find(StringRef Name) const {
+  auto Iter = Map_.find(Name);
+  return Iter != Map_.end() ? &Iter->second : nullptr;
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,105 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/BinaryFormat/MachO.h"
+#include "llvm/Support/Error.h"
+
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Atom;
+class InputFile;
+class Layout;
+
+/// A symbol defined or referenced by an input, or the definition an external
+/// symbol resolved to in a link.
+struct Symbol {
+  StringRef Name;
+
+  /// The atom defining this symbol, nullptr if it's undefined.
+  const Atom *Definition = nullptr;
+
+  /// The offset of this symbol within \c Definition.
+  uint64_t Offset = 0;
+
+  /// The \c n_type and \c n_desc of the definition.
+  uint8_t Type = 0;
+  uint16_t Desc = 0;
+
+  bool isDefined() const { return Definition != nullptr; }
+
+  bool isExternal() const { return Type & ::llvm::MachO::N_EXT; }
+
+  /// Whether this is a weak definition the output exports, which dyld may
+  /// coalesce with other images' definitions.
+  bool isWeakDefinition() const {
+    return isDefined() && isExternal() &&
+           (Type & ::llvm::MachO::N_PEXT) == 0 &&
+           (Desc & ::llvm::MachO::N_WEAK_DEF);
+  }
+
+  /// Whether this is a local label the assembler left behind, e.g. ltmp0,
+  /// which ld64 doesn't copy to the output.
+  bool isTemporary() const {
+    return Name.startswith("l") || Name.startswith("L");
+  }
+};
+
+/// Resolves the symbols of a link's inputs: external symbols are interned, so
+/// that each name maps to a single \c Symbol no matter how many inputs
+/// reference it, and every input symbol is mapped to what it resolved to.
+/// Inputs are shared between links, so this is kept apart from them.
+class SymbolTable {
+public:
+  /// Resolve the symbols of \c IF against those of the inputs added before.
+  /// Of several definitions of a symbol a strong one beats weak ones and
+  /// otherwise the first in input order wins. A weak definition which loses
+  /// is folded into the winner in \c L when it's an atom of its own.
+  Error addFile(const InputFile &IF, Layout &L);
+
+  /// What the symbol \c S of \c IF resolved to: the interned symbol if it's
+  /// external and \c S itself otherwise. \c IF must have been added.
+  const Symbol &resolve(const InputFile &IF, const Symbol &S) const;
+
+  /// Return the symbol named \c Name, adding an undefined one if there isn't
+  /// one yet.
+  Symbol &intern(StringRef Name);
+
+  /// Return the symbol named \c Name, or nullptr if no input mentions it.
+  Symbol *find(StringRef Name);
+  const Symbol *find(StringRef Name) const;
+
+  /// Every symbol, in the order they were first interned.
+  ArrayRef<Symbol *> symbols() const { return Symbols_; }
+
+  size_t size() const { return Symbols_.size(); }
+
+  /// The number of atoms of weak definitions dropped in favour of another
+  /// one which were folded into the winner's while loading. Dropped
+  /// definitions which don't have an atom of their own aren't counted.
+  size_t getNumCoalesced() const { return NumCoalesced_; }
+
+private:
+  StringMap<Symbol> Map_;
+  std::vector<Symbol *> Symbols_;
+  /// What each input's symbols resolved to, one after another. Inputs are
+  /// found by the index of their first symbol.
+  DenseMap<const InputFile *, size_t> FileBase_;
+  std::vector<const Symbol *> Resolved_;
+  size_t NumCoalesced_ = 0;
+};
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
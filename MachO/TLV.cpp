@@ -0,0 +1,138 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/TLV.h"
+
+#include "MachO/File.h"
+#include "MachO/Layout.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Endian.h"
+
+#include <cstring>
+
+using namespace llvm::MachO;
+using namespace llvm::support::endian;
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace {
+
+/// The size of a descriptor in __thread_vars: the thunk, a key for the thunk
+/// and the variable's offset in the template.
+constexpr uint64_t TLVDescriptorSize = 24;
+constexpr uint64_t TLVOffsetField = 16;
+
+/// Fill in \c P, which holds the original bytes, for \c R in \c A. Returns
+/// false if \c R isn't a thread-local relocation this can resolve.
+bool resolve(const Layout &L, const SymbolTable &Symtab, const Atom &A,
+             const Relocation &R, Patch &P) {
+  const InputSection &IS = A.getSection();
+  uint64_t Fixup = L.getAddr(A) + (R.Offset - A.getOffset());
+  const Symbol *Sym =
+      R.Sym != nullptr ? &Symtab.resolve(IS.getInputFile(), *R.Sym) : nullptr;
+  uint8_t *Loc = P.Bytes + (R.Offset - A.getOffset() - P.Offset);
+
+  // Descriptors hold their variable's offset in the template. Both
+  // architectures use type 0, *_RELOC_UNSIGNED, for it.
+  if (IS.getType() == S_THREAD_LOCAL_VARIABLES) {
+    if (R.Type != 0 || R.Length != 3 ||
+        R.Offset % TLVDescriptorSize != TLVOffsetField) {
+      return false;
+    }
+    uint64_t Target;
+    if (Sym != nullptr) {
+      if (!Sym->isDefined()) {
+        return false;
+      }
+      Target = L.getAddr(*Sym) + read64le(Loc);
+    } else {
+      const Atom *TargetAtom;
+      uint64_t Offset;
+      if (!IS.decodeTarget(R, TargetAtom, Offset)) {
+        return false;
+      }
+      Target = L.getAddr(*TargetAtom) + Offset;
+    }
+    write64le(Loc, Target - L.getTLVAddr());
+    return true;
+  }
+
+  if (Sym == nullptr || !Sym->isDefined()) {
+    return false;
+  }
+  uint64_t Target = L.getAddr(*Sym) + R.Addend;
+  if (IS.getFile().getTriple().getArch() == Triple::x86_64) {
+    // The opcode is rewritten too, so it must be in the patch.
+    if (R.Type != X86_64_RELOC_TLV || Loc < P.Bytes + 2) {
+      return false;
+    }
+    // movq _v@TLVP(%rip), %reg becomes leaq _v(%rip), %reg.
+    if (Loc[-2] == 0x8b) {
+      Loc[-2] = 0x8d;
+    }
+    write32le(Loc, Target + int32_t(read32le(Loc)) - (Fixup + 4));
+    return true;
+  }
+
+  switch (R.Type) {
+  case ARM64_RELOC_TLVP_LOAD_PAGE21: {
+    int64_t Pages = int64_t(Target >> 12) - int64_t(Fixup >> 12);
+    uint32_t Insn = read32le(Loc) & 0x9f00001f;
+    write32le(Loc, Insn | (uint32_t(Pages) & 0x3) << 29 |
+                       (uint32_t(Pages >> 2) & 0x7ffff) << 5);
+    return true;
+  }
+  case ARM64_RELOC_TLVP_LOAD_PAGEOFF12: {
+    // ldr xd, [xn, _v@TLVPPAGEOFF] becomes add xd, xn, _v@PAGEOFF.
+    uint32_t Insn = read32le(Loc);
+    write32le(Loc, 0x91000000 | uint32_t(Target & 0xfff) << 10 |
+                       (Insn & 0x3ff));
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+bool isThreadLocalTemplate(uint32_t Type) {
+  return Type == S_THREAD_LOCAL_REGULAR || Type == S_THREAD_LOCAL_ZEROFILL;
+}
+
+void resolveTLVRelocations(ArrayRef<const InputFile *> Inputs,
+                           const SymbolTable &Symtab, Layout &L) {
+  std::vector<std::pair<const Atom *, Patch>> Patches;
+  for (const InputFile *IF : Inputs) {
+    for (const auto &Entry : IF->tlvRelocations()) {
+      const Atom &A = *Entry.first;
+      const Relocation &R = *Entry.second;
+      ArrayRef<uint8_t> Contents = A.getContents();
+      // Folded atoms aren't in the output, their leaders speak for them.
+      if (Contents.empty() || L.isFolded(A)) {
+        continue;
+      }
+      // Patches reach at most 2 bytes before their fixup.
+      uint64_t Offset = R.Offset - A.getOffset();
+      Patch P;
+      P.Offset = Offset >= 2 ? Offset - 2 : 0;
+      P.Size = std::min<uint64_t>(Offset + (1u << R.Length), Contents.size()) -
+               P.Offset;
+      memcpy(P.Bytes, Contents.data() + P.Offset, P.Size);
+      if (resolve(L, Symtab, A, R, P)) {
+        Patches.emplace_back(&A, P);
+      }
+    }
+  }
+  L.addPatches(Patches);
+}
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,37 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "MachO/InputFile.h"
+
+#include <cstdint>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+class Layout;
+class SymbolTable;
+
+/// Whether sections of \c Type make up the template every thread's copy of
+/// the thread-local variables is initialized from, i.e. __thread_data and
+/// __thread_bss.
+bool isThreadLocalTemplate(uint32_t Type);
+
+/// Resolve the relocations of \c Inputs which thread-local variables need:
+/// the offsets into the template in __thread_vars descriptors, and the code
+/// loading descriptors, which is rewritten to compute their address since
+/// descriptors are always in the output. Only the relocations the inputs
+/// recorded as \c tlvRelocations are visited, and the results are added to
+/// \c L as patches, so it must have been finalized. Symbols are resolved with
+/// \c Symtab.
+void resolveTLVRelocations(ArrayRef<const InputFile *> Inputs,
+                           const SymbolTable &Symtab, Layout &L);
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -1,5 +1,7 @@
 // Copyright (c) 2020 Daniel Zimmerman
 
+#pragma once
+
 #include "llvm/BinaryFormat/MachO.h"
 #include "llvm/Support/MemoryBuffer.h"
 
@@ -0,0 +1,352 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Writer.h"
+
+#include "MachO/Builder.h"
+
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/xxhash.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(LLVM_ON_UNIX)
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace Builder {
+
+PieceHasher::PieceHasher(uint64_t Size, uint64_t PieceSize)
+    : Size_(Size), PieceSize_(PieceSize),
+      Digests_(divideCeil(Size, PieceSize)) {}
+
+void PieceHasher::hashPiece(size_t Index, ArrayRef<uint8_t> Bytes) {
+  Digests_[Index] = xxHash64(Bytes);
+}
+
+void PieceHasher::hashNext(ArrayRef<uint8_t> Bytes) {
+  while (!Bytes.empty()) {
+    uint64_t Left = getPieceEnd_(Cursor_) - Cursor_;
+    if (Partial_.empty() && Bytes.size() >= Left) {
+      hashPiece(Cursor_ / PieceSize_, Bytes.take_front(Left));
+      Bytes = Bytes.drop_front(Left);
+      Cursor_ += Left;
+      continue;
+    }
+
+    uint64_t PieceBegin = Cursor_ - Partial_.size();
+    size_t Count = std::min<uint64_t>(Bytes.size(), Left);
+    Partial_.insert(Partial_.end(), Bytes.begin(), Bytes.begin() + Count);
+    Bytes = Bytes.drop_front(Count);
+    Cursor_ += Count;
+    if (Cursor_ == getPieceEnd_(PieceBegin)) {
+      hashPiece(PieceBegin / PieceSize_, Partial_);
+      Partial_.clear();
+    }
+  }
+}
+
+Error MappedWriter::write(sys::fs::file_t FD, uint64_t Size,
+                          ArrayRef<const Chunk *> Chunks,
+                          PieceHasher *Hasher) {
+  if (Size == 0) {
+    return Error::success();
+  }
+
+  std::error_code EC;
+  sys::fs::mapped_file_region Region(
+      FD, sys::fs::mapped_file_region::readwrite, Size, 0, EC);
+  if (EC) {
+    return errorCodeToError(EC);
+  }
+
+  // Big chunks, e.g. the __text of a unity build, are copied in pieces so
+  // that they spread over every thread.
+  auto Base = (uint8_t *)Region.data();
+  std::vector<uint64_t> Sizes;
+  Sizes.reserve(Chunks.size());
+  for (const Chunk *C : Chunks) {
+    Sizes.push_back(C->size());
+  }
+  Scheduler::get().forEachRange(
+      Sizes, [&](size_t I, uint64_t Begin, uint64_t End) {
+        Chunks[I]->write(Base + Chunks[I]->getFileOffset() + Begin, Begin, End);
+      });
+
+  // Hash the output while it's still mapped rather than reading it back.
+  if (Hasher) {
+    Scheduler::get().forEachRange(
+        Size,
+        [&](size_t, uint64_t Begin, uint64_t End) {
+          Hasher->hashPiece(Begin / Hasher->getPieceSize(),
+                            ArrayRef<uint8_t>(Base + Begin, Base + End));
+        },
+        Hasher->getPieceSize());
+  }
+  return Error::success();
+}
+
+constexpr size_t StreamingWriter::DefaultBufferSize;
+constexpr unsigned StreamingWriter::DefaultNumBuffers;
+
+#if defined(LLVM_ON_UNIX)
+
+namespace {
+
+/// A buffer from the pool which holds the bytes [Offset, Offset + Size) of the
+/// output.
+struct FilledBuffer {
+  unsigned Index;
+  uint64_t Offset;
+  size_t Size;
+};
+
+/// Hands empty buffers to the thread filling them and filled buffers to the
+/// I/O thread. Buffers are filled and written in file order.
+class BufferPipe {
+public:
+  explicit BufferPipe(unsigned NumBuffers) {
+    for (unsigned I = 0; I < NumBuffers; ++I) {
+      Free_.push_back(I);
+    }
+  }
+
+  /// Blocks until a buffer is free. Returns false if writing failed and the
+  /// producer should stop.
+  bool acquireFree(unsigned &Index) {
+    std::unique_lock<std::mutex> Lock(M_);
+    CV_.wait(Lock, [this]() { return !Free_.empty() || EC_; });
+    if (EC_) {
+      return false;
+    }
+    Index = Free_.front();
+    Free_.pop_front();
+    return true;
+  }
+
+  void pushFilled(FilledBuffer B) {
+    std::lock_guard<std::mutex> Lock(M_);
+    Filled_.push_back(B);
+    CV_.notify_all();
+  }
+
+  /// Blocks until at least one buffer is filled, then takes every filled
+  /// buffer. Returns false once the producer is done and nothing is left.
+  bool takeFilled(SmallVectorImpl<FilledBuffer> &Batch) {
+    std::unique_lock<std::mutex> Lock(M_);
+    CV_.wait(Lock, [this]() { return !Filled_.empty() || Done_; });
+    if (Filled_.empty()) {
+      return false;
+    }
+    Batch.append(Filled_.begin(), Filled_.end());
+    Filled_.clear();
+    return true;
+  }
+
+  void release(ArrayRef<FilledBuffer> Batch, std::error_code EC) {
+    std::lock_guard<std::mutex> Lock(M_);
+    for (const FilledBuffer &B : Batch) {
+      Free_.push_back(B.Index);
+    }
+    if (EC && !EC_) {
+      EC_ = EC;
+    }
+    CV_.notify_all();
+  }
+
+  void finish() {
+    std::lock_guard<std::mutex> Lock(M_);
+    Done_ = true;
+    CV_.notify_all();
+  }
+
+  std::error_code getError() {
+    std::lock_guard<std::mutex> Lock(M_);
+    return EC_;
+  }
+
+private:
+  std::mutex M_;
+  std::condition_variable CV_;
+  std::deque<unsigned> Free_;
+  std::deque<FilledBuffer> Filled_;
+  bool Done_ = false;
+  std::error_code EC_;
+};
+
+/// Write every byte described by \c IOV at \c Offset, retrying short writes.
+std::error_code pwritevAll(int FD, MutableArrayRef<iovec> IOV,
+                           uint64_t Offset) {
+  iovec *Cur = IOV.begin();
+  iovec *End = IOV.end();
+  while (Cur != End) {
+    int Count = std::min<ptrdiff_t>(End - Cur, IOV_MAX);
+    ssize_t Written = ::pwritev(FD, Cur, Count, Offset);
+    if (Written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return std::error_code(errno, std::generic_category());
+    }
+    if (Written == 0) {
+      return make_error_code(errc::io_error);
+    }
+    Offset += Written;
+    while (Cur != End && size_t(Written) >= Cur->iov_len) {
+      Written -= Cur->iov_len;
+      ++Cur;
+    }
+    if (Written != 0) {
+      Cur->iov_base = (uint8_t *)Cur->iov_base + Written;
+      Cur->iov_len -= Written;
+    }
+  }
+  return std::error_code();
+}
+
+} // namespace
+
+Error StreamingWriter::write(sys::fs::file_t FD, uint64_t Size,
+                             ArrayRef<const Chunk *> Chunks,
+                             PieceHasher *Hasher) {
+  std::vector<const Chunk *> Sorted(Chunks.begin(), Chunks.end());
+  llvm::stable_sort(Sorted, [](const Chunk *LHS, const Chunk *RHS) {
+    return LHS->getFileOffset() < RHS->getFileOffset();
+  });
+
+  std::vector<std::unique_ptr<uint8_t[]>> Buffers;
+  for (unsigned I = 0; I < NumBuffers_; ++I) {
+    Buffers.push_back(std::make_unique<uint8_t[]>(BufferSize_));
+  }
+
+  BufferPipe Pipe(NumBuffers_);
+
+  // Consecutive filled buffers cover consecutive ranges of the file, so
+  // everything taken at once goes out in a single pwritev. Buffers are hashed
+  // here too, in file order, so that hashing overlaps with filling.
+  std::thread IOThread([&]() {
+    SmallVector<FilledBuffer, 8> Batch;
+    SmallVector<iovec, 8> IOV;
+    while (Pipe.takeFilled(Batch)) {
+      IOV.clear();
+      for (const FilledBuffer &B : Batch) {
+        if (Hasher) {
+          Hasher->hashNext(
+              ArrayRef<uint8_t>(Buffers[B.Index].get(), B.Size));
+        }
+        IOV.push_back(iovec{Buffers[B.Index].get(), B.Size});
+      }
+      std::error_code EC = Pipe.getError();
+      if (!EC) {
+        EC = pwritevAll(FD, IOV, Batch.front().Offset);
+      }
+      Pipe.release(Batch, EC);
+      Batch.clear();
+    }
+  });
+
+  size_t NextChunk = 0;
+  for (uint64_t Begin = 0; Begin < Size; Begin += BufferSize_) {
+    uint64_t End = std::min<uint64_t>(Begin + BufferSize_, Size);
+    unsigned Index;
+    if (!Pipe.acquireFree(Index)) {
+      break;
+    }
+    uint8_t *Buf = Buffers[Index].get();
+
+    while (NextChunk < Sorted.size() &&
+           Sorted[NextChunk]->getFileOffset() + Sorted[NextChunk]->size() <=
+               Begin) {
+      ++NextChunk;
+    }
+
+    // Copy every piece of a chunk that lands in this buffer, zeroing the
+    // padding between chunks.
+    uint64_t Cursor = Begin;
+    for (size_t I = NextChunk;
+         I < Sorted.size() && Sorted[I]->getFileOffset() < End; ++I) {
+      const Chunk *C = Sorted[I];
+      uint64_t PieceBegin = std::max(Begin, C->getFileOffset());
+      uint64_t PieceEnd = std::min(End, C->getFileOffset() + C->size());
+      if (PieceBegin >= PieceEnd) {
+        continue;
+      }
+      memset(Buf + (Cursor - Begin), 0, PieceBegin - Cursor);
+      C->write(Buf + (PieceBegin - Begin), PieceBegin - C->getFileOffset(),
+               PieceEnd - C->getFileOffset());
+      Cursor = PieceEnd;
+    }
+    memset(Buf + (Cursor - Begin), 0, End - Cursor);
+
+    Pipe.pushFilled(FilledBuffer{Index, Begin, size_t(End - Begin)});
+  }
+
+  Pipe.finish();
+  IOThread.join();
+  return errorCodeToError(Pipe.getError());
+}
+
+Error writeAt(sys::fs::file_t FD, uint64_t Offset, ArrayRef<uint8_t> Bytes) {
+  while (!Bytes.empty()) {
+    ssize_t Written = ::pwrite(FD, Bytes.data(), Bytes.size(), Offset);
+    if (Written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errorCodeToError(std::error_code(errno, std::generic_category()));
+    }
+    if (Written == 0) {
+      return errorCodeToError(make_error_code(errc::io_error));
+    }
+    Offset += Written;
+    Bytes = Bytes.drop_front(Written);
+  }
+  return Error::success();
+}
+
+#else
+
+Error StreamingWriter::write(sys::fs::file_t, uint64_t,
+                             ArrayRef<const Chunk *>, PieceHasher *) {
+  return createStringError(errc::function_not_supported,
+                           "streaming output is unsupported on this platform");
+}
+
+Error writeAt(sys::fs::file_t FD, uint64_t Offset, ArrayRef<uint8_t> Bytes) {
+  // Mappings start on a page boundary, so map just the pages being patched.
+  uint64_t Begin = alignDown(Offset, sys::fs::mapped_file_region::alignment());
+  std::error_code EC;
+  sys::fs::mapped_file_region Region(FD,
+                                     sys::fs::mapped_file_region::readwrite,
+                                     Offset - Begin + Bytes.size(), Begin, EC);
+  if (EC) {
+    return errorCodeToError(EC);
+  }
+  memcpy(Region.data() + (Offset - Begin), Bytes.data(), Bytes.size());
+  return Error::success();
+}
+
+#endif
+
+} // end namespace Builder
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,108 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+
+namespace Builder {
+
+class Chunk;
+
+/// Hashes the output in fixed size pieces as a writer produces it, so that a
+/// digest of the output, e.g. its UUID, never requires reading it back.
+class PieceHasher {
+public:
+  PieceHasher(uint64_t Size, uint64_t PieceSize);
+
+  uint64_t getPieceSize() const { return PieceSize_; }
+
+  /// Hash piece \c Index of the output, whose bytes are \c Bytes. Different
+  /// pieces may be hashed concurrently.
+  void hashPiece(size_t Index, ArrayRef<uint8_t> Bytes);
+
+  /// Hash the next \c Bytes of the output, which must be handed over in file
+  /// order. Pieces split between calls are buffered until they're complete.
+  void hashNext(ArrayRef<uint8_t> Bytes);
+
+  /// The digest of each piece of the output.
+  ArrayRef<uint64_t> getDigests() const { return Digests_; }
+
+private:
+  uint64_t getPieceEnd_(uint64_t Offset) const {
+    return std::min((Offset / PieceSize_ + 1) * PieceSize_, Size_);
+  }
+
+  uint64_t Size_;
+  uint64_t PieceSize_;
+  uint64_t Cursor_ = 0;
+  std::vector<uint64_t> Digests_;
+  std::vector<uint8_t> Partial_;
+};
+
+/// A strategy for getting the laid out chunks of a \c Builder::File into the
+/// output file.
+class Writer {
+public:
+  virtual ~Writer() {}
+
+  /// Write \c Chunks to \c FD, which refers to a file that has already been
+  /// resized to \c Size bytes. Bytes not covered by any chunk must read as 0.
+  /// If \c Hasher is set, every piece of the output is hashed with it too.
+  virtual Error write(sys::fs::file_t FD, uint64_t Size,
+                      ArrayRef<const Chunk *> Chunks,
+                      PieceHasher *Hasher) = 0;
+};
+
+/// Overwrite the bytes at \c Offset of the already written file \c FD with
+/// \c Bytes.
+Error writeAt(sys::fs::file_t FD, uint64_t Offset, ArrayRef<uint8_t> Bytes);
+
+/// Maps the whole output into memory and writes every chunk in place. This is
+/// the fastest writer when the output comfortably fits in memory.
+class MappedWriter : public Writer {
+public:
+  Error write(sys::fs::file_t FD, uint64_t Size,
+              ArrayRef<const Chunk *> Chunks, PieceHasher *Hasher) override;
+};
+
+/// Streams the output to disk through a fixed pool of reusable buffers, so the
+/// memory used to write the output is bounded by the pool no matter how big the
+/// output is. The calling thread fills buffers in file order while a dedicated
+/// I/O thread writes filled buffers out with \c pwritev, so copying the next
+/// piece of the output overlaps with writing the previous one.
+class StreamingWriter : public Writer {
+public:
+  static constexpr size_t DefaultBufferSize = 1 << 20;
+  static constexpr unsigned DefaultNumBuffers = 4;
+
+  explicit StreamingWriter(size_t BufferSize = DefaultBufferSize,
+                           unsigned NumBuffers = DefaultNumBuffers)
+      : BufferSize_(std::max<size_t>(BufferSize, 1)),
+        NumBuffers_(std::max(NumBuffers, 2u)) {}
+
+  Error write(sys::fs::file_t FD, uint64_t Size,
+              ArrayRef<const Chunk *> Chunks, PieceHasher *Hasher) override;
+
+private:
+  size_t BufferSize_;
+  unsigned NumBuffers_;
+};
+
+} // end namespace Builder
+
+} // end namespace MachO
+
+} // end namespace ald
+
+} // end namespace llvm
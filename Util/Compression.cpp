@@ -0,0 +1,157 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/Compression.h"
+
+#include "Util/Scheduler.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if LLVM_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <atomic>
+
+namespace llvm {
+
+namespace ald {
+
+#if LLVM_ENABLE_ZLIB
+
+namespace {
+
+/// The default compression level's zlib header.
+constexpr uint8_t ZlibHeader[] = {0x78, 0x9c};
+
+/// Deflate \c In as a raw stream, without zlib's header and checksum, into
+/// \c Out. Unless \c Last, the stream ends with a sync flush instead of a final
+/// block so that the next block's stream can follow it directly. \c Out's
+/// capacity is left at the worst case.
+bool deflateBlock(ArrayRef<uint8_t> In, bool Last, std::vector<uint8_t> &Out) {
+  z_stream S = {};
+  if (deflateInit2(&S, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  // A sync flush adds an empty stored block on top of the bound.
+  Out.resize(deflateBound(&S, In.size()) + 16);
+  S.next_in = const_cast<Bytef *>(In.data());
+  S.avail_in = In.size();
+  S.next_out = Out.data();
+  S.avail_out = Out.size();
+  int RC = deflate(&S, Last ? Z_FINISH : Z_SYNC_FLUSH);
+  bool OK = Last ? RC == Z_STREAM_END : RC == Z_OK && S.avail_in == 0;
+  Out.resize(S.total_out);
+  deflateEnd(&S);
+  return OK;
+}
+
+} // namespace
+
+bool isCompressionAvailable() { return true; }
+
+Expected<std::unique_ptr<ZlibStream>> ZlibStream::create(size_t NumBlocks,
+                                                         FillFn Fill) {
+  // Even nothing needs a final block.
+  if (NumBlocks == 0) {
+    NumBlocks = 1;
+    Fill = [](size_t, std::vector<uint8_t> &) {};
+  }
+
+  int FD;
+  SmallString<128> Path;
+  if (auto EC = sys::fs::createTemporaryFile("ald-zlib", "z", FD, Path)) {
+    return errorCodeToError(EC);
+  }
+  // Nothing but the stream refers to the spill, so it goes when that does.
+  sys::fs::remove(Path);
+  std::unique_ptr<ZlibStream> S(
+      new ZlibStream(sys::fs::convertFDToNativeFile(FD)));
+  raw_fd_ostream OS(FD, /*shouldClose=*/false);
+  OS.write(reinterpret_cast<const char *>(ZlibHeader), sizeof(ZlibHeader));
+
+  struct Deflated {
+    std::vector<uint8_t> Bytes;
+    uint64_t Uncompressed;
+    uLong Adler;
+  };
+  uLong Adler = adler32(0, nullptr, 0);
+  size_t WindowSize = Scheduler::get().getNumThreads();
+  for (size_t Begin = 0; Begin < NumBlocks; Begin += WindowSize) {
+    std::vector<Deflated> Window(std::min(WindowSize, NumBlocks - Begin));
+    std::atomic<bool> Failed{false};
+    Scheduler::get().forEach(Window.size(), [&](size_t I) {
+      std::vector<uint8_t> In;
+      Fill(Begin + I, In);
+      if (!deflateBlock(In, Begin + I + 1 == NumBlocks, Window[I].Bytes)) {
+        Failed = true;
+      }
+      Window[I].Uncompressed = In.size();
+      Window[I].Adler = adler32(adler32(0, nullptr, 0), In.data(), In.size());
+    });
+    if (Failed) {
+      return createStringError(std::errc::not_enough_memory,
+                               "zlib failed to compress");
+    }
+    for (const Deflated &D : Window) {
+      OS.write(reinterpret_cast<const char *>(D.Bytes.data()), D.Bytes.size());
+      S->UncompressedSize_ += D.Uncompressed;
+      Adler = adler32_combine(Adler, D.Adler, D.Uncompressed);
+    }
+  }
+
+  uint8_t Trailer[4];
+  support::endian::write32be(Trailer, Adler);
+  OS.write(reinterpret_cast<const char *>(Trailer), sizeof(Trailer));
+  OS.flush();
+  if (auto EC = OS.error()) {
+    OS.clear_error();
+    return errorCodeToError(EC);
+  }
+  S->Size_ = OS.tell();
+  return std::move(S);
+}
+
+void ZlibStream::read(uint8_t *Buf, uint64_t Begin, uint64_t End) const {
+  while (Begin < End) {
+    auto ReadOrErr = sys::fs::readNativeFileSlice(
+        File_,
+        MutableArrayRef<char>(reinterpret_cast<char *>(Buf), End - Begin),
+        Begin);
+    if (!ReadOrErr) {
+      report_fatal_error(ReadOrErr.takeError());
+    }
+    if (*ReadOrErr == 0) {
+      report_fatal_error("a compressed stream's spill was truncated");
+    }
+    Buf += *ReadOrErr;
+    Begin += *ReadOrErr;
+  }
+}
+
+#else
+
+bool isCompressionAvailable() { return false; }
+
+Expected<std::unique_ptr<ZlibStream>> ZlibStream::create(size_t NumBlocks,
+                                                         FillFn Fill) {
+  return createStringError(std::errc::not_supported,
+                           "ald was built without zlib");
+}
+
+void ZlibStream::read(uint8_t *Buf, uint64_t Begin, uint64_t End) const {
+  llvm_unreachable("Streams can't be created without zlib");
+}
+
+#endif
+
+ZlibStream::~ZlibStream() { sys::fs::closeFile(File_); }
+
+} // end namespace ald
+
+} // end namespace llvm
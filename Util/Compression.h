@@ -0,0 +1,70 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+/// Whether ald was built with zlib. Without it \c ZlibStream::create fails.
+bool isCompressionAvailable();
+
+/// The size of the blocks callers split what they compress into. Smaller
+/// blocks spread better over threads but compress a little worse, since no
+/// block can refer back into the one before it.
+constexpr uint64_t DefaultCompressionBlockSize = 1 << 20;
+
+/// A zlib stream whose blocks are deflated independently, each ending on a
+/// byte boundary, and stitched together with a combined checksum like pigz
+/// does, so any zlib can inflate it. Blocks are compressed in parallel, a
+/// window of them at a time, and each is compressed exactly once: the stream
+/// is spilled to an unlinked temporary file as the windows complete and read
+/// back from there. So neither the uncompressed nor the compressed data is
+/// ever held in memory as a whole, and the stream's size is known before
+/// anything reads it.
+class ZlibStream {
+public:
+  /// Fill \c Buf, which is empty, with the uncompressed bytes of block
+  /// \c Index. Blocks are filled concurrently, each once.
+  using FillFn = std::function<void(size_t Index, std::vector<uint8_t> &Buf)>;
+
+  /// The stream of the concatenation of \c NumBlocks blocks filled by
+  /// \c Fill. Fails if zlib does, if the stream can't be spilled, or if ald
+  /// was built without zlib.
+  static Expected<std::unique_ptr<ZlibStream>> create(size_t NumBlocks,
+                                                      FillFn Fill);
+
+  ZlibStream(const ZlibStream &) = delete;
+  ZlibStream &operator=(const ZlibStream &) = delete;
+  ~ZlibStream();
+
+  /// The size of the compressed stream.
+  uint64_t size() const { return Size_; }
+
+  /// The size of the data the stream inflates to.
+  uint64_t getUncompressedSize() const { return UncompressedSize_; }
+
+  /// Copy bytes [Begin, End) of the stream to \c Buf. Safe to call
+  /// concurrently.
+  void read(uint8_t *Buf, uint64_t Begin, uint64_t End) const;
+
+private:
+  explicit ZlibStream(sys::fs::file_t File) : File_(File) {}
+
+  /// The spilled stream.
+  sys::fs::file_t File_;
+  uint64_t Size_ = 0;
+  uint64_t UncompressedSize_ = 0;
+};
+
+} // end namespace ald
+
+} // end namespace llvm
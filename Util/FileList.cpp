@@ -0,0 +1,73 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/FileList.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace {
+
+/// Call \c Fn with every non-empty line of \c Contents, without its line
+/// ending.
+template <typename Fn> void forEachLine(StringRef Contents, Fn F) {
+  while (!Contents.empty()) {
+    StringRef Line;
+    std::tie(Line, Contents) = Contents.split('\n');
+    if (!Line.empty() && Line.back() == '\r') {
+      Line = Line.drop_back();
+    }
+    if (!Line.empty()) {
+      F(Line);
+    }
+  }
+}
+
+} // namespace
+
+Expected<ArrayRef<StringRef>> FileList::add(StringRef Path, StringRef Dir) {
+  auto MBOrErr = errorOrToExpected(
+      MemoryBuffer::getFile(Path, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false));
+  if (auto Err = MBOrErr.takeError()) {
+    return std::move(Err);
+  }
+  return add(std::move(*MBOrErr), Dir);
+}
+
+ArrayRef<StringRef> FileList::add(std::unique_ptr<MemoryBuffer> MB,
+                                  StringRef Dir) {
+  Lists_.emplace_back();
+  std::vector<StringRef> &Paths = Lists_.back();
+  StringRef Contents = MB->getBuffer();
+  // One path per line is a good enough guess to avoid growing the list over
+  // and over.
+  Paths.reserve(Contents.count('\n') + 1);
+  forEachLine(Contents, [&](StringRef Line) {
+    if (Dir.empty() || sys::path::is_absolute(Line)) {
+      Paths.push_back(Line);
+      return;
+    }
+    SmallString<128> Joined(Dir);
+    sys::path::append(Joined, Line);
+    Paths.push_back(Saver_.save(Joined.str()));
+  });
+  Buffers_.push_back(std::move(MB));
+  return Paths;
+}
+
+bool FileList::isPlainList(StringRef Contents) {
+  bool Plain = true;
+  forEachLine(Contents, [&](StringRef Line) {
+    Plain &= Line.front() != '-' && Line.front() != '@' &&
+             Line.find_first_of(" \t\"'\\") == StringRef::npos;
+  });
+  return Plain;
+}
+
+} // end namespace ald
+
+} // end namespace llvm
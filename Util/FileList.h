@@ -0,0 +1,54 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+/// Lists of input paths, one per line, as given to -filelist or in a response
+/// file. Lists are mapped rather than read and the paths they hold refer
+/// straight into the mapping, so that a list of many thousands of inputs
+/// doesn't cost an allocation per path.
+class FileList {
+public:
+  FileList() : Saver_(Alloc_) {}
+
+  FileList(const FileList &) = delete;
+  FileList &operator=(const FileList &) = delete;
+
+  /// Map the list at \c Path and return its paths. Relative paths are resolved
+  /// against \c Dir, if it isn't empty. The paths live as long as this object.
+  Expected<ArrayRef<StringRef>> add(StringRef Path, StringRef Dir = "");
+
+  /// Like \c add, for a list which has already been mapped.
+  ArrayRef<StringRef> add(std::unique_ptr<MemoryBuffer> MB,
+                          StringRef Dir = "");
+
+  /// Whether \c Contents only holds a path per line, i.e. has no options,
+  /// quoting or escapes which a response file parser would have to handle.
+  static bool isPlainList(StringRef Contents);
+
+private:
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers_;
+  /// Each list's paths. A deque so that returned lists never move.
+  std::deque<std::vector<StringRef>> Lists_;
+  /// Holds paths which had to be joined with a directory.
+  BumpPtrAllocator Alloc_;
+  StringSaver Saver_;
+};
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -61,7 +61,7 @@ private:
   PathList SDKPrefixes_;
   Path Cwd_;
   SmallVector<std::string, 16> Paths_;
-  size_t NumAbsolute_;
+  size_t NumAbsolute_ = 0;
 };
 
 namespace details {
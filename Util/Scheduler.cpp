@@ -0,0 +1,153 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/Scheduler.h"
+
+#include "llvm/Support/Parallel.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+namespace {
+
+/// The tasks a worker has left, [Begin, End) packed into one word so that the
+/// owner and thieves can update them with a single compare and swap. Padded
+/// so that workers don't share cache lines.
+struct alignas(64) TaskRange {
+  std::atomic<uint64_t> Packed{0};
+
+  static uint64_t pack(uint32_t Begin, uint32_t End) {
+    return uint64_t(Begin) << 32 | End;
+  }
+  static uint32_t begin(uint64_t P) { return P >> 32; }
+  static uint32_t end(uint64_t P) { return uint32_t(P); }
+
+  /// Take the first task, as the owner.
+  bool pop(uint32_t &Task) {
+    uint64_t P = Packed.load(std::memory_order_relaxed);
+    while (begin(P) < end(P)) {
+      if (Packed.compare_exchange_weak(P, pack(begin(P) + 1, end(P)))) {
+        Task = begin(P);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Take the back half of the tasks, as a thief.
+  bool steal(uint32_t &Begin, uint32_t &End) {
+    uint64_t P = Packed.load(std::memory_order_relaxed);
+    while (begin(P) < end(P)) {
+      uint32_t Mid = begin(P) + (end(P) - begin(P)) / 2;
+      if (Packed.compare_exchange_weak(P, pack(begin(P), Mid))) {
+        Begin = Mid;
+        End = end(P);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/// Run every task in [0, NumTasks) on \c NumThreads threads. Each thread
+/// starts with a contiguous share of the tasks, which keeps neighbouring
+/// pieces of an item on one thread, and steals from the others once it runs
+/// out. Tasks are never added, so a thread which finds every share empty is
+/// done: whatever is left is already being run by its thief.
+void run(unsigned NumThreads, size_t NumTasks,
+         function_ref<void(size_t)> Task) {
+  if (NumTasks == 0) {
+    return;
+  }
+  NumThreads = std::min<size_t>(NumThreads, NumTasks);
+  if (NumThreads <= 1) {
+    for (size_t I = 0; I < NumTasks; ++I) {
+      Task(I);
+    }
+    return;
+  }
+
+  assert(NumTasks <= UINT32_MAX && "Too many tasks");
+  auto Ranges = std::make_unique<TaskRange[]>(NumThreads);
+  for (unsigned W = 0; W < NumThreads; ++W) {
+    Ranges[W].Packed = TaskRange::pack(NumTasks * W / NumThreads,
+                                       NumTasks * (W + 1) / NumThreads);
+  }
+
+  auto Work = [&](unsigned Self) {
+    for (;;) {
+      uint32_t T;
+      while (Ranges[Self].pop(T)) {
+        Task(T);
+      }
+      bool Stole = false;
+      for (unsigned I = 1; I < NumThreads && !Stole; ++I) {
+        uint32_t Begin, End;
+        if (Ranges[(Self + I) % NumThreads].steal(Begin, End)) {
+          Ranges[Self].Packed = TaskRange::pack(Begin, End);
+          Stole = true;
+        }
+      }
+      if (!Stole) {
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> Threads;
+  Threads.reserve(NumThreads - 1);
+  for (unsigned W = 1; W < NumThreads; ++W) {
+    Threads.emplace_back(Work, W);
+  }
+  Work(0);
+  for (std::thread &T : Threads) {
+    T.join();
+  }
+}
+
+} // namespace
+
+constexpr uint64_t Scheduler::DefaultGrainSize;
+
+Scheduler::Scheduler(unsigned NumThreads)
+    : NumThreads_(NumThreads != 0 ? NumThreads
+                                  : parallel::strategy.compute_thread_count()) {
+}
+
+void Scheduler::forEach(size_t N, function_ref<void(size_t)> F) const {
+  run(NumThreads_, N, F);
+}
+
+void Scheduler::forEachRange(ArrayRef<uint64_t> Sizes,
+                             function_ref<void(size_t, uint64_t, uint64_t)> F,
+                             uint64_t GrainSize) const {
+  struct Piece {
+    size_t Item;
+    uint64_t Begin;
+    uint64_t End;
+  };
+  GrainSize = std::max<uint64_t>(GrainSize, 1);
+  std::vector<Piece> Pieces;
+  for (size_t I = 0; I < Sizes.size(); ++I) {
+    for (uint64_t Begin = 0; Begin < Sizes[I]; Begin += GrainSize) {
+      Pieces.push_back({I, Begin, std::min(Sizes[I], Begin + GrainSize)});
+    }
+  }
+  run(NumThreads_, Pieces.size(), [&](size_t I) {
+    F(Pieces[I].Item, Pieces[I].Begin, Pieces[I].End);
+  });
+}
+
+const Scheduler &Scheduler::get() {
+  static const Scheduler S;
+  return S;
+}
+
+} // end namespace ald
+
+} // end namespace llvm
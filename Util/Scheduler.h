@@ -0,0 +1,53 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+
+#include <cstdint>
+
+namespace llvm {
+
+namespace ald {
+
+/// The execution engine behind every parallel phase of a link: copying
+/// sections to the output, hashing and folding. Work is handed out in small
+/// tasks which idle threads steal from busy ones, so that a single input
+/// holding most of the bytes doesn't leave every other thread waiting.
+///
+/// Threads only exist while a call is running, so that nothing is left behind
+/// in a process which forks, e.g. ald -daemon.
+class Scheduler {
+public:
+  /// The size of the pieces \c forEachRange splits work into unless told
+  /// otherwise. Small enough that big items spread over every thread, large
+  /// enough that the cost of handing out a piece doesn't matter.
+  static constexpr uint64_t DefaultGrainSize = 256 * 1024;
+
+  /// Run work on \c NumThreads threads, including the calling one. 0 uses as
+  /// many as \c llvm::parallel::strategy allows.
+  explicit Scheduler(unsigned NumThreads = 0);
+
+  unsigned getNumThreads() const { return NumThreads_; }
+
+  /// Call \c F with every index in [0, N), in parallel.
+  void forEach(size_t N, function_ref<void(size_t)> F) const;
+
+  /// Split every item into pieces of at most \c GrainSize bytes and call
+  /// \c F(Item, Begin, End) for each of them, in parallel. The pieces of an
+  /// item cover [0, Sizes[Item]), empty items aren't visited.
+  void forEachRange(ArrayRef<uint64_t> Sizes,
+                    function_ref<void(size_t, uint64_t, uint64_t)> F,
+                    uint64_t GrainSize = DefaultGrainSize) const;
+
+  /// The scheduler shared by every phase.
+  static const Scheduler &get();
+
+private:
+  unsigned NumThreads_;
+};
+
+} // end namespace ald
+
+} // end namespace llvm
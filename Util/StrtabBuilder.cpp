@@ -0,0 +1,161 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/StrtabBuilder.h"
+
+#include "Util/Scheduler.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <array>
+
+namespace llvm {
+
+namespace ald {
+
+namespace {
+
+using Entry = StrtabBuilder::Entry;
+
+/// Every character plus one key for strings which have run out.
+constexpr size_t NumKeys = 257;
+
+/// Buckets this small are sorted by comparison rather than split further.
+constexpr size_t SmallSortSize = 32;
+
+/// The key of \c S at \c Depth: its characters from the last one backwards,
+/// then 0 once they run out.
+unsigned keyAt(StringRef S, size_t Depth) {
+  return Depth < S.size() ? uint8_t(S[S.size() - 1 - Depth]) + 1 : 0;
+}
+
+/// Whether reversed \c A sorts before reversed \c B in descending order, given
+/// that they share their last \c Depth characters. A string sorts after every
+/// longer string ending with it.
+bool reversedGreater(const Entry *A, const Entry *B, size_t Depth) {
+  StringRef SA = A->S, SB = B->S;
+  size_t N = std::min(SA.size(), SB.size());
+  for (size_t I = Depth; I < N; ++I) {
+    uint8_t CA = SA[SA.size() - 1 - I], CB = SB[SB.size() - 1 - I];
+    if (CA != CB) {
+      return CA > CB;
+    }
+  }
+  return SA.size() > SB.size();
+}
+
+/// A range of entries sharing their last \c Depth characters which still has
+/// to be sorted.
+struct Bucket {
+  size_t Begin;
+  size_t End;
+  size_t Depth;
+};
+
+/// Sort \c Items by key at \c Depth, descending, and call \c F with every
+/// bucket that still needs sorting. Strings which have run out are equal and
+/// so already sorted.
+template <typename Fn>
+void splitBucket(MutableArrayRef<Entry *> Items, MutableArrayRef<Entry *> Tmp,
+                 size_t Begin, size_t Depth, Fn F) {
+  std::array<size_t, NumKeys> Counts = {};
+  for (Entry *E : Items) {
+    ++Counts[keyAt(E->S, Depth)];
+  }
+  std::array<size_t, NumKeys> Starts;
+  size_t Pos = 0;
+  for (size_t K = NumKeys; K-- > 0;) {
+    Starts[K] = Pos;
+    Pos += Counts[K];
+  }
+  std::array<size_t, NumKeys> Next = Starts;
+  for (Entry *E : Items) {
+    Tmp[Next[keyAt(E->S, Depth)]++] = E;
+  }
+  std::copy(Tmp.begin(), Tmp.begin() + Items.size(), Items.begin());
+  for (size_t K = NumKeys; K-- > 1;) {
+    if (Counts[K] > 1) {
+      F(Bucket{Begin + Starts[K], Begin + Starts[K] + Counts[K], Depth + 1});
+    }
+  }
+}
+
+/// Sort \c Items, which share their last \c Depth characters, on this thread.
+void sortBucket(MutableArrayRef<Entry *> Items, MutableArrayRef<Entry *> Tmp,
+                size_t Depth) {
+  if (Items.size() <= SmallSortSize) {
+    std::sort(Items.begin(), Items.end(), [Depth](Entry *A, Entry *B) {
+      return reversedGreater(A, B, Depth);
+    });
+    return;
+  }
+  splitBucket(Items, Tmp, 0, Depth, [&](const Bucket &B) {
+    sortBucket(Items.slice(B.Begin, B.End - B.Begin),
+               Tmp.slice(B.Begin, B.End - B.Begin), B.Depth);
+  });
+}
+
+} // namespace
+
+void StrtabBuilder::finalize() {
+  std::vector<Entry *> Items;
+  Items.reserve(Entries_.size());
+  for (Entry &E : Entries_) {
+    if (!E.S.empty()) {
+      Items.push_back(&E);
+    }
+  }
+  std::vector<Entry *> Tmp(Items.size());
+  MutableArrayRef<Entry *> AllItems(Items), AllTmp(Tmp);
+
+  // Split the largest buckets on this thread until there are enough small
+  // ones to keep every thread busy, then sort those in parallel.
+  const Scheduler &S = Scheduler::get();
+  size_t Grain =
+      std::max(SmallSortSize, Items.size() / (8 * S.getNumThreads()));
+  std::vector<Bucket> Pending = {{0, Items.size(), 0}};
+  std::vector<Bucket> Ready;
+  while (!Pending.empty()) {
+    Bucket B = Pending.back();
+    Pending.pop_back();
+    if (B.End - B.Begin <= Grain) {
+      Ready.push_back(B);
+      continue;
+    }
+    splitBucket(AllItems.slice(B.Begin, B.End - B.Begin),
+                AllTmp.slice(B.Begin, B.End - B.Begin),
+                B.Begin, B.Depth,
+                [&](const Bucket &Sub) { Pending.push_back(Sub); });
+  }
+  S.forEach(Ready.size(), [&](size_t I) {
+    const Bucket &B = Ready[I];
+    sortBucket(AllItems.slice(B.Begin, B.End - B.Begin),
+               AllTmp.slice(B.Begin, B.End - B.Begin),
+               B.Depth);
+  });
+
+  // Each string is either the tail of the last string written or written
+  // itself.
+  Data_.assign(1, '\0');
+  StringRef Last;
+  uint32_t LastOffset = 0;
+  for (Entry *E : Items) {
+    if (Last.endswith(E->S)) {
+      E->Offset = LastOffset + Last.size() - E->S.size();
+      continue;
+    }
+    E->Offset = Data_.size();
+    Data_.insert(Data_.end(), E->S.bytes_begin(), E->S.bytes_end());
+    Data_.push_back('\0');
+    Last = E->S;
+    LastOffset = E->Offset;
+  }
+}
+
+void StrtabBuilder::pad(uint64_t Align) {
+  Data_.resize(alignTo(Data_.size(), Align), '\0');
+}
+
+} // end namespace ald
+
+} // end namespace llvm
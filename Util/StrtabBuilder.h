@@ -0,0 +1,57 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <vector>
+
+namespace llvm {
+
+namespace ald {
+
+/// Builds a string table in which strings share the bytes of any longer
+/// string ending with them, e.g. "foo" is stored as the tail of "barfoo".
+///
+/// Strings are sorted by their reversed characters, which puts each one right
+/// after the longest string ending with it. The sort is a radix sort whose
+/// buckets are sorted in parallel, and offsets only depend on the set of
+/// strings, never on how the work was split.
+class StrtabBuilder {
+public:
+  /// Add \c S and return a handle for its offset. \c S isn't copied, so it
+  /// must outlive the builder.
+  size_t add(StringRef S) {
+    Entries_.push_back({S, 0});
+    return Entries_.size() - 1;
+  }
+
+  size_t getNumStrings() const { return Entries_.size(); }
+
+  /// Lay out the table. No strings can be added afterwards.
+  void finalize();
+
+  /// The offset of the string with \c Handle, once finalized. Empty strings
+  /// are at offset 0.
+  uint32_t getOffset(size_t Handle) const { return Entries_[Handle].Offset; }
+
+  /// The laid out table, which starts with the NUL empty strings refer to.
+  ArrayRef<uint8_t> data() const { return Data_; }
+
+  /// Pad the table with NULs to a multiple of \c Align bytes.
+  void pad(uint64_t Align);
+
+  struct Entry {
+    StringRef S;
+    uint32_t Offset;
+  };
+
+private:
+  std::vector<Entry> Entries_;
+  std::vector<uint8_t> Data_;
+};
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,549 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "ald/Daemon.h"
+
+#include "MachO/FileCache.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(LLVM_ON_UNIX)
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace llvm {
+
+namespace ald {
+
+#if defined(LLVM_ON_UNIX)
+
+namespace {
+
+/// A request is the client's working directory followed by its arguments,
+/// each a 32 bit little endian length and then the bytes. The daemon answers
+/// with frames of output and finally the exit code.
+enum FrameKind : uint8_t {
+  Stdout = 1,
+  Stderr = 2,
+  Exit = 3,
+};
+
+/// Bounds on requests, so that a confused client can't exhaust the daemon.
+constexpr uint32_t MaxRequestStrings = 1 << 20;
+constexpr uint32_t MaxStringSize = 1 << 20;
+
+bool writeAll(int FD, const void *Data, size_t Size) {
+  const char *P = static_cast<const char *>(Data);
+  while (Size != 0) {
+    ssize_t N = ::write(FD, P, Size);
+    if (N < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    P += N;
+    Size -= N;
+  }
+  return true;
+}
+
+bool readAll(int FD, void *Data, size_t Size) {
+  char *P = static_cast<char *>(Data);
+  while (Size != 0) {
+    ssize_t N = ::read(FD, P, Size);
+    if (N < 0 && errno == EINTR) {
+      continue;
+    }
+    if (N <= 0) {
+      return false;
+    }
+    P += N;
+    Size -= N;
+  }
+  return true;
+}
+
+bool writeU32(int FD, uint32_t V) {
+  uint8_t Buf[4];
+  support::endian::write32le(Buf, V);
+  return writeAll(FD, Buf, sizeof(Buf));
+}
+
+bool readU32(int FD, uint32_t &V) {
+  uint8_t Buf[4];
+  if (!readAll(FD, Buf, sizeof(Buf))) {
+    return false;
+  }
+  V = support::endian::read32le(Buf);
+  return true;
+}
+
+bool writeFrame(int FD, FrameKind Kind, StringRef Data) {
+  uint8_t K = Kind;
+  return writeAll(FD, &K, 1) && writeU32(FD, Data.size()) &&
+         writeAll(FD, Data.data(), Data.size());
+}
+
+bool writeExit(int FD, int RC) {
+  char Buf[4];
+  support::endian::write32le(Buf, RC);
+  return writeFrame(FD, Exit, StringRef(Buf, sizeof(Buf)));
+}
+
+enum class Parse { Incomplete, Complete, Invalid };
+
+/// Parse the request at the start of \c Data, which holds what was read from
+/// the client so far.
+Parse parseRequest(StringRef Data, std::vector<std::string> &Strings) {
+  auto ReadU32 = [&](uint32_t &V) {
+    if (Data.size() < 4) {
+      return false;
+    }
+    V = support::endian::read32le(Data.data());
+    Data = Data.drop_front(4);
+    return true;
+  };
+  uint32_t Count;
+  if (!ReadU32(Count)) {
+    return Parse::Incomplete;
+  }
+  if (Count > MaxRequestStrings) {
+    return Parse::Invalid;
+  }
+  Strings.clear();
+  for (uint32_t I = 0; I < Count; ++I) {
+    uint32_t Size;
+    if (!ReadU32(Size)) {
+      return Parse::Incomplete;
+    }
+    if (Size > MaxStringSize) {
+      return Parse::Invalid;
+    }
+    if (Data.size() < Size) {
+      return Parse::Incomplete;
+    }
+    Strings.push_back(Data.take_front(Size).str());
+    Data = Data.drop_front(Size);
+  }
+  return Parse::Complete;
+}
+
+void setCloseOnExec(int FD) { ::fcntl(FD, F_SETFD, FD_CLOEXEC); }
+
+/// How often exited children are checked for once they've closed their
+/// pipes, but couldn't be reaped yet.
+constexpr int ReapIntervalMillis = 10;
+
+/// How many of the inputs links journaled the daemon loads and parses per
+/// round of its poll loop, so that warming the cache after a link which
+/// loaded thousands of inputs doesn't hold up the other clients.
+constexpr size_t WarmsPerRound = 16;
+
+/// A client which connected but hasn't sent all of its request yet.
+struct Client {
+  int Conn;
+  std::string Request;
+};
+
+/// A link running in a child: its client's connection and the pipes the
+/// child writes its output and journal to, or -1 once they're closed.
+struct Link {
+  pid_t Pid;
+  int Conn;
+  int Pipes[3];
+  /// What the child journaled, the paths of the files it loaded.
+  std::string Loaded;
+  bool ClientGone = false;
+
+  bool isDone() const {
+    return Pipes[0] < 0 && Pipes[1] < 0 && Pipes[2] < 0;
+  }
+};
+
+/// Serves links, each in a child of its own, and relays their output from a
+/// single poll loop so that the daemon keeps accepting links while others
+/// run.
+class Server {
+public:
+  Server(int Listen, MachO::FileCache &Cache, LinkFn Link)
+      : Listen_(Listen), Cache_(Cache), Link_(Link) {}
+
+  /// Serve links until accepting one fails.
+  Error run();
+
+private:
+  /// Read what \c C sent, and start its link once the request is complete.
+  /// Returns false once \c C is done with, its connection is then closed or
+  /// belongs to the link.
+  bool read_(Client &C);
+  /// Start the link in \c Request for the client on \c Conn.
+  void start_(int Conn, ArrayRef<std::string> Request);
+  /// Relay what's ready to be read from pipe \c I of \c L.
+  void relay_(Link &L, size_t I);
+  /// Reap the child of \c L if it exited, answer its client and queue what
+  /// it journaled to be warmed. Returns false if it's still running.
+  bool finish_(Link &L);
+  /// Load and parse a bounded number of the queued inputs.
+  void warm_();
+
+  int Listen_;
+  MachO::FileCache &Cache_;
+  LinkFn Link_;
+  std::vector<Client> Clients_;
+  std::vector<std::unique_ptr<Link>> Links_;
+  /// Inputs finished links loaded, which the cache is yet to load.
+  std::deque<std::string> Cold_;
+};
+
+Error Server::run() {
+  std::vector<struct pollfd> FDs;
+  std::vector<std::pair<Link *, size_t>> Owners;
+  for (;;) {
+    // The listening socket, then clients' connections, then children's pipes.
+    FDs.assign(1, {Listen_, POLLIN, 0});
+    for (const Client &C : Clients_) {
+      FDs.push_back({C.Conn, POLLIN, 0});
+    }
+    size_t NumClients = Clients_.size();
+    Owners.assign(FDs.size(), {nullptr, 0});
+    bool Waiting = false;
+    for (auto &L : Links_) {
+      Waiting |= L->isDone();
+      for (size_t I = 0; I < 3; ++I) {
+        if (L->Pipes[I] >= 0) {
+          FDs.push_back({L->Pipes[I], POLLIN, 0});
+          Owners.emplace_back(L.get(), I);
+        }
+      }
+    }
+
+    int Timeout = -1;
+    if (!Cold_.empty()) {
+      Timeout = 0;
+    } else if (Waiting) {
+      Timeout = ReapIntervalMillis;
+    }
+    if (::poll(FDs.data(), FDs.size(), Timeout) < 0) {
+      if (errno != EINTR) {
+        return errorCodeToError(
+            std::error_code(errno, std::generic_category()));
+      }
+      continue;
+    }
+    for (size_t I = 1 + NumClients; I < FDs.size(); ++I) {
+      if (FDs[I].revents != 0) {
+        relay_(*Owners[I].first, Owners[I].second);
+      }
+    }
+    // Links started by clients are appended to Links_, so they're only polled
+    // from the next round on.
+    for (size_t I = 0; I < NumClients; ++I) {
+      if (FDs[1 + I].revents != 0 && !read_(Clients_[I])) {
+        Clients_[I].Conn = -1;
+      }
+    }
+    Clients_.erase(remove_if(Clients_,
+                             [](const Client &C) { return C.Conn < 0; }),
+                   Clients_.end());
+    Links_.erase(remove_if(Links_,
+                           [&](const std::unique_ptr<Link> &L) {
+                             return L->isDone() && finish_(*L);
+                           }),
+                 Links_.end());
+
+    if (FDs[0].revents != 0) {
+      int Conn = ::accept(Listen_, nullptr, nullptr);
+      if (Conn >= 0) {
+        setCloseOnExec(Conn);
+        Clients_.push_back({Conn, ""});
+      } else if (errno != EINTR && errno != ECONNABORTED &&
+                 errno != EAGAIN) {
+        return errorCodeToError(
+            std::error_code(errno, std::generic_category()));
+      }
+    }
+    warm_();
+  }
+}
+
+bool Server::read_(Client &C) {
+  char Buf[64 * 1024];
+  ssize_t N = ::read(C.Conn, Buf, sizeof(Buf));
+  if (N < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return true;
+  }
+  if (N > 0) {
+    C.Request.append(Buf, N);
+    std::vector<std::string> Request;
+    switch (parseRequest(C.Request, Request)) {
+    case Parse::Incomplete:
+      return true;
+    case Parse::Complete:
+      if (Request.size() >= 2) {
+        start_(C.Conn, Request);
+        return false;
+      }
+      break;
+    case Parse::Invalid:
+      break;
+    }
+  }
+  // The client went away or isn't speaking the protocol.
+  ::close(C.Conn);
+  return false;
+}
+
+void Server::start_(int Conn, ArrayRef<std::string> Request) {
+  int Out[2], Err[2], Journal[2];
+  if (::pipe(Out) != 0 || ::pipe(Err) != 0 || ::pipe(Journal) != 0) {
+    writeFrame(Conn, Stderr, "ald: couldn't create pipes for the link\n");
+    writeExit(Conn, 1);
+    ::close(Conn);
+    return;
+  }
+
+  outs().flush();
+  errs().flush();
+  pid_t Pid = ::fork();
+  if (Pid == 0) {
+    // The child only keeps the pipes of its own link.
+    ::close(Listen_);
+    ::close(Conn);
+    for (const Client &C : Clients_) {
+      if (C.Conn >= 0 && C.Conn != Conn) {
+        ::close(C.Conn);
+      }
+    }
+    for (auto &L : Links_) {
+      ::close(L->Conn);
+      for (int FD : L->Pipes) {
+        if (FD >= 0) {
+          ::close(FD);
+        }
+      }
+    }
+    ::dup2(Out[1], STDOUT_FILENO);
+    ::dup2(Err[1], STDERR_FILENO);
+    for (int FD : {Out[0], Out[1], Err[0], Err[1], Journal[0]}) {
+      ::close(FD);
+    }
+    if (::chdir(Request[0].c_str()) != 0) {
+      errs() << "ald: couldn't change directory to '" << Request[0] << "'\n";
+      ::_exit(1);
+    }
+
+    raw_fd_ostream JournalOS(Journal[1], /*shouldClose=*/true,
+                             /*unbuffered=*/true);
+    Cache_.setJournal(&JournalOS);
+    std::vector<const char *> Argv;
+    for (size_t I = 1; I < Request.size(); ++I) {
+      Argv.push_back(Request[I].c_str());
+    }
+    Argv.push_back(nullptr);
+    int RC = Link_(Argv.size() - 1, Argv.data());
+    outs().flush();
+    errs().flush();
+    ::exit(RC);
+  }
+
+  for (int FD : {Out[1], Err[1], Journal[1]}) {
+    ::close(FD);
+  }
+  if (Pid < 0) {
+    for (int FD : {Out[0], Err[0], Journal[0]}) {
+      ::close(FD);
+    }
+    writeFrame(Conn, Stderr, "ald: couldn't fork the link\n");
+    writeExit(Conn, 1);
+    ::close(Conn);
+    return;
+  }
+  for (int FD : {Out[0], Err[0], Journal[0]}) {
+    setCloseOnExec(FD);
+  }
+  Links_.push_back(std::unique_ptr<Link>(
+      new Link{Pid, Conn, {Out[0], Err[0], Journal[0]}, "", false}));
+}
+
+void Server::relay_(Link &L, size_t I) {
+  char Buf[64 * 1024];
+  ssize_t N = ::read(L.Pipes[I], Buf, sizeof(Buf));
+  if (N < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return;
+  }
+  if (N <= 0) {
+    ::close(L.Pipes[I]);
+    L.Pipes[I] = -1;
+    return;
+  }
+  StringRef Data(Buf, N);
+  if (I == 2) {
+    L.Loaded += Data;
+  } else if (!L.ClientGone) {
+    L.ClientGone = !writeFrame(L.Conn, I == 0 ? Stdout : Stderr, Data);
+  }
+}
+
+bool Server::finish_(Link &L) {
+  int Status = 0;
+  pid_t Reaped;
+  while ((Reaped = ::waitpid(L.Pid, &Status, WNOHANG)) < 0 && errno == EINTR) {
+  }
+  if (Reaped == 0) {
+    return false;
+  }
+  int RC = 1;
+  if (Reaped == L.Pid) {
+    RC = WIFEXITED(Status) ? WEXITSTATUS(Status) : 128 + WTERMSIG(Status);
+  }
+  writeExit(L.Conn, RC);
+  ::close(L.Conn);
+
+  // Only now that the client has its answer, queue what the link had to load
+  // so the next links find it warm.
+  StringRef Rest = L.Loaded;
+  while (!Rest.empty()) {
+    StringRef Path;
+    std::tie(Path, Rest) = Rest.split('\n');
+    if (!Path.empty()) {
+      Cold_.push_back(Path.str());
+    }
+  }
+  return true;
+}
+
+void Server::warm_() {
+  for (size_t I = 0; I < WarmsPerRound && !Cold_.empty(); ++I) {
+    consumeError(Cache_.get(Cold_.front(), /*Parse=*/true).takeError());
+    Cold_.pop_front();
+  }
+}
+
+} // namespace
+
+Error serveLinks(StringRef SocketPath, MachO::FileCache &Cache, LinkFn Link) {
+  struct sockaddr_un Addr = {};
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+    return createStringError(std::errc::filename_too_long,
+                             "socket path is too long");
+  }
+  std::memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+
+  // Replace the socket of a daemon which is gone, but nothing else.
+  sys::fs::file_status Status;
+  if (!sys::fs::status(SocketPath, Status) &&
+      Status.type() == sys::fs::file_type::socket_file) {
+    ::unlink(Addr.sun_path);
+  }
+
+  int Listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Listen < 0) {
+    return errorCodeToError(std::error_code(errno, std::generic_category()));
+  }
+  setCloseOnExec(Listen);
+  if (::bind(Listen, (struct sockaddr *)&Addr, sizeof(Addr)) != 0 ||
+      ::listen(Listen, SOMAXCONN) != 0) {
+    std::error_code EC(errno, std::generic_category());
+    ::close(Listen);
+    return errorCodeToError(EC);
+  }
+
+  // A client going away mid-link must not take the daemon with it.
+  ::signal(SIGPIPE, SIG_IGN);
+  Error Err = Server(Listen, Cache, Link).run();
+  ::close(Listen);
+  return Err;
+}
+
+Optional<int> forwardLink(StringRef SocketPath, ArrayRef<const char *> Args) {
+  struct sockaddr_un Addr = {};
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+    return None;
+  }
+  std::memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+
+  int Conn = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Conn < 0) {
+    return None;
+  }
+  if (::connect(Conn, (struct sockaddr *)&Addr, sizeof(Addr)) != 0) {
+    ::close(Conn);
+    return None;
+  }
+
+  SmallString<256> Cwd;
+  bool Sent = !sys::fs::current_path(Cwd) && writeU32(Conn, Args.size() + 1) &&
+              writeU32(Conn, Cwd.size()) &&
+              writeAll(Conn, Cwd.data(), Cwd.size());
+  for (size_t I = 0; Sent && I < Args.size(); ++I) {
+    size_t Size = std::strlen(Args[I]);
+    Sent = writeU32(Conn, Size) && writeAll(Conn, Args[I], Size);
+  }
+
+  std::string Data;
+  while (Sent) {
+    uint8_t Kind;
+    uint32_t Size;
+    if (!readAll(Conn, &Kind, 1) || !readU32(Conn, Size) ||
+        Size > MaxStringSize) {
+      break;
+    }
+    Data.resize(Size);
+    if (Size != 0 && !readAll(Conn, &Data[0], Size)) {
+      break;
+    }
+    switch (Kind) {
+    case Stdout:
+      outs() << Data;
+      outs().flush();
+      break;
+    case Stderr:
+      errs() << Data;
+      break;
+    case Exit:
+      ::close(Conn);
+      return Size == 4 ? int(support::endian::read32le(Data.data())) : 1;
+    default:
+      break;
+    }
+  }
+  ::close(Conn);
+  errs() << "ald: lost the connection to the daemon at '" << SocketPath
+         << "'\n";
+  return 1;
+}
+
+#else
+
+Error serveLinks(StringRef SocketPath, MachO::FileCache &Cache, LinkFn Link) {
+  return createStringError(std::errc::function_not_supported,
+                           "the link daemon requires a UNIX host");
+}
+
+Optional<int> forwardLink(StringRef SocketPath, ArrayRef<const char *> Args) {
+  return None;
+}
+
+#endif
+
+} // end namespace ald
+
+} // end namespace llvm
@@ -0,0 +1,41 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#pragma once
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+namespace llvm {
+
+namespace ald {
+
+namespace MachO {
+class FileCache;
+} // end namespace MachO
+
+/// Runs a forwarded link with its arguments and returns its exit code.
+using LinkFn = function_ref<int(int Argc, const char **Argv)>;
+
+/// Serve links forwarded by \c forwardLink over the Unix socket at
+/// \c SocketPath until the process is killed.
+///
+/// Every link runs in a child forked from the daemon, in the client's working
+/// directory and with its output relayed back to the client. Links run
+/// concurrently: a single poll loop accepts clients, relays the output of
+/// every child and reaps those which exited. Children inherit the inputs
+/// already in \c Cache, parsed, and every input a child had to load is loaded
+/// and parsed into the daemon's \c Cache once it exits, a few per round of the
+/// poll loop, so that later links neither load nor parse it again. The daemon
+/// itself must not start any threads, they wouldn't survive the fork.
+Error serveLinks(StringRef SocketPath, MachO::FileCache &Cache, LinkFn Link);
+
+/// Run a link with \c Args in the daemon listening at \c SocketPath, relaying
+/// its output. Returns the link's exit code, or None if no daemon is listening.
+Optional<int> forwardLink(StringRef SocketPath, ArrayRef<const char *> Args);
+
+} // end namespace ald
+
+} // end namespace llvm
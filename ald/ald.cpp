@@ -1,17 +1,32 @@
 // Copyright (c) 2020 Daniel Zimmerman
 
 #include "ald/ald.h"
+#include "ald/Daemon.h"
 
 #include "Aldy/Aldy.h"
 
 #include "MachO/Builder.h"
+#include "MachO/CostReport.h"
+#include "MachO/DebugCompanion.h"
 #include "MachO/File.h"
+#include "MachO/FileCache.h"
+#include "MachO/LinkMap.h"
+#include "MachO/Linker.h"
+#include "MachO/LoadCommandStats.h"
+#include "MachO/OrderFile.h"
 #include "MachO/Visitor.h"
+#include "Util/FileList.h"
+#include "Util/Scheduler.h"
 
 #include "llvm/Object/MachO.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/WithColor.h"
 
+#include <future>
 #include <map>
 
 using namespace llvm;
@@ -33,6 +48,23 @@ static cl::list<std::string> InputFilenames(cl::Positional,
                                             cl::desc("<input object files>"),
                                             cl::ZeroOrMore);
 
+static cl::list<std::string> FileListPaths(
+    "filelist", cl::ZeroOrMore,
+    cl::desc("Read input object files from <file>, one path per line. "
+             "Relative paths are resolved against <dir>, if given"),
+    cl::value_desc("file[,dir]"));
+/// Response files which only list paths are rewritten to this option, see
+/// \c mapResponseFileLists.
+static cl::list<unsigned> ResponseFileLists("response-file-list", cl::Hidden,
+                                            cl::ZeroOrMore);
+
+static cl::list<std::string> Binaries(
+    "binary", cl::ZeroOrMore,
+    cl::desc("Link <output> from <input>s plus the input object files given "
+             "on the command line, which are shared with every other "
+             "-binary. Can't be combined with -o"),
+    cl::value_desc("output=input[,input...]"));
+
 static cl::list<std::string> LibrarySearchPaths(
     "L", cl::Prefix, cl::ZeroOrMore,
     cl::desc(
@@ -58,8 +90,101 @@ static cl::opt<bool> DontAddStandardSearchPaths(
         "Don't search standard search paths by default (/usr/lib, "
         "/usr/lib/local, /Library/Frameworks/, /System/Library/Frameworks/)"));
 
+static cl::opt<bool>
+    TimePhases("time-phases",
+               cl::desc("Report the time spent in each phase of the link"));
+static cl::opt<std::string> TimePhasesJSON(
+    "time-phases-json",
+    cl::desc("Write the time spent in each phase of the link to <file> as "
+             "JSON"),
+    cl::value_desc("file"));
+
+static cl::opt<std::string>
+    OrderFilePath("order_file",
+                  cl::desc("Lay out the symbols listed in <file> first, in "
+                           "order"),
+                  cl::value_desc("file"));
+
+static cl::opt<std::string> CallGraphProfilePath(
+    "call-graph-profile",
+    cl::desc("Cluster hot functions using the call graph in <file>, one "
+             "'<caller> <callee> <weight>' edge per line"),
+    cl::value_desc("file"));
+
+static cl::opt<ald::MachO::ICFLevel> ICF(
+    "icf", cl::desc("Fold identical functions and read-only data"),
+    cl::init(ald::MachO::ICFLevel::None),
+    cl::values(clEnumValN(ald::MachO::ICFLevel::None, "none",
+                          "Don't fold anything (default)"),
+               clEnumValN(ald::MachO::ICFLevel::Safe, "safe",
+                          "Only fold functions whose address isn't taken"),
+               clEnumValN(ald::MachO::ICFLevel::All, "all",
+                          "Fold every identical function and read-only "
+                          "data")));
+
+static cl::opt<bool> StripDebugMap(
+    "S", cl::desc("Don't emit the debug map, i.e. the stabs telling the "
+                  "debugger which inputs have debug info"));
+
+static cl::opt<bool> DebugCompanion(
+    "debug-companion",
+    cl::desc("Write the inputs' debug info, merged and compressed, to "
+             "<output>.dwarf"));
+
+static cl::opt<bool> PrintLoadCommands(
+    "print-load-commands",
+    cl::desc("Print every load command, segment and section of the inputs"));
+static cl::opt<bool> LoadCommandStats(
+    "load-command-stats",
+    cl::desc("Print how many of each load command the inputs have and how "
+             "many bytes they take, the total size of each section and the "
+             "largest inputs"));
+static cl::opt<unsigned> LoadCommandStatsTop(
+    "load-command-stats-top",
+    cl::desc("Number of inputs -load-command-stats lists (default 10)"),
+    cl::init(10));
+
+static cl::opt<std::string> MapPath(
+    "map",
+    cl::desc("Write a link map of the output's sections and symbols to "
+             "<file>. With several -binary outputs each gets <file>.<output "
+             "name>"),
+    cl::value_desc("file"));
+
+static cl::opt<std::string> CostReportPath(
+    "cost-report",
+    cl::desc("Write what each input costs the link, i.e. its bytes, atoms, "
+             "symbols, relocations and parse time, to <file> as JSON. With "
+             "several -binary outputs each gets <file>.<output name>"),
+    cl::value_desc("file"));
+
+static cl::opt<bool> NoUUID("no_uuid",
+                            cl::desc("Don't emit an LC_UUID load command"));
+
+static cl::opt<bool> StreamOutput(
+    "stream-output",
+    cl::desc("Write the output through a bounded pool of buffers instead of "
+             "mapping the whole file into memory"));
+static cl::opt<uint64_t> StreamOutputBufferSize(
+    "stream-output-buffer-size",
+    cl::desc("Size in bytes of each buffer used by -stream-output"),
+    cl::init(ald::MachO::Builder::StreamingWriter::DefaultBufferSize));
+static cl::opt<unsigned> StreamOutputBuffers(
+    "stream-output-buffers",
+    cl::desc("Number of buffers used by -stream-output (at least 2)"),
+    cl::init(ald::MachO::Builder::StreamingWriter::DefaultNumBuffers));
+
+static cl::opt<std::string> DaemonSocket(
+    "daemon",
+    cl::desc("Serve links over the Unix socket at <path>, keeping inputs "
+             "loaded between them. ald forwards its links to the daemon "
+             "named by $ALD_DAEMON"),
+    cl::value_desc("path"));
+
 static cl::extrahelp
-    HelpResponse("\nPass @FILE as argument to read options from FILE.\n");
+    HelpResponse("\nPass @FILE as argument to read options from FILE. A FILE "
+                 "which only lists paths, one per line, is read like "
+                 "-filelist.\n");
 
 static StringRef ToolName;
 
@@ -122,35 +247,230 @@ LLVM_ATTRIBUTE_NORETURN static void reportCmdLineError(Twine Message) {
 }
 #endif
 
+/// Times each phase of a link when -time-phases or -time-phases-json is given.
+/// When neither is given \c get returns nullptr, which TimeRegion ignores.
+class PhaseTimers {
+public:
+  PhaseTimers() : Group_("ald", "ald link phases") {}
+
+  bool enabled() const { return TimePhases || !TimePhasesJSON.empty(); }
+
+  Timer *get(StringRef Name, StringRef Description) {
+    if (!enabled()) {
+      return nullptr;
+    }
+    Timers_.push_back(std::make_unique<Timer>(Name, Description, Group_));
+    return Timers_.back().get();
+  }
+
+  void report(size_t NumInputs) {
+    if (!TimePhasesJSON.empty()) {
+      std::error_code EC;
+      raw_fd_ostream OS(TimePhasesJSON, EC, sys::fs::OF_Text);
+      if (EC) {
+        reportError(errorCodeToError(EC), TimePhasesJSON);
+      }
+      writeJSON_(OS, NumInputs);
+    }
+    if (TimePhases) {
+      Group_.print(errs());
+    }
+  }
+
+private:
+  void writeJSON_(raw_ostream &OS, size_t NumInputs) {
+    json::OStream J(OS, 2);
+    J.object([&]() {
+      J.attribute("inputs", int64_t(NumInputs));
+      J.attributeObject("phases", [&]() {
+        for (auto &T : Timers_) {
+          TimeRecord R = T->getTotalTime();
+          J.attributeObject(T->getName(), [&]() {
+            J.attribute("wall", R.getWallTime());
+            J.attribute("user", R.getUserTime());
+            J.attribute("sys", R.getSystemTime());
+          });
+        }
+      });
+    });
+    OS << "\n";
+  }
+
+  TimerGroup Group_;
+  std::vector<std::unique_ptr<Timer>> Timers_;
+};
+
+/// Response files are expanded by the command line parser into a string per
+/// argument. Lists of tens of thousands of inputs are common though, so
+/// response files which only list paths are instead mapped into \c Lists and
+/// their arguments replaced by -response-file-list=<index>, keeping their
+/// position relative to the other inputs.
+SmallVector<const char *, 32>
+mapResponseFileLists(int argc, const char **argv, FileList &Lists,
+                     std::vector<ArrayRef<StringRef>> &Mapped,
+                     StringSaver &Saver) {
+  SmallVector<const char *, 32> Args(argv, argv + argc);
+  for (const char *&Arg : Args) {
+    if (Arg[0] != '@') {
+      continue;
+    }
+    auto MBOrErr = MemoryBuffer::getFile(Arg + 1, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+    // Leave anything unusual for the command line parser to report.
+    if (!MBOrErr || !FileList::isPlainList((*MBOrErr)->getBuffer())) {
+      continue;
+    }
+    Mapped.push_back(Lists.add(std::move(*MBOrErr)));
+    Arg = Saver.save("-response-file-list=" + Twine(Mapped.size() - 1))
+              .data();
+  }
+  return Args;
+}
+
+/// Collect every input, from the command line and from file lists, in the
+/// order they were given.
+std::vector<StringRef>
+collectInputs(FileList &Lists, ArrayRef<ArrayRef<StringRef>> Mapped) {
+  std::vector<std::pair<unsigned, ArrayRef<StringRef>>> Sources;
+  std::vector<StringRef> Positional(InputFilenames.begin(),
+                                    InputFilenames.end());
+  for (unsigned I = 0; I < Positional.size(); ++I) {
+    Sources.emplace_back(InputFilenames.getPosition(I),
+                         makeArrayRef(Positional[I]));
+  }
+  for (unsigned I = 0; I < FileListPaths.size(); ++I) {
+    StringRef Path, Dir;
+    std::tie(Path, Dir) = StringRef(FileListPaths[I]).split(',');
+    Sources.emplace_back(FileListPaths.getPosition(I),
+                         unwrapOrError(Lists.add(Path, Dir), Path));
+  }
+  for (unsigned I = 0; I < ResponseFileLists.size(); ++I) {
+    if (ResponseFileLists[I] >= Mapped.size()) {
+      reportToolError("invalid -response-file-list");
+    }
+    Sources.emplace_back(ResponseFileLists.getPosition(I),
+                         Mapped[ResponseFileLists[I]]);
+  }
+  llvm::stable_sort(Sources, [](const auto &LHS, const auto &RHS) {
+    return LHS.first < RHS.first;
+  });
+
+  size_t NumInputs = 0;
+  for (auto &Source : Sources) {
+    NumInputs += Source.second.size();
+  }
+  std::vector<StringRef> Inputs;
+  Inputs.reserve(NumInputs);
+  for (auto &Source : Sources) {
+    Inputs.insert(Inputs.end(), Source.second.begin(), Source.second.end());
+  }
+  return Inputs;
+}
+
+/// A binary to link and the inputs linked into it.
+struct Target {
+  StringRef Output;
+  std::vector<StringRef> Inputs;
+};
+
+/// Every target links the inputs given on the command line. With -binary each
+/// one adds its own inputs too, otherwise there's a single target named by -o.
+std::vector<Target> collectTargets(ArrayRef<StringRef> Inputs) {
+  std::vector<Target> Targets;
+  if (Binaries.empty()) {
+    Targets.push_back(Target{OutputFilename, Inputs});
+    return Targets;
+  }
+  if (OutputFilename.getNumOccurrences() != 0) {
+    reportToolError("-o can't be combined with -binary, name each output with "
+                    "-binary instead");
+  }
+  for (StringRef Binary : Binaries) {
+    StringRef Output, Rest;
+    std::tie(Output, Rest) = Binary.split('=');
+    if (Output.empty() || Rest.empty()) {
+      reportToolError("-binary expects <output>=<input>[,<input>...], got '" +
+                      Binary + "'");
+    }
+    Target T{Output, Inputs};
+    SmallVector<StringRef, 8> Own;
+    Rest.split(Own, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    T.Inputs.insert(T.Inputs.end(), Own.begin(), Own.end());
+    Targets.push_back(std::move(T));
+  }
+  return Targets;
+}
+
 class Context {
 public:
-  Context() {}
+  /// Inputs are taken from \c Cache when it's given, see -daemon.
+  explicit Context(ald::MachO::FileCache *Cache = nullptr) : Cache_(Cache) {}
 
-  void loadFiles(const std::vector<std::string> &Filenames) {
+  /// Load the inputs of every target. Inputs shared between targets are only
+  /// read, parsed and validated once, and every target links the same parse.
+  void loadFiles(ArrayRef<Target> Targets) {
     if (LoadedFiles_.size() != 0) {
       return;
     }
 
     reportStatus("Loading binaries...");
-    LoadedFiles_.reserve(Filenames.size());
-    llvm::for_each(Filenames,
-                   [this](StringRef Filename) { this->loadFile(Filename); });
+    for (const Target &T : Targets) {
+      for (StringRef Filename : T.Inputs) {
+        if (Index_.try_emplace(Filename, LoadedFiles_.size()).second) {
+          loadFile(Filename);
+        }
+      }
+    }
     validateLoadedFiles_();
+    parseLoadedFiles_();
   }
 
+  size_t size() const { return LoadedFiles_.size(); }
+
   const Triple &getTriple() const { return Triple_; }
 
+  std::vector<const ald::MachO::File *> files() const {
+    std::vector<const ald::MachO::File *> Files;
+    Files.reserve(LoadedFiles_.size());
+    for (const LoadedFile &LF : LoadedFiles_) {
+      Files.push_back(LF.File);
+    }
+    return Files;
+  }
+
   void visitFiles(LCVisitor &Visitor) {
     llvm::for_each(LoadedFiles_, [&Visitor](const LoadedFile &LF) {
       Visitor.visit(*LF.File);
     });
   }
 
+  void addFilesTo(ald::MachO::Linker &L, const Target &T) {
+    for (StringRef Filename : T.Inputs) {
+      const LoadedFile &LF = LoadedFiles_[Index_.lookup(Filename)];
+      if (auto Err = L.addFile(*LF.Input)) {
+        reportError(std::move(Err), LF.Path);
+      }
+    }
+  }
+
 private:
   void loadFile(StringRef Path) {
+    if (Cache_ != nullptr) {
+      // The daemon parses what it caches, so mostly only new inputs are left
+      // to parse.
+      auto Cached = unwrapOrError(Cache_->get(Path), Path);
+      LoadedFiles_.push_back(LoadedFile{
+          .Path = Path,
+          .File = Cached.F,
+          .Input = Cached.Input,
+      });
+      return;
+    }
+    auto F = unwrapOrError(ald::MachO::File::read(Path), Path);
     LoadedFiles_.push_back(LoadedFile{
         .Path = Path,
-        .File = unwrapOrError(ald::MachO::File::read(Path), Path),
+        .File = F.get(),
+        .Owned = std::move(F),
     });
   }
 
@@ -181,35 +501,92 @@ private:
     }
   }
 
+  /// Inputs which weren't parsed already are parsed in parallel. Errors are
+  /// reported in input order once they're all done.
+  void parseLoadedFiles_() {
+    std::vector<std::string> Errors(LoadedFiles_.size());
+    ald::Scheduler::get().forEach(LoadedFiles_.size(), [&](size_t I) {
+      LoadedFile &LF = LoadedFiles_[I];
+      if (LF.Input != nullptr) {
+        return;
+      }
+      auto IFOrErr = ald::MachO::InputFile::create(*LF.File);
+      if (!IFOrErr) {
+        Errors[I] = toString(IFOrErr.takeError());
+        return;
+      }
+      LF.OwnedInput = std::move(*IFOrErr);
+      LF.Input = LF.OwnedInput.get();
+    });
+    for (size_t I = 0; I < Errors.size(); ++I) {
+      if (!Errors[I].empty()) {
+        reportError(createStringError(inconvertibleErrorCode(), Errors[I]),
+                    LoadedFiles_[I].Path);
+      }
+    }
+  }
+
   struct LoadedFile {
     StringRef Path;
-    std::unique_ptr<ald::MachO::File> File;
+    const ald::MachO::File *File;
+    std::unique_ptr<ald::MachO::File> Owned;
+    const ald::MachO::InputFile *Input = nullptr;
+    std::unique_ptr<ald::MachO::InputFile> OwnedInput;
   };
 
+  ald::MachO::FileCache *Cache_;
+
   std::vector<LoadedFile> LoadedFiles_;
+  StringMap<size_t> Index_;
   Triple Triple_;
 };
 
 } // namespace
 
-int main(int argc, char **argv) {
-  using namespace llvm;
-  InitLLVM X(argc, argv);
-
-  cl::ParseCommandLineOptions(argc, argv, "novel mach-o linker\n", nullptr,
+/// Link as told by \c argv. Inputs come from \c Cache if it's given, which is
+/// how links forwarded to a daemon run.
+static int runLink(int argc, const char **argv,
+                   ald::MachO::FileCache *Cache) {
+  BumpPtrAllocator Alloc;
+  StringSaver Saver(Alloc);
+  FileList Lists;
+  std::vector<ArrayRef<StringRef>> Mapped;
+  auto Args = mapResponseFileLists(argc, argv, Lists, Mapped, Saver);
+  cl::ParseCommandLineOptions(Args.size(), Args.data(),
+                              "novel mach-o linker\n", nullptr,
                               /*EnvVar=*/nullptr,
                               /*LongOptionsUseDoubleDash=*/false);
+  ToolName = argv[0];
 
-  // Defaults to a.out if no filenames specified.
-  if (InputFilenames.empty()) {
-    InputFilenames.push_back("a.out");
-  }
-  // Defaults to Input[0] + .bin
-  if (OutputFilename.size() == 0) {
-    OutputFilename = InputFilenames[0] + ".bin";
+  if (!DaemonSocket.empty()) {
+    if (Cache != nullptr) {
+      reportToolError("-daemon can't be forwarded to a daemon");
+    }
+    ald::MachO::FileCache DaemonCache;
+    reportStatus("Serving links on '" + DaemonSocket + "'");
+    auto Err = ald::serveLinks(
+        DaemonSocket, DaemonCache, [&](int Argc, const char **Argv) {
+          // Every link parses its own options, not the daemon's. Options
+          // without a cl::init keep their value through a reset.
+          cl::ResetAllOptionOccurrences();
+          DaemonSocket = "";
+          return runLink(Argc, Argv, &DaemonCache);
+        });
+    reportError(std::move(Err), DaemonSocket);
   }
 
-  ToolName = argv[0];
+  std::vector<StringRef> Inputs = collectInputs(Lists, Mapped);
+  if (Binaries.empty()) {
+    // Defaults to a.out if no filenames specified.
+    if (Inputs.empty()) {
+      Inputs.push_back("a.out");
+    }
+    // Defaults to Input[0] + .bin
+    if (OutputFilename.size() == 0) {
+      OutputFilename = (Inputs[0] + ".bin").str();
+    }
+  }
+  std::vector<Target> Targets = collectTargets(Inputs);
 
   if (Dummy) {
     reportStatus("Passed dummy");
@@ -218,8 +595,13 @@ int main(int argc, char **argv) {
   Aldy Al(Prefixes, LibrarySearchPaths, FrameworkSearchPaths,
           DontAddStandardSearchPaths);
 
-  Context Ctx;
-  Ctx.loadFiles(InputFilenames);
+  PhaseTimers Phases;
+
+  Context Ctx(Cache);
+  {
+    TimeRegion T(Phases.get("load", "Load inputs"));
+    Ctx.loadFiles(Targets);
+  }
 
   class Printer : public LCSegVisitor {
   public:
@@ -253,18 +635,145 @@ int main(int argc, char **argv) {
     }
   };
 
-  Printer P;
-  Ctx.visitFiles(P);
+  if (PrintLoadCommands) {
+    TimeRegion T(Phases.get("visit", "Visit load commands"));
+    Printer P;
+    Ctx.visitFiles(P);
+  }
+  if (LoadCommandStats) {
+    TimeRegion T(Phases.get("stats", "Collect load command statistics"));
+    ald::MachO::LoadCommandStats::collect(Ctx.files())
+        .print(outs(), LoadCommandStatsTop);
+  }
+
+  // Order files and profiles are only read once, every target shares them.
+  Optional<ald::MachO::OrderFile> OF;
+  if (!OrderFilePath.empty()) {
+    OF = unwrapOrError(
+        ald::MachO::OrderFile::read(OrderFilePath, Ctx.getTriple()),
+        OrderFilePath);
+  }
+  Optional<ald::MachO::CallGraphProfile> Profile;
+  if (!CallGraphProfilePath.empty()) {
+    Profile = unwrapOrError(
+        ald::MachO::CallGraphProfile::read(CallGraphProfilePath),
+        CallGraphProfilePath);
+  }
+
+  for (const Target &Tgt : Targets) {
+    reportStatus("Successfully started up, will write to '" + Tgt.Output +
+                 "'");
+
+    // Phases are reported per target when there are several.
+    auto PhaseName = [&](StringRef Phase) {
+      if (Targets.size() == 1) {
+        return Phase.str();
+      }
+      return (Phase + ":" + Tgt.Output).str();
+    };
+    // As are report files.
+    auto ReportPath = [&](StringRef Path) {
+      if (Targets.size() == 1) {
+        return Path.str();
+      }
+      return (Path + "." + sys::path::filename(Tgt.Output)).str();
+    };
+
+    ald::MachO::Linker L(Ctx.getTriple());
+    ald::MachO::Builder::File FB;
+    FB.setTriple(Ctx.getTriple());
+    {
+      TimeRegion T(Phases.get(PhaseName("layout"), "Lay out inputs"));
+      Ctx.addFilesTo(L, Tgt);
+      if (OF) {
+        L.setOrderFile(*OF);
+      }
+      if (Profile) {
+        L.setCallGraphProfile(*Profile);
+      }
+      L.setICFLevel(ICF);
+      L.setEmitDebugMap(!StripDebugMap);
+      if (auto Err = L.link(FB)) {
+        reportError(std::move(Err), Tgt.Output);
+      }
+    }
+
+    // The map only reads the finished layout, so it's written while the
+    // output is.
+    std::string TargetMapPath;
+    std::future<Error> Map;
+    if (!MapPath.empty()) {
+      TargetMapPath = ReportPath(MapPath);
+      Map = std::async(std::launch::async, [&] {
+        return ald::MachO::writeLinkMap(L, Tgt.Output, TargetMapPath);
+      });
+    }
+
+    {
+      TimeRegion T(Phases.get(PhaseName("write"), "Write output"));
+      if (!NoUUID) {
+        FB.addUUIDCommand();
+      }
+      if (StreamOutput) {
+        FB.setWriter(std::make_unique<ald::MachO::Builder::StreamingWriter>(
+            StreamOutputBufferSize, StreamOutputBuffers));
+      }
+      if (auto Err = FB.buildAndWrite(Tgt.Output.str())) {
+        if (Map.valid()) {
+          consumeError(Map.get());
+        }
+        reportError(std::move(Err), Tgt.Output);
+      }
+    }
+
+    if (Map.valid()) {
+      TimeRegion T(Phases.get(PhaseName("map"), "Wait for the link map"));
+      if (auto Err = Map.get()) {
+        reportError(std::move(Err), TargetMapPath);
+      }
+    }
 
-  reportStatus("Successfully started up, will write to '" + OutputFilename +
-               "'");
+    if (!CostReportPath.empty()) {
+      TimeRegion T(Phases.get(PhaseName("cost"), "Write the cost report"));
+      std::string Path = ReportPath(CostReportPath);
+      std::error_code EC;
+      raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+      if (EC) {
+        reportError(errorCodeToError(EC), Path);
+      }
+      ald::MachO::writeCostReport(L, OS);
+    }
 
-  ald::MachO::Builder::File FB;
-  if (auto Err = FB.setTriple(Ctx.getTriple()).buildAndWrite(OutputFilename)) {
-    reportError(std::move(Err), OutputFilename);
+    if (DebugCompanion) {
+      TimeRegion T(Phases.get(PhaseName("debug"), "Write debug companion"));
+      std::string Path = (Tgt.Output + ".dwarf").str();
+      if (auto Err = ald::MachO::writeDebugCompanion(L, FB.getUUID(), Path)) {
+        reportError(std::move(Err), Path);
+      }
+    }
   }
 
   reportStatus("Wrote mach header!");
 
+  Phases.report(Ctx.size());
+
   return EXIT_SUCCESS;
 }
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  // Links are forwarded to a running daemon, if there is one, and otherwise
+  // run here.
+  const char *Socket = std::getenv("ALD_DAEMON");
+  bool IsDaemon = llvm::any_of(makeArrayRef(argv, argc), [](StringRef Arg) {
+    return Arg.startswith("-daemon") || Arg.startswith("--daemon");
+  });
+  if (Socket != nullptr && *Socket != '\0' && !IsDaemon) {
+    if (auto RC = ald::forwardLink(
+            Socket, makeArrayRef(const_cast<const char **>(argv), argc))) {
+      return *RC;
+    }
+  }
+  return runLink(argc, const_cast<const char **>(argv), nullptr);
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/FileSearcher.h"
+
+#include "benchmark/benchmark.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+struct AnyFile {
+  Error operator()(file_t &) const { return Error::success(); }
+};
+
+struct LibName {
+  raw_ostream &operator()(StringRef Name, raw_ostream &OS) const {
+    return OS << "lib" << Name << ".a";
+  }
+};
+
+/// Creates State.range(0) search paths under each of State.range(1) SDK
+/// prefixes. Only the very last directory searched contains the library, so
+/// every search visits every path.
+class SearchFixture {
+public:
+  SearchFixture(unsigned NumPaths, unsigned NumPrefixes) {
+    sys::fs::createUniqueDirectory("ald.FileSearcherBenchmarks", Root_);
+    for (unsigned I = 0; I < NumPrefixes; ++I) {
+      SmallString<256> Prefix(Root_);
+      sys::path::append(Prefix, formatv("sdk{0}", I));
+      Prefixes_.push_back(Prefix.str().str());
+    }
+    for (unsigned I = 0; I < NumPaths; ++I) {
+      Paths_.push_back(formatv("/usr/lib{0}", I).str());
+    }
+
+    SmallString<256> Lib(Prefixes_.back());
+    sys::path::append(Lib, Paths_.back());
+    sys::fs::create_directories(Lib);
+    sys::path::append(Lib, "libfound.a");
+    int FD;
+    if (!sys::fs::openFileForWrite(Lib, FD)) {
+      sys::fs::closeFile(FD);
+    }
+
+    SP_ = std::make_unique<SearchPath>(Prefixes_, Paths_,
+                                       SmallVector<StringRef, 2>{});
+  }
+
+  ~SearchFixture() { sys::fs::remove_directories(Root_); }
+
+  const SearchPath &getSearchPath() const { return *SP_; }
+
+private:
+  SmallString<256> Root_;
+  std::vector<std::string> Prefixes_;
+  std::vector<std::string> Paths_;
+  std::unique_ptr<SearchPath> SP_;
+};
+
+void BM_SearchPathVisit(benchmark::State &State) {
+  SearchFixture Fixture(State.range(0), State.range(1));
+  const SearchPath &SP = Fixture.getSearchPath();
+  for (auto _ : State) {
+    size_t Length = 0;
+    SP.visit([&Length](const Twine &Dir) {
+      Path P;
+      Length += Dir.toStringRef(P).size();
+      return false;
+    });
+    benchmark::DoNotOptimize(Length);
+  }
+  State.SetItemsProcessed(State.iterations() * SP.size());
+}
+
+void BM_SearchFound(benchmark::State &State) {
+  SearchFixture Fixture(State.range(0), State.range(1));
+  FileSearcher<AnyFile, LibName> FS(Fixture.getSearchPath());
+  for (auto _ : State) {
+    auto P = FS.search("found");
+    if (!P) {
+      State.SkipWithError("Failed to find the library");
+      consumeError(P.takeError());
+      return;
+    }
+    benchmark::DoNotOptimize(*P);
+  }
+}
+
+void BM_SearchNotFound(benchmark::State &State) {
+  SearchFixture Fixture(State.range(0), State.range(1));
+  FileSearcher<AnyFile, LibName> FS(Fixture.getSearchPath());
+  for (auto _ : State) {
+    auto P = FS.search("missing");
+    if (P) {
+      State.SkipWithError("Found a library which doesn't exist");
+      return;
+    }
+    consumeError(P.takeError());
+  }
+}
+
+void SearchArgs(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"paths", "prefixes"});
+  for (int Paths : {1, 16, 128}) {
+    for (int Prefixes : {1, 4}) {
+      B->Args({Paths, Prefixes});
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_SearchPathVisit)->Apply(SearchArgs);
+BENCHMARK(BM_SearchFound)->Apply(SearchArgs);
+BENCHMARK(BM_SearchNotFound)->Apply(SearchArgs);
+
+BENCHMARK_MAIN();
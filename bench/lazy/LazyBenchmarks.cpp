@@ -0,0 +1,95 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "ADT/ConcurrentLazy.h"
+#include "ADT/Lazy.h"
+
+#include "benchmark/benchmark.h"
+
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+template <template <typename> class LazyT>
+void BM_GetComputed(benchmark::State &State) {
+  LazyT<uint64_t> L(uint64_t(42));
+  for (auto _ : State) {
+    benchmark::DoNotOptimize(L.get());
+  }
+}
+
+template <template <typename> class LazyT>
+void BM_CreateAndForce(benchmark::State &State) {
+  uint64_t X = 1;
+  for (auto _ : State) {
+    LazyT<uint64_t> L([&X]() { return X + 1; });
+    benchmark::DoNotOptimize(L.get());
+  }
+}
+
+// Builds a chain of State.range(0) maps on top of a single lazy value and then
+// forces the end of the chain.
+template <template <typename> class LazyT>
+void BM_MapChain(benchmark::State &State) {
+  const int64_t Depth = State.range(0);
+  for (auto _ : State) {
+    std::vector<LazyT<uint64_t>> Chain;
+    Chain.reserve(Depth + 1);
+    Chain.emplace_back([]() { return uint64_t(1); });
+    for (int64_t I = 0; I < Depth; ++I) {
+      Chain.push_back(Chain.back().map([](uint64_t V) { return V * 3 + 1; }));
+    }
+    benchmark::DoNotOptimize(Chain.back().get());
+  }
+  State.SetItemsProcessed(State.iterations() * Depth);
+}
+
+// Lazy::map(&&) moves the previous value into the next generator rather than
+// referencing it.
+void BM_MoveMapChain(benchmark::State &State) {
+  const int64_t Depth = State.range(0);
+  for (auto _ : State) {
+    Lazy<uint64_t> L([]() { return uint64_t(1); });
+    for (int64_t I = 0; I < Depth; ++I) {
+      L = std::move(L).map([](uint64_t V) { return V * 3 + 1; });
+    }
+    benchmark::DoNotOptimize(L.get());
+  }
+  State.SetItemsProcessed(State.iterations() * Depth);
+}
+
+void BM_ForceAll(benchmark::State &State) {
+  ThreadPool TP;
+  const int64_t Count = State.range(0);
+  for (auto _ : State) {
+    std::vector<Lazy<uint64_t>> Lazies;
+    Lazies.reserve(Count);
+    for (int64_t I = 0; I < Count; ++I) {
+      Lazies.emplace_back([I]() {
+        uint64_t V = I;
+        for (unsigned J = 0; J < 1000; ++J) {
+          V = V * 6364136223846793005ull + 1442695040888963407ull;
+        }
+        return V;
+      });
+    }
+    forceAll(Lazies, TP);
+    benchmark::DoNotOptimize(Lazies.back().get());
+  }
+  State.SetItemsProcessed(State.iterations() * Count);
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_GetComputed, Lazy);
+BENCHMARK_TEMPLATE(BM_GetComputed, ConcurrentLazy);
+BENCHMARK_TEMPLATE(BM_CreateAndForce, Lazy);
+BENCHMARK_TEMPLATE(BM_CreateAndForce, ConcurrentLazy);
+BENCHMARK_TEMPLATE(BM_MapChain, Lazy)->Arg(1)->Arg(8)->Arg(64);
+BENCHMARK_TEMPLATE(BM_MapChain, ConcurrentLazy)->Arg(1)->Arg(8)->Arg(64);
+BENCHMARK(BM_MoveMapChain)->Arg(1)->Arg(8)->Arg(64);
+BENCHMARK(BM_ForceAll)->Arg(64)->Arg(4096)->UseRealTime();
+
+BENCHMARK_MAIN();
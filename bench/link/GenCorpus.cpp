@@ -0,0 +1,307 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+// Writes a directory full of synthetic MH_OBJECT files for benchmarking ald.
+// Every object gets the same number of sections, symbols and relocations so
+// that link time can be plotted against a single knob (the number of files).
+// Relocations reference symbols defined in other objects of the corpus, so
+// the corpus links as a whole.
+
+#include "MachO/Builder.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/WithColor.h"
+
+#include <mutex>
+#include <random>
+
+using namespace llvm;
+using namespace llvm::MachO;
+using namespace llvm::ald::MachO;
+
+static cl::opt<std::string>
+    OutputDirectory("o", cl::desc("Directory to write the corpus to"),
+                    cl::value_desc("dir"), cl::Required);
+
+static cl::opt<unsigned> NumFiles("files",
+                                  cl::desc("Number of object files to write"),
+                                  cl::init(100));
+static cl::opt<unsigned>
+    NumSections("sections", cl::desc("Number of sections in each object file"),
+                cl::init(4));
+static cl::opt<unsigned>
+    NumSymbols("symbols",
+               cl::desc("Number of symbols defined in each section"),
+               cl::init(16));
+static cl::opt<unsigned>
+    NumRelocations("relocations",
+                   cl::desc("Number of relocations in each section"),
+                   cl::init(32));
+
+static cl::opt<std::string> Arch("arch",
+                                 cl::desc("Architecture of the objects "
+                                          "(x86_64 or arm64)"),
+                                 cl::init("x86_64"));
+
+static cl::opt<unsigned> Seed("seed", cl::desc("Seed for the corpus contents"),
+                              cl::init(0));
+
+static StringRef ToolName;
+
+namespace {
+
+struct SectionKind {
+  const char *SegName;
+  const char *SectName;
+  bool IsCode;
+};
+
+// The first few sections of every object mimic what a compiler emits. Any
+// sections beyond these are extra code sections.
+const SectionKind BaseSections[] = {
+    {"__TEXT", "__text", true},
+    {"__DATA", "__data", false},
+    {"__TEXT", "__const", false},
+    {"__DATA", "__const", false},
+};
+
+SectionKind getSectionKind(unsigned Index, std::string &NameStorage) {
+  if (Index < array_lengthof(BaseSections)) {
+    return BaseSections[Index];
+  }
+  NameStorage = formatv("__text{0}", Index).str();
+  return SectionKind{"__TEXT", NameStorage.c_str(), true};
+}
+
+std::string getSymbolName(unsigned File, unsigned Section, unsigned Index) {
+  return formatv("_f{0}_s{1}_{2}", File, Section, Index).str();
+}
+
+// Every fourth symbol is local to its object, the rest may be referenced from
+// any object in the corpus.
+bool isExternal(unsigned Index) { return Index % 4 != 3; }
+
+struct Atom {
+  std::string Name;
+  uint64_t Offset;
+  uint64_t Size;
+};
+
+struct Reloc {
+  uint64_t Offset;
+  std::string Target;
+};
+
+class ObjectGenerator {
+public:
+  ObjectGenerator(unsigned FileIndex, const Triple &T)
+      : FileIndex_(FileIndex), IsARM_(T.getArch() == Triple::aarch64),
+        Rand_(Seed * 7919 + FileIndex) {}
+
+  Error write(StringRef Path, const Triple &T) {
+    Builder::File F;
+    F.setTriple(T).setFileType(MH_OBJECT);
+
+    auto Seg = std::make_unique<Builder::SegmentCommand>("");
+    auto Symtab = std::make_unique<Builder::SymtabCommand>();
+
+    std::vector<std::vector<Atom>> Atoms(NumSections);
+    std::vector<std::vector<Reloc>> Relocs(NumSections);
+    std::vector<uint64_t> Addrs(NumSections);
+    std::vector<std::vector<uint8_t>> Contents(NumSections);
+
+    uint64_t Addr = 0;
+    for (unsigned S = 0; S < NumSections; ++S) {
+      std::string NameStorage;
+      SectionKind Kind = getSectionKind(S, NameStorage);
+      uint32_t Align = Kind.IsCode ? (IsARM_ ? 2 : 4) : 3;
+
+      Addr = alignTo(Addr, 1ull << Align);
+      Addrs[S] = Addr;
+      Contents[S] = buildSection_(S, Kind, Atoms[S], Relocs[S]);
+      Addr += Contents[S].size();
+    }
+
+    // Symbols must be ordered locals, then external definitions, then
+    // undefined references.
+    StringMap<uint32_t> SymbolIndices;
+    auto AddDefined = [&](bool External) {
+      for (unsigned S = 0; S < NumSections; ++S) {
+        for (unsigned I = 0; I < Atoms[S].size(); ++I) {
+          if (isExternal(I) != External) {
+            continue;
+          }
+          const Atom &A = Atoms[S][I];
+          SymbolIndices[A.Name] = Symtab->addSymbol(
+              A.Name, N_SECT | (External ? N_EXT : 0), S + 1, 0,
+              Addrs[S] + A.Offset);
+        }
+      }
+    };
+    AddDefined(false);
+    AddDefined(true);
+    for (auto &SectionRelocs : Relocs) {
+      for (const Reloc &R : SectionRelocs) {
+        if (SymbolIndices.count(R.Target) == 0) {
+          SymbolIndices[R.Target] =
+              Symtab->addSymbol(R.Target, N_UNDF | N_EXT, NO_SECT, 0, 0);
+        }
+      }
+    }
+
+    for (unsigned S = 0; S < NumSections; ++S) {
+      std::string NameStorage;
+      SectionKind Kind = getSectionKind(S, NameStorage);
+      uint32_t Flags = Kind.IsCode ? (S_REGULAR | S_ATTR_PURE_INSTRUCTIONS |
+                                      S_ATTR_SOME_INSTRUCTIONS)
+                                   : S_REGULAR;
+      uint32_t Align = Kind.IsCode ? (IsARM_ ? 2 : 4) : 3;
+      auto &Sect = Seg->addSection(std::make_unique<Builder::Section>(
+          Kind.SegName, Kind.SectName, Flags, Align,
+          std::make_unique<Builder::DataChunk>(std::move(Contents[S]))));
+      for (const Reloc &R : Relocs[S]) {
+        Sect.addRelocation(
+            buildRelocation_(R.Offset, SymbolIndices[R.Target], Kind.IsCode));
+      }
+    }
+
+    F.addLoadCommand(std::move(Seg));
+    F.addLoadCommand(std::move(Symtab));
+    return F.buildAndWrite(Path.str());
+  }
+
+private:
+  std::vector<uint8_t> buildSection_(unsigned S, const SectionKind &Kind,
+                                     std::vector<Atom> &Atoms,
+                                     std::vector<Reloc> &Relocs) {
+    // Each relocation needs its own 8 byte slot, so make sure the atoms are
+    // large enough to fit all of them.
+    uint64_t Slot = 8;
+    uint64_t MinAtomSize =
+        NumSymbols == 0 ? 0 : divideCeil(NumRelocations * Slot, NumSymbols);
+    std::uniform_int_distribution<uint64_t> SizeDist(16, 256);
+
+    uint64_t Offset = 0;
+    for (unsigned I = 0; I < NumSymbols; ++I) {
+      uint64_t Size = alignTo(std::max(SizeDist(Rand_), MinAtomSize), Slot);
+      Atoms.push_back(Atom{getSymbolName(FileIndex_, S, I), Offset, Size});
+      Offset += Size;
+    }
+
+    std::vector<uint8_t> Contents(Offset, Kind.IsCode ? codeFill_() : 0);
+
+    std::uniform_int_distribution<unsigned> FileDist(0, NumFiles - 1);
+    std::uniform_int_distribution<unsigned> SymbolDist(
+        0, std::max(NumSymbols.getValue(), 1u) - 1);
+    uint64_t NumSlots = Offset / Slot;
+    for (unsigned I = 0; I < NumRelocations && I < NumSlots; ++I) {
+      // Spread the relocations evenly across the section.
+      uint64_t RelocOffset = (I * NumSlots / NumRelocations) * Slot;
+
+      // Branches target code in another object, pointers target anything.
+      unsigned TargetFile = FileDist(Rand_);
+      unsigned TargetSection = Kind.IsCode ? 0 : (I % NumSections);
+      unsigned TargetSymbol = SymbolDist(Rand_);
+      if (!isExternal(TargetSymbol) || TargetFile == FileIndex_) {
+        TargetFile = FileIndex_;
+        TargetSection = S;
+      }
+      Relocs.push_back(Reloc{
+          RelocOffset,
+          getSymbolName(TargetFile, TargetSection, TargetSymbol),
+      });
+
+      if (Kind.IsCode) {
+        writeBranch_(Contents.data() + RelocOffset);
+      }
+    }
+
+    return Contents;
+  }
+
+  uint8_t codeFill_() const { return IsARM_ ? 0x00 : 0x90; }
+
+  void writeBranch_(uint8_t *Buf) const {
+    if (IsARM_) {
+      // bl 0
+      support::endian::write32le(Buf, 0x94000000);
+    } else {
+      // call 0
+      Buf[0] = 0xe8;
+      support::endian::write32le(Buf + 1, 0);
+    }
+  }
+
+  any_relocation_info buildRelocation_(uint64_t Offset, uint32_t SymbolIndex,
+                                       bool IsCode) const {
+    unsigned Type;
+    if (IsCode) {
+      Type = IsARM_ ? ARM64_RELOC_BRANCH26 : X86_64_RELOC_BRANCH;
+    } else {
+      Type = IsARM_ ? ARM64_RELOC_UNSIGNED : X86_64_RELOC_UNSIGNED;
+    }
+
+    // For x86_64 the branch's displacement starts after the opcode.
+    uint32_t Address = Offset + ((IsCode && !IsARM_) ? 1 : 0);
+    uint32_t Length = IsCode ? 2 : 3;
+
+    any_relocation_info RI;
+    RI.r_word0 = Address;
+    RI.r_word1 = (SymbolIndex & 0xffffff) | ((IsCode ? 1u : 0u) << 24) |
+                 (Length << 25) | (1u << 27) | (Type << 28);
+    return RI;
+  }
+
+  unsigned FileIndex_;
+  bool IsARM_;
+  std::mt19937_64 Rand_;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "synthetic mach-o corpus generator\n");
+  ToolName = argv[0];
+
+  Triple T;
+  if (Arch == "x86_64") {
+    T = Triple("x86_64-apple-macos");
+  } else if (Arch == "arm64") {
+    T = Triple("arm64-apple-macos");
+  } else {
+    WithColor::error(errs(), ToolName) << "unsupported arch '" << Arch << "'\n";
+    return EXIT_FAILURE;
+  }
+
+  if (auto EC = sys::fs::create_directories(OutputDirectory)) {
+    WithColor::error(errs(), ToolName)
+        << "unable to create '" << OutputDirectory << "': " << EC.message()
+        << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::mutex ErrorLock;
+  Error Err = Error::success();
+  parallelForEachN(0, NumFiles, [&](size_t I) {
+    SmallString<256> Path(OutputDirectory);
+    sys::path::append(Path, formatv("obj{0}.o", I));
+    if (auto E = ObjectGenerator(I, T).write(Path, T)) {
+      std::lock_guard<std::mutex> Lock(ErrorLock);
+      Err = joinErrors(std::move(Err), std::move(E));
+    }
+  });
+  if (Err) {
+    logAllUnhandledErrors(std::move(Err), WithColor::error(errs(), ToolName));
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+# -*- Python -*-
+
+# Generates synthetic corpora of increasing size with ald-gen-corpus, links
+# each one with ald and records how long every phase of the link took.
+#
+# The results are written as a single JSON document:
+#
+#   {
+#     "config": {...},
+#     "runs": [
+#       {"files": 1000, "repeat": 0, "max_rss_kb": ..., "wall": ...,
+#        "phases": {"load": {"wall": ..., "user": ..., "sys": ...}, ...}},
+#       ...
+#     ]
+#   }
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--ald', required=True, help='Path to ald')
+    parser.add_argument('--gen-corpus', required=True,
+                        help='Path to ald-gen-corpus')
+    parser.add_argument('--work-dir', required=True,
+                        help='Directory to generate corpora in')
+    parser.add_argument('--sizes', default='1000,10000',
+                        help='Comma separated numbers of input files')
+    parser.add_argument('--sections', type=int, default=4)
+    parser.add_argument('--symbols', type=int, default=16)
+    parser.add_argument('--relocations', type=int, default=32)
+    parser.add_argument('--arch', default='x86_64',
+                        choices=['x86_64', 'arm64'])
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='Number of times to link each corpus')
+    parser.add_argument('--output', default='-',
+                        help='Where to write the JSON results')
+    return parser.parse_args()
+
+
+def generate(args, files):
+    corpus = os.path.join(args.work_dir, '%s-%d' % (args.arch, files))
+    stamp = os.path.join(corpus, 'corpus.json')
+    config = {
+        'files': files,
+        'sections': args.sections,
+        'symbols': args.symbols,
+        'relocations': args.relocations,
+        'arch': args.arch,
+    }
+
+    # Corpora are expensive to write, so reuse one with the same shape.
+    if os.path.exists(stamp):
+        with open(stamp) as f:
+            if json.load(f) == config:
+                return corpus
+
+    subprocess.check_call([
+        args.gen_corpus, '-o', corpus,
+        '-files=%d' % files,
+        '-sections=%d' % args.sections,
+        '-symbols=%d' % args.symbols,
+        '-relocations=%d' % args.relocations,
+        '-arch=%s' % args.arch,
+    ])
+
+    # Large corpora don't fit in argv, so pass them through a response file.
+    with open(os.path.join(corpus, 'inputs.rsp'), 'w') as f:
+        for i in range(files):
+            f.write(os.path.join(corpus, 'obj%d.o\n' % i))
+    with open(stamp, 'w') as f:
+        json.dump(config, f)
+    return corpus
+
+
+def link(args, corpus, files, repeat):
+    phases = os.path.join(corpus, 'phases.json')
+    cmd = [
+        args.ald,
+        '-o', os.path.join(corpus, 'a.out'),
+        '-time-phases-json=%s' % phases,
+        '@' + os.path.join(corpus, 'inputs.rsp'),
+    ]
+
+    with tempfile.TemporaryFile() as stderr:
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=stderr)
+        # wait4 rather than wait so that we get this link's peak RSS.
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        if proc.returncode != 0:
+            stderr.seek(0)
+            sys.stderr.write(stderr.read().decode(errors='replace'))
+            raise RuntimeError('ald failed linking %d files' % files)
+
+    with open(phases) as f:
+        result = json.load(f)
+    return {
+        'files': files,
+        'repeat': repeat,
+        'wall': wall,
+        'max_rss_kb': rusage.ru_maxrss,
+        'phases': result['phases'],
+    }
+
+
+def main():
+    args = parse_args()
+    sizes = [int(s) for s in args.sizes.split(',') if s]
+
+    runs = []
+    for files in sizes:
+        corpus = generate(args, files)
+        for repeat in range(args.repeat):
+            run = link(args, corpus, files, repeat)
+            runs.append(run)
+            sys.stderr.write('%8d files: %.3fs (%s)\n' % (
+                files, run['wall'], ', '.join(
+                    '%s %.3fs' % (name, phase['wall'])
+                    for name, phase in run['phases'].items())))
+
+    results = {
+        'config': {
+            'sections': args.sections,
+            'symbols': args.symbols,
+            'relocations': args.relocations,
+            'arch': args.arch,
+        },
+        'runs': runs,
+    }
+    if args.output == '-':
+        json.dump(results, sys.stdout, indent=2)
+        sys.stdout.write('\n')
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
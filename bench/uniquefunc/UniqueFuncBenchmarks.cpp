@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "ADT/UniqueFunc.h"
+
+#include "benchmark/benchmark.h"
+
+#include "llvm/ADT/FunctionExtras.h"
+
+#include <functional>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+// Captures a single pointer, which every implementation stores inline.
+struct SmallFunctor {
+  int operator()(int X) const { return X + *P; }
+
+  const int *P;
+};
+
+// Captures more than any of the implementations are willing to store inline.
+struct LargeFunctor {
+  int operator()(int X) const { return X + *P + Pad[0] + Pad[7]; }
+
+  const int *P;
+  uint64_t Pad[8];
+};
+
+template <typename FuncT, typename FunctorT>
+void BM_ConstructAndInvoke(benchmark::State &State) {
+  int V = 1;
+  FunctorT Functor{&V};
+  int X = 0;
+  for (auto _ : State) {
+    FuncT F(Functor);
+    X = F(X);
+    benchmark::DoNotOptimize(X);
+  }
+}
+
+template <typename FuncT, typename FunctorT>
+void BM_Invoke(benchmark::State &State) {
+  int V = 1;
+  FuncT F(FunctorT{&V});
+  int X = 0;
+  for (auto _ : State) {
+    X = F(X);
+    benchmark::DoNotOptimize(X);
+  }
+}
+
+template <typename FuncT, typename FunctorT>
+void BM_Move(benchmark::State &State) {
+  int V = 1;
+  FuncT F(FunctorT{&V});
+  for (auto _ : State) {
+    FuncT F2(std::move(F));
+    F = std::move(F2);
+    benchmark::ClobberMemory();
+  }
+}
+
+} // namespace
+
+#define ALD_UF_BENCHMARKS(Name, Functor)                                       \
+  BENCHMARK_TEMPLATE(Name, UniqueFunc<int(int)>, Functor);                     \
+  BENCHMARK_TEMPLATE(Name, std::function<int(int)>, Functor);                  \
+  BENCHMARK_TEMPLATE(Name, unique_function<int(int)>, Functor)
+
+ALD_UF_BENCHMARKS(BM_ConstructAndInvoke, SmallFunctor);
+ALD_UF_BENCHMARKS(BM_ConstructAndInvoke, LargeFunctor);
+ALD_UF_BENCHMARKS(BM_Invoke, SmallFunctor);
+ALD_UF_BENCHMARKS(BM_Invoke, LargeFunctor);
+ALD_UF_BENCHMARKS(BM_Move, SmallFunctor);
+ALD_UF_BENCHMARKS(BM_Move, LargeFunctor);
+
+#undef ALD_UF_BENCHMARKS
+
+BENCHMARK_MAIN();
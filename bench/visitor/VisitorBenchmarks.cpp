@@ -0,0 +1,110 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Builder.h"
+#include "MachO/File.h"
+#include "MachO/Visitor.h"
+
+#include "benchmark/benchmark.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+
+using namespace llvm;
+using namespace llvm::MachO;
+using namespace llvm::ald::MachO;
+
+namespace {
+
+// Writes an object with \p NumSegments segments of \p NumSections sections
+// each (plus a symbol table) and maps it back in.
+std::unique_ptr<File> buildFile(unsigned NumSegments, unsigned NumSections) {
+  SmallString<128> Path;
+  if (sys::fs::createTemporaryFile("ald.VisitorBenchmarks", "o", Path)) {
+    return nullptr;
+  }
+
+  Builder::File F;
+  F.setTriple(Triple("x86_64-apple-macos")).setFileType(MH_OBJECT);
+  for (unsigned I = 0; I < NumSegments; ++I) {
+    auto Seg = std::make_unique<Builder::SegmentCommand>(
+        formatv("__SEG{0}", I).str());
+    for (unsigned J = 0; J < NumSections; ++J) {
+      Seg->addSection(std::make_unique<Builder::Section>(
+          "__DATA",
+          formatv("__sect{0}", J).str(), S_REGULAR, 3,
+          std::make_unique<Builder::DataChunk>(std::vector<uint8_t>(16))));
+    }
+    F.addLoadCommand(std::move(Seg));
+  }
+  F.addLoadCommand(std::make_unique<Builder::SymtabCommand>());
+
+  std::unique_ptr<File> Result;
+  if (!F.buildAndWrite(Path.str().str())) {
+    if (auto FOrErr = File::read(Path)) {
+      Result = std::move(*FOrErr);
+    } else {
+      consumeError(FOrErr.takeError());
+    }
+  }
+  sys::fs::remove(Path);
+  return Result;
+}
+
+class CountingVisitor : public LCVisitor {
+public:
+  void visitCmd(const File &, const load_command *LC) override {
+    Commands += 1;
+    Bytes += LC->cmdsize;
+  }
+
+  uint64_t Commands = 0;
+  uint64_t Bytes = 0;
+};
+
+class CountingSegVisitor : public LCSegVisitor {
+public:
+  void visitSegment(const File &, const segment_command_64 *) override {
+    Segments += 1;
+  }
+
+  void visitSection(const File &, const segment_command_64 *,
+                    const section_64 *Sect) override {
+    Sections += 1;
+    Bytes += Sect->size;
+  }
+
+  uint64_t Segments = 0;
+  uint64_t Sections = 0;
+  uint64_t Bytes = 0;
+};
+
+template <typename VisitorT> void BM_Visit(benchmark::State &State) {
+  auto F = buildFile(State.range(0), State.range(1));
+  if (F == nullptr) {
+    State.SkipWithError("Unable to build input file");
+    return;
+  }
+
+  for (auto _ : State) {
+    VisitorT V;
+    V.visit(*F);
+    benchmark::DoNotOptimize(V);
+  }
+  State.SetItemsProcessed(State.iterations() * F->loadCommandCount());
+}
+
+void VisitArgs(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"segments", "sections"});
+  for (int Segments : {1, 4, 16}) {
+    for (int Sections : {1, 8, 64}) {
+      B->Args({Segments, Sections});
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Visit, CountingVisitor)->Apply(VisitArgs);
+BENCHMARK_TEMPLATE(BM_Visit, CountingSegVisitor)->Apply(VisitArgs);
+
+BENCHMARK_MAIN();
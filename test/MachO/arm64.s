@@ -0,0 +1,69 @@
+# REQUIRES: aarch64
+# RUN: llvm-mc -filetype=obj -triple=arm64-apple-macos %s -o %t.o
+# RUN: ald %t.o -o %t > /dev/null
+# RUN: llvm-objdump --macho --private-header %t | FileCheck %s --check-prefix=HEADER
+# RUN: llvm-objdump --macho --section-headers %t | FileCheck %s --check-prefix=SECTIONS
+# RUN: llvm-nm -m -p %t | FileCheck %s --check-prefix=SYMS
+# RUN: llvm-objdump --macho -d --section=__stubs --section=__stub_helper %t \
+# RUN:   | FileCheck %s --check-prefix=CODE
+# RUN: llvm-objdump --macho --bind --lazy-bind %t \
+# RUN:   | FileCheck %s --check-prefix=DYLD
+
+# HEADER:      MH_MAGIC_64 ARM64 ALL 0x00 EXECUTE
+# HEADER-SAME: NOUNDEFS DYLDLINK TWOLEVEL PIE
+
+## Segments are aligned to 16KB pages.
+# SECTIONS:      __text          00000018 0000000100000000 TEXT
+# SECTIONS-NEXT: __stubs         0000000c 0000000100000018 TEXT
+# SECTIONS-NEXT: __stub_helper   00000024 0000000100000024 TEXT
+# SECTIONS-NEXT: __got           00000010 0000000100004000 DATA
+# SECTIONS-NEXT: __la_symbol_ptr 00000008 0000000100008000 DATA
+# SECTIONS-NEXT: __data          00000008 0000000100008008 DATA
+
+# SYMS:      0000000100000014 (__TEXT,__text) non-external _helper
+# SYMS-NEXT: 0000000100000000 (__TEXT,__text) external _main
+# SYMS-NEXT:                  (undefined) external _environ
+# SYMS-NEXT:                  (undefined) external _puts
+# SYMS-NEXT:                  (undefined) external dyld_stub_binder
+
+## Calls to imports go through their stubs and loads through their GOT
+## slots. The stub loads its lazy pointer into x16 and jumps to it, which
+## starts out at the stub's entry in the stub helper.
+# CODE:      100000004: 05 00 00 94 bl 0x100000018
+# CODE-NEXT: 100000008: 28 00 00 90 adrp x8, 4 ; 0x100004000
+# CODE-NEXT: 10000000c: 08 01 40 f9 ldr x8, [x8]
+# CODE:      Contents of (__TEXT,__stubs) section
+# CODE-NEXT: 100000018: 50 00 00 90 adrp x16, 8 ; 0x100008000
+# CODE-NEXT: 10000001c: 10 02 40 f9 ldr x16, [x16]
+# CODE-NEXT: 100000020: 00 02 1f d6 br x16
+# CODE:      Contents of (__TEXT,__stub_helper) section
+# CODE-NEXT: 100000024: 51 00 00 90 adrp x17, 8 ; 0x100008000
+# CODE-NEXT: 100000028: 31 22 00 91 add x17, x17, #8
+# CODE-NEXT: 10000002c: f0 47 bf a9 stp x16, x17, [sp, #-16]!
+# CODE-NEXT: 100000030: 30 00 00 90 adrp x16, 4 ; 0x100004000
+# CODE-NEXT: 100000034: 10 06 40 f9 ldr x16, [x16, #8]
+# CODE-NEXT: 100000038: 00 02 1f d6 br x16
+# CODE-NEXT: 10000003c: 50 00 00 18 ldr w16, 0x100000044
+# CODE-NEXT: 100000040: f9 ff ff 17 b 0x100000024
+# CODE-NEXT: 100000044: 00 00 00 00
+
+# DYLD:      Bind table:
+# DYLD:      __DATA_CONST __got 0x100004000 pointer 0 flat-namespace _environ
+# DYLD-NEXT: __DATA_CONST __got 0x100004008 pointer 0 flat-namespace dyld_stub_binder
+# DYLD:      Lazy bind table:
+# DYLD:      __DATA __la_symbol_ptr 0x100008000 flat-namespace _puts
+
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+  .p2align 2
+_main:
+  bl _helper
+  bl _puts
+  adrp x8, _environ@GOTPAGE
+  ldr x8, [x8, _environ@GOTPAGEOFF]
+  ret
+  .p2align 2
+_helper:
+  ret
+
+  .subsections_via_symbols
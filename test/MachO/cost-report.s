@@ -0,0 +1,97 @@
+# REQUIRES: x86
+# RUN: rm -rf %t && split-file %s %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/main.s -o %t/main.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/other.s -o %t/other.o
+
+## Every input gets an entry, and the weak _f other.o loses to main.o's shows
+## up as a folded atom.
+# RUN: ald %t/main.o %t/other.o -o %t/out -cost-report=%t/cost.json > /dev/null
+# RUN: FileCheck %s < %t/cost.json
+
+# CHECK:      "total": {
+# CHECK-NEXT:   "inputs": 2,
+# CHECK-NEXT:   "bytes_mapped": {{[1-9][0-9]*}},
+# CHECK-NEXT:   "bytes_laid_out": 23,
+# CHECK-NEXT:   "atoms": 4,
+# CHECK-NEXT:   "atoms_folded": 1,
+# CHECK-NEXT:   "symbols": 5,
+# CHECK-NEXT:   "relocations": 2,
+# CHECK-NEXT:   "parse_ms": {{[0-9.e+-]+}},
+# CHECK-NEXT:   "relocations_ms": {{[0-9.e+-]+}},
+# CHECK-NEXT:   "atoms_coalesced": 1,
+# CHECK-NEXT:   "atoms_icf_folded": 0
+# CHECK-NEXT: },
+# CHECK-NEXT: "inputs": [
+# CHECK-NEXT:   {
+# CHECK-NEXT:     "path": "{{.*}}main.o",
+# CHECK-NEXT:     "bytes_mapped": {{[1-9][0-9]*}},
+# CHECK-NEXT:     "bytes_laid_out": 17,
+# CHECK-NEXT:     "atoms": 2,
+# CHECK-NEXT:     "atoms_folded": 0,
+# CHECK-NEXT:     "symbols": 3,
+# CHECK-NEXT:     "relocations": 2,
+# CHECK:        {
+# CHECK-NEXT:     "path": "{{.*}}other.o",
+# CHECK-NEXT:     "bytes_mapped": {{[1-9][0-9]*}},
+# CHECK-NEXT:     "bytes_laid_out": 6,
+# CHECK-NEXT:     "atoms": 2,
+# CHECK-NEXT:     "atoms_folded": 1,
+# CHECK-NEXT:     "symbols": 2,
+# CHECK-NEXT:     "relocations": 0,
+
+## Only the atoms of dropped weak definitions which are folded count as
+## coalesced. The weak _f in inner.o isn't at the start of its atom, so
+## main.o's can't stand in for it.
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/inner.s -o %t/inner.o
+# RUN: ald %t/inner.o %t/main.o -o %t/inner -cost-report=%t/inner.json \
+# RUN:   > /dev/null
+# RUN: FileCheck %s --check-prefix=INNER < %t/inner.json
+
+# INNER: "atoms_coalesced": 0,
+
+## With several outputs each gets its own report.
+# RUN: ald -cost-report=%t/multi -binary=%t/one=%t/other.o \
+# RUN:   -binary=%t/two=%t/other.o %t/main.o > /dev/null
+# RUN: FileCheck %s --check-prefix=MULTI < %t/multi.one
+# RUN: FileCheck %s --check-prefix=MULTI < %t/multi.two
+
+# MULTI: "inputs": 2,
+
+#--- main.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  callq _f
+  callq _g
+  retq
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $1, %eax
+  retq
+  .subsections_via_symbols
+
+#--- other.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $2, %eax
+  retq
+  .globl _g
+_g:
+  movl $3, %eax
+  retq
+  .subsections_via_symbols
+
+#--- inner.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _h
+_h:
+  movl $4, %eax
+  retq
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $5, %eax
+  retq
@@ -0,0 +1,53 @@
+# REQUIRES: x86
+# UNSUPPORTED: system-windows
+# RUN: rm -rf %t && split-file %s %t && mkdir %t/sub
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/a.s -o %t/a.o
+
+# RUN: (ald -daemon %t/sock > %t/daemon.log 2>&1 & echo $! > %t/daemon.pid)
+# RUN: for i in $(seq 1 100); do test -S %t/sock && break; sleep 0.1; done
+# RUN: FileCheck %s --check-prefix=DAEMON < %t/daemon.log
+
+# DAEMON: Serving links on '{{.*}}sock'
+
+## Links are run in the client's working directory.
+# RUN: cd %t/sub && env ALD_DAEMON=%t/sock ald ../a.o -o out > /dev/null
+# RUN: llvm-nm %t/sub/out | FileCheck %s --check-prefix=FIRST
+
+# FIRST: T _main
+# FIRST-NOT: _rebuilt
+
+## Errors and the exit code make it back to the client.
+# RUN: not env ALD_DAEMON=%t/sock ald %t/a.o %t/a.o -o %t/dup 2>&1 | \
+# RUN:   FileCheck %s --check-prefix=DUP
+
+# DUP: duplicate symbol '_main'
+
+## Links run side by side.
+# RUN: (env ALD_DAEMON=%t/sock ald %t/a.o -o %t/one > /dev/null & \
+# RUN:  env ALD_DAEMON=%t/sock ald %t/a.o -o %t/two > /dev/null & wait)
+# RUN: cmp %t/one %t/two
+
+## An input which was rebuilt is loaded again.
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/b.s -o %t/a.o
+# RUN: env ALD_DAEMON=%t/sock ald %t/a.o -o %t/rebuilt > /dev/null
+# RUN: llvm-nm %t/rebuilt | FileCheck %s --check-prefix=REBUILT
+
+# REBUILT: T _main
+# REBUILT: T _rebuilt
+
+# RUN: kill $(cat %t/daemon.pid)
+
+#--- a.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  retq
+
+#--- b.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  retq
+  .globl _rebuilt
+_rebuilt:
+  retq
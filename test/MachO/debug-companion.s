@@ -0,0 +1,141 @@
+# REQUIRES: x86, zlib
+# RUN: rm -rf %t; split-file %s %t
+# RUN: cd %t && llvm-mc -g -fdebug-compilation-dir=. -filetype=obj \
+# RUN:   -triple=x86_64-apple-macos a.s -o a.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/b.s -o %t/b.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos -defsym SECOND=1 \
+# RUN:   %t/b.s -o %t/c.o
+
+## -debug-companion writes the debug info, compressed, next to the output,
+## with the output's UUID.
+# RUN: ald -debug-companion %t/a.o %t/b.o %t/c.o -o %t/out > /dev/null
+# RUN: llvm-dwarfdump --uuid %t/out %t/out.dwarf | \
+# RUN:   FileCheck %s --check-prefix=UUID
+# RUN: llvm-objdump --macho --private-header --section-headers %t/out.dwarf | \
+# RUN:   FileCheck %s --check-prefix=COMPANION
+# RUN: llvm-objdump --macho -s --section=__DWARF,.zdebug_abbrev \
+# RUN:   %t/out.dwarf | FileCheck %s --check-prefix=ZLIB
+
+# UUID:      UUID: [[UUID:[0-9A-F-]+]] (x86_64)
+# UUID-NEXT: UUID: [[UUID]] (x86_64)
+
+## Sections are named like GNU compressed sections, so that LLVM's DWARF tools
+## inflate them.
+# COMPANION:     .zdebug_info
+# COMPANION:     .zdebug_abbrev
+# COMPANION:     .zdebug_line
+# COMPANION:     .zdebug_str
+# COMPANION:     .zdebug_aranges
+# COMPANION-NOT: __text
+# COMPANION:     X86_64 ALL 0x00 DSYM
+
+# ZLIB: 5a 4c 49 42
+
+## Every input's units are appended, with their offsets into the other debug
+## sections rebased to where those were appended and their addresses
+## relocated to the output's: _main is at 0x100000000 and the two _helpers at
+## 0x100000001 and 0x100000003.
+# RUN: llvm-dwarfdump --verify %t/out.dwarf
+# RUN: llvm-dwarfdump --debug-info --debug-line %t/out.dwarf | \
+# RUN:   FileCheck %s --check-prefix=DWARF
+
+# DWARF:      Compile Unit: {{.*}} abbr_offset = 0x0000,
+# DWARF:        DW_AT_stmt_list (0x00000000)
+# DWARF-NEXT:   DW_AT_low_pc (0x0000000100000000)
+# DWARF:        DW_AT_name ("a.s")
+# DWARF:      Compile Unit: {{.*}} abbr_offset = 0x0021,
+# DWARF:      DW_TAG_compile_unit
+# DWARF-NEXT:   DW_AT_name ("b.c")
+# DWARF-NEXT:   DW_AT_stmt_list (0x00000036)
+# DWARF-NEXT:   DW_AT_low_pc (0x0000000100000001)
+# DWARF-NEXT:   DW_AT_high_pc (0x0000000100000003)
+# DWARF:        DW_TAG_subprogram
+# DWARF-NEXT:     DW_AT_name ("helper")
+# DWARF:      Compile Unit: {{.*}} abbr_offset = 0x003a,
+# DWARF:      DW_TAG_compile_unit
+# DWARF-NEXT:   DW_AT_name ("c.c")
+# DWARF-NEXT:   DW_AT_stmt_list (0x00000072)
+# DWARF-NEXT:   DW_AT_low_pc (0x0000000100000003)
+# DWARF-NEXT:   DW_AT_high_pc (0x0000000100000005)
+# DWARF:        DW_TAG_subprogram
+# DWARF-NEXT:     DW_AT_name ("second_helper")
+
+# DWARF:      debug_line[0x00000036]
+# DWARF:      0x0000000100000001 2 0 1 0 0 is_stmt
+# DWARF:      debug_line[0x00000072]
+# DWARF:      0x0000000100000003 2 0 1 0 0 is_stmt
+
+## Which is all a symbolizer needs.
+# RUN: llvm-symbolizer --obj=%t/out.dwarf 0x100000004 | \
+# RUN:   FileCheck %s --check-prefix=SYMBOLIZE
+
+# SYMBOLIZE:      second_helper
+# SYMBOLIZE-NEXT: /src/b.c:3:0
+
+#--- a.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  retq
+
+  .subsections_via_symbols
+
+#--- b.s
+## A unit like the ones clang writes, whose names are in __debug_str.
+  .section __TEXT,__text,regular,pure_instructions
+_helper:
+Lfunc_begin:
+  .file 1 "/src" "b.c"
+  .loc 1 2 0
+  nop
+  .loc 1 3 0
+  retq
+Lfunc_end:
+
+  .section __DWARF,__debug_str,regular,debug
+Lsection_str:
+.ifdef SECOND
+Lname:
+  .asciz "c.c"
+Lhelper:
+  .asciz "second_helper"
+.else
+Lname:
+  .asciz "b.c"
+Lhelper:
+  .asciz "helper"
+.endif
+
+  .section __DWARF,__debug_abbrev,regular,debug
+  .byte 1, 0x11, 1       # DW_TAG_compile_unit, with children
+  .byte 0x03, 0x0e       # DW_AT_name, DW_FORM_strp
+  .byte 0x10, 0x17       # DW_AT_stmt_list, DW_FORM_sec_offset
+  .byte 0x11, 0x01       # DW_AT_low_pc, DW_FORM_addr
+  .byte 0x12, 0x06       # DW_AT_high_pc, DW_FORM_data4
+  .byte 0, 0
+  .byte 2, 0x2e, 0       # DW_TAG_subprogram, without children
+  .byte 0x03, 0x0e
+  .byte 0x11, 0x01
+  .byte 0x12, 0x06
+  .byte 0, 0
+  .byte 0
+
+  .section __DWARF,__debug_info,regular,debug
+  .long Lcu_end-Lcu_start
+Lcu_start:
+  .short 4
+  .long 0                # The offset of the unit's abbreviations
+  .byte 8
+  .byte 1
+  .long Lname-Lsection_str
+  .long 0                # The offset of the unit's line table
+  .quad Lfunc_begin
+  .long Lfunc_end-Lfunc_begin
+  .byte 2
+  .long Lhelper-Lsection_str
+  .quad Lfunc_begin
+  .long Lfunc_end-Lfunc_begin
+  .byte 0
+Lcu_end:
+
+  .subsections_via_symbols
@@ -0,0 +1,33 @@
+# REQUIRES: x86
+# RUN: llvm-mc -g -filetype=obj -triple=x86_64-apple-macos %s -o %t.o
+# RUN: ald %t.o -o %t > /dev/null
+# RUN: llvm-nm -pa %t | FileCheck %s -DOBJ=%t.o --check-prefix=MAP
+# RUN: llvm-objdump --macho --section-headers %t | \
+# RUN:   FileCheck %s --check-prefix=SECTIONS
+
+## The debug info stays in the object, the debug map points at it.
+# MAP:      - 00 0000 SO {{.*}}
+# MAP-NEXT: - 00 0000 SO debug-info.s
+# MAP-NEXT: - 00 0001 OSO [[OBJ]]
+# MAP-NEXT: 0000000100000000 - 01 0000 BNSYM
+# MAP-NEXT: 0000000100000000 - 01 0000 FUN _main
+# MAP-NEXT: 0000000000000001 - 00 0000 FUN
+# MAP-NEXT: 0000000000000001 - 01 0000 ENSYM
+# MAP-NEXT: 0000000000000000 - 01 0000 SO
+# MAP-NEXT: 0000000100000000 T _main
+
+# SECTIONS-NOT: __debug
+
+## -S leaves the debug map out.
+# RUN: ald -S %t.o -o %t.stripped > /dev/null
+# RUN: llvm-nm -pa %t.stripped | FileCheck %s --check-prefix=STRIPPED
+
+# STRIPPED-NOT: SO
+# STRIPPED:     0000000100000000 T _main
+
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  retq
+
+  .subsections_via_symbols
@@ -0,0 +1,83 @@
+# REQUIRES: x86
+# RUN: rm -rf %t; split-file %s %t
+# RUN: cd %t && llvm-mc -filetype=obj -triple=x86_64-apple-macos a.s -o a.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos b.s -o b.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos c.s -o c.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos d.s -o d.o
+# RUN: mkdir sub
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos e.s -o sub/e.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos f.s -o f.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos g.s -o g.o
+
+## Inputs from response files which only list paths, from -filelist, with or
+## without a directory to resolve them against, and from the command line are
+## linked in the order they were given.
+# RUN: ald a.o @plain.rsp d.o -filelist sub.list,%t/sub -filelist tail.list \
+# RUN:   -o out > /dev/null
+# RUN: llvm-nm -n out | FileCheck %s --check-prefix=ORDER
+
+# ORDER:      0000000100000000 T _a
+# ORDER-NEXT: 0000000100000001 T _b
+# ORDER-NEXT: 0000000100000002 T _c
+# ORDER-NEXT: 0000000100000003 T _d
+# ORDER-NEXT: 0000000100000004 T _e
+# ORDER-NEXT: 0000000100000005 T _f
+# ORDER-NEXT: 0000000100000006 T _g
+
+## A response file holding options is still expanded by the command line
+## parser, in place.
+# RUN: ald g.o @options.rsp a.o > /dev/null
+# RUN: llvm-nm -n options-out | FileCheck %s --check-prefix=OPTIONS
+
+# OPTIONS:      0000000100000000 T _g
+# OPTIONS-NEXT: 0000000100000001 T _b
+# OPTIONS-NEXT: 0000000100000002 T _c
+# OPTIONS-NEXT: 0000000100000003 T _a
+
+## Response files are only ever mapped by ald itself, so indices that don't
+## name one are rejected.
+# RUN: not ald -response-file-list=0 a.o -o bad 2>&1 | \
+# RUN:   FileCheck %s --check-prefix=INDEX
+
+# INDEX: invalid -response-file-list
+
+#--- plain.rsp
+b.o
+c.o
+#--- sub.list
+e.o
+#--- tail.list
+f.o
+g.o
+#--- options.rsp
+-o options-out
+b.o
+c.o
+#--- a.s
+  .globl _a
+_a:
+  retq
+#--- b.s
+  .globl _b
+_b:
+  retq
+#--- c.s
+  .globl _c
+_c:
+  retq
+#--- d.s
+  .globl _d
+_d:
+  retq
+#--- e.s
+  .globl _e
+_e:
+  retq
+#--- f.s
+  .globl _f
+_f:
+  retq
+#--- g.s
+  .globl _g
+_g:
+  retq
@@ -0,0 +1,49 @@
+# REQUIRES: x86
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %s -o %t.o
+# RUN: ald %t.o -o %t.none > /dev/null
+# RUN: ald -icf=safe %t.o -o %t.safe > /dev/null
+# RUN: ald -icf=all %t.o -o %t.all > /dev/null
+# RUN: llvm-nm -n %t.none | FileCheck %s --check-prefix=NONE
+# RUN: llvm-nm -n %t.safe | FileCheck %s --check-prefix=ALL
+# RUN: llvm-nm -n %t.all | FileCheck %s --check-prefix=ALL
+
+## Without ICF every function keeps its own copy.
+# NONE:      0000000100000000 T _f
+# NONE-NEXT: 0000000100000006 T _g
+# NONE-NEXT: 000000010000000c T _h
+# NONE-NEXT: 0000000100000012 T _p
+# NONE-NEXT: 000000010000001a T _q
+
+## _g is folded into _f, _h returns something else. _p and _q assemble to the
+## same bytes, but their pc-relative fixups load different strings.
+# ALL:      0000000100000000 T _f
+# ALL-NEXT: 0000000100000000 T _g
+# ALL-NEXT: 0000000100000006 T _h
+# ALL-NEXT: 000000010000000c T _p
+# ALL-NEXT: 0000000100000014 T _q
+
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _f, _g, _h, _p, _q
+_f:
+  movl $1, %eax
+  retq
+_g:
+  movl $1, %eax
+  retq
+_h:
+  movl $2, %eax
+  retq
+_p:
+  leaq L_a(%rip), %rax
+  retq
+_q:
+  leaq L_b(%rip), %rax
+  retq
+
+  .section __TEXT,__cstring,cstring_literals
+L_a:
+  .asciz "string1"
+L_b:
+  .asciz "string2"
+
+  .subsections_via_symbols
@@ -0,0 +1,51 @@
+# REQUIRES: x86
+# RUN: rm -rf %t && split-file %s %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/a.s -o %t/a.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/b.s -o %t/b.o
+
+## Nothing is printed about the inputs unless asked for.
+# RUN: ald %t/a.o %t/b.o -o %t/out | count 0
+
+# RUN: ald -print-load-commands %t/a.o %t/b.o -o %t/out | \
+# RUN:   FileCheck %s --check-prefix=PRINT -DDIR=%t
+
+# PRINT:      [[DIR]]/a.o: Parsing load commands...
+# PRINT-NEXT: [[DIR]]/a.o:  Segment: ''
+# PRINT-NEXT: [[DIR]]/a.o:    '__text,__TEXT'
+# PRINT:      [[DIR]]/b.o: Parsing load commands...
+
+# RUN: ald -load-command-stats -load-command-stats-top=1 %t/a.o %t/b.o \
+# RUN:   -o %t/out | FileCheck %s --check-prefix=STATS -DDIR=%t
+
+# STATS:      Load commands:
+# STATS-NEXT:   Command                           Count          Bytes
+# STATS-NEXT:   LC_SYMTAB                             2             48
+# STATS-NEXT:   LC_DYSYMTAB                           2            160
+# STATS-NEXT:   LC_SEGMENT_64                         2            384
+# STATS-NEXT: Sections:
+# STATS-NEXT:   Section                                          Bytes
+# STATS-NEXT:   __DATA,__data                                        8
+# STATS-NEXT:   __TEXT,__text                                        3
+# STATS-NEXT: Largest inputs (1 of 2):
+# STATS-NEXT:   {{ +[0-9]+}} [[DIR]]/b.o
+# STATS-EMPTY:
+
+#--- a.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  retq
+  .subsections_via_symbols
+
+#--- b.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _f, _g
+_f:
+  retq
+_g:
+  retq
+
+  .section __DATA,__data
+  .globl _x
+_x:
+  .quad 42
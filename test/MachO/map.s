@@ -0,0 +1,68 @@
+# REQUIRES: x86
+# RUN: rm -rf %t && split-file %s %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/a.s -o %t/a.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/b.s -o %t/b.o
+# RUN: ald -map=%t/map %t/a.o %t/b.o -o %t/out > /dev/null
+# RUN: FileCheck %s -DDIR=%t < %t/map
+
+# CHECK:      # Path: [[DIR]]/out
+# CHECK-NEXT: # Arch: x86_64
+# CHECK-NEXT: # Object files:
+# CHECK-NEXT: [  0] linker synthesized
+# CHECK-NEXT: [  1] [[DIR]]/a.o
+# CHECK-NEXT: [  2] [[DIR]]/b.o
+# CHECK-NEXT: # Sections:
+# CHECK-NEXT: # Address	Size    	Segment	Section
+# CHECK-NEXT: 0x100000000	0x0000000F	__TEXT	__text
+# CHECK-NEXT: 0x100000010	0x00000006	__TEXT	__stubs
+# CHECK-NEXT: 0x100000018	0x0000001A	__TEXT	__stub_helper
+# CHECK-NEXT: 0x100001000	0x00000010	__DATA_CONST	__got
+# CHECK-NEXT: 0x100002000	0x00000018	__DATA	__data
+# CHECK-NEXT: 0x100002018	0x00000008	__DATA	__la_symbol_ptr
+
+## Symbols are listed in address order, each up to the next one in its atom.
+# CHECK-NEXT: # Symbols:
+# CHECK-NEXT: # Address	Size    	File  Name
+# CHECK-NEXT: 0x100000000	0x0000000C	[  1] _main
+# CHECK-NEXT: 0x10000000C	0x00000001	[  1] _helper
+# CHECK-NEXT: 0x10000000E	0x00000001	[  2] _f
+# CHECK-NEXT: 0x100000010	0x00000006	[  0] stub for _puts
+# CHECK-NEXT: 0x100001000	0x00000008	[  0] GOT slot for _environ
+# CHECK-NEXT: 0x100001008	0x00000008	[  0] GOT slot for dyld_stub_binder
+# CHECK-NEXT: 0x100002000	0x00000004	[  2] _table
+# CHECK-NEXT: 0x100002004	0x0000000C	[  2] _table_end
+# CHECK-EMPTY:
+
+## Each output of a multi-binary link gets a map of its own.
+# RUN: ald -map=%t/multi -binary=%t/one=%t/a.o -binary=%t/two=%t/a.o %t/b.o \
+# RUN:   > /dev/null
+# RUN: FileCheck %s --check-prefix=ONE -DDIR=%t < %t/multi.one
+# RUN: FileCheck %s --check-prefix=TWO -DDIR=%t < %t/multi.two
+
+# ONE: # Path: [[DIR]]/one
+# TWO: # Path: [[DIR]]/two
+
+#--- a.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  callq _puts
+  movq _environ@GOTPCREL(%rip), %rax
+_helper:
+  retq
+  .subsections_via_symbols
+
+#--- b.s
+  .section __TEXT,__text,regular,pure_instructions
+  .p2align 1
+  .globl _f
+_f:
+  retq
+
+  .section __DATA,__data
+  .globl _table
+_table:
+  .long 1
+_table_end:
+  .quad 2
+  .long 3
@@ -0,0 +1,27 @@
+# REQUIRES: x86
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %s -o %t.o
+# RUN: echo "_c" > %t.order
+# RUN: echo "x86_64:_a" >> %t.order
+# RUN: echo "arm64:_b" >> %t.order
+# RUN: ald -order_file=%t.order %t.o -o %t > /dev/null
+# RUN: llvm-nm -n %t | FileCheck %s
+
+## Ordered symbols come first, entries for other architectures are ignored
+## and the rest keep their input order.
+# CHECK:      0000000100000000 T _c
+# CHECK-NEXT: 0000000100000001 T _a
+# CHECK-NEXT: 0000000100000002 T _b
+# CHECK-NEXT: 0000000100000003 T _d
+
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _a, _b, _c, _d
+_a:
+  retq
+_b:
+  retq
+_c:
+  retq
+_d:
+  retq
+
+  .subsections_via_symbols
@@ -0,0 +1,106 @@
+# REQUIRES: aarch64, x86
+# RUN: rm -rf %t && split-file %s %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/x86_64.s -o %t/x86_64.o
+# RUN: llvm-mc -filetype=obj -triple=arm64-apple-macos %t/arm64.s -o %t/arm64.o
+# RUN: ald %t/x86_64.o -o %t/x86_64 > /dev/null
+# RUN: ald %t/arm64.o -o %t/arm64 > /dev/null
+# RUN: llvm-objdump --macho --private-header --section-headers -d %t/x86_64 | \
+# RUN:   FileCheck %s --check-prefixes=CHECK,X86_64
+# RUN: llvm-objdump --macho --private-header --section-headers -d %t/arm64 | \
+# RUN:   FileCheck %s --check-prefixes=CHECK,ARM64
+# RUN: llvm-objdump --macho -s --section=__thread_vars %t/x86_64 | \
+# RUN:   FileCheck %s --check-prefix=X86_64-VARS
+# RUN: llvm-objdump --macho -s --section=__thread_vars %t/arm64 | \
+# RUN:   FileCheck %s --check-prefix=ARM64-VARS
+# RUN: llvm-objdump --macho --bind %t/x86_64 | \
+# RUN:   FileCheck %s --check-prefix=X86_64-BIND
+# RUN: llvm-objdump --macho --bind %t/arm64 | \
+# RUN:   FileCheck %s --check-prefix=ARM64-BIND
+
+## Loads of a variable's descriptor through its TLVP slot become address
+## computations of the descriptor itself.
+# X86_64:      100000000: 48 8d 3d 11 10 00 00 leaq _tv(%rip), %rdi
+# ARM64:       100000000: 20 00 00 90 adrp x0, 4 ; 0x100004000
+# ARM64-NEXT:  100000004: 00 60 00 91 add x0, x0, #24
+
+## The templates follow the descriptors, initialized data first.
+# CHECK:       __text
+# X86_64-NEXT: __thread_vars 00000030 0000000100001000 DATA
+# X86_64-NEXT: __thread_data 00000008 0000000100001030 DATA
+# ARM64-NEXT:  __thread_vars 00000030 0000000100004000 DATA
+# ARM64-NEXT:  __thread_data 00000008 0000000100004030 DATA
+# CHECK:       EXECUTE
+# CHECK-SAME:  MH_HAS_TLV_DESCRIPTORS
+
+## _tv's initial value is 4 bytes into the template.
+# X86_64-VARS:      0000000100001010 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+# X86_64-VARS-NEXT: 0000000100001020 00 00 00 00 00 00 00 00 04 00 00 00 00 00 00 00
+# ARM64-VARS:       0000000100004010 00000000 00000000 00000000 00000000
+# ARM64-VARS-NEXT:  0000000100004020 00000000 00000000 00000004 00000000
+
+## dyld binds every descriptor's thunk.
+# X86_64-BIND:      __DATA __thread_vars 0x100001000 pointer 0 flat-namespace __tlv_bootstrap
+# X86_64-BIND-NEXT: __DATA __thread_vars 0x100001018 pointer 0 flat-namespace __tlv_bootstrap
+# ARM64-BIND:       __DATA __thread_vars 0x100004000 pointer 0 flat-namespace __tlv_bootstrap
+# ARM64-BIND-NEXT:  __DATA __thread_vars 0x100004018 pointer 0 flat-namespace __tlv_bootstrap
+
+#--- x86_64.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  movq _tv@TLVP(%rip), %rdi
+  callq *(%rdi)
+  retq
+
+  .section __DATA,__thread_data,thread_local_regular
+  .p2align 2
+_other$tlv$init:
+  .long 7
+_tv$tlv$init:
+  .long 42
+
+  .section __DATA,__thread_vars,thread_local_variables
+  .globl _other
+_other:
+  .quad __tlv_bootstrap
+  .quad 0
+  .quad _other$tlv$init
+  .globl _tv
+_tv:
+  .quad __tlv_bootstrap
+  .quad 0
+  .quad _tv$tlv$init
+
+  .subsections_via_symbols
+
+#--- arm64.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+  .p2align 2
+_main:
+  adrp x0, _tv@TLVPPAGE
+  ldr x0, [x0, _tv@TLVPPAGEOFF]
+  ldr x8, [x0]
+  blr x8
+  ret
+
+  .section __DATA,__thread_data,thread_local_regular
+  .p2align 2
+_other$tlv$init:
+  .long 7
+_tv$tlv$init:
+  .long 42
+
+  .section __DATA,__thread_vars,thread_local_variables
+  .globl _other
+_other:
+  .quad __tlv_bootstrap
+  .quad 0
+  .quad _other$tlv$init
+  .globl _tv
+_tv:
+  .quad __tlv_bootstrap
+  .quad 0
+  .quad _tv$tlv$init
+
+  .subsections_via_symbols
@@ -0,0 +1,108 @@
+# REQUIRES: x86
+# RUN: rm -rf %t && split-file %s %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/main.s -o %t/main.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/weak.s -o %t/weak.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/strong.s -o %t/strong.o
+
+## The first weak definition wins, and the other one is dropped.
+# RUN: ald %t/main.o %t/weak.o -o %t/weak > /dev/null
+# RUN: llvm-objdump --macho --private-header -d %t/weak | \
+# RUN:   FileCheck %s --check-prefix=WEAK
+# RUN: llvm-nm -m %t/weak | FileCheck %s --check-prefix=WEAK-SYMS
+# RUN: llvm-objdump --macho --weak-bind %t/weak | \
+# RUN:   FileCheck %s --check-prefix=WEAK-BIND
+
+# WEAK:      (__TEXT,__text) section
+# WEAK:      _f:
+# WEAK-NEXT: movl $1, %eax
+# WEAK-NEXT: retq
+# WEAK-NOT:  movl $2, %eax
+# WEAK:      EXECUTE
+# WEAK-SAME: WEAK_DEFINES BINDS_TO_WEAK
+
+# WEAK-SYMS: (__TEXT,__text) weak external _f
+
+## The load of _f's address goes through a GOT slot, which dyld may bind to
+## another image's definition. That's what BINDS_TO_WEAK is for.
+# WEAK-BIND:      Weak bind table:
+# WEAK-BIND-NEXT: segment section address type addend symbol
+# WEAK-BIND-NEXT: __DATA_CONST __got 0x100001000 pointer 0 _f
+
+## A strong definition beats weak ones, wherever it is.
+# RUN: ald %t/main.o %t/strong.o %t/weak.o -o %t/strong > /dev/null
+# RUN: llvm-objdump --macho --private-header -d %t/strong | \
+# RUN:   FileCheck %s --check-prefix=STRONG
+# RUN: llvm-nm -m %t/strong | FileCheck %s --check-prefix=STRONG-SYMS
+
+# STRONG:      (__TEXT,__text) section
+# STRONG:      _f:
+# STRONG-NEXT: movl $3, %eax
+# STRONG-NEXT: retq
+# STRONG-NOT:  movl ${{[12]}}, %eax
+# STRONG:      EXECUTE
+# STRONG-NOT:  WEAK
+
+# STRONG-SYMS: (__TEXT,__text) external _f
+
+## Two strong definitions are still an error.
+# RUN: not ald %t/strong.o %t/strong.o -o %t/dup 2>&1 | \
+# RUN:   FileCheck %s --check-prefix=DUP
+
+# DUP: duplicate symbol '_f'
+
+## A weak definition which isn't at the start of its atom can't stand in for
+## the duplicate's whole atom, so the duplicate's bytes stay.
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %t/inner.s -o %t/inner.o
+# RUN: ald %t/inner.o %t/weak.o -o %t/inner > /dev/null
+# RUN: llvm-objdump --macho -d %t/inner | FileCheck %s --check-prefix=INNER
+
+# INNER:      _main:
+# INNER-NEXT: movl $4, %eax
+# INNER-NEXT: retq
+# INNER:      _f:
+# INNER-NEXT: movl $1, %eax
+# INNER-NEXT: retq
+# INNER-NEXT: movl $2, %eax
+
+#--- main.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  callq _f
+  movq _f@GOTPCREL(%rip), %rax
+  retq
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $1, %eax
+  retq
+  .subsections_via_symbols
+
+#--- weak.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $2, %eax
+  retq
+  .subsections_via_symbols
+
+#--- strong.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _f
+_f:
+  movl $3, %eax
+  retq
+  .subsections_via_symbols
+
+#--- inner.s
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  movl $4, %eax
+  retq
+  .globl _f
+  .weak_definition _f
+_f:
+  movl $1, %eax
+  retq
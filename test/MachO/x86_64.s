@@ -0,0 +1,90 @@
+# REQUIRES: x86
+# RUN: llvm-mc -filetype=obj -triple=x86_64-apple-macos %s -o %t.o
+# RUN: ald %t.o -o %t > /dev/null
+# RUN: llvm-objdump --macho --private-header %t | FileCheck %s --check-prefix=HEADER
+# RUN: llvm-objdump --macho --section-headers %t | FileCheck %s --check-prefix=SECTIONS
+# RUN: llvm-nm -m -p %t | FileCheck %s --check-prefix=SYMS
+# RUN: llvm-objdump --macho -d --section=__stubs --section=__stub_helper %t \
+# RUN:   | FileCheck %s --check-prefix=CODE
+# RUN: llvm-objdump --macho --rebase --bind --lazy-bind %t \
+# RUN:   | FileCheck %s --check-prefix=DYLD
+# RUN: llvm-objdump --macho --indirect-symbols %t \
+# RUN:   | FileCheck %s --check-prefix=INDIRECT
+
+# HEADER:      MH_MAGIC_64 X86_64 ALL 0x00 EXECUTE
+# HEADER-SAME: NOUNDEFS DYLDLINK TWOLEVEL PIE
+
+## __data ends with the word the stub helper hands dyld.
+# SECTIONS:      __text          00000013 0000000100000000 TEXT
+# SECTIONS-NEXT: __cstring       00000006 0000000100000013 DATA
+# SECTIONS-NEXT: __stubs         00000006 000000010000001a TEXT
+# SECTIONS-NEXT: __stub_helper   0000001a 0000000100000020 TEXT
+# SECTIONS-NEXT: __got           00000010 0000000100001000 DATA
+# SECTIONS-NEXT: __data          00000010 0000000100002000 DATA
+# SECTIONS-NEXT: __la_symbol_ptr 00000008 0000000100002010 DATA
+
+## Locals come first and keep their names, temporary labels are dropped and
+## imports stay undefined.
+# SYMS:      0000000100000012 (__TEXT,__text) non-external _helper
+# SYMS-NEXT: 0000000100002000 (__DATA,__data) external _data
+# SYMS-NEXT: 0000000100000000 (__TEXT,__text) external _main
+# SYMS-NEXT:                  (undefined) external _environ
+# SYMS-NEXT:                  (undefined) external _puts
+# SYMS-NEXT:                  (undefined) external dyld_stub_binder
+# SYMS-NOT:  L_str
+
+## Calls to imports go through their stubs and loads through their GOT
+## slots. The stub jumps through its lazy pointer, which starts out at the
+## stub's entry in the stub helper: it pushes the offset of the import's lazy
+## bind opcodes and jumps to the header, which calls dyld_stub_binder.
+# CODE:      100000005: e8 10 00 00 00 callq 0x10000001a
+# CODE:      10000000a: 48 8b 05 ef 0f 00 00 movq 4079(%rip), %rax
+# CODE:      Contents of (__TEXT,__stubs) section
+# CODE-NEXT: 10000001a: ff 25 f0 1f 00 00 jmpq *8176(%rip)
+# CODE:      Contents of (__TEXT,__stub_helper) section
+# CODE-NEXT: 100000020: 4c 8d 1d e1 1f 00 00 leaq 8161(%rip), %r11
+# CODE-NEXT: 100000027: 41 53 pushq %r11
+# CODE-NEXT: 100000029: ff 25 d9 0f 00 00 jmpq *4057(%rip)
+# CODE-NEXT: 10000002f: 90 nop
+# CODE-NEXT: 100000030: 68 00 00 00 00 pushq $0
+# CODE-NEXT: 100000035: e9 e6 ff ff ff jmp 0x100000020
+
+# DYLD:      Rebase table:
+# DYLD-NEXT: segment section address type
+# DYLD-NEXT: __DATA __la_symbol_ptr 0x100002010 pointer
+# DYLD:      Bind table:
+# DYLD-NEXT: segment section address type addend dylib symbol
+# DYLD-NEXT: __DATA_CONST __got 0x100001000 pointer 0 flat-namespace _environ
+# DYLD-NEXT: __DATA_CONST __got 0x100001008 pointer 0 flat-namespace dyld_stub_binder
+# DYLD:      Lazy bind table:
+# DYLD-NEXT: segment section address dylib symbol
+# DYLD-NEXT: __DATA __la_symbol_ptr 0x100002010 flat-namespace _puts
+
+# INDIRECT:      Indirect symbols for (__TEXT,__stubs) 1 entries
+# INDIRECT:      0x000000010000001a 4 _puts
+# INDIRECT:      Indirect symbols for (__DATA_CONST,__got) 2 entries
+# INDIRECT:      0x0000000100001000 3 _environ
+# INDIRECT-NEXT: 0x0000000100001008 5 dyld_stub_binder
+# INDIRECT:      Indirect symbols for (__DATA,__la_symbol_ptr) 1 entries
+# INDIRECT:      0x0000000100002010 4 _puts
+
+  .section __TEXT,__text,regular,pure_instructions
+  .globl _main
+_main:
+  callq _helper
+  callq _puts
+  movq _environ@GOTPCREL(%rip), %rax
+  retq
+_helper:
+  retq
+
+  .section __TEXT,__cstring,cstring_literals
+L_str:
+  .asciz "hello"
+
+  .section __DATA,__data
+  .globl _data
+_data:
+  .quad 42
+
+  .subsections_via_symbols
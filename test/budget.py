@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+# -*- Python -*-
+
+# Runs a command and fails if it takes longer than its time budget:
+#
+#   budget.py [--scale=<factor>] <seconds> <command> [<args>...]
+#
+# The command's exit code is passed through when it finishes in time.
+
+import argparse
+import subprocess
+import sys
+import time
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--scale', type=float, default=1.0,
+                        help='Factor to multiply the budget by')
+    parser.add_argument('seconds', type=float)
+    parser.add_argument('command', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    if not args.command:
+        parser.error('no command to run')
+
+    budget = args.seconds * args.scale
+    start = time.perf_counter()
+    try:
+        returncode = subprocess.call(args.command, timeout=budget)
+    except subprocess.TimeoutExpired:
+        returncode = None
+    elapsed = time.perf_counter() - start
+    if returncode is None or elapsed > budget:
+        sys.stderr.write('budget.py: %s took %.2fs, over its budget of %.2fs\n'
+                         % (args.command[0], elapsed, budget))
+        return 1
+    return returncode
+
+
+if __name__ == '__main__':
+    sys.exit(main())
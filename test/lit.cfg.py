@@ -0,0 +1,49 @@
+# -*- Python -*-
+
+# Configuration file for the 'lit' test runner: end to end tests which
+# assemble Mach-O objects with llvm-mc, link them with ald and inspect the
+# output. Nothing here needs a Darwin host.
+
+import os
+
+import lit.formats
+
+from lit.llvm import llvm_config
+
+# name: The name of this test suite.
+config.name = 'ALD'
+
+# testFormat: The test format to use to interpret tests.
+config.test_format = lit.formats.ShTest(not llvm_config.use_lit_shell)
+
+# suffixes: A list of file extensions to treat as test files.
+config.suffixes = ['.s', '.test']
+
+# excludes: A list of directories and files to exclude from the testsuite.
+config.excludes = ['Inputs', 'CMakeLists.txt', 'budget.py']
+
+# test_source_root: The root path where tests are located.
+# test_exec_root: The root path where tests should be run.
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = os.path.join(config.ald_obj_root, 'test')
+
+llvm_config.feature_config(
+    [('--targets-built', {'AArch64': 'aarch64', 'X86': 'x86'})])
+
+llvm_config.use_default_substitutions()
+llvm_config.with_environment('PATH', config.llvm_tools_dir, append_path=True)
+llvm_config.add_tool_substitutions(
+    ['ald', 'ald-gen-corpus', 'llvm-mc', 'llvm-nm', 'llvm-objdump',
+     'llvm-readobj', 'split-file'],
+    [config.ald_tools_dir, config.llvm_tools_dir])
+
+# %budget <seconds> <command> fails if <command> takes longer than <seconds>,
+# so that tests linking large generated inputs catch slowdowns. Slow
+# configurations, e.g. sanitizer builds, can scale every budget with
+# --param budget_scale=<factor>.
+budget_scale = lit_config.params.get('budget_scale', '1')
+config.substitutions.append(
+    ('%budget', '"%s" "%s" --scale=%s' % (
+        config.python_executable,
+        os.path.join(config.ald_src_root, 'test', 'budget.py'),
+        budget_scale)))
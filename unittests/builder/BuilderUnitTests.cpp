@@ -0,0 +1,263 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Builder.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/Object/MachO.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+using namespace llvm::MachO;
+using namespace llvm::ald::MachO;
+
+class BuilderTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createTemporaryFile("ald.BuilderTest", "o", Path));
+  }
+
+  void TearDown() override { sys::fs::remove(Path); }
+
+  std::unique_ptr<object::MachOObjectFile> readBack() {
+    auto MBOrErr = MemoryBuffer::getFile(Path);
+    EXPECT_TRUE(bool(MBOrErr));
+    MB = std::move(*MBOrErr);
+    auto ObjOrErr = object::MachOObjectFile::create(
+        *MB, /*IsLittleEndian=*/true, /*Is64Bits=*/true);
+    if (!ObjOrErr) {
+      ADD_FAILURE() << toString(ObjOrErr.takeError());
+      return nullptr;
+    }
+    return std::move(*ObjOrErr);
+  }
+
+  SmallString<128> Path;
+  std::unique_ptr<MemoryBuffer> MB;
+};
+
+TEST_F(BuilderTest, writesHeaderOnly) {
+  Builder::File F;
+  ASSERT_FALSE(bool(F.setTriple(Triple("x86_64-apple-macos"))
+                        .buildAndWrite(Path.str().str())));
+
+  auto Obj = readBack();
+  ASSERT_NE(Obj, nullptr);
+  ASSERT_EQ(Obj->getHeader64().filetype, (uint32_t)MH_EXECUTE);
+  ASSERT_EQ(Obj->getHeader64().ncmds, 0u);
+}
+
+TEST_F(BuilderTest, writesObjectWithSectionsAndSymbols) {
+  Builder::File F;
+  F.setTriple(Triple("arm64-apple-macos")).setFileType(MH_OBJECT);
+
+  auto Seg = std::make_unique<Builder::SegmentCommand>("");
+  auto &Text = Seg->addSection(std::make_unique<Builder::Section>(
+      "__TEXT", "__text", S_ATTR_PURE_INSTRUCTIONS, 2,
+      std::make_unique<Builder::DataChunk>(
+          std::vector<uint8_t>{0x00, 0x00, 0x00, 0x94, 0xc0, 0x03, 0x5f,
+                               0xd6})));
+  Seg->addSection(std::make_unique<Builder::Section>(
+      "__DATA", "__data", S_REGULAR, 3,
+      std::make_unique<Builder::DataChunk>(std::vector<uint8_t>(8, 0x42))));
+  Seg->addSection(std::make_unique<Builder::Section>(
+      "__DATA", "__bss", S_ZEROFILL, 4, uint64_t(32)));
+
+  auto Symtab = std::make_unique<Builder::SymtabCommand>();
+  ASSERT_EQ(Symtab->addSymbol("_main", N_SECT | N_EXT, 1, 0, 0), 0u);
+  ASSERT_EQ(Symtab->addSymbol("_data", N_SECT | N_EXT, 2, 0, 8), 1u);
+  ASSERT_EQ(Symtab->addSymbol("_callee", N_UNDF | N_EXT, NO_SECT, 0, 0), 2u);
+
+  any_relocation_info RI;
+  RI.r_word0 = 0;
+  RI.r_word1 = 2 | (1u << 24) | (2u << 25) | (1u << 27) |
+               (ARM64_RELOC_BRANCH26 << 28);
+  Text.addRelocation(RI);
+
+  F.addLoadCommand(std::move(Seg));
+  F.addLoadCommand(std::move(Symtab));
+  ASSERT_FALSE(bool(F.buildAndWrite(Path.str().str())));
+
+  auto Obj = readBack();
+  ASSERT_NE(Obj, nullptr);
+  ASSERT_EQ(Obj->getHeader64().filetype, (uint32_t)MH_OBJECT);
+  ASSERT_EQ(Obj->getHeader64().ncmds, 2u);
+
+  std::vector<std::string> Names;
+  for (const auto &S : Obj->sections()) {
+    Names.push_back(cantFail(S.getName()).str());
+  }
+  ASSERT_EQ(Names, (std::vector<std::string>{"__text", "__data", "__bss"}));
+
+  auto Sections = Obj->sections();
+  auto Iter = Sections.begin();
+  ASSERT_EQ(Iter->getAddress(), 0u);
+  ASSERT_EQ(cantFail(Iter->getContents())[3], '\x94');
+  ASSERT_EQ(std::distance(Iter->relocations().begin(),
+                          Iter->relocations().end()),
+            1);
+  ++Iter;
+  ASSERT_EQ(Iter->getAddress(), 8u);
+  ASSERT_EQ(cantFail(Iter->getContents()), StringRef("BBBBBBBB"));
+  ++Iter;
+  ASSERT_EQ(Iter->getAddress(), 16u);
+  ASSERT_EQ(Iter->getSize(), 32u);
+
+  std::vector<std::string> Symbols;
+  for (const auto &Sym : Obj->symbols()) {
+    Symbols.push_back(cantFail(Sym.getName()).str());
+  }
+  ASSERT_EQ(Symbols,
+            (std::vector<std::string>{"_main", "_data", "_callee"}));
+}
+
+namespace {
+
+void addLoadCommands(Builder::File &F) {
+  F.setTriple(Triple("x86_64-apple-macos")).setFileType(MH_OBJECT);
+
+  auto Seg = std::make_unique<Builder::SegmentCommand>("");
+  std::vector<uint8_t> Text(1000);
+  for (size_t I = 0; I < Text.size(); ++I) {
+    Text[I] = I * 7;
+  }
+  Seg->addSection(std::make_unique<Builder::Section>(
+      "__TEXT", "__text", S_ATTR_PURE_INSTRUCTIONS, 4,
+      std::make_unique<Builder::DataChunk>(std::move(Text))));
+  Seg->addSection(std::make_unique<Builder::Section>(
+      "__DATA", "__data", S_REGULAR, 6,
+      std::make_unique<Builder::DataChunk>(std::vector<uint8_t>(3, 0x42))));
+
+  auto Symtab = std::make_unique<Builder::SymtabCommand>();
+  for (unsigned I = 0; I < 20; ++I) {
+    Symtab->addSymbol(Symtab->saveName("_sym" + std::to_string(I)),
+                      N_SECT | N_EXT, 1, 0, I);
+  }
+
+  F.addLoadCommand(std::move(Seg));
+  F.addLoadCommand(std::move(Symtab));
+}
+
+} // namespace
+
+TEST_F(BuilderTest, streamingWriterMatchesMappedWriter) {
+  Builder::File Mapped;
+  addLoadCommands(Mapped);
+  ASSERT_FALSE(bool(Mapped.buildAndWrite(Path.str().str())));
+  auto Expected = MemoryBuffer::getFile(Path);
+  ASSERT_TRUE(bool(Expected));
+
+  // Buffers which don't line up with any chunk, and fewer of them than the
+  // output needs, make sure chunks are written in pieces and buffers reused.
+  for (size_t BufferSize : {1, 13, 64, 4096}) {
+    Builder::File Streamed;
+    addLoadCommands(Streamed);
+    Streamed.setWriter(
+        std::make_unique<Builder::StreamingWriter>(BufferSize, 2));
+    ASSERT_FALSE(bool(Streamed.buildAndWrite(Path.str().str())));
+
+    auto Actual = MemoryBuffer::getFile(Path);
+    ASSERT_TRUE(bool(Actual));
+    ASSERT_EQ((*Actual)->getBuffer(), (*Expected)->getBuffer())
+        << "buffer size " << BufferSize;
+  }
+
+  auto Obj = readBack();
+  ASSERT_NE(Obj, nullptr);
+  ASSERT_EQ(Obj->getHeader64().ncmds, 2u);
+}
+
+TEST_F(BuilderTest, replacesExistingOutputAtomically) {
+  Builder::File Old;
+  ASSERT_FALSE(bool(Old.setTriple(Triple("x86_64-apple-macos"))
+                        .buildAndWrite(Path.str().str())));
+
+  auto OldFOrErr = sys::fs::openNativeFileForRead(Path);
+  ASSERT_TRUE(bool(OldFOrErr));
+  sys::fs::file_t OldF = *OldFOrErr;
+
+  Builder::File New;
+  addLoadCommands(New);
+  ASSERT_FALSE(bool(New.buildAndWrite(Path.str().str())));
+
+  // The old output must have been replaced rather than rewritten in place, so
+  // anyone still reading it sees the old contents.
+  mach_header_64 Header;
+  auto ReadOrErr = sys::fs::readNativeFile(
+      OldF, MutableArrayRef<char>((char *)&Header, sizeof(Header)));
+  sys::fs::closeFile(OldF);
+  ASSERT_TRUE(bool(ReadOrErr));
+  ASSERT_EQ(*ReadOrErr, sizeof(Header));
+  ASSERT_EQ(Header.filetype, (uint32_t)MH_EXECUTE);
+
+  auto Obj = readBack();
+  ASSERT_NE(Obj, nullptr);
+  ASSERT_EQ(Obj->getHeader64().filetype, (uint32_t)MH_OBJECT);
+}
+
+namespace {
+
+Optional<std::vector<uint8_t>> getUUID(const object::MachOObjectFile &Obj) {
+  for (const auto &LC : Obj.load_commands()) {
+    if (LC.C.cmd == LC_UUID) {
+      auto Cmd = Obj.getUuidCommand(LC);
+      return std::vector<uint8_t>(Cmd.uuid, Cmd.uuid + sizeof(Cmd.uuid));
+    }
+  }
+  return None;
+}
+
+} // namespace
+
+TEST_F(BuilderTest, uuidIsAHashOfTheOutput) {
+  std::vector<uint8_t> Zero(16, 0);
+  std::vector<std::vector<uint8_t>> UUIDs;
+  for (unsigned I = 0; I < 3; ++I) {
+    Builder::File F;
+    addLoadCommands(F);
+    F.addUUIDCommand();
+    if (I == 1) {
+      F.setWriter(std::make_unique<Builder::StreamingWriter>(100, 2));
+    } else if (I == 2) {
+      F.setTriple(Triple("arm64-apple-macos"));
+    }
+    ASSERT_FALSE(bool(F.buildAndWrite(Path.str().str())));
+
+    auto Obj = readBack();
+    ASSERT_NE(Obj, nullptr);
+    auto UUID = getUUID(*Obj);
+    ASSERT_TRUE(UUID.hasValue());
+    ASSERT_NE(*UUID, Zero);
+    UUIDs.push_back(*UUID);
+  }
+
+  // Identical outputs get identical UUIDs, however they were written.
+  ASSERT_EQ(UUIDs[0], UUIDs[1]);
+  ASSERT_NE(UUIDs[0], UUIDs[2]);
+}
+
+TEST(PieceHasherTest, hashesPiecesSplitAcrossCalls) {
+  std::vector<uint8_t> Output(100);
+  for (size_t I = 0; I < Output.size(); ++I) {
+    Output[I] = I * 7;
+  }
+
+  Builder::PieceHasher Whole(Output.size(), 16);
+  for (size_t Begin = 0; Begin < Output.size(); Begin += 16) {
+    size_t Size = std::min<size_t>(16, Output.size() - Begin);
+    Whole.hashPiece(Begin / 16, ArrayRef<uint8_t>(Output).slice(Begin, Size));
+  }
+
+  // Slices smaller than, larger than, and straddling pieces all give the
+  // same digests.
+  for (size_t SliceSize : {1, 5, 16, 40, 100}) {
+    Builder::PieceHasher Streamed(Output.size(), 16);
+    for (size_t Begin = 0; Begin < Output.size(); Begin += SliceSize) {
+      Streamed.hashNext(ArrayRef<uint8_t>(Output).slice(
+          Begin, std::min(SliceSize, Output.size() - Begin)));
+    }
+    ASSERT_EQ(Streamed.getDigests(), Whole.getDigests())
+        << "slice size " << SliceSize;
+  }
+}
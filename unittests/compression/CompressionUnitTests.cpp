@@ -0,0 +1,113 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/Compression.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/Support/Compression.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+std::string uncompress(ArrayRef<uint8_t> Compressed, size_t Size) {
+  SmallVector<char, 0> Out;
+  EXPECT_FALSE(bool(zlib::uncompress(
+      StringRef((const char *)Compressed.data(), Compressed.size()), Out,
+      Size)));
+  return std::string(Out.begin(), Out.end());
+}
+
+/// Read all of \c S, in pieces of \c PieceSize.
+std::vector<uint8_t> readAll(const ZlibStream &S, uint64_t PieceSize) {
+  std::vector<uint8_t> Out(S.size());
+  for (uint64_t Begin = 0; Begin < Out.size(); Begin += PieceSize) {
+    S.read(Out.data() + Begin, Begin,
+           std::min<uint64_t>(Begin + PieceSize, Out.size()));
+  }
+  return Out;
+}
+
+} // namespace
+
+TEST(CompressionTest, stitchesBlocksIntoOneStream) {
+  if (!isCompressionAvailable()) {
+    return;
+  }
+  std::string A, B;
+  for (unsigned I = 0; I < 1000; ++I) {
+    A += "block " + std::to_string(I) + "\n";
+    B += std::to_string(I * 7919 % 1000);
+  }
+  std::vector<StringRef> Blocks = {A, "", B};
+  auto StreamOrErr = ZlibStream::create(
+      Blocks.size(), [&](size_t I, std::vector<uint8_t> &Buf) {
+        Buf.assign(Blocks[I].begin(), Blocks[I].end());
+      });
+  ASSERT_TRUE(bool(StreamOrErr));
+  ASSERT_EQ((*StreamOrErr)->getUncompressedSize(), A.size() + B.size());
+
+  // Pieces smaller than the blocks, so that blocks are read in several, and
+  // bigger.
+  for (uint64_t PieceSize : {1u, 97u, 4096u, 1u << 20}) {
+    ASSERT_EQ(uncompress(readAll(**StreamOrErr, PieceSize),
+                         A.size() + B.size()),
+              A + B);
+  }
+}
+
+TEST(CompressionTest, readsOutOfOrder) {
+  if (!isCompressionAvailable()) {
+    return;
+  }
+  // More blocks than threads, so that they're compressed in several windows.
+  std::vector<std::string> Blocks;
+  std::string All;
+  for (unsigned I = 0; I < 100; ++I) {
+    Blocks.push_back(std::string(I * 10, 'a' + I % 26));
+    All += Blocks.back();
+  }
+  auto StreamOrErr = ZlibStream::create(
+      Blocks.size(), [&](size_t I, std::vector<uint8_t> &Buf) {
+        Buf.assign(Blocks[I].begin(), Blocks[I].end());
+      });
+  ASSERT_TRUE(bool(StreamOrErr));
+  const ZlibStream &S = **StreamOrErr;
+
+  std::vector<uint8_t> Out(S.size());
+  uint64_t Half = S.size() / 2;
+  S.read(Out.data() + Half, Half, S.size());
+  S.read(Out.data(), 0, Half);
+  ASSERT_EQ(uncompress(Out, All.size()), All);
+}
+
+TEST(CompressionTest, fillsEachBlockOnce) {
+  if (!isCompressionAvailable()) {
+    return;
+  }
+  std::vector<std::atomic<unsigned>> Fills(100);
+  auto StreamOrErr = ZlibStream::create(
+      Fills.size(), [&](size_t I, std::vector<uint8_t> &Buf) {
+        ++Fills[I];
+        Buf.assign(I, uint8_t(I));
+      });
+  ASSERT_TRUE(bool(StreamOrErr));
+  readAll(**StreamOrErr, 4096);
+  readAll(**StreamOrErr, 1);
+  for (const std::atomic<unsigned> &F : Fills) {
+    ASSERT_EQ(F, 1u);
+  }
+}
+
+TEST(CompressionTest, compressesNothing) {
+  if (!isCompressionAvailable()) {
+    return;
+  }
+  auto StreamOrErr = ZlibStream::create(0, nullptr);
+  ASSERT_TRUE(bool(StreamOrErr));
+  ASSERT_EQ(uncompress(readAll(**StreamOrErr, 1), 0), "");
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Builder.h"
+#include "MachO/FileCache.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/Support/FileSystem.h"
+
+using namespace llvm;
+using namespace llvm::MachO;
+using namespace llvm::ald::MachO;
+
+class FileCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createTemporaryFile("ald.FileCacheTest", "o", Path));
+  }
+
+  void TearDown() override { sys::fs::remove(Path); }
+
+  /// Write an object with a __data section of \c Size bytes of \c Fill to
+  /// \c Path.
+  void writeObject(uint64_t Size, uint8_t Fill) {
+    Builder::File F;
+    F.setTriple(Triple("x86_64-apple-macos")).setFileType(MH_OBJECT);
+    auto Seg = std::make_unique<Builder::SegmentCommand>("");
+    Seg->addSection(std::make_unique<Builder::Section>(
+        "__DATA", "__data", S_REGULAR, 0,
+        std::make_unique<Builder::DataChunk>(
+            std::vector<uint8_t>(Size, Fill))));
+    F.addLoadCommand(std::move(Seg));
+    ASSERT_FALSE(bool(F.buildAndWrite(Path.str().str())));
+  }
+
+  /// Set the modification time of \c Path to \c Time.
+  void touch(sys::TimePoint<> Time) {
+    int FD;
+    ASSERT_FALSE(sys::fs::openFileForWrite(Path, FD, sys::fs::CD_OpenExisting,
+                                           sys::fs::OF_Append));
+    ASSERT_FALSE(sys::fs::setLastAccessAndModificationTime(FD, Time));
+    sys::fs::closeFile(FD);
+  }
+
+  /// The number of files \c Cache loaded since its journal was set.
+  size_t numLoaded() const { return StringRef(Journal).count('\n'); }
+
+  SmallString<128> Path;
+  std::string Journal;
+};
+
+TEST_F(FileCacheTest, keepsUnchangedFiles) {
+  writeObject(16, 'a');
+  FileCache Cache;
+  raw_string_ostream OS(Journal);
+  Cache.setJournal(&OS);
+
+  auto First = Cache.get(Path);
+  ASSERT_TRUE(bool(First));
+  auto Second = Cache.get(Path);
+  ASSERT_TRUE(bool(Second));
+  ASSERT_EQ(First->F, Second->F);
+  OS.flush();
+  ASSERT_EQ(numLoaded(), 1u);
+  ASSERT_EQ(Cache.size(), 1u);
+}
+
+TEST_F(FileCacheTest, reloadsFilesWhoseSizeChanged) {
+  writeObject(16, 'a');
+  FileCache Cache;
+  raw_string_ostream OS(Journal);
+  Cache.setJournal(&OS);
+  auto Old = Cache.get(Path);
+  ASSERT_TRUE(bool(Old));
+  size_t OldSize = Old->F->getBuffer().getBufferSize();
+
+  // Keep the modification time, so that only the size tells them apart.
+  sys::fs::file_status Status;
+  ASSERT_FALSE(sys::fs::status(Path, Status));
+  writeObject(32, 'b');
+  touch(Status.getLastModificationTime());
+
+  auto New = Cache.get(Path);
+  ASSERT_TRUE(bool(New));
+  ASSERT_EQ(New->F->getBuffer().getBufferSize(), OldSize + 16);
+  OS.flush();
+  ASSERT_EQ(numLoaded(), 2u);
+  ASSERT_EQ(Cache.size(), 1u);
+}
+
+TEST_F(FileCacheTest, reloadsFilesWhoseModificationTimeChanged) {
+  writeObject(16, 'a');
+  FileCache Cache;
+  raw_string_ostream OS(Journal);
+  Cache.setJournal(&OS);
+  ASSERT_TRUE(bool(Cache.get(Path)));
+
+  // Same size, different contents and a later modification time.
+  sys::fs::file_status Status;
+  ASSERT_FALSE(sys::fs::status(Path, Status));
+  writeObject(16, 'b');
+  touch(Status.getLastModificationTime() + std::chrono::seconds(10));
+
+  auto New = Cache.get(Path);
+  ASSERT_TRUE(bool(New));
+  ASSERT_EQ(New->F->getFileEnd()[-1], 'b');
+  OS.flush();
+  ASSERT_EQ(numLoaded(), 2u);
+}
+
+TEST_F(FileCacheTest, keepsParsesUntilFilesChange) {
+  writeObject(16, 'a');
+  FileCache Cache;
+  auto Loaded = Cache.get(Path);
+  ASSERT_TRUE(bool(Loaded));
+  ASSERT_EQ(Loaded->Input, nullptr);
+
+  auto Parsed = Cache.get(Path, /*Parse=*/true);
+  ASSERT_TRUE(bool(Parsed));
+  ASSERT_NE(Parsed->Input, nullptr);
+  ASSERT_EQ(&Parsed->Input->getFile(), Parsed->F);
+  auto Again = Cache.get(Path);
+  ASSERT_TRUE(bool(Again));
+  ASSERT_EQ(Again->Input, Parsed->Input);
+
+  // A rebuilt file's old parse is dropped along with it.
+  sys::fs::file_status Status;
+  ASSERT_FALSE(sys::fs::status(Path, Status));
+  writeObject(32, 'b');
+  touch(Status.getLastModificationTime() + std::chrono::seconds(10));
+  auto New = Cache.get(Path);
+  ASSERT_TRUE(bool(New));
+  ASSERT_EQ(New->Input, nullptr);
+}
+
+TEST_F(FileCacheTest, forgetsFilesWhichFailToLoad) {
+  writeObject(16, 'a');
+  FileCache Cache;
+  ASSERT_TRUE(bool(Cache.get(Path)));
+
+  sys::fs::remove(Path);
+  auto Missing = Cache.get(Path);
+  ASSERT_FALSE(bool(Missing));
+  consumeError(Missing.takeError());
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/FileList.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+std::vector<std::string> toStrings(ArrayRef<StringRef> Paths) {
+  return std::vector<std::string>(Paths.begin(), Paths.end());
+}
+
+} // namespace
+
+TEST(FileListTest, listsOnePathPerLine) {
+  FileList Lists;
+  auto Paths = Lists.add(
+      MemoryBuffer::getMemBuffer("a.o\n\nobj/b.o\r\n/abs/c.o", "list"));
+  ASSERT_EQ(toStrings(Paths),
+            (std::vector<std::string>{"a.o", "obj/b.o", "/abs/c.o"}));
+}
+
+TEST(FileListTest, resolvesRelativePathsAgainstDir) {
+  FileList Lists;
+  auto Paths = Lists.add(MemoryBuffer::getMemBuffer("a.o\n/abs/c.o\n", "list"),
+                         "/build");
+  ASSERT_EQ(toStrings(Paths),
+            (std::vector<std::string>{"/build/a.o", "/abs/c.o"}));
+}
+
+TEST(FileListTest, recognizesPlainLists) {
+  ASSERT_TRUE(FileList::isPlainList("a.o\nb.o\r\n\n"));
+  ASSERT_TRUE(FileList::isPlainList(""));
+  ASSERT_FALSE(FileList::isPlainList("a.o\n-o\nout\n"));
+  ASSERT_FALSE(FileList::isPlainList("a.o\n@more\n"));
+  ASSERT_FALSE(FileList::isPlainList("\"with space.o\"\n"));
+  ASSERT_FALSE(FileList::isPlainList("a.o b.o\n"));
+}
+
+TEST(FileListTest, reportsMissingLists) {
+  FileList Lists;
+  auto PathsOrErr = Lists.add("/nonexistent/ald/filelist");
+  ASSERT_FALSE(bool(PathsOrErr));
+  consumeError(PathsOrErr.takeError());
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "ADT/ConcurrentLazy.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+TEST(ConcurrentLazyTest, TestEager) {
+  ConcurrentLazy<uint32_t> L(4u);
+  ASSERT_TRUE(L.isComputed());
+  ASSERT_EQ(L.get(), 4u);
+
+  auto LM = L.map([](uint32_t x) { return x * 7; });
+  ASSERT_FALSE(LM.isComputed());
+  ASSERT_EQ(LM.get(), 28u);
+}
+
+TEST(ConcurrentLazyTest, TestLazy) {
+  ConcurrentLazy<uint32_t> L([]() { return 5u; });
+  ASSERT_FALSE(L.isComputed());
+  ASSERT_EQ(L.get(), 5u);
+  ASSERT_TRUE(L.isComputed());
+}
+
+TEST(ConcurrentLazyTest, TestMoveOnly) {
+  auto P = std::make_unique<uint32_t>(5);
+  auto RP = P.get();
+  ConcurrentLazy<std::unique_ptr<uint32_t>> L(
+      [PP = std::move(P)]() mutable { return std::move(PP); });
+
+  ConcurrentLazy<std::unique_ptr<uint32_t>> L2(std::move(L));
+  ASSERT_EQ(L2.get().get(), RP);
+  ASSERT_EQ(L2.take().get(), RP);
+}
+
+TEST(ConcurrentLazyTest, TestComputesOnce) {
+  constexpr unsigned NumThreads = 8;
+  constexpr unsigned NumLazies = 256;
+
+  std::atomic<unsigned> Calls(0);
+  std::vector<ConcurrentLazy<unsigned>> Lazies;
+  Lazies.reserve(NumLazies);
+  for (unsigned I = 0; I < NumLazies; ++I) {
+    Lazies.emplace_back([&Calls, I]() {
+      Calls.fetch_add(1);
+      std::this_thread::yield();
+      return I * 3;
+    });
+  }
+
+  std::atomic<bool> Go(false);
+  std::atomic<unsigned> Mismatches(0);
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T < NumThreads; ++T) {
+    Threads.emplace_back([&]() {
+      while (!Go.load()) {
+        std::this_thread::yield();
+      }
+      for (unsigned I = 0; I < NumLazies; ++I) {
+        if (Lazies[I].get() != I * 3) {
+          Mismatches.fetch_add(1);
+        }
+      }
+    });
+  }
+  Go.store(true);
+  for (auto &T : Threads) {
+    T.join();
+  }
+
+  ASSERT_EQ(Calls.load(), NumLazies);
+  ASSERT_EQ(Mismatches.load(), 0u);
+}
@@ -4,6 +4,9 @@
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <vector>
+
 using namespace llvm;
 using namespace llvm::ald;
 
@@ -39,3 +42,84 @@ TEST(LazyTest, EagerMoveOnlySupported) {
   auto TTP = LM.take();
   ASSERT_EQ(TTP.get(), RP);
 }
+
+TEST(LazyTest, LazyMoveOnlyDestroyed) {
+  auto P = std::make_shared<uint32_t>(5);
+  {
+    Lazy<std::shared_ptr<uint32_t>> L([P]() { return P; });
+    ASSERT_EQ(P.use_count(), 2);
+    ASSERT_EQ(*L.get(), 5u);
+    ASSERT_EQ(P.use_count(), 2);
+  }
+  ASSERT_EQ(P.use_count(), 1);
+}
+
+TEST(LazyTest, TestFlatMap) {
+  Lazy<uint32_t> L([]() { return 5u; });
+  auto LM = L.flatMap([](uint32_t x) {
+    return Lazy<std::string>([x]() { return std::to_string(x * 3); });
+  });
+  ASSERT_FALSE(L.isComputed());
+  ASSERT_EQ(LM.get(), "15");
+  ASSERT_TRUE(L.isComputed());
+
+  auto P = std::make_unique<uint32_t>(6);
+  auto RP = P.get();
+  Lazy<std::unique_ptr<uint32_t>> L2(std::move(P));
+  auto LM2 = std::move(L2).flatMap([](std::unique_ptr<uint32_t> &&TakenP) {
+    return Lazy<std::unique_ptr<uint32_t>>(std::move(TakenP));
+  });
+  ASSERT_EQ(LM2.take().get(), RP);
+}
+
+TEST(LazyTest, TestZip) {
+  unsigned Calls = 0;
+  Lazy<uint32_t> LA([&Calls]() {
+    ++Calls;
+    return 2u;
+  });
+  Lazy<std::string> LB([&Calls]() {
+    ++Calls;
+    return std::string("two");
+  });
+
+  auto LZ = zip(LA, LB);
+  ASSERT_EQ(Calls, 0u);
+  ASSERT_EQ(LZ.get().first, 2u);
+  ASSERT_EQ(LZ.get().second, "two");
+  ASSERT_EQ(Calls, 2u);
+
+  auto LZ2 = zip(Lazy<uint32_t>(3u), Lazy<std::unique_ptr<uint32_t>>([]() {
+                   return std::make_unique<uint32_t>(4);
+                 }));
+  auto Z = LZ2.take();
+  ASSERT_EQ(Z.first, 3u);
+  ASSERT_EQ(*Z.second, 4u);
+}
+
+TEST(LazyTest, TestForceAll) {
+  constexpr unsigned NumLazies = 1000;
+
+  std::atomic<unsigned> Calls(0);
+  std::vector<Lazy<unsigned>> Lazies;
+  Lazies.reserve(NumLazies);
+  for (unsigned I = 0; I < NumLazies; ++I) {
+    Lazies.emplace_back([&Calls, I]() {
+      Calls.fetch_add(1);
+      return I + 1;
+    });
+  }
+
+  ThreadPool TP;
+  forceAll(Lazies, TP);
+  ASSERT_EQ(Calls.load(), NumLazies);
+
+  for (unsigned I = 0; I < NumLazies; ++I) {
+    ASSERT_TRUE(Lazies[I].isComputed());
+    ASSERT_EQ(Lazies[I].get(), I + 1);
+  }
+  ASSERT_EQ(Calls.load(), NumLazies);
+
+  std::vector<Lazy<unsigned>> Empty;
+  forceAll(Empty, TP);
+}
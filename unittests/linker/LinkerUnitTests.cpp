@@ -0,0 +1,607 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "MachO/Builder.h"
+#include "MachO/File.h"
+#include "MachO/Linker.h"
+#include "MachO/OrderFile.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/Object/MachO.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+using namespace llvm::MachO;
+using namespace llvm::ald::MachO;
+
+namespace {
+
+std::vector<std::string> parseOrderFile(StringRef Contents, const Triple &T) {
+  auto OF = OrderFile::parse(MemoryBuffer::getMemBufferCopy(Contents), T);
+  std::vector<std::string> Symbols;
+  for (StringRef S : OF.symbols()) {
+    Symbols.push_back(S.str());
+  }
+  return Symbols;
+}
+
+} // namespace
+
+TEST(OrderFileTest, parsesEntries) {
+  Triple T("arm64-apple-macos");
+  auto Symbols = parseOrderFile("# startup\n"
+                                "_main\n"
+                                "  _indented  \n"
+                                "\n"
+                                "arm64:_arm\n"
+                                "x86_64:_intel\n"
+                                "foo.o:_qualified\n"
+                                "arm64:bar.o:_both\n"
+                                "-[Foo bar:baz:]\n"
+                                "_last",
+                                T);
+  ASSERT_EQ(Symbols, (std::vector<std::string>{"_main", "_indented", "_arm",
+                                               "_qualified", "_both",
+                                               "-[Foo bar:baz:]", "_last"}));
+}
+
+class LinkerTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    for (auto &Path : Paths) {
+      sys::fs::remove(Path);
+    }
+  }
+
+  /// A reference from the start of the atom defining \c From to \c To.
+  struct Ref {
+    StringRef From;
+    StringRef To;
+    uint8_t Type;
+  };
+
+  /// Write an object with a __text section holding a 16 byte atom per symbol
+  /// in \c Names, filled with the last character of the name, then load it.
+  /// Targets of \c Refs which aren't in \c Names are undefined. Given a
+  /// \c Source, the object gets DWARF for a compile unit of that name. Every
+  /// definition gets the \c n_desc \c Desc.
+  const File &addObject(ArrayRef<StringRef> Names, ArrayRef<Ref> Refs = {},
+                        StringRef Source = "", uint16_t Desc = 0) {
+    Builder::File F;
+    F.setTriple(Triple("x86_64-apple-macos")).setFileType(MH_OBJECT);
+
+    std::vector<uint8_t> Text;
+    auto Symtab = std::make_unique<Builder::SymtabCommand>();
+    std::vector<StringRef> Symbols(Names.begin(), Names.end());
+    for (StringRef Name : Names) {
+      Symtab->addSymbol(Name, N_SECT | N_EXT, 1, Desc, Text.size());
+      Text.insert(Text.end(), 16, uint8_t(Name.back()));
+    }
+    auto Sect = std::make_unique<Builder::Section>(
+        "__TEXT", "__text", S_ATTR_PURE_INSTRUCTIONS, 4,
+        std::make_unique<Builder::DataChunk>(std::move(Text)));
+    for (const Ref &R : Refs) {
+      auto It = llvm::find(Symbols, R.To);
+      if (It == Symbols.end()) {
+        Symtab->addSymbol(R.To, N_UNDF | N_EXT, NO_SECT, 0, 0);
+        It = Symbols.insert(Symbols.end(), R.To);
+      }
+      bool IsBranch = R.Type == X86_64_RELOC_BRANCH;
+      any_relocation_info RI;
+      RI.r_word0 = (llvm::find(Names, R.From) - Names.begin()) * 16;
+      RI.r_word1 = (It - Symbols.begin()) | (IsBranch ? 1 : 0) << 24 |
+                   (IsBranch ? 2 : 3) << 25 | 1 << 27 | R.Type << 28;
+      Sect->addRelocation(RI);
+    }
+    auto Seg = std::make_unique<Builder::SegmentCommand>("");
+    Seg->addSection(std::move(Sect));
+    if (!Source.empty()) {
+      addDebugInfo(*Seg, Source);
+    }
+    F.addLoadCommand(std::move(Seg));
+    F.addLoadCommand(std::move(Symtab));
+    return load(F);
+  }
+
+  /// Write the object \c F and load it.
+  const File &load(Builder::File &F) {
+    SmallString<128> Path;
+    EXPECT_FALSE(sys::fs::createTemporaryFile("ald.LinkerTest", "o", Path));
+    EXPECT_FALSE(bool(F.buildAndWrite(Path.str().str())));
+    Paths.push_back(Path.str().str());
+
+    auto FOrErr = File::read(Paths.back());
+    EXPECT_TRUE(bool(FOrErr));
+    Files.push_back(std::move(*FOrErr));
+    return *Files.back();
+  }
+
+  /// Add a compile unit named \c Source built in /src to \c Seg.
+  static void addDebugInfo(Builder::SegmentCommand &Seg, StringRef Source) {
+    // DW_TAG_compile_unit with a DW_FORM_string DW_AT_name and DW_AT_comp_dir.
+    std::vector<uint8_t> Abbrev = {1, 0x11, 0, 0x03, 0x08, 0x1b, 0x08, 0, 0, 0};
+    std::vector<uint8_t> Info = {0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 8, 1};
+    Info.insert(Info.end(), Source.begin(), Source.end());
+    for (char C : StringRef("\0/src\0\0", 7)) {
+      Info.push_back(C);
+    }
+    Info[0] = Info.size() - 4;
+    Seg.addSection(std::make_unique<Builder::Section>(
+        "__DWARF", "__debug_abbrev", S_ATTR_DEBUG, 0,
+        std::make_unique<Builder::DataChunk>(std::move(Abbrev))));
+    Seg.addSection(std::make_unique<Builder::Section>(
+        "__DWARF", "__debug_info", S_ATTR_DEBUG, 0,
+        std::make_unique<Builder::DataChunk>(std::move(Info))));
+  }
+
+  /// Write \c Out and read it back.
+  std::unique_ptr<object::MachOObjectFile> writeAndRead(Builder::File &Out) {
+    SmallString<128> Path;
+    EXPECT_FALSE(sys::fs::createTemporaryFile("ald.LinkerTest", "out", Path));
+    EXPECT_FALSE(bool(Out.buildAndWrite(Path.str().str())));
+    Paths.push_back(Path.str().str());
+    Buffers.push_back(cantFail(errorOrToExpected(
+        MemoryBuffer::getFile(Path, /*IsText=*/false,
+                              /*RequiresNullTerminator=*/false))));
+    auto ObjOrErr = object::ObjectFile::createMachOObjectFile(
+        Buffers.back()->getMemBufferRef());
+    EXPECT_TRUE(bool(ObjOrErr));
+    return std::move(*ObjOrErr);
+  }
+
+  std::vector<std::string> Paths;
+  std::vector<std::unique_ptr<File>> Files;
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
+};
+
+TEST_F(LinkerTest, splitsSectionsIntoAtoms) {
+  Linker L(Triple("x86_64-apple-macos"));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a", "_b", "_c"}))));
+
+  auto Sections = L.inputs().front()->sections();
+  ASSERT_EQ(Sections.size(), 1u);
+  ASSERT_EQ(Sections.front()->atoms().size(), 3u);
+  ASSERT_EQ(Sections.front()->atoms()[1].getOffset(), 16u);
+  ASSERT_EQ(Sections.front()->atoms()[1].getContents()[0], 'b');
+}
+
+TEST_F(LinkerTest, reportsDuplicateSymbols) {
+  Linker L(Triple("x86_64-apple-macos"));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a"}))));
+  auto Err = L.addFile(addObject({"_a"}));
+  ASSERT_TRUE(bool(Err));
+  ASSERT_NE(toString(std::move(Err)).find("duplicate symbol '_a'"),
+            std::string::npos);
+}
+
+TEST_F(LinkerTest, ordersAtomsByOrderFile) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a", "_b", "_c"}))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_d", "_e"}))));
+  auto OF = OrderFile::parse(
+      MemoryBuffer::getMemBuffer("_e\n_missing\n_b\n_e\n"), T);
+  L.setOrderFile(OF);
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+
+  auto Sections = L.getLayout().sections();
+  ASSERT_EQ(Sections.size(), 1u);
+  std::string Order;
+  for (const Atom *A : Sections.front()->atoms()) {
+    Order += A->getContents()[0];
+  }
+  ASSERT_EQ(Order, "ebacd");
+
+  const Symbol *E = L.getSymbolTable().find("_e");
+  ASSERT_NE(E, nullptr);
+  const Layout &Lay = L.getLayout();
+  ASSERT_EQ(Lay.getAddr(*E), Sections.front()->getAddr());
+  ASSERT_EQ(Lay.getAddr(*L.getSymbolTable().find("_b")), Lay.getAddr(*E) + 16);
+
+  // The output's contents follow the new order too.
+  SmallString<128> Path;
+  ASSERT_FALSE(sys::fs::createTemporaryFile("ald.LinkerTest", "out", Path));
+  Paths.push_back(Path.str().str());
+  ASSERT_FALSE(bool(Out.buildAndWrite(Paths.back())));
+  auto MB = MemoryBuffer::getFile(Paths.back());
+  ASSERT_TRUE(bool(MB));
+  auto Obj = object::MachOObjectFile::create(**MB, true, true);
+  ASSERT_TRUE(bool(Obj));
+  for (const auto &S : (*Obj)->sections()) {
+    StringRef Contents = cantFail(S.getContents());
+    ASSERT_EQ(Contents.size(), 80u);
+    ASSERT_EQ(Contents[0], 'e');
+    ASSERT_EQ(Contents[16], 'b');
+    ASSERT_EQ(Contents[79], 'd');
+  }
+}
+
+TEST(CallGraphProfileTest, parsesEdges) {
+  auto ProfileOrErr = CallGraphProfile::parse(MemoryBuffer::getMemBuffer(
+      "# caller callee weight\n_main  _foo 100\n\n_foo _bar 7\n"));
+  ASSERT_TRUE(bool(ProfileOrErr));
+  auto Edges = ProfileOrErr->edges();
+  ASSERT_EQ(Edges.size(), 2u);
+  ASSERT_EQ(Edges[0].From, "_main");
+  ASSERT_EQ(Edges[0].To, "_foo");
+  ASSERT_EQ(Edges[0].Weight, 100u);
+  ASSERT_EQ(Edges[1].Weight, 7u);
+
+  auto Err = CallGraphProfile::parse(
+                 MemoryBuffer::getMemBuffer("_main _foo 1\n_main _foo\n"))
+                 .takeError();
+  ASSERT_TRUE(bool(Err));
+  ASSERT_NE(toString(std::move(Err)).find("line 2"), std::string::npos);
+}
+
+TEST_F(LinkerTest, clustersHotCallsByCallGraph) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a", "_b", "_c"}))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_d", "_e"}))));
+  auto OF = OrderFile::parse(MemoryBuffer::getMemBuffer("_e\n"), T);
+  auto Profile = cantFail(CallGraphProfile::parse(
+      MemoryBuffer::getMemBuffer("_a _c 100\n_c _d 50\n_b _missing 9\n")));
+  L.setOrderFile(OF);
+  L.setCallGraphProfile(Profile);
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+
+  // The order file comes first, then _c follows its caller _a and _d its
+  // caller _c. Atoms the profile doesn't mention stay at the end.
+  std::string Order;
+  for (const Atom *A : L.getLayout().sections().front()->atoms()) {
+    Order += A->getContents()[0];
+  }
+  ASSERT_EQ(Order, "eacdb");
+}
+
+namespace {
+
+std::string contentsOf(const Layout &L) {
+  std::string Contents;
+  for (const Atom *A : L.sections().front()->atoms()) {
+    Contents += A->getContents()[0];
+  }
+  return Contents;
+}
+
+} // namespace
+
+TEST_F(LinkerTest, foldsIdenticalCode) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a1", "_b2"}))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_c1", "_d3", "_e2"}))));
+  L.setICFLevel(ICFLevel::All);
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  ASSERT_EQ(L.getNumFolded(), 2u);
+  ASSERT_EQ(contentsOf(L.getLayout()), "123");
+
+  // Symbols of folded atoms end up at their leaders, the first of them in
+  // input order.
+  const SymbolTable &Symtab = L.getSymbolTable();
+  const Layout &Lay = L.getLayout();
+  ASSERT_EQ(Lay.getAddr(*Symtab.find("_c1")), Lay.getAddr(*Symtab.find("_a1")));
+  ASSERT_EQ(Lay.getAddr(*Symtab.find("_e2")), Lay.getAddr(*Symtab.find("_b2")));
+  ASSERT_EQ(&Lay.getLeader(*Symtab.find("_e2")->Definition),
+            Symtab.find("_b2")->Definition);
+}
+
+TEST_F(LinkerTest, sharesInputsBetweenLinks) {
+  Triple T("x86_64-apple-macos");
+  auto IFOrErr = InputFile::create(addObject({"_a1", "_b2", "_c1"}));
+  ASSERT_TRUE(bool(IFOrErr));
+  const InputFile &IF = **IFOrErr;
+
+  // Folding in one link mustn't leak into another one using the same input.
+  Linker Folded(T);
+  Linker Unfolded(T);
+  ASSERT_FALSE(bool(Folded.addFile(IF)));
+  ASSERT_FALSE(bool(Unfolded.addFile(IF)));
+  Folded.setICFLevel(ICFLevel::All);
+
+  Builder::File FoldedOut;
+  FoldedOut.setTriple(T);
+  ASSERT_FALSE(bool(Folded.link(FoldedOut)));
+  Builder::File UnfoldedOut;
+  UnfoldedOut.setTriple(T);
+  ASSERT_FALSE(bool(Unfolded.link(UnfoldedOut)));
+
+  ASSERT_EQ(contentsOf(Folded.getLayout()), "12");
+  ASSERT_EQ(contentsOf(Unfolded.getLayout()), "121");
+  const Atom &C = IF.sections()[0]->atoms()[2];
+  ASSERT_TRUE(Folded.getLayout().isFolded(C));
+  ASSERT_FALSE(Unfolded.getLayout().isFolded(C));
+}
+
+TEST_F(LinkerTest, coalescesWeakDefinitions) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_w"}, {}, "", N_WEAK_DEF))));
+  ASSERT_FALSE(bool(L.addFile(addObject(
+      {"_b", "_w"}, {{"_b", "_w", X86_64_RELOC_GOT_LOAD}}, "", N_WEAK_DEF))));
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  ASSERT_EQ(L.getNumCoalesced(), 1u);
+  ASSERT_FALSE(L.getImports().getWeakBindInfo().empty());
+
+  // The first definition wins, and the duplicate is never laid out.
+  ASSERT_EQ(contentsOf(L.getLayout()), "wb");
+  const Symbol *W = L.getSymbolTable().find("_w");
+  ASSERT_EQ(W->Definition, &L.inputs()[0]->sections()[0]->atoms()[0]);
+  ASSERT_TRUE(
+      L.getLayout().isFolded(L.inputs()[1]->sections()[0]->atoms()[1]));
+
+  auto Obj = writeAndRead(Out);
+  ASSERT_TRUE(Obj);
+  uint32_t Flags = Obj->getHeader64().flags;
+  ASSERT_TRUE(Flags & MH_WEAK_DEFINES);
+  ASSERT_TRUE(Flags & MH_BINDS_TO_WEAK);
+}
+
+TEST_F(LinkerTest, strongDefinitionsBeatWeakOnes) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_w"}, {}, "", N_WEAK_DEF))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_w"}))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_w"}, {}, "", N_WEAK_DEF))));
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  ASSERT_EQ(L.getNumCoalesced(), 2u);
+  ASSERT_EQ(contentsOf(L.getLayout()), "w");
+  const Symbol *W = L.getSymbolTable().find("_w");
+  ASSERT_EQ(W->Definition, &L.inputs()[1]->sections()[0]->atoms()[0]);
+  ASSERT_EQ(W->Desc, 0u);
+
+  auto Obj = writeAndRead(Out);
+  ASSERT_TRUE(Obj);
+  ASSERT_FALSE(Obj->getHeader64().flags & (MH_WEAK_DEFINES | MH_BINDS_TO_WEAK));
+}
+
+TEST_F(LinkerTest, foldsOnlyEquivalentRelocations) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  // _f, _g and _h are identical but _h calls a different function. _r and _s
+  // each call themselves, which doesn't stop them folding.
+  ASSERT_FALSE(bool(L.addFile(
+      addObject({"_f1", "_g1", "_h1", "_x2", "_y3", "_r4", "_s4"},
+                {{"_f1", "_x2", X86_64_RELOC_BRANCH},
+                 {"_g1", "_x2", X86_64_RELOC_BRANCH},
+                 {"_h1", "_y3", X86_64_RELOC_BRANCH},
+                 {"_r4", "_r4", X86_64_RELOC_BRANCH},
+                 {"_s4", "_s4", X86_64_RELOC_BRANCH}}))));
+  L.setICFLevel(ICFLevel::All);
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  ASSERT_EQ(contentsOf(L.getLayout()), "11234");
+  const SymbolTable &Symtab = L.getSymbolTable();
+  const Layout &Lay = L.getLayout();
+  ASSERT_EQ(Lay.getAddr(*Symtab.find("_g1")), Lay.getAddr(*Symtab.find("_f1")));
+  ASSERT_NE(Lay.getAddr(*Symtab.find("_h1")), Lay.getAddr(*Symtab.find("_f1")));
+  ASSERT_EQ(Lay.getAddr(*Symtab.find("_s4")), Lay.getAddr(*Symtab.find("_r4")));
+}
+
+TEST_F(LinkerTest, safeFoldingKeepsAddressTakenFunctions) {
+  Triple T("x86_64-apple-macos");
+  for (ICFLevel Level : {ICFLevel::Safe, ICFLevel::All}) {
+    Linker L(T);
+    ASSERT_FALSE(bool(L.addFile(addObject(
+        {"_a1", "_b1", "_p2"}, {{"_p2", "_b1", X86_64_RELOC_UNSIGNED}}))));
+    L.setICFLevel(Level);
+
+    Builder::File Out;
+    Out.setTriple(T);
+    ASSERT_FALSE(bool(L.link(Out)));
+    ASSERT_EQ(contentsOf(L.getLayout()),
+              Level == ICFLevel::Safe ? "112" : "12");
+  }
+}
+
+TEST_F(LinkerTest, emitsDebugMapInsteadOfDebugInfo) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject({"_a", "_b"}, {}, "a.c"))));
+  ASSERT_FALSE(bool(L.addFile(addObject({"_c"}))));
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  auto Obj = writeAndRead(Out);
+  ASSERT_TRUE(Obj);
+  for (const object::SectionRef &S : Obj->sections()) {
+    ASSERT_NE(Obj->getSectionFinalSegmentName(S.getRawDataRefImpl()),
+              "__DWARF");
+  }
+
+  std::vector<std::pair<uint8_t, std::string>> Stabs;
+  for (const object::SymbolRef &S : Obj->symbols()) {
+    nlist_64 NL = Obj->getSymbol64TableEntry(S.getRawDataRefImpl());
+    if (NL.n_type & N_STAB) {
+      Stabs.emplace_back(NL.n_type, cantFail(S.getName()).str());
+    }
+  }
+  // Only the object with debug info gets a unit.
+  SmallString<128> Path(Paths[0]);
+  sys::fs::make_absolute(Path);
+  ASSERT_EQ(Stabs, (std::vector<std::pair<uint8_t, std::string>>{
+                       {N_SO, "/src/"},
+                       {N_SO, "a.c"},
+                       {N_OSO, Path.str().str()},
+                       {N_BNSYM, ""},
+                       {N_FUN, "_a"},
+                       {N_FUN, ""},
+                       {N_ENSYM, ""},
+                       {N_BNSYM, ""},
+                       {N_FUN, "_b"},
+                       {N_FUN, ""},
+                       {N_ENSYM, ""},
+                       {N_SO, ""}}));
+}
+
+TEST_F(LinkerTest, synthesizesStubsAndGOT) {
+  Triple T("x86_64-apple-macos");
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(addObject(
+      {"_a", "_b"}, {{"_a", "_puts", X86_64_RELOC_BRANCH},
+                     {"_b", "_exit", X86_64_RELOC_BRANCH},
+                     {"_a", "_environ", X86_64_RELOC_GOT_LOAD},
+                     {"_a", "_b", X86_64_RELOC_BRANCH}}))));
+  ASSERT_FALSE(bool(L.addFile(addObject(
+      {"_c"}, {{"_c", "_puts", X86_64_RELOC_BRANCH},
+               {"_c", "_b", X86_64_RELOC_GOT_LOAD}}))));
+
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+
+  // Calls to definitions don't need stubs, and slots are sorted by name. The
+  // stub helper reaches dyld through a GOT slot of its own.
+  const ImportSections &Imports = L.getImports();
+  std::vector<StringRef> Stubs, GOT;
+  for (const Symbol *S : Imports.stubs()) {
+    Stubs.push_back(S->Name);
+  }
+  for (const Symbol *S : Imports.got()) {
+    GOT.push_back(S->Name);
+  }
+  ASSERT_EQ(Stubs, (std::vector<StringRef>{"_exit", "_puts"}));
+  ASSERT_EQ(GOT,
+            (std::vector<StringRef>{"_b", "_environ", "dyld_stub_binder"}));
+
+  auto Obj = writeAndRead(Out);
+  ASSERT_TRUE(Obj);
+  uint64_t StubHelper = 0, Text = 0;
+  StringRef StubContents, LazyPtrContents, GOTContents, TextContents;
+  for (const object::SectionRef &S : Obj->sections()) {
+    StringRef Name = cantFail(S.getName());
+    const section_64 Header = Obj->getSection64(S.getRawDataRefImpl());
+    if (Name == "__stubs") {
+      StubContents = cantFail(S.getContents());
+      ASSERT_EQ(S.getAddress(), Imports.getStubAddr(0));
+      ASSERT_EQ(Header.reserved1, 0u);
+      ASSERT_EQ(Header.reserved2, 6u);
+    } else if (Name == "__stub_helper") {
+      StubHelper = S.getAddress();
+    } else if (Name == "__la_symbol_ptr") {
+      LazyPtrContents = cantFail(S.getContents());
+      ASSERT_EQ(S.getAddress() + 8, Imports.getStubAddr(1) + 6 +
+                                        int32_t(support::endian::read32le(
+                                            StubContents.data() + 8)));
+      ASSERT_EQ(Header.reserved1, 2u);
+    } else if (Name == "__got") {
+      GOTContents = cantFail(S.getContents());
+      ASSERT_EQ(Header.reserved1, 4u);
+    } else if (Name == "__text") {
+      Text = S.getAddress();
+      TextContents = cantFail(S.getContents());
+    }
+  }
+
+  // Each stub jumps through its lazy pointer, which starts out at the stub's
+  // entry in the stub helper, past the helper's 16 byte header.
+  ASSERT_EQ(StubContents.size(), 12u);
+  ASSERT_EQ(LazyPtrContents.size(), 16u);
+  for (size_t I = 0; I < 2; ++I) {
+    const char *Stub = StubContents.data() + I * 6;
+    ASSERT_EQ(uint8_t(Stub[0]), 0xff);
+    ASSERT_EQ(uint8_t(Stub[1]), 0x25);
+    ASSERT_EQ(support::endian::read64le(LazyPtrContents.data() + I * 8),
+              StubHelper + 16 + I * 10);
+  }
+
+  // Defined symbols' slots hold their address, imports are left to dyld.
+  ASSERT_EQ(GOTContents.size(), 24u);
+  ASSERT_EQ(support::endian::read64le(GOTContents.data()),
+            L.getLayout().getAddr(*L.getSymbolTable().find("_b")));
+  ASSERT_EQ(support::endian::read64le(GOTContents.data() + 8), 0u);
+  ASSERT_EQ(support::endian::read64le(GOTContents.data() + 16), 0u);
+
+  // Calls to imports go to their stubs, keeping what the fixup held.
+  uint64_t C = L.getLayout().getAddr(*L.getSymbolTable().find("_c"));
+  int32_t Disp = support::endian::read32le(TextContents.data() + (C - Text));
+  ASSERT_EQ(C + 4 + Disp, Imports.getStubAddr(1) + 0x63636363);
+}
+
+TEST_F(LinkerTest, resolvesThreadLocalVariables) {
+  Triple T("x86_64-apple-macos");
+  Builder::File F;
+  F.setTriple(T).setFileType(MH_OBJECT);
+
+  // movq _tv@TLVP(%rip), %rdi, and _tv's descriptor, whose initial value is
+  // after 4 bytes of someone else's.
+  auto Symtab = std::make_unique<Builder::SymtabCommand>();
+  uint32_t Init = Symtab->addSymbol("_tv$tlv$init", N_SECT, 2, 0, 12);
+  uint32_t TV = Symtab->addSymbol("_tv", N_SECT | N_EXT, 3, 0, 16);
+  Symtab->addSymbol("_main", N_SECT | N_EXT, 1, 0, 0);
+  auto Seg = std::make_unique<Builder::SegmentCommand>("");
+  any_relocation_info RI;
+  RI.r_word0 = 3;
+  RI.r_word1 = TV | 1 << 24 | 2 << 25 | 1 << 27 | X86_64_RELOC_TLV << 28;
+  Seg->addSection(std::make_unique<Builder::Section>(
+                      "__TEXT", "__text", S_ATTR_PURE_INSTRUCTIONS, 0,
+                      std::make_unique<Builder::DataChunk>(
+                          std::vector<uint8_t>{0x48, 0x8b, 0x3d, 0, 0, 0, 0})))
+      .addRelocation(RI);
+  Seg->addSection(std::make_unique<Builder::Section>(
+      "__DATA", "__thread_data", S_THREAD_LOCAL_REGULAR, 2,
+      std::make_unique<Builder::DataChunk>(std::vector<uint8_t>(8, 0x2a))));
+  RI.r_word0 = 16;
+  RI.r_word1 = Init | 3 << 25 | 1 << 27 | X86_64_RELOC_UNSIGNED << 28;
+  Seg->addSection(std::make_unique<Builder::Section>(
+                      "__DATA", "__thread_vars", S_THREAD_LOCAL_VARIABLES, 3,
+                      std::make_unique<Builder::DataChunk>(
+                          std::vector<uint8_t>(24, 0))))
+      .addRelocation(RI);
+  F.addLoadCommand(std::move(Seg));
+  F.addLoadCommand(std::move(Symtab));
+
+  Linker L(T);
+  ASSERT_FALSE(bool(L.addFile(load(F))));
+  Builder::File Out;
+  Out.setTriple(T);
+  ASSERT_FALSE(bool(L.link(Out)));
+  auto Obj = writeAndRead(Out);
+  ASSERT_TRUE(Obj);
+  ASSERT_TRUE(Obj->getHeader64().flags & MH_HAS_TLV_DESCRIPTORS);
+
+  StringRef Text, Vars;
+  uint64_t TextAddr = 0, VarsAddr = 0;
+  std::vector<std::string> Names;
+  for (const object::SectionRef &S : Obj->sections()) {
+    StringRef Name = cantFail(S.getName());
+    Names.push_back(Name.str());
+    if (Name == "__text") {
+      Text = cantFail(S.getContents());
+      TextAddr = S.getAddress();
+    } else if (Name == "__thread_vars") {
+      Vars = cantFail(S.getContents());
+      VarsAddr = S.getAddress();
+    }
+  }
+  ASSERT_EQ(Names, (std::vector<std::string>{"__text", "__thread_vars",
+                                             "__thread_data"}));
+
+  // The load becomes a leaq of the descriptor, which holds the offset of the
+  // initial value in the template.
+  ASSERT_EQ(uint8_t(Text[1]), 0x8d);
+  ASSERT_EQ(TextAddr + 7 + int32_t(support::endian::read32le(Text.data() + 3)),
+            VarsAddr);
+  ASSERT_EQ(support::endian::read64le(Vars.data() + 16), 4u);
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/Scheduler.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+TEST(SchedulerTest, runsEveryTaskOnce) {
+  for (unsigned NumThreads : {1u, 2u, 8u}) {
+    Scheduler S(NumThreads);
+    std::vector<std::atomic<unsigned>> Runs(10000);
+    S.forEach(Runs.size(), [&](size_t I) { ++Runs[I]; });
+    for (auto &R : Runs) {
+      ASSERT_EQ(R.load(), 1u);
+    }
+  }
+}
+
+TEST(SchedulerTest, stealsFromBusyThreads) {
+  // The first thread's share is slow, the others have to take it over.
+  Scheduler S(4);
+  std::mutex M;
+  std::vector<std::thread::id> Ran(64);
+  S.forEach(Ran.size(), [&](size_t I) {
+    if (I < 16) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::lock_guard<std::mutex> Lock(M);
+    Ran[I] = std::this_thread::get_id();
+  });
+  std::vector<std::thread::id> SlowThreads(Ran.begin(), Ran.begin() + 16);
+  llvm::sort(SlowThreads);
+  SlowThreads.erase(std::unique(SlowThreads.begin(), SlowThreads.end()),
+                    SlowThreads.end());
+  ASSERT_GT(SlowThreads.size(), 1u);
+}
+
+TEST(SchedulerTest, splitsItemsIntoRanges) {
+  Scheduler S(4);
+  std::vector<uint64_t> Sizes = {1000, 0, 10, 256};
+  std::mutex M;
+  std::vector<std::vector<bool>> Covered;
+  for (uint64_t Size : Sizes) {
+    Covered.emplace_back(Size, false);
+  }
+  S.forEachRange(
+      Sizes,
+      [&](size_t Item, uint64_t Begin, uint64_t End) {
+        ASSERT_LT(Begin, End);
+        ASSERT_LE(End - Begin, 64u);
+        std::lock_guard<std::mutex> Lock(M);
+        for (uint64_t I = Begin; I < End; ++I) {
+          ASSERT_FALSE(Covered[Item][I]);
+          Covered[Item][I] = true;
+        }
+      },
+      /*GrainSize=*/64);
+  for (auto &Item : Covered) {
+    ASSERT_EQ(llvm::count(Item, false), 0);
+  }
+}
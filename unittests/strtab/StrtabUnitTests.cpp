@@ -0,0 +1,62 @@
+// Copyright (c) 2020 Daniel Zimmerman
+
+#include "Util/StrtabBuilder.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::ald;
+
+namespace {
+
+StringRef stringAt(const StrtabBuilder &B, size_t Handle) {
+  ArrayRef<uint8_t> Data = B.data();
+  return StringRef((const char *)Data.data() + B.getOffset(Handle));
+}
+
+} // namespace
+
+TEST(StrtabBuilderTest, mergesTails) {
+  StrtabBuilder B;
+  std::vector<StringRef> Strings = {"foo", "barfoo", "", "oo", "bar", "foo",
+                                    "xbarfoo"};
+  for (StringRef S : Strings) {
+    B.add(S);
+  }
+  B.finalize();
+
+  for (size_t I = 0; I < Strings.size(); ++I) {
+    ASSERT_EQ(stringAt(B, I), Strings[I]);
+  }
+  ASSERT_EQ(B.getOffset(2), 0u);
+  ASSERT_EQ(B.getOffset(0), B.getOffset(5));
+  // Only "xbarfoo" and "bar" need storage of their own.
+  ASSERT_EQ(B.data().size(), 1 + 8 + 4u);
+}
+
+TEST(StrtabBuilderTest, offsetsDontDependOnAddOrder) {
+  // Enough strings that buckets are split and sorted in parallel.
+  std::vector<std::string> Strings;
+  for (unsigned I = 0; I < 20000; ++I) {
+    Strings.push_back("_sym" + std::to_string(I * 7919 % 5000));
+  }
+  StrtabBuilder Forward, Backward;
+  for (const std::string &S : Strings) {
+    Forward.add(S);
+  }
+  for (auto It = Strings.rbegin(); It != Strings.rend(); ++It) {
+    Backward.add(*It);
+  }
+  Forward.finalize();
+  Backward.finalize();
+
+  ASSERT_EQ(Forward.data(), Backward.data());
+  for (size_t I = 0; I < Strings.size(); ++I) {
+    ASSERT_EQ(stringAt(Forward, I), Strings[I]);
+    ASSERT_EQ(Forward.getOffset(I),
+              Backward.getOffset(Strings.size() - 1 - I));
+  }
+}
@@ -89,3 +89,61 @@ TEST(UFTest, TestPassingMoveAndCapturingMoveOnly) {
 
   ASSERT_EQ(Invoker(std::move(F), 5), RP + 5);
 }
+
+namespace {
+struct Counted {
+  Counted(int &Live) : Live_(&Live) { ++*Live_; }
+  Counted(Counted &&Other) noexcept : Live_(Other.Live_) { ++*Live_; }
+  Counted(const Counted &) = delete;
+  ~Counted() { --*Live_; }
+
+  int *Live_;
+};
+} // namespace
+
+TEST(UFTest, TestInlineDestruction) {
+  int Live = 0;
+  {
+    UniqueFunc<int(void)> F([C = Counted(Live)]() { return *C.Live_; });
+    ASSERT_EQ(Live, 1);
+    ASSERT_EQ(F(), 1);
+
+    UniqueFunc<int(void)> F2(std::move(F));
+    ASSERT_FALSE(bool(F));
+    ASSERT_TRUE(bool(F2));
+    ASSERT_EQ(Live, 1);
+    ASSERT_EQ(F2(), 1);
+  }
+  ASSERT_EQ(Live, 0);
+}
+
+TEST(UFTest, TestHeapDestruction) {
+  int Live = 0;
+  char Big[128] = {42};
+  {
+    UniqueFunc<int(void)> F(
+        [C = Counted(Live), Big]() { return Big[0] + *C.Live_; });
+    ASSERT_EQ(Live, 1);
+    ASSERT_EQ(F(), 43);
+
+    UniqueFunc<int(void)> F2;
+    F2 = std::move(F);
+    ASSERT_FALSE(bool(F));
+    ASSERT_EQ(Live, 1);
+    ASSERT_EQ(F2(), 43);
+
+    F2 = UniqueFunc<int(void)>([]() { return 7; });
+    ASSERT_EQ(Live, 0);
+    ASSERT_EQ(F2(), 7);
+  }
+  ASSERT_EQ(Live, 0);
+}
+
+TEST(UFTest, TestInlineMutableState) {
+  UniqueFunc<int(void)> F([X = 0]() mutable { return ++X; });
+  ASSERT_EQ(F(), 1);
+
+  UniqueFunc<int(void)> F2(std::move(F));
+  ASSERT_EQ(F2(), 2);
+  ASSERT_EQ(F2(), 3);
+}